@@ -0,0 +1,91 @@
+/**
+ * @file cli_output.c
+ * @brief a text ring that collects CLI output until the host can take it
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "cli_output.h"
+
+void cli_output_init(cli_output_t* output, char* storage, uint32_t size)
+{
+  assert(size != 0 && (size & (size - 1)) == 0);
+  output->storage = storage;
+  output->size = size;
+  output->head = 0;
+  output->tail = 0;
+}
+
+uint32_t cli_output_count(const cli_output_t* output)
+{
+  return output->head - output->tail;
+}
+
+uint32_t cli_output_space(const cli_output_t* output)
+{
+  return output->size - cli_output_count(output);
+}
+
+bool cli_output_write(cli_output_t* output, const char* text, uint32_t len)
+{
+  if (len > cli_output_space(output)) {
+    return false;
+  }
+  uint32_t start = output->head & (output->size - 1);
+  uint32_t first = output->size - start;
+  if (first > len) {
+    first = len;
+  }
+  memcpy(output->storage + start, text, first);
+  memcpy(output->storage, text + first, len - first);
+  output->head += len;
+  return true;
+}
+
+uint32_t cli_output_drain(cli_output_t* output, cli_output_write_fn write, void* context)
+{
+  uint32_t sent = 0;
+  while (cli_output_count(output) != 0) {
+    // Send the characters up to the end of the storage, then the rest
+    uint32_t start = output->tail & (output->size - 1);
+    uint32_t len = output->size - start;
+    if (len > cli_output_count(output)) {
+      len = cli_output_count(output);
+    }
+    uint32_t accepted = write(context, output->storage + start, len);
+    output->tail += accepted;
+    sent += accepted;
+    if (accepted < len) {
+      break;
+    }
+  }
+  return sent;
+}
+
+void cli_output_clear(cli_output_t* output)
+{
+  output->tail = output->head;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file cli_output.h
+ * @brief a text ring that collects CLI output until the host can take it
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef CLI_OUTPUT_H
+#define CLI_OUTPUT_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/**
+ * @brief send text to the host
+ *
+ * @param context the context passed to cli_output_drain()
+ * @param text the text to send
+ * @param len the number of characters in text
+ * @return the number of characters accepted; fewer than len means the
+ * host connection can take no more for now
+ */
+typedef uint32_t (*cli_output_write_fn)(void* context, const char* text, uint32_t len);
+
+/**
+ * @brief A ring of characters written by the CLI and drained to the host
+ * a piece at a time, so printing never waits for the host to read.
+ */
+typedef struct {
+  char* storage;
+  uint32_t size; // must be a power of 2
+  uint32_t head; // characters written, modulo 2^32
+  uint32_t tail; // characters drained, modulo 2^32
+} cli_output_t;
+
+/**
+ * @brief initialize the ring
+ *
+ * @param output the ring to initialize
+ * @param storage size characters of storage for the ring
+ * @param size the capacity of the ring; must be a power of 2
+ */
+void cli_output_init(cli_output_t* output, char* storage, uint32_t size);
+
+/**
+ * @return the number of characters waiting to be drained
+ */
+uint32_t cli_output_count(const cli_output_t* output);
+
+/**
+ * @return the number of characters that can be written without draining
+ */
+uint32_t cli_output_space(const cli_output_t* output);
+
+/**
+ * @brief add text to the ring
+ *
+ * @param output the ring
+ * @param text the characters to add
+ * @param len the number of characters to add
+ * @return true if all of the text fit; false without adding any of it if not
+ */
+bool cli_output_write(cli_output_t* output, const char* text, uint32_t len);
+
+/**
+ * @brief send the oldest characters in the ring to the host
+ *
+ * Stops when the ring is empty or write accepts fewer characters than
+ * it was offered.
+ *
+ * @param output the ring
+ * @param write the function that sends text to the host
+ * @param context passed to write
+ * @return the number of characters sent
+ */
+uint32_t cli_output_drain(cli_output_t* output, cli_output_write_fn write, void* context);
+
+/**
+ * @brief discard everything in the ring
+ */
+void cli_output_clear(cli_output_t* output);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
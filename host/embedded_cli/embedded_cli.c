@@ -0,0 +1,259 @@
+/**
+ * @file embedded_cli.c
+ * @brief a minimal stand-in for lib/embedded-cli for host builds
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "embedded_cli.h"
+
+typedef struct {
+  const char* invitation;
+  char* rx;             // received characters not processed yet
+  uint16_t rx_size;
+  uint16_t rx_head;
+  uint16_t rx_count;
+  char* line;           // the command being typed; room for a second '\0'
+  uint16_t line_size;
+  uint16_t line_len;
+  CliCommandBinding* bindings;
+  uint16_t max_bindings;
+  uint16_t num_bindings;
+  uint8_t escape;       // characters of an escape sequence still to skip
+  bool last_cr;
+} cli_impl_t;
+
+static void write_text(EmbeddedCli* cli, const char* text)
+{
+  while (*text != '\0') {
+    cli->writeChar(cli, *text++);
+  }
+}
+
+EmbeddedCli* embeddedCliNew(EmbeddedCliConfig* config)
+{
+  EmbeddedCli* cli = calloc(1, sizeof(EmbeddedCli));
+  cli_impl_t* impl = calloc(1, sizeof(cli_impl_t));
+  impl->invitation = config->invitation;
+  impl->rx_size = config->rxBufferSize;
+  impl->rx = malloc(impl->rx_size);
+  impl->line_size = config->cmdBufferSize;
+  impl->line = malloc(impl->line_size + 2);
+  impl->max_bindings = config->maxBindingCount;
+  impl->bindings = calloc(impl->max_bindings, sizeof(CliCommandBinding));
+  cli->_impl = impl;
+  return cli;
+}
+
+void embeddedCliFree(EmbeddedCli* cli)
+{
+  cli_impl_t* impl = cli->_impl;
+  free(impl->rx);
+  free(impl->line);
+  free(impl->bindings);
+  free(impl);
+  free(cli);
+}
+
+bool embeddedCliAddBinding(EmbeddedCli* cli, CliCommandBinding binding)
+{
+  cli_impl_t* impl = cli->_impl;
+  if (impl->num_bindings == impl->max_bindings) {
+    return false;
+  }
+  impl->bindings[impl->num_bindings++] = binding;
+  return true;
+}
+
+void embeddedCliReceiveChar(EmbeddedCli* cli, char c)
+{
+  cli_impl_t* impl = cli->_impl;
+  if (impl->rx_count < impl->rx_size) {
+    impl->rx[(impl->rx_head + impl->rx_count++) % impl->rx_size] = c;
+  }
+}
+
+static void print_help(EmbeddedCli* cli)
+{
+  cli_impl_t* impl = cli->_impl;
+  write_text(cli, " * help\r\n\tPrint list of commands\r\n");
+  for (uint16_t idx = 0; idx < impl->num_bindings; idx++) {
+    write_text(cli, " * ");
+    write_text(cli, impl->bindings[idx].name);
+    write_text(cli, "\r\n");
+    if (impl->bindings[idx].help != NULL) {
+      write_text(cli, "\t");
+      write_text(cli, impl->bindings[idx].help);
+      write_text(cli, "\r\n");
+    }
+  }
+}
+
+static void run_line(EmbeddedCli* cli)
+{
+  cli_impl_t* impl = cli->_impl;
+  char* name = impl->line;
+  impl->line[impl->line_len] = '\0';
+  impl->line[impl->line_len + 1] = '\0';
+  impl->line_len = 0;
+  while (*name == ' ') {
+    name++;
+  }
+  if (*name == '\0') {
+    return;
+  }
+  char* args = name;
+  while (*args != ' ' && *args != '\0') {
+    args++;
+  }
+  if (*args != '\0') {
+    *args++ = '\0';
+  }
+  if (strcmp(name, "help") == 0) {
+    print_help(cli);
+    return;
+  }
+  for (uint16_t idx = 0; idx < impl->num_bindings; idx++) {
+    const CliCommandBinding* binding = impl->bindings + idx;
+    if (strcmp(name, binding->name) == 0) {
+      if (binding->tokenizeArgs) {
+        embeddedCliTokenizeArgs(args);
+      }
+      binding->binding(cli, args, binding->context);
+      return;
+    }
+  }
+  if (cli->onCommand != NULL) {
+    CliCommand command = {name, args};
+    cli->onCommand(cli, &command);
+  }
+}
+
+void embeddedCliProcess(EmbeddedCli* cli)
+{
+  cli_impl_t* impl = cli->_impl;
+  while (impl->rx_count != 0) {
+    char c = impl->rx[impl->rx_head];
+    impl->rx_head = (impl->rx_head + 1) % impl->rx_size;
+    impl->rx_count--;
+    bool cr = c == '\r';
+    if (impl->escape != 0) {
+      // Skip the arrow keys: ESC [ and a letter
+      impl->escape = c == '[' ? 1 : 0;
+    }
+    else if (c == 0x1b) {
+      impl->escape = 1;
+    }
+    else if (c == '\r' || c == '\n') {
+      if (c == '\r' || !impl->last_cr) {
+        write_text(cli, "\r\n");
+        run_line(cli);
+        write_text(cli, impl->invitation);
+      }
+    }
+    else if (c == '\b' || c == 0x7f) {
+      if (impl->line_len != 0) {
+        impl->line_len--;
+        write_text(cli, "\b \b");
+      }
+    }
+    else if (c >= ' ' && impl->line_len < impl->line_size) {
+      impl->line[impl->line_len++] = c;
+      cli->writeChar(cli, c);
+    }
+    impl->last_cr = cr;
+  }
+}
+
+void embeddedCliPrint(EmbeddedCli* cli, const char* string)
+{
+  write_text(cli, string);
+  write_text(cli, "\r\n");
+}
+
+void embeddedCliTokenizeArgs(char* args)
+{
+  if (args == NULL) {
+    return;
+  }
+  // Tokens are separated by spaces; quotes keep spaces in a token and a
+  // backslash keeps the next character as it is
+  char* out = args;
+  const char* in = args;
+  bool quoted = false;
+  bool in_token = false;
+  while (*in != '\0') {
+    char c = *in++;
+    if (c == '\\' && *in != '\0') {
+      *out++ = *in++;
+      in_token = true;
+    }
+    else if (c == '"') {
+      quoted = !quoted;
+      in_token = true;
+    }
+    else if (c == ' ' && !quoted) {
+      if (in_token) {
+        *out++ = '\0';
+        in_token = false;
+      }
+    }
+    else {
+      *out++ = c;
+      in_token = true;
+    }
+  }
+  if (in_token) {
+    *out++ = '\0';
+  }
+  *out = '\0';
+}
+
+const char* embeddedCliGetToken(const char* tokenizedStr, uint16_t pos)
+{
+  if (tokenizedStr == NULL || pos == 0) {
+    return NULL;
+  }
+  const char* token = tokenizedStr;
+  for (uint16_t idx = 1; *token != '\0'; idx++) {
+    if (idx == pos) {
+      return token;
+    }
+    token += strlen(token) + 1;
+  }
+  return NULL;
+}
+
+uint16_t embeddedCliGetTokenCount(const char* tokenizedStr)
+{
+  uint16_t count = 0;
+  if (tokenizedStr != NULL) {
+    for (const char* token = tokenizedStr; *token != '\0'; token += strlen(token) + 1) {
+      count++;
+    }
+  }
+  return count;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file embedded_cli.h
+ * @brief the embedded-cli API the firmware uses, for host builds without the submodule
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef HOST_EMBEDDED_CLI_H
+#define HOST_EMBEDDED_CLI_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/**
+ * A minimal stand-in for lib/embedded-cli with the same API: line input
+ * with echo and backspace, the help command, bindings and argument
+ * tokens with quotes. There is no history and no autocompletion.
+ */
+typedef struct CliCommand CliCommand;
+struct CliCommand {
+  const char* name;
+  char* args;
+};
+
+typedef struct EmbeddedCli EmbeddedCli;
+struct EmbeddedCli {
+  void (*writeChar)(EmbeddedCli* cli, char c);
+  void (*onCommand)(EmbeddedCli* cli, CliCommand* command);
+  void* appContext;
+  void* _impl;
+};
+
+typedef struct CliCommandBinding {
+  const char* name;
+  const char* help;
+  bool tokenizeArgs;
+  void* context;
+  void (*binding)(EmbeddedCli* cli, char* args, void* context);
+} CliCommandBinding;
+
+typedef struct EmbeddedCliConfig {
+  const char* invitation;
+  uint16_t rxBufferSize;
+  uint16_t cmdBufferSize;
+  uint16_t historyBufferSize;
+  uint16_t maxBindingCount;
+  void* cliBuffer;         // ignored; the stand-in allocates
+  uint16_t cliBufferSize;
+  bool enableAutoComplete; // ignored
+} EmbeddedCliConfig;
+
+EmbeddedCli* embeddedCliNew(EmbeddedCliConfig* config);
+bool embeddedCliAddBinding(EmbeddedCli* cli, CliCommandBinding binding);
+void embeddedCliReceiveChar(EmbeddedCli* cli, char c);
+void embeddedCliProcess(EmbeddedCli* cli);
+void embeddedCliPrint(EmbeddedCli* cli, const char* string);
+void embeddedCliFree(EmbeddedCli* cli);
+
+/**
+ * @brief split args in place into tokens that end with '\0'; the last
+ * ends with two
+ */
+void embeddedCliTokenizeArgs(char* args);
+
+/**
+ * @return token pos, counting from 1, or NULL if there are fewer
+ */
+const char* embeddedCliGetToken(const char* tokenizedStr, uint16_t pos);
+uint16_t embeddedCliGetTokenCount(const char* tokenizedStr);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
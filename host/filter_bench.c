@@ -0,0 +1,315 @@
+/**
+ * @file host/filter_bench.c
+ * @brief measure what the route filters cost per message
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "midi_parser.h"
+#include "midi_router.h"
+#include "midi_merger.h"
+
+static const char usage[] =
+  "usage: filter-bench [-o <file>] [<rounds>]\n"
+  "Routes a mix of channel, clock, active sensing and SysEx messages from one input to four\n"
+  "outputs with several route filters and writes the time and the estimated CPU cycles\n"
+  "per message to filter-bench.csv unless -o names a file; - is stdout.\n";
+
+#define NUM_PORTS 16
+#define NUM_OUTPUTS 4
+#define QUEUE_LEN 64
+#define MAX_PACKETS 4096
+#define BATCH 16
+#define DEFAULT_ROUNDS 200
+
+static midi_router_t router;
+static midi_merger_t mergers[NUM_PORTS];
+static midi_merger_entry_t queues[NUM_PORTS][QUEUE_LEN];
+static uint64_t delivered;
+
+static uint8_t packets[MAX_PACKETS][4];
+static uint32_t num_packets;
+
+static uint32_t count_write(void* handle, const uint8_t* buffer, uint32_t nbytes)
+{
+  (void)handle;
+  (void)buffer;
+  delivered++;
+  return nbytes;
+}
+
+static uint32_t now_us(void)
+{
+  return 0;
+}
+
+static void add_packet(void* context, const uint8_t packet[4])
+{
+  (void)context;
+  if (num_packets < MAX_PACKETS) {
+    memcpy(packets[num_packets++], packet, 4);
+  }
+}
+
+// Notes and controllers on all channels with clock, active sensing and
+// now and then a short SysEx message, as the input of a busy setup
+static void make_packets(void)
+{
+  midi_parser_t parser;
+  midi_parser_init(&parser, 0);
+  for (uint32_t idx = 0; num_packets < MAX_PACKETS - 8; idx++) {
+    uint8_t bytes[8];
+    uint8_t nbytes = 3;
+    switch (idx % 16) {
+    case 3:
+      bytes[0] = 0xF8;
+      nbytes = 1;
+      break;
+    case 11:
+      bytes[0] = 0xFE;
+      nbytes = 1;
+      break;
+    case 15:
+      if (idx % 64 == 15) {
+        static const uint8_t sysex[] = {0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7};
+        memcpy(bytes, sysex, sizeof(sysex));
+        nbytes = sizeof(sysex);
+        break;
+      }
+      // fall through
+    default:
+      bytes[0] = (idx % 2 ? 0xB0 : 0x90) | (idx / 2 % 16);
+      bytes[1] = idx % 128;
+      bytes[2] = 1 + idx % 127;
+      break;
+    }
+    midi_parser_parse(&parser, bytes, nbytes, add_packet, NULL);
+  }
+}
+
+static void block_status(midi_router_filter_t* filter, uint8_t status)
+{
+  midi_router_filter_set(filter, MIDI_ROUTER_SYSTEM_CLASS(status), true);
+}
+
+static void block_channels(midi_router_filter_t* filter, uint8_t first, uint8_t last)
+{
+  for (uint8_t type = 0x8; type <= 0xE; type++) {
+    for (uint8_t channel = first; channel <= last; channel++) {
+      midi_router_filter_set(filter, MIDI_ROUTER_CHANNEL_CLASS(type << 4 | channel), true);
+    }
+  }
+}
+
+static void filter_none(midi_router_filter_t* filter)
+{
+  (void)filter;
+}
+
+static void filter_active_sensing(midi_router_filter_t* filter)
+{
+  block_status(filter, 0xFE);
+}
+
+static void filter_clock(midi_router_filter_t* filter)
+{
+  block_status(filter, 0xF8);
+  block_status(filter, 0xFA);
+  block_status(filter, 0xFB);
+  block_status(filter, 0xFC);
+  block_status(filter, 0xFE);
+}
+
+static void filter_channels(midi_router_filter_t* filter)
+{
+  block_channels(filter, 8, 15);
+}
+
+static void filter_sysex(midi_router_filter_t* filter)
+{
+  block_status(filter, 0xF0);
+}
+
+static void filter_all(midi_router_filter_t* filter)
+{
+  memset(filter, 0xFF, sizeof(*filter));
+}
+
+static const struct {
+  const char* name;
+  void (*make)(midi_router_filter_t* filter);
+} filters[] = {
+  {"none", filter_none},
+  {"active-sensing", filter_active_sensing},
+  {"clock+active-sensing", filter_clock},
+  {"channels-9-16", filter_channels},
+  {"sysex", filter_sysex},
+  {"all", filter_all},
+};
+
+static void set_up(void (*make)(midi_router_filter_t* filter), midi_router_filter_t* filter)
+{
+  midi_router_init(&router, NUM_PORTS, now_us);
+  for (uint8_t port = 0; port < NUM_PORTS; port++) {
+    midi_merger_init(mergers + port, count_write, NULL, queues[port], QUEUE_LEN);
+    midi_merger_set_packet_output(mergers + port, true);
+    midi_router_set_output(&router, port, mergers + port, false);
+  }
+  memset(filter, 0, sizeof(*filter));
+  make(filter);
+  for (uint8_t out = 1; out <= NUM_OUTPUTS; out++) {
+    midi_router_connect(&router, 0, out);
+    midi_router_set_filter(&router, 0, out, filter);
+  }
+  midi_router_publish(&router);
+}
+
+static double seconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Estimate the clock rate from a chain of dependent additions, which run
+// at one per cycle
+static double cycles_per_ns(void)
+{
+  volatile uint64_t seed = 1;
+  uint64_t value = seed;
+  const uint64_t steps = 200000000;
+  double start = seconds();
+  for (uint64_t idx = 0; idx < steps; idx++) {
+    value += idx;
+    __asm__ volatile("" : "+r"(value));
+  }
+  double elapsed = seconds() - start;
+  seed = value;
+  return steps / (elapsed * 1e9);
+}
+
+// Return the time per message to find the outputs a message may go to:
+// the filter on its own
+static double time_lookup(uint32_t rounds, uint64_t* kept)
+{
+  midi_router_pass_t pass;
+  midi_router_begin(&router, &pass, (1u << NUM_PORTS) - 1);
+  const midi_router_fanout_t* fan = pass.fanout;
+  uint64_t outputs = 0;
+  double start = seconds();
+  for (uint32_t round = 0; round < rounds; round++) {
+    for (uint32_t idx = 0; idx < num_packets; idx++) {
+      uint8_t msg_class = midi_router_message_class(packets[idx]);
+      uint16_t mask = pass.enabled_outputs & fan->outputs & ~fan->blocked[msg_class];
+      outputs += __builtin_popcount(mask);
+      __asm__ volatile("" : "+r"(outputs));
+    }
+  }
+  double elapsed = seconds() - start;
+  midi_router_end(&pass);
+  *kept = outputs;
+  return elapsed * 1e9 / ((double)rounds * num_packets);
+}
+
+// Return the time per message to route the messages and write them out
+static double time_route(uint32_t rounds)
+{
+  delivered = 0;
+  double start = seconds();
+  for (uint32_t round = 0; round < rounds; round++) {
+    for (uint32_t first = 0; first < num_packets; first += BATCH) {
+      midi_router_pass_t pass;
+      midi_router_begin(&router, &pass, (1u << NUM_PORTS) - 1);
+      for (uint32_t idx = first; idx < first + BATCH && idx < num_packets; idx++) {
+        midi_router_route(&pass, packets[idx]);
+      }
+      for (uint8_t out = 1; out <= NUM_OUTPUTS; out++) {
+        midi_merger_flush(mergers + out);
+      }
+      midi_router_end(&pass);
+    }
+  }
+  double elapsed = seconds() - start;
+  return elapsed * 1e9 / ((double)rounds * num_packets);
+}
+
+// The number of packets a filter lets through to each output
+static uint32_t expected_packets(const midi_router_filter_t* filter)
+{
+  uint32_t count = 0;
+  for (uint32_t idx = 0; idx < num_packets; idx++) {
+    count += !midi_router_filter_blocks(filter, midi_router_message_class(packets[idx]));
+  }
+  return count;
+}
+
+int main(int argc, char* argv[])
+{
+  const char* path = "filter-bench.csv";
+  uint32_t rounds = DEFAULT_ROUNDS;
+  for (int idx = 1; idx < argc; idx++) {
+    char* end;
+    if (strcmp(argv[idx], "-o") == 0 && idx + 1 < argc) {
+      path = argv[++idx];
+    }
+    else if ((rounds = strtoul(argv[idx], &end, 10)) == 0 || *end != '\0') {
+      fputs(usage, stderr);
+      return 2;
+    }
+  }
+  FILE* out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (out == NULL) {
+    perror(path);
+    return 1;
+  }
+  make_packets();
+  double rate = cycles_per_ns();
+  bool ok = true;
+  fprintf(out, "filter,messages,passed,lookup_ns,lookup_cycles,route_ns,route_cycles\n");
+  for (size_t idx = 0; idx < sizeof(filters) / sizeof(filters[0]); idx++) {
+    midi_router_filter_t filter;
+    set_up(filters[idx].make, &filter);
+    uint64_t kept;
+    double lookup_ns = time_lookup(rounds, &kept);
+    double route_ns = time_route(rounds);
+    uint32_t passed = expected_packets(&filter);
+    // Every message that passes reaches each output once per round
+    if (kept != (uint64_t)passed * NUM_OUTPUTS * rounds || delivered != kept) {
+      fprintf(stderr, "%s: %llu packets out, %llu expected\n", filters[idx].name, (unsigned long long)delivered,
+        (unsigned long long)passed * NUM_OUTPUTS * rounds);
+      ok = false;
+    }
+    fprintf(out, "%s,%u,%u,%.2f,%.1f,%.2f,%.1f\n", filters[idx].name, num_packets, passed, lookup_ns,
+      lookup_ns * rate, route_ns, route_ns * rate);
+  }
+  if (out != stdout && fclose(out) != 0) {
+    perror(path);
+    return 1;
+  }
+  return ok ? 0 : 1;
+}
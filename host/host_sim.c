@@ -0,0 +1,896 @@
+/**
+ * @file host_sim.c
+ * @brief stand-ins for the Pico SDK, TinyUSB and MIDI UART libraries on a simulated clock
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "host_sim.h"
+#include "tusb.h"
+#include "bsp/board.h"
+#include "pio_midi_uart_lib.h"
+#include "midi_uart_lib.h"
+#include "midi_uart_lib_config.h"
+#include "midi_device_multistream.h"
+#include "cdc_stdio_lib.h"
+#include "hardware/uart.h"
+#include "hardware/flash.h"
+#include "pico/flash.h"
+
+// main.c built with main renamed
+int firmware_main(void);
+
+// The UART library rings and the USB endpoint FIFOs
+#define SERIAL_RING_LEN 128
+#define USB_FIFO_LEN 64
+#define NUM_PIO_PORTS 6
+#define NUM_HW_PORTS 2
+// The UARTs run from clk_peri, 125 MHz on an RP2040
+#define UART_CLOCK_HZ 125000000u
+// The PIO UART programs take 8 state machine cycles per bit
+#define PIO_CLOCK_HZ 125000000u
+#define PIO_CYCLES_PER_BIT 8
+// Typical times of the QSPI flash on Pico boards
+#define FLASH_SECTOR_ERASE_US 45000
+#define FLASH_PAGE_PROGRAM_US 700
+
+#define NS_PER_US 1000u
+
+/**
+ * @brief a byte queue; a ring with a limit models a library buffer, one
+ * without grows to hold what a script sends
+ */
+typedef struct {
+  uint8_t* data;
+  uint32_t capacity;
+  uint32_t limit; // the most bytes it holds, or 0 for no limit
+  uint32_t head;
+  uint32_t count;
+} queue_t;
+
+typedef struct {
+  char id;              // 0 until the firmware creates the port
+  uint32_t baud;
+  uint64_t byte_ns;     // wire time of one byte: start, 8 data and stop bit
+  queue_t tx;           // the library's TX ring
+  bool sending;         // a byte is on the MIDI OUT wire
+  uint64_t tx_done_ns;  // when it has left
+  queue_t rx;           // the library's RX ring
+  queue_t wire_in;      // bytes the far end of the MIDI IN has still to send
+  uint64_t rx_next_ns;  // when the first of them has arrived
+  uint64_t rx_idle_ns;  // when the MIDI IN wire is free for the next byte
+  uint32_t rx_lost;
+} serial_port_t;
+
+// The MIDI OUT endpoint and the CDC data OUT endpoint
+typedef struct {
+  queue_t host;         // what the host has still to send
+  uint32_t eligible;    // bytes of it that were sent before this frame
+  bool armed;           // the device has room for a whole transaction
+  uint8_t xfer[USB_FIFO_LEN]; // the last transaction, until tud_task() takes it
+  uint32_t xfer_len;
+  queue_t fifo;
+} usb_out_t;
+
+// The MIDI IN endpoint and the CDC data IN endpoint
+typedef struct {
+  queue_t fifo;
+  uint8_t xfer[USB_FIFO_LEN]; // the transfer the host completes next
+  uint32_t xfer_len;
+  bool busy;
+  bool done;            // a transfer completed; tud_task() starts the next
+} usb_in_t;
+
+struct uart_inst {
+  serial_port_t* port;
+};
+
+static host_sim_config_t sim;
+static jmp_buf run_done;
+static uint64_t now_ns;
+static uint64_t step_ns;       // when the script runs next
+static uint64_t usb_tick_ns;   // the next host poll
+static bool event_register;    // set by interrupts and __sev(), cleared by WFE
+static serial_port_t serial_ports[NUM_PIO_PORTS + NUM_HW_PORTS]; // 'A' first
+static uint8_t num_pio_ports;
+static uint8_t num_hw_ports;
+static struct uart_inst uart_insts[NUM_HW_PORTS];
+static bool usb_mount_pending;
+static bool usb_mounted;
+static bool usb_event;         // something for tud_task() to handle
+static bool cdc_connected;
+static usb_out_t midi_out;
+static usb_out_t cdc_out;
+static usb_in_t midi_in;
+static usb_in_t cdc_in;
+uint8_t host_flash_image[PICO_FLASH_SIZE_BYTES];
+static FILE* flash_file;
+
+//--------------------------------------------------------------------+
+// Queues
+//--------------------------------------------------------------------+
+static void queue_init(queue_t* queue, uint32_t limit)
+{
+  free(queue->data);
+  memset(queue, 0, sizeof(*queue));
+  queue->limit = limit;
+}
+
+static uint32_t queue_room(const queue_t* queue)
+{
+  return queue->limit == 0 ? UINT32_MAX - queue->count : queue->limit - queue->count;
+}
+
+static bool queue_push(queue_t* queue, uint8_t byte)
+{
+  if (queue_room(queue) == 0) {
+    return false;
+  }
+  if (queue->count == queue->capacity) {
+    uint32_t capacity = queue->capacity == 0 ? 256 : 2 * queue->capacity;
+    uint8_t* data = malloc(capacity);
+    assert(data != NULL);
+    for (uint32_t idx = 0; idx < queue->count; idx++) {
+      data[idx] = queue->data[(queue->head + idx) % queue->capacity];
+    }
+    free(queue->data);
+    queue->data = data;
+    queue->capacity = capacity;
+    queue->head = 0;
+  }
+  queue->data[(queue->head + queue->count++) % queue->capacity] = byte;
+  return true;
+}
+
+static bool queue_pop(queue_t* queue, uint8_t* byte)
+{
+  if (queue->count == 0) {
+    return false;
+  }
+  *byte = queue->data[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->count--;
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Simulated time
+//--------------------------------------------------------------------+
+static void set_byte_time(serial_port_t* port, uint32_t baud)
+{
+  port->baud = baud;
+  port->byte_ns = 10ull * 1000000000u / baud;
+}
+
+static bool serial_events(serial_port_t* port)
+{
+  bool interrupt = false;
+  if (port->sending && port->tx_done_ns <= now_ns) {
+    // The TX interrupt puts the next byte on the wire right away
+    uint8_t byte;
+    port->sending = queue_pop(&port->tx, &byte);
+    if (port->sending) {
+      if (sim.wire) {
+        sim.wire(sim.context, port->id, byte, port->tx_done_ns / NS_PER_US);
+      }
+      port->tx_done_ns += port->byte_ns;
+    }
+    interrupt = true;
+  }
+  while (port->wire_in.count != 0 && port->rx_next_ns <= now_ns) {
+    uint8_t byte;
+    (void)queue_pop(&port->wire_in, &byte);
+    if (!queue_push(&port->rx, byte)) {
+      port->rx_lost++;
+    }
+    port->rx_idle_ns = port->rx_next_ns;
+    port->rx_next_ns += port->byte_ns;
+    interrupt = true;
+  }
+  return interrupt;
+}
+
+// The host sends one transaction of what it sent before this frame
+static bool usb_out_poll(usb_out_t* out)
+{
+  if (!usb_mounted || !out->armed || out->eligible == 0) {
+    return false;
+  }
+  while (out->eligible != 0 && out->xfer_len < USB_FIFO_LEN) {
+    (void)queue_pop(&out->host, out->xfer + out->xfer_len++);
+    out->eligible--;
+  }
+  out->armed = false;
+  return true;
+}
+
+// The host completes the transfer in progress
+static bool usb_in_poll(usb_in_t* in, bool midi)
+{
+  if (!in->busy) {
+    return false;
+  }
+  uint64_t time_us = now_ns / NS_PER_US;
+  if (midi && sim.usb_in) {
+    for (uint32_t idx = 0; idx + 4 <= in->xfer_len; idx += 4) {
+      sim.usb_in(sim.context, in->xfer + idx, time_us);
+    }
+  }
+  else if (!midi && sim.cdc) {
+    sim.cdc(sim.context, (const char*)in->xfer, in->xfer_len);
+  }
+  in->xfer_len = 0;
+  in->busy = false;
+  in->done = true;
+  return true;
+}
+
+static bool usb_events(void)
+{
+  if (usb_tick_ns > now_ns) {
+    return false;
+  }
+  if (usb_tick_ns % (HOST_SIM_USB_FRAME_US * NS_PER_US) == 0) {
+    midi_out.eligible = midi_out.host.count;
+    cdc_out.eligible = cdc_out.host.count;
+  }
+  usb_tick_ns += HOST_SIM_USB_POLL_US * NS_PER_US;
+  bool interrupt = usb_out_poll(&midi_out);
+  interrupt |= usb_out_poll(&cdc_out);
+  interrupt |= usb_in_poll(&midi_in, true);
+  interrupt |= usb_in_poll(&cdc_in, false);
+  usb_event |= interrupt;
+  return interrupt;
+}
+
+static uint64_t next_event_ns(void)
+{
+  uint64_t next_ns = step_ns < usb_tick_ns ? step_ns : usb_tick_ns;
+  for (uint8_t idx = 0; idx < NUM_PIO_PORTS + NUM_HW_PORTS; idx++) {
+    const serial_port_t* port = serial_ports + idx;
+    if (port->sending && port->tx_done_ns < next_ns) {
+      next_ns = port->tx_done_ns;
+    }
+    if (port->wire_in.count != 0 && port->rx_next_ns < next_ns) {
+      next_ns = port->rx_next_ns;
+    }
+  }
+  return next_ns;
+}
+
+static void run_step(void)
+{
+  if (step_ns > now_ns) {
+    return;
+  }
+  uint64_t next_us = sim.step(sim.context, now_ns / NS_PER_US);
+  if (next_us == HOST_SIM_STOP) {
+    longjmp(run_done, 1);
+  }
+  step_ns = next_us * NS_PER_US > now_ns ? next_us * NS_PER_US : now_ns + NS_PER_US;
+}
+
+/**
+ * @brief let simulated time pass
+ *
+ * @param until_ns the time to stop at
+ * @param wake true to stop at the first interrupt
+ * @return true if an interrupt stopped it
+ */
+static bool run_until(uint64_t until_ns, bool wake)
+{
+  while (true) {
+    uint64_t next_ns = next_event_ns();
+    if (next_ns > until_ns) {
+      break;
+    }
+    if (next_ns > now_ns) {
+      now_ns = next_ns;
+    }
+    run_step();
+    bool interrupt = usb_events();
+    for (uint8_t idx = 0; idx < NUM_PIO_PORTS + NUM_HW_PORTS; idx++) {
+      interrupt |= serial_events(serial_ports + idx);
+    }
+    event_register |= interrupt;
+    if (interrupt && wake) {
+      return true;
+    }
+  }
+  if (until_ns > now_ns) {
+    now_ns = until_ns;
+  }
+  return false;
+}
+
+static void spend_us(uint64_t us)
+{
+  run_until(now_ns + us * NS_PER_US, false);
+}
+
+static void wait_for_event(uint64_t until_ns)
+{
+  if (!event_register) {
+    (void)run_until(until_ns, true);
+  }
+  event_register = false;
+}
+
+uint64_t time_us_64(void)
+{
+  return now_ns / NS_PER_US;
+}
+
+uint32_t time_us_32(void)
+{
+  return (uint32_t)time_us_64();
+}
+
+absolute_time_t get_absolute_time(void)
+{
+  return time_us_64();
+}
+
+absolute_time_t make_timeout_time_us(uint64_t us)
+{
+  return time_us_64() + us;
+}
+
+absolute_time_t make_timeout_time_ms(uint32_t ms)
+{
+  return time_us_64() + 1000ull * ms;
+}
+
+bool time_reached(absolute_time_t t)
+{
+  return time_us_64() >= t;
+}
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp)
+{
+  wait_for_event(timeout_timestamp * NS_PER_US);
+  return time_reached(timeout_timestamp);
+}
+
+void sleep_us(uint64_t us)
+{
+  spend_us(us);
+}
+
+void sleep_ms(uint32_t ms)
+{
+  spend_us(1000ull * ms);
+}
+
+void __wfe(void)
+{
+  wait_for_event(UINT64_MAX);
+}
+
+void __sev(void)
+{
+  event_register = true;
+}
+
+void tight_loop_contents(void)
+{
+  spend_us(1);
+}
+
+//--------------------------------------------------------------------+
+// Board
+//--------------------------------------------------------------------+
+void board_init(void)
+{
+}
+
+uint32_t board_millis(void)
+{
+  return (uint32_t)(time_us_64() / 1000);
+}
+
+void board_led_write(bool state)
+{
+  (void)state;
+}
+
+//--------------------------------------------------------------------+
+// Serial MIDI
+//--------------------------------------------------------------------+
+static serial_port_t* create_port(char id)
+{
+  serial_port_t* port = serial_ports + id - 'A';
+  port->id = id;
+  set_byte_time(port, MIDI_UART_LIB_BAUD_RATE);
+  queue_init(&port->tx, SERIAL_RING_LEN);
+  queue_init(&port->rx, SERIAL_RING_LEN);
+  queue_init(&port->wire_in, 0);
+  port->rx_idle_ns = now_ns;
+  return port;
+}
+
+static uint8_t poll_rx(serial_port_t* port, uint8_t* buffer, uint8_t buflen)
+{
+  uint8_t nread = 0;
+  while (nread < buflen && queue_pop(&port->rx, buffer + nread)) {
+    nread++;
+  }
+  return nread;
+}
+
+static uint8_t write_tx(serial_port_t* port, const uint8_t* buffer, uint8_t buflen)
+{
+  uint8_t nwritten = 0;
+  while (nwritten < buflen && queue_push(&port->tx, buffer[nwritten])) {
+    nwritten++;
+  }
+  return nwritten;
+}
+
+static void drain_tx(serial_port_t* port)
+{
+  uint8_t byte;
+  if (!port->sending && queue_pop(&port->tx, &byte)) {
+    if (sim.wire) {
+      sim.wire(sim.context, port->id, byte, time_us_64());
+    }
+    port->sending = true;
+    port->tx_done_ns = now_ns + port->byte_ns;
+  }
+}
+
+void* pio_midi_uart_create(uint8_t txgpio, uint8_t rxgpio)
+{
+  (void)txgpio;
+  (void)rxgpio;
+  if (num_pio_ports == NUM_PIO_PORTS) {
+    return NULL;
+  }
+  return create_port('A' + num_pio_ports++);
+}
+
+// The divider arithmetic of the SDK's pio_sm_set_clkdiv(): 16 integer
+// and 8 fraction bits
+uint32_t pio_midi_uart_set_baudrate(void* instance, uint32_t baudrate)
+{
+  uint64_t div_q8 = ((uint64_t)PIO_CLOCK_HZ << 8) / ((uint64_t)PIO_CYCLES_PER_BIT * baudrate);
+  if (div_q8 < 0x100) {
+    div_q8 = 0x100;
+  }
+  else if (div_q8 > 0xFFFFFF) {
+    div_q8 = 0xFFFFFF;
+  }
+  uint32_t actual = ((uint64_t)PIO_CLOCK_HZ << 8) / (PIO_CYCLES_PER_BIT * div_q8);
+  set_byte_time(instance, actual);
+  return actual;
+}
+
+uint8_t pio_midi_uart_poll_rx_buffer(void* instance, uint8_t* buffer, uint8_t buflen)
+{
+  return poll_rx(instance, buffer, buflen);
+}
+
+uint8_t pio_midi_uart_write_tx_buffer(void* instance, const uint8_t* buffer, uint8_t buflen)
+{
+  return write_tx(instance, buffer, buflen);
+}
+
+void pio_midi_uart_drain_tx_buffer(void* instance)
+{
+  drain_tx(instance);
+}
+
+void* midi_uart_configure(uint8_t uartnum, uint8_t txgpio, uint8_t rxgpio)
+{
+  (void)txgpio;
+  (void)rxgpio;
+  if (uartnum >= NUM_HW_PORTS || num_hw_ports == NUM_HW_PORTS || uart_insts[uartnum].port != NULL) {
+    return NULL;
+  }
+  uart_insts[uartnum].port = create_port('G' + num_hw_ports++);
+  return uart_insts[uartnum].port;
+}
+
+uint8_t midi_uart_poll_rx_buffer(void* instance, uint8_t* buffer, uint8_t buflen)
+{
+  return poll_rx(instance, buffer, buflen);
+}
+
+uint8_t midi_uart_write_tx_buffer(void* instance, const uint8_t* buffer, uint8_t buflen)
+{
+  return write_tx(instance, buffer, buflen);
+}
+
+void midi_uart_drain_tx_buffer(void* instance)
+{
+  drain_tx(instance);
+}
+
+uart_inst_t* uart_get_instance(uint num)
+{
+  assert(num < NUM_HW_PORTS);
+  return uart_insts + num;
+}
+
+// The divider arithmetic of the SDK's uart_set_baudrate()
+uint uart_set_baudrate(uart_inst_t* uart, uint baudrate)
+{
+  uint32_t div = 8 * UART_CLOCK_HZ / baudrate;
+  uint32_t ibrd = div >> 7;
+  uint32_t fbrd;
+  if (ibrd == 0) {
+    ibrd = 1;
+    fbrd = 0;
+  }
+  else if (ibrd >= 65535) {
+    ibrd = 65535;
+    fbrd = 0;
+  }
+  else {
+    fbrd = ((div & 0x7f) + 1) / 2;
+  }
+  uint actual = (4 * (uint64_t)UART_CLOCK_HZ) / (64 * ibrd + fbrd);
+  if (uart->port != NULL) {
+    set_byte_time(uart->port, actual);
+  }
+  return actual;
+}
+
+//--------------------------------------------------------------------+
+// USB
+//--------------------------------------------------------------------+
+static void usb_out_init(usb_out_t* out)
+{
+  queue_init(&out->host, 0);
+  queue_init(&out->fifo, USB_FIFO_LEN);
+  out->eligible = 0;
+  out->armed = true;
+  out->xfer_len = 0;
+}
+
+static void usb_in_init(usb_in_t* in)
+{
+  queue_init(&in->fifo, USB_FIFO_LEN);
+  in->xfer_len = 0;
+  in->busy = false;
+  in->done = false;
+}
+
+// Move the last transaction to the FIFO; return true if there was one
+static bool usb_out_receive(usb_out_t* out)
+{
+  if (out->xfer_len == 0) {
+    return false;
+  }
+  for (uint32_t idx = 0; idx < out->xfer_len; idx++) {
+    (void)queue_push(&out->fifo, out->xfer[idx]);
+  }
+  out->xfer_len = 0;
+  out->armed = queue_room(&out->fifo) >= USB_FIFO_LEN;
+  return true;
+}
+
+static bool usb_out_read(usb_out_t* out, uint8_t* byte)
+{
+  if (!queue_pop(&out->fifo, byte)) {
+    return false;
+  }
+  if (!out->armed && out->xfer_len == 0 && queue_room(&out->fifo) >= USB_FIFO_LEN) {
+    out->armed = true;
+  }
+  return true;
+}
+
+// Start a transfer of everything in the FIFO if none is in progress
+static uint32_t usb_in_flush(usb_in_t* in)
+{
+  if (in->busy || in->fifo.count == 0) {
+    return 0;
+  }
+  while (queue_pop(&in->fifo, in->xfer + in->xfer_len)) {
+    in->xfer_len++;
+  }
+  in->busy = true;
+  return in->xfer_len;
+}
+
+bool tud_init(uint8_t rhport)
+{
+  (void)rhport;
+  usb_out_init(&midi_out);
+  usb_out_init(&cdc_out);
+  usb_in_init(&midi_in);
+  usb_in_init(&cdc_in);
+  usb_mount_pending = true;
+  usb_event = true;
+  return true;
+}
+
+void tud_task(void)
+{
+  spend_us(HOST_SIM_TASK_US);
+  usb_event = false;
+  if (usb_mount_pending) {
+    // The host enumerates the device and opens the terminal at once
+    usb_mount_pending = false;
+    usb_mounted = true;
+    tud_mount_cb();
+    cdc_connected = true;
+    tud_cdc_line_state_cb(0, true, true);
+  }
+  if (usb_out_receive(&midi_out)) {
+    tud_midi_rx_cb(0);
+  }
+  if (usb_out_receive(&cdc_out)) {
+    tud_cdc_rx_cb(0);
+  }
+  if (midi_in.done) {
+    midi_in.done = false;
+    (void)usb_in_flush(&midi_in);
+  }
+  if (cdc_in.done) {
+    cdc_in.done = false;
+    (void)usb_in_flush(&cdc_in);
+  }
+}
+
+bool tud_task_event_ready(void)
+{
+  return usb_event;
+}
+
+bool tud_mounted(void)
+{
+  return usb_mounted;
+}
+
+bool tud_midi_mounted(void)
+{
+  return usb_mounted;
+}
+
+bool tud_midi_packet_read(uint8_t packet[4])
+{
+  if (midi_out.fifo.count < 4) {
+    return false;
+  }
+  for (uint8_t idx = 0; idx < 4; idx++) {
+    (void)usb_out_read(&midi_out, packet + idx);
+  }
+  return true;
+}
+
+bool tud_midi_packet_write(const uint8_t packet[4])
+{
+  return tud_midi_packet_write_n(packet, 1) == 1;
+}
+
+uint32_t tud_midi_packet_write_n(const uint8_t* packets, uint32_t npackets)
+{
+  uint32_t nwritten = 0;
+  while (usb_mounted && nwritten < npackets && queue_room(&midi_in.fifo) >= 4) {
+    for (uint8_t idx = 0; idx < 4; idx++) {
+      (void)queue_push(&midi_in.fifo, packets[4 * nwritten + idx]);
+    }
+    nwritten++;
+  }
+  if (nwritten != 0) {
+    (void)usb_in_flush(&midi_in);
+  }
+  return nwritten;
+}
+
+bool tud_cdc_connected(void)
+{
+  return cdc_connected;
+}
+
+uint32_t tud_cdc_write(const void* buffer, uint32_t bufsize)
+{
+  const uint8_t* bytes = buffer;
+  uint32_t nwritten = 0;
+  while (cdc_connected && nwritten < bufsize && queue_push(&cdc_in.fifo, bytes[nwritten])) {
+    nwritten++;
+  }
+  return nwritten;
+}
+
+uint32_t tud_cdc_write_flush(void)
+{
+  return usb_in_flush(&cdc_in);
+}
+
+void cdc_stdio_lib_init(void)
+{
+}
+
+int getchar_timeout_us(uint32_t timeout_us)
+{
+  uint64_t until_ns = now_ns + (uint64_t)timeout_us * NS_PER_US;
+  uint8_t c;
+  while (!usb_out_read(&cdc_out, &c)) {
+    if (now_ns >= until_ns) {
+      return PICO_ERROR_TIMEOUT;
+    }
+    wait_for_event(until_ns);
+    tud_task();
+  }
+  return c;
+}
+
+//--------------------------------------------------------------------+
+// Flash
+//--------------------------------------------------------------------+
+static void save_flash(uint32_t offset, size_t count)
+{
+  if (flash_file != NULL) {
+    fseek(flash_file, offset, SEEK_SET);
+    fwrite(host_flash_image + offset, 1, count, flash_file);
+    fflush(flash_file);
+  }
+}
+
+static bool open_flash(const char* path)
+{
+  memset(host_flash_image, 0xff, sizeof(host_flash_image));
+  if (path == NULL) {
+    return true;
+  }
+  flash_file = fopen(path, "r+b");
+  if (flash_file != NULL) {
+    // A short file is a flash that was erased past its end
+    (void)fread(host_flash_image, 1, sizeof(host_flash_image), flash_file);
+    save_flash(0, sizeof(host_flash_image));
+    return true;
+  }
+  flash_file = fopen(path, "w+b");
+  save_flash(0, sizeof(host_flash_image));
+  return flash_file != NULL;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+  assert(flash_offs % FLASH_SECTOR_SIZE == 0 && count % FLASH_SECTOR_SIZE == 0);
+  assert(flash_offs + count <= sizeof(host_flash_image));
+  memset(host_flash_image + flash_offs, 0xff, count);
+  save_flash(flash_offs, count);
+  spend_us(count / FLASH_SECTOR_SIZE * FLASH_SECTOR_ERASE_US);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t* data, size_t count)
+{
+  assert(flash_offs % FLASH_PAGE_SIZE == 0 && count % FLASH_PAGE_SIZE == 0);
+  assert(flash_offs + count <= sizeof(host_flash_image));
+  // Programming can only clear bits
+  for (size_t idx = 0; idx < count; idx++) {
+    host_flash_image[flash_offs + idx] &= data[idx];
+  }
+  save_flash(flash_offs, count);
+  spend_us(count / FLASH_PAGE_SIZE * FLASH_PAGE_PROGRAM_US);
+}
+
+bool flash_safe_execute_core_init(void)
+{
+  return true;
+}
+
+int flash_safe_execute(void (*func)(void*), void* param, uint32_t enter_exit_timeout_ms)
+{
+  (void)enter_exit_timeout_ms;
+  func(param);
+  return PICO_OK;
+}
+
+//--------------------------------------------------------------------+
+// Simulation control
+//--------------------------------------------------------------------+
+int host_sim_run(const host_sim_config_t* config)
+{
+  sim = *config;
+  now_ns = config->start_us * NS_PER_US;
+  step_ns = now_ns;
+  usb_tick_ns = (now_ns / (HOST_SIM_USB_POLL_US * NS_PER_US) + 1) * HOST_SIM_USB_POLL_US * NS_PER_US;
+  if (!open_flash(config->flash_file)) {
+    return 1;
+  }
+  if (setjmp(run_done) == 0) {
+    (void)firmware_main();
+  }
+  if (flash_file != NULL) {
+    fclose(flash_file);
+    flash_file = NULL;
+  }
+  return 0;
+}
+
+uint64_t host_sim_now_us(void)
+{
+  return time_us_64();
+}
+
+void host_sim_usb_send(const uint8_t packet[4])
+{
+  for (uint8_t idx = 0; idx < 4; idx++) {
+    (void)queue_push(&midi_out.host, packet[idx]);
+  }
+}
+
+void host_sim_cdc_send(const char* text, uint32_t len)
+{
+  for (uint32_t idx = 0; idx < len; idx++) {
+    (void)queue_push(&cdc_out.host, (uint8_t)text[idx]);
+  }
+}
+
+static serial_port_t* find_port(char port_id)
+{
+  if (port_id < 'A' || port_id >= 'A' + NUM_PIO_PORTS + NUM_HW_PORTS) {
+    return NULL;
+  }
+  serial_port_t* port = serial_ports + port_id - 'A';
+  return port->id == 0 ? NULL : port;
+}
+
+void host_sim_serial_send(char port_id, const uint8_t* bytes, uint32_t nbytes)
+{
+  serial_port_t* port = find_port(port_id);
+  if (port == NULL || nbytes == 0) {
+    return;
+  }
+  if (port->wire_in.count == 0) {
+    uint64_t start_ns = port->rx_idle_ns > now_ns ? port->rx_idle_ns : now_ns;
+    port->rx_next_ns = start_ns + port->byte_ns;
+  }
+  for (uint32_t idx = 0; idx < nbytes; idx++) {
+    (void)queue_push(&port->wire_in, bytes[idx]);
+  }
+}
+
+uint32_t host_sim_serial_baud(char port_id)
+{
+  const serial_port_t* port = find_port(port_id);
+  return port == NULL ? 0 : port->baud;
+}
+
+uint32_t host_sim_serial_rx_lost(char port_id)
+{
+  const serial_port_t* port = find_port(port_id);
+  return port == NULL ? 0 : port->rx_lost;
+}
+
+bool host_sim_idle(void)
+{
+  for (uint8_t idx = 0; idx < NUM_PIO_PORTS + NUM_HW_PORTS; idx++) {
+    const serial_port_t* port = serial_ports + idx;
+    if (port->sending || port->tx.count != 0 || port->rx.count != 0 || port->wire_in.count != 0) {
+      return false;
+    }
+  }
+  return midi_out.host.count == 0 && midi_out.xfer_len == 0 && midi_out.fifo.count == 0 &&
+    cdc_out.host.count == 0 && cdc_out.xfer_len == 0 && cdc_out.fifo.count == 0 &&
+    !midi_in.busy && midi_in.fifo.count == 0 && !cdc_in.busy && cdc_in.fifo.count == 0;
+}
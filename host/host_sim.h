@@ -0,0 +1,164 @@
+/**
+ * @file host_sim.h
+ * @brief a simulation of the board, USB and MIDI wires the firmware runs on
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/**
+ * The host build compiles main.c with main() renamed to firmware_main()
+ * and links it with stand-ins for the Pico SDK, TinyUSB and the MIDI
+ * UART libraries. The stand-ins run on a simulated clock:
+ *
+ * - Every serial MIDI OUT has a 128 byte TX ring that the libraries'
+ *   drain functions start and that empties one byte time at a time, at
+ *   31250 baud or at the rate set with uart_set_baudrate() for the HW
+ *   UARTs. Bytes sent to a MIDI IN arrive one byte time apart in a 128
+ *   byte RX ring; bytes that do not fit are lost.
+ * - The host sends USB data at the start of the next 1 ms frame and
+ *   then, while the device has no room, every HOST_SIM_USB_POLL_US.
+ *   The device's 64 byte IN FIFOs go out in one transfer that completes
+ *   at the next poll. TinyUSB callbacks run from tud_task() as on the
+ *   device.
+ * - Each tud_task() costs HOST_SIM_TASK_US; everything else the firmware
+ *   does takes no time. Sleeping with WFE lasts until its timeout or the
+ *   next interrupt: a serial byte received or sent, a USB transfer or a
+ *   script step.
+ * - Flash is a RAM image, erased at start, or a file that keeps it
+ *   between runs. Erasing a sector and programming a page take as long
+ *   as on the chip, and the firmware waits meanwhile.
+ *
+ * The firmware keeps its state in static variables, so it can run only
+ * once per process.
+ */
+#define HOST_SIM_USB_FRAME_US 1000
+#define HOST_SIM_USB_POLL_US 200
+#define HOST_SIM_TASK_US 2
+
+/// a script step returns this to end the run
+#define HOST_SIM_STOP UINT64_MAX
+
+/**
+ * @brief feed the simulation and decide when to look again
+ *
+ * A step runs on simulated time between two things the firmware does,
+ * so it can send data and check what the firmware has sent, but must
+ * not call the firmware.
+ *
+ * @param context the config's context
+ * @param now_us the simulated time
+ * @return when to run the next step, or HOST_SIM_STOP to end the run
+ */
+typedef uint64_t (*host_sim_step_fn)(void* context, uint64_t now_us);
+
+/**
+ * @brief called for each packet the host receives on the MIDI IN endpoint
+ */
+typedef void (*host_sim_usb_fn)(void* context, const uint8_t packet[4], uint64_t time_us);
+
+/**
+ * @brief called for each byte when it starts on a MIDI OUT wire
+ *
+ * @param port_id 'A'-'F' for PIO ports, 'G'-'H' for HW UART ports
+ */
+typedef void (*host_sim_wire_fn)(void* context, char port_id, uint8_t byte, uint64_t time_us);
+
+/**
+ * @brief called with the text the terminal receives on the CDC port
+ */
+typedef void (*host_sim_cdc_fn)(void* context, const char* text, uint32_t len);
+
+typedef struct {
+  host_sim_step_fn step;   // first runs at start_us
+  host_sim_usb_fn usb_in;  // or NULL
+  host_sim_wire_fn wire;   // or NULL
+  host_sim_cdc_fn cdc;     // or NULL to discard the terminal output
+  void* context;
+  uint64_t start_us;       // time_us_32() wraps 2^32 us after 0
+  const char* flash_file;  // the flash image to use and update, or NULL
+} host_sim_config_t;
+
+/**
+ * @brief run the firmware until a script step returns HOST_SIM_STOP
+ *
+ * @return 0, or 1 if the flash file could not be used
+ */
+int host_sim_run(const host_sim_config_t* config);
+
+/**
+ * @return the simulated time
+ */
+uint64_t host_sim_now_us(void);
+
+/**
+ * @brief queue a USB MIDI event packet for the MIDI OUT endpoint
+ */
+void host_sim_usb_send(const uint8_t packet[4]);
+
+/**
+ * @brief queue bytes for the terminal to send to the CDC port
+ */
+void host_sim_cdc_send(const char* text, uint32_t len);
+
+/**
+ * @brief start bytes on the wire to a MIDI IN after those already queued
+ *
+ * The bytes come at the port's rate. Nothing is sent to a port the
+ * firmware has not created.
+ *
+ * @param port_id 'A'-'F' for PIO ports, 'G'-'H' for HW UART ports
+ */
+void host_sim_serial_send(char port_id, const uint8_t* bytes, uint32_t nbytes);
+
+/**
+ * @return the wire rate of a serial port, or 0 if the firmware has not
+ * created it
+ */
+uint32_t host_sim_serial_baud(char port_id);
+
+/**
+ * @return the bytes a MIDI IN lost because its RX ring was full
+ */
+uint32_t host_sim_serial_rx_lost(char port_id);
+
+/**
+ * @return true if nothing waits on any simulated wire or bus or in any
+ * library buffer
+ */
+bool host_sim_idle(void);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
@@ -0,0 +1,51 @@
+/**
+ * @file midi_device_multistream.h
+ * @brief the USB MIDI device class API the firmware uses, for the host build
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef HOST_MIDI_DEVICE_MULTISTREAM_H
+#define HOST_MIDI_DEVICE_MULTISTREAM_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+bool tud_midi_mounted(void);
+bool tud_midi_packet_read(uint8_t packet[4]);
+bool tud_midi_packet_write(const uint8_t packet[4]);
+// Write up to npackets packets and start one transfer; return how many fit
+uint32_t tud_midi_packet_write_n(const uint8_t* packets, uint32_t npackets);
+
+// Defined by the firmware
+void tud_midi_rx_cb(uint8_t itf);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
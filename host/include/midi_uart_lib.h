@@ -0,0 +1,50 @@
+/**
+ * @file midi_uart_lib.h
+ * @brief the HW MIDI UART API the firmware uses, for the host build
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef HOST_MIDI_UART_LIB_H
+#define HOST_MIDI_UART_LIB_H
+#include <stdint.h>
+#include "pico/stdlib.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/**
+ * @brief set up a HW UART for MIDI; the first is port G
+ */
+void* midi_uart_configure(uint8_t uartnum, uint8_t txgpio, uint8_t rxgpio);
+uint8_t midi_uart_poll_rx_buffer(void* instance, uint8_t* buffer, uint8_t buflen);
+uint8_t midi_uart_write_tx_buffer(void* instance, const uint8_t* buffer, uint8_t buflen);
+void midi_uart_drain_tx_buffer(void* instance);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
@@ -0,0 +1,346 @@
+/**
+ * @file midi_bench_main.c
+ * @brief run the routing benchmarks on the host and write the results to a file
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "tusb.h"
+#include "midi_uart_lib_config.h"
+#include "midi_bench.h"
+
+static const char usage[] =
+  "usage: midi-bench [-o <file>] [all|<workload>] [csv|json] [fair|fifo] [drop-newest|drop-oldest|block]\n"
+  "                  [usb-flush <us>] [usb-per-packet] [delay <us>]\n"
+  "                  [ports <Serial port ID> <Serial port ID>] [baud <Serial port ID> <rate>]...\n"
+  "workloads: cc-sweep mpe-bend sysex-dump clock-24 clock-96 merge cc-filter merge-flood timed-burst\n"
+  "           clock-master clock-follow\n"
+  "The workloads use serial ports A and B unless ports names two others. The ports run at 31250 baud\n"
+  "unless baud sets another rate, 9600-1000000 baud.\n"
+  "The results go to midi-bench.csv or midi-bench.json unless -o names a file; - is stdout.\n";
+
+// The ports and queues of the firmware; see main.c
+#if NUM_PIOS == 2
+#define NUM_PIO_MIDI_UARTS 4
+#else
+#define NUM_PIO_MIDI_UARTS 6
+#endif
+#define NUM_HW_MIDI_UARTS 2
+#define NUM_USB_MIDI_PORTS (CFG_TUD_MIDI_NUMCABLES_OUT - 1)
+#define NUM_SERIAL_MIDI_PORTS (NUM_PIO_MIDI_UARTS + NUM_HW_MIDI_UARTS)
+#define NUM_MIDI_PORTS (NUM_USB_MIDI_PORTS + NUM_SERIAL_MIDI_PORTS)
+#define USB_MERGER_QUEUE_LEN 32
+#define SERIAL_MERGER_QUEUE_LEN 128
+#define SERIAL_WHEEL_LEN 64
+#define SERIAL_BYTE_TIME_US (10 * 1000000 / MIDI_UART_LIB_BAUD_RATE)
+#define SERIAL_TX_LEAD_BYTES 4
+#define SERIAL_TX_MAX_LEAD_BYTES 32
+#define SERIAL_MIN_BAUD 9600
+#define SERIAL_MAX_BAUD 1000000
+#define USB_TX_FLUSH_DEADLINE_US 250
+
+static midi_merger_entry_t queue_pool[NUM_USB_MIDI_PORTS * USB_MERGER_QUEUE_LEN +
+  NUM_SERIAL_MIDI_PORTS * SERIAL_MERGER_QUEUE_LEN];
+static timer_wheel_entry_t wheel_pool[NUM_SERIAL_MIDI_PORTS * SERIAL_WHEEL_LEN];
+static FILE* out;
+
+static char port_to_port_id(uint8_t port)
+{
+  if (port < NUM_USB_MIDI_PORTS) {
+    return '1' + port;
+  }
+  if (port < NUM_USB_MIDI_PORTS + NUM_PIO_MIDI_UARTS) {
+    return 'A' + port - NUM_USB_MIDI_PORTS;
+  }
+  return 'G' + port - NUM_USB_MIDI_PORTS - NUM_PIO_MIDI_UARTS;
+}
+
+// Return the serial port number of a port ID, or 0 if it is not one
+static uint8_t serial_port(const char* id)
+{
+  if (id == NULL || id[0] == '\0' || id[1] != '\0') {
+    return 0;
+  }
+  char c = toupper((unsigned char)id[0]);
+  if (c >= 'A' && c < 'A' + NUM_PIO_MIDI_UARTS) {
+    return NUM_USB_MIDI_PORTS + c - 'A';
+  }
+  if (c >= 'G' && c < 'G' + NUM_HW_MIDI_UARTS) {
+    return NUM_USB_MIDI_PORTS + NUM_PIO_MIDI_UARTS + c - 'G';
+  }
+  return 0;
+}
+
+// Pace a serial port the way the firmware does at the same rate
+static void set_wire_rate(midi_bench_config_t* config, uint8_t port, uint32_t baud)
+{
+  uint32_t byte_us = (10 * 1000000 + baud - 1) / baud;
+  uint32_t lead = SERIAL_TX_LEAD_BYTES * SERIAL_BYTE_TIME_US / byte_us;
+  config->serial_byte_us[port] = byte_us;
+  config->serial_tx_lead_bytes[port] = lead < SERIAL_TX_LEAD_BYTES ? SERIAL_TX_LEAD_BYTES :
+    lead > SERIAL_TX_MAX_LEAD_BYTES ? SERIAL_TX_MAX_LEAD_BYTES : lead;
+}
+
+static uint32_t cpu_clock(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)((uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+static void print_csv(const char* name, const midi_bench_result_t* result)
+{
+  const midi_router_t* bench = result->router;
+  for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+    const midi_router_counters_t* c = bench->dest_counters + port;
+    if (c->offered == 0) {
+      continue;
+    }
+    fprintf(out, "%s,output,,%c,%lu,%lu,%lu,%lu,%lu,%u,%lu,,,,,\n", name, port_to_port_id(port),
+      (unsigned long)result->duration_us, (unsigned long)result->cpu_us, (unsigned long)c->offered,
+      (unsigned long)c->written, (unsigned long)c->dropped, c->high_water,
+      (unsigned long)((uint64_t)c->written * 1000000 / result->duration_us));
+  }
+  for (uint8_t in = 0; in < NUM_MIDI_PORTS; in++) {
+    const midi_router_counters_t* c = bench->source_counters + in;
+    if (c->offered == 0) {
+      continue;
+    }
+    fprintf(out, "%s,input,%c,,%lu,%lu,%lu,%lu,%lu,%u,%lu,,,,,\n", name, port_to_port_id(in),
+      (unsigned long)result->duration_us, (unsigned long)result->cpu_us, (unsigned long)c->offered,
+      (unsigned long)c->written, (unsigned long)c->dropped, c->high_water,
+      (unsigned long)((uint64_t)c->written * 1000000 / result->duration_us));
+  }
+  for (uint8_t in = 0; in < NUM_MIDI_PORTS; in++) {
+    for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+      const route_stats_t* stats = &bench->latency[in][port];
+      if (stats->count != 0) {
+        fprintf(out, "%s,route,%c,%c,%lu,%lu,,,,,,%lu,%lu,%lu,%lu,\n", name, port_to_port_id(in), port_to_port_id(port),
+          (unsigned long)result->duration_us, (unsigned long)result->cpu_us, (unsigned long)stats->count,
+          (unsigned long)stats->min_us, (unsigned long)route_stats_mean_us(stats), (unsigned long)stats->max_us);
+      }
+    }
+  }
+  const route_stats_t* usb = &result->usb_delivery;
+  if (usb->count != 0) {
+    fprintf(out, "%s,usb,,,%lu,%lu,,,,,,%lu,%lu,%lu,%lu,%lu\n", name, (unsigned long)result->duration_us,
+      (unsigned long)result->cpu_us, (unsigned long)usb->count, (unsigned long)usb->min_us,
+      (unsigned long)route_stats_mean_us(usb), (unsigned long)usb->max_us, (unsigned long)result->usb_transfers);
+  }
+  // The clock record counts tick intervals and puts their jitter in the latency columns
+  const route_stats_t* jitter = &result->clock_jitter;
+  if (jitter->count != 0) {
+    fprintf(out, "%s,clock,,%c,%lu,%lu,,,,,,%lu,%lu,%lu,%lu,\n", name, port_to_port_id(result->clock_output),
+      (unsigned long)result->duration_us, (unsigned long)result->cpu_us, (unsigned long)jitter->count,
+      (unsigned long)jitter->min_us, (unsigned long)route_stats_mean_us(jitter), (unsigned long)jitter->max_us);
+  }
+}
+
+static void print_json(const char* name, const midi_bench_result_t* result, bool last)
+{
+  const midi_router_t* bench = result->router;
+  fprintf(out, "{\"workload\":\"%s\",\"duration_us\":%lu,\"cpu_us\":%lu,\"outputs\":[", name,
+    (unsigned long)result->duration_us, (unsigned long)result->cpu_us);
+  const char* separator = "";
+  for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+    const midi_router_counters_t* c = bench->dest_counters + port;
+    if (c->offered != 0) {
+      fprintf(out, "%s{\"port\":\"%c\",\"offered\":%lu,\"written\":%lu,\"dropped\":%lu,\"peak\":%u,\"bytes_per_s\":%lu}",
+        separator, port_to_port_id(port), (unsigned long)c->offered, (unsigned long)c->written,
+        (unsigned long)c->dropped, c->high_water,
+        (unsigned long)((uint64_t)c->written * 1000000 / result->duration_us));
+      separator = ",";
+    }
+  }
+  fprintf(out, "],\"inputs\":[");
+  separator = "";
+  for (uint8_t in = 0; in < NUM_MIDI_PORTS; in++) {
+    const midi_router_counters_t* c = bench->source_counters + in;
+    if (c->offered != 0) {
+      fprintf(out, "%s{\"port\":\"%c\",\"offered\":%lu,\"written\":%lu,\"dropped\":%lu,\"peak\":%u,\"bytes_per_s\":%lu}",
+        separator, port_to_port_id(in), (unsigned long)c->offered, (unsigned long)c->written,
+        (unsigned long)c->dropped, c->high_water,
+        (unsigned long)((uint64_t)c->written * 1000000 / result->duration_us));
+      separator = ",";
+    }
+  }
+  fprintf(out, "],\"routes\":[");
+  separator = "";
+  for (uint8_t in = 0; in < NUM_MIDI_PORTS; in++) {
+    for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+      const route_stats_t* stats = &bench->latency[in][port];
+      if (stats->count != 0) {
+        fprintf(out, "%s{\"from\":\"%c\",\"to\":\"%c\",\"packets\":%lu,\"latency_min_us\":%lu,\"latency_mean_us\":%lu,"
+          "\"latency_max_us\":%lu}", separator, port_to_port_id(in), port_to_port_id(port), (unsigned long)stats->count,
+          (unsigned long)stats->min_us, (unsigned long)route_stats_mean_us(stats), (unsigned long)stats->max_us);
+        separator = ",";
+      }
+    }
+  }
+  const route_stats_t* usb = &result->usb_delivery;
+  fprintf(out, "],\"usb\":{\"packets\":%lu,\"transfers\":%lu,\"latency_min_us\":%lu,\"latency_mean_us\":%lu,"
+    "\"latency_max_us\":%lu}", (unsigned long)usb->count, (unsigned long)result->usb_transfers,
+    (unsigned long)usb->min_us, (unsigned long)route_stats_mean_us(usb), (unsigned long)usb->max_us);
+  const route_stats_t* jitter = &result->clock_jitter;
+  if (jitter->count != 0) {
+    fprintf(out, ",\"clock\":{\"to\":\"%c\",\"intervals\":%lu,\"jitter_min_us\":%lu,\"jitter_mean_us\":%lu,"
+      "\"jitter_max_us\":%lu}", port_to_port_id(result->clock_output), (unsigned long)jitter->count,
+      (unsigned long)jitter->min_us, (unsigned long)route_stats_mean_us(jitter), (unsigned long)jitter->max_us);
+  }
+  fprintf(out, "}%s\n", last ? "" : ",");
+}
+
+static bool parse_us(const char* token, uint32_t max, uint32_t* us)
+{
+  char* end;
+  unsigned long value = token == NULL ? 0 : strtoul(token, &end, 10);
+  if (token == NULL || !isdigit((unsigned char)*token) || *end != '\0' || value > max) {
+    return false;
+  }
+  *us = value;
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  const char* path = NULL;
+  bool all = true;
+  bool json = false;
+  midi_merger_policy_t policy = MIDI_MERGER_DROP_NEWEST;
+  midi_bench_workload_t workload = MIDI_BENCH_CC_SWEEP;
+  midi_bench_config_t config = {
+    .num_ports = NUM_MIDI_PORTS,
+    .num_usb_ports = NUM_USB_MIDI_PORTS,
+    .usb_queue_len = USB_MERGER_QUEUE_LEN,
+    .serial_queue_len = SERIAL_MERGER_QUEUE_LEN,
+    .queue_pool = queue_pool,
+    .serial_ports = {NUM_USB_MIDI_PORTS, NUM_USB_MIDI_PORTS + 1},
+    .serial_sysex_flow_control = true,
+    .serial_fair = true,
+    .serial_delay_us = 0,
+    .wheel_pool = wheel_pool,
+    .wheel_len = SERIAL_WHEEL_LEN,
+    .usb_flush_deadline_us = USB_TX_FLUSH_DEADLINE_US,
+    .usb_write_per_packet = false,
+    .cpu_clock = cpu_clock,
+  };
+  for (uint8_t port = NUM_USB_MIDI_PORTS; port < NUM_MIDI_PORTS; port++) {
+    set_wire_rate(&config, port, MIDI_UART_LIB_BAUD_RATE);
+  }
+  for (int idx = 1; idx < argc; idx++) {
+    const char* arg = argv[idx];
+    const char* next = idx + 1 < argc ? argv[idx + 1] : NULL;
+    if (strcmp(arg, "-o") == 0 && next != NULL) {
+      path = argv[++idx];
+    }
+    else if (strcmp(arg, "json") == 0 || strcmp(arg, "csv") == 0) {
+      json = arg[0] == 'j';
+    }
+    else if (strcmp(arg, "fifo") == 0 || strcmp(arg, "fair") == 0) {
+      config.serial_fair = arg[1] == 'a';
+    }
+    else if (strcmp(arg, "drop-newest") == 0) {
+      policy = MIDI_MERGER_DROP_NEWEST;
+    }
+    else if (strcmp(arg, "drop-oldest") == 0) {
+      policy = MIDI_MERGER_DROP_OLDEST;
+    }
+    else if (strcmp(arg, "block") == 0) {
+      policy = MIDI_MERGER_BLOCK_SOURCE;
+    }
+    else if (strcmp(arg, "usb-flush") == 0 && parse_us(next, UINT32_MAX, &config.usb_flush_deadline_us)) {
+      idx++;
+    }
+    else if (strcmp(arg, "usb-per-packet") == 0) {
+      config.usb_write_per_packet = true;
+    }
+    else if (strcmp(arg, "delay") == 0 && parse_us(next, MIDI_ROUTER_MAX_DELAY_US, &config.serial_delay_us)) {
+      idx++;
+    }
+    else if (strcmp(arg, "ports") == 0 && idx + 2 < argc && serial_port(next) != 0 &&
+        serial_port(argv[idx + 2]) != 0 && serial_port(next) != serial_port(argv[idx + 2])) {
+      config.serial_ports[0] = serial_port(argv[++idx]);
+      config.serial_ports[1] = serial_port(argv[++idx]);
+    }
+    else if (strcmp(arg, "baud") == 0 && idx + 2 < argc && serial_port(next) != 0) {
+      uint8_t port = serial_port(argv[++idx]);
+      uint32_t baud;
+      if (!parse_us(argv[++idx], SERIAL_MAX_BAUD, &baud) || baud < SERIAL_MIN_BAUD) {
+        fprintf(stderr, "Rate %s not valid. Can be %u-%u\n", argv[idx], SERIAL_MIN_BAUD, SERIAL_MAX_BAUD);
+        return 2;
+      }
+      set_wire_rate(&config, port, baud);
+    }
+    else if (midi_bench_find_workload(arg, &workload)) {
+      all = false;
+    }
+    else if (strcmp(arg, "all") != 0) {
+      fputs(usage, stderr);
+      return 2;
+    }
+  }
+  if (path == NULL) {
+    path = json ? "midi-bench.json" : "midi-bench.csv";
+  }
+  out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (out == NULL) {
+    perror(path);
+    return 1;
+  }
+  for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+    config.policy[port] = policy;
+  }
+  if (json) {
+    fprintf(out, "[\n");
+  }
+  else {
+    fprintf(out, "workload,record,from,to,duration_us,cpu_us,offered,written,dropped,peak,bytes_per_s,packets,"
+      "latency_min_us,latency_mean_us,latency_max_us,transfers\n");
+  }
+  midi_bench_workload_t first = all ? 0 : workload;
+  midi_bench_workload_t last = all ? MIDI_BENCH_NUM_WORKLOADS - 1 : workload;
+  for (midi_bench_workload_t run = first; run <= last; run++) {
+    midi_bench_result_t result;
+    midi_bench_run(&config, run, &result);
+    if (json) {
+      print_json(midi_bench_workload_name(run), &result, run == last);
+    }
+    else {
+      print_csv(midi_bench_workload_name(run), &result);
+    }
+  }
+  if (json) {
+    fprintf(out, "]\n");
+  }
+  if (out != stdout && fclose(out) != 0) {
+    perror(path);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,313 @@
+/**
+ * @file host/routing_bench.c
+ * @brief compare the routing throughput of the compiled fan-out table with the old route lists
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "midi_parser.h"
+#include "midi_router.h"
+#include "midi_merger.h"
+
+static const char usage[] =
+  "usage: routing-bench [-o <file>] [<packets per source>]\n"
+  "Routes note messages from every input to 1, 2, 4, 8 and 15 outputs, once through the\n"
+  "old lists of port ID characters and once through midi_router, both with a parser per\n"
+  "input and a merger per output, and writes the packets\n"
+  "per second of each input to routing-bench.csv unless -o names a file; - is stdout.\n";
+
+// The ports of the firmware with three PIOs: USB cables 1-8, PIO serial
+// ports A-F and hardware serial ports G-H
+#define NUM_USB_MIDI_PORTS 8
+#define NUM_PIO_MIDI_UARTS 6
+#define NUM_HW_MIDI_UARTS 2
+#define NUM_MIDI_PORTS (NUM_USB_MIDI_PORTS + NUM_PIO_MIDI_UARTS + NUM_HW_MIDI_UARTS)
+#define QUEUE_LEN 32
+// The old MIDI task read up to 48 bytes at a time from an input
+#define CHUNK_LEN 48
+#define DEFAULT_PACKETS 200000
+
+// Every output copies what it gets, as the UART and USB drivers do, and
+// counts it. The sink is not inlined, as the drivers are not.
+static uint8_t sink_buffer[NUM_MIDI_PORTS][CHUNK_LEN * 2];
+static uint64_t sink_bytes[NUM_MIDI_PORTS];
+
+__attribute__((noinline)) static uint32_t sink_write(uint8_t port, const uint8_t* buffer, uint32_t nbytes)
+{
+  memcpy(sink_buffer[port], buffer, nbytes);
+  sink_bytes[port] += nbytes;
+  return nbytes;
+}
+
+//--------------------------------------------------------------------+
+// A reference model of the old layout: per input, one list of port ID
+// characters per kind of output, decoded for every packet. It feeds the
+// same parser and mergers as midi_router, so only the layout differs.
+//--------------------------------------------------------------------+
+typedef struct {
+  uint8_t pio_uart_number_list[NUM_PIO_MIDI_UARTS];
+  uint8_t hw_uart_number_list[NUM_HW_MIDI_UARTS];
+  uint8_t usb_midi_cable_list[NUM_USB_MIDI_PORTS];
+  uint8_t num_pio_uart_routes;
+  uint8_t num_hw_uart_routes;
+  uint8_t num_usb_midi_routes;
+} midi_input_routes_t;
+
+static midi_input_routes_t old_routes[NUM_MIDI_PORTS];
+
+static uint8_t port_id(uint8_t port)
+{
+  if (port < NUM_USB_MIDI_PORTS) {
+    return '1' + port;
+  }
+  if (port < NUM_USB_MIDI_PORTS + NUM_PIO_MIDI_UARTS) {
+    return 'A' + port - NUM_USB_MIDI_PORTS;
+  }
+  return 'G' + port - NUM_USB_MIDI_PORTS - NUM_PIO_MIDI_UARTS;
+}
+
+static bool old_route(midi_input_routes_t* route, uint8_t out)
+{
+  if (out <= '8') {
+    for (size_t idx = 0; idx < route->num_usb_midi_routes; idx++) {
+      if (route->usb_midi_cable_list[idx] == out) {
+        return true;
+      }
+    }
+    route->usb_midi_cable_list[route->num_usb_midi_routes++] = out;
+  }
+  else if (out <= 'F') {
+    for (size_t idx = 0; idx < route->num_pio_uart_routes; idx++) {
+      if (route->pio_uart_number_list[idx] == out) {
+        return true;
+      }
+    }
+    route->pio_uart_number_list[route->num_pio_uart_routes++] = out;
+  }
+  else if (out <= 'H') {
+    for (size_t idx = 0; idx < route->num_hw_uart_routes; idx++) {
+      if (route->hw_uart_number_list[idx] == out) {
+        return true;
+      }
+    }
+    route->hw_uart_number_list[route->num_hw_uart_routes++] = out;
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+static midi_merger_t mergers[NUM_MIDI_PORTS];
+
+// Route one packet the way send_to_connected() routed a chunk: walk each
+// list and turn every port ID character back into a port number
+static void old_send_to_connected(void* context, const uint8_t packet[4])
+{
+  midi_input_routes_t* routes = context;
+  for (size_t cable = 0; cable < routes->num_usb_midi_routes; cable++) {
+    midi_merger_push(mergers + routes->usb_midi_cable_list[cable] - '1', packet, 0);
+  }
+  for (size_t idx = 0; idx < routes->num_pio_uart_routes; idx++) {
+    midi_merger_push(mergers + NUM_USB_MIDI_PORTS + routes->pio_uart_number_list[idx] - 'A', packet, 0);
+  }
+  for (size_t idx = 0; idx < routes->num_hw_uart_routes; idx++) {
+    midi_merger_push(mergers + NUM_USB_MIDI_PORTS + NUM_PIO_MIDI_UARTS + routes->hw_uart_number_list[idx] - 'G',
+      packet, 0);
+  }
+}
+
+//--------------------------------------------------------------------+
+// The new layout: midi_router with a merger per output
+//--------------------------------------------------------------------+
+static midi_router_t router;
+static midi_merger_entry_t queues[NUM_MIDI_PORTS][QUEUE_LEN];
+
+static uint32_t merger_write(void* handle, const uint8_t* buffer, uint32_t nbytes)
+{
+  return sink_write((uint8_t)(uintptr_t)handle, buffer, nbytes);
+}
+
+static uint32_t now_us(void)
+{
+  return 0;
+}
+
+// Both layouts route to the same mergers
+static void init_mergers(void)
+{
+  for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+    midi_merger_init(mergers + port, merger_write, (void*)(uintptr_t)port, queues[port], QUEUE_LEN);
+    // USB outputs write event packets, as in the firmware
+    midi_merger_set_packet_output(mergers + port, port < NUM_USB_MIDI_PORTS);
+  }
+}
+
+static void init_router(void)
+{
+  init_mergers();
+  midi_router_init(&router, NUM_MIDI_PORTS, now_us);
+  for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+    midi_router_set_output(&router, port, mergers + port, false);
+  }
+}
+
+//--------------------------------------------------------------------+
+// The benchmark
+//--------------------------------------------------------------------+
+static uint8_t input[3 * DEFAULT_PACKETS];
+
+// Note messages, a whole number of them in every chunk
+static void make_input(uint32_t npackets)
+{
+  for (uint32_t idx = 0; idx < npackets; idx++) {
+    input[3 * idx] = 0x90 | (idx % 16);
+    input[3 * idx + 1] = idx % 128;
+    input[3 * idx + 2] = 1 + idx % 127;
+  }
+}
+
+static double seconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// The outputs an input routes to: the next fanout ports after it
+static uint8_t route_out(uint8_t in, uint8_t idx)
+{
+  return (in + 1 + idx) % NUM_MIDI_PORTS;
+}
+
+static uint64_t total_sink_bytes(void)
+{
+  uint64_t total = 0;
+  for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+    total += sink_bytes[port];
+  }
+  return total;
+}
+
+// Return the packets per second the old layout routes from one input
+static double run_old(uint8_t in, uint8_t fanout, uint32_t npackets, bool* ok)
+{
+  init_mergers();
+  memset(old_routes, 0, sizeof(old_routes));
+  uint64_t expected = 0;
+  for (uint8_t idx = 0; idx < fanout; idx++) {
+    uint8_t out = route_out(in, idx);
+    old_route(old_routes + in, port_id(out));
+    expected += (uint64_t)npackets * (out < NUM_USB_MIDI_PORTS ? 4 : 3);
+  }
+  midi_parser_t parser;
+  midi_parser_init(&parser, in);
+  memset(sink_bytes, 0, sizeof(sink_bytes));
+  uint32_t nbytes = 3 * npackets;
+  double start = seconds();
+  for (uint32_t pos = 0; pos < nbytes; pos += CHUNK_LEN) {
+    uint8_t nread = nbytes - pos < CHUNK_LEN ? nbytes - pos : CHUNK_LEN;
+    midi_parser_parse(&parser, input + pos, nread, old_send_to_connected, old_routes + in);
+    for (uint8_t idx = 0; idx < fanout; idx++) {
+      midi_merger_flush(mergers + route_out(in, idx));
+    }
+  }
+  double elapsed = seconds() - start;
+  *ok = *ok && total_sink_bytes() == expected;
+  return npackets / elapsed;
+}
+
+// Return the packets per second midi_router routes from one input
+static double run_new(uint8_t in, uint8_t fanout, uint32_t npackets, bool* ok)
+{
+  init_router();
+  uint64_t expected = 0;
+  for (uint8_t idx = 0; idx < fanout; idx++) {
+    uint8_t out = route_out(in, idx);
+    midi_router_connect(&router, in, out);
+    expected += (uint64_t)npackets * (out < NUM_USB_MIDI_PORTS ? 4 : 3);
+  }
+  midi_router_publish(&router);
+  memset(sink_bytes, 0, sizeof(sink_bytes));
+  uint32_t nbytes = 3 * npackets;
+  double start = seconds();
+  for (uint32_t pos = 0; pos < nbytes; pos += CHUNK_LEN) {
+    uint8_t nread = nbytes - pos < CHUNK_LEN ? nbytes - pos : CHUNK_LEN;
+    midi_router_pass_t pass;
+    midi_router_begin(&router, &pass, (1u << NUM_MIDI_PORTS) - 1);
+    midi_router_parse(&pass, in, input + pos, nread);
+    for (uint8_t idx = 0; idx < fanout; idx++) {
+      midi_merger_flush(mergers + route_out(in, idx));
+    }
+    midi_router_end(&pass);
+  }
+  double elapsed = seconds() - start;
+  *ok = *ok && total_sink_bytes() == expected;
+  return npackets / elapsed;
+}
+
+int main(int argc, char* argv[])
+{
+  const char* path = "routing-bench.csv";
+  uint32_t npackets = DEFAULT_PACKETS;
+  for (int idx = 1; idx < argc; idx++) {
+    char* end;
+    if (strcmp(argv[idx], "-o") == 0 && idx + 1 < argc) {
+      path = argv[++idx];
+    }
+    else if ((npackets = strtoul(argv[idx], &end, 10)) == 0 || *end != '\0' || npackets > DEFAULT_PACKETS) {
+      fputs(usage, stderr);
+      return 2;
+    }
+  }
+  FILE* out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (out == NULL) {
+    perror(path);
+    return 1;
+  }
+  make_input(npackets);
+  static const uint8_t fanouts[] = {1, 2, 4, 8, 15};
+  bool ok = true;
+  fprintf(out, "fanout,source,packets,old_packets_per_s,new_packets_per_s,speedup\n");
+  for (uint8_t fanout = 0; fanout < sizeof(fanouts); fanout++) {
+    for (uint8_t in = 0; in < NUM_MIDI_PORTS; in++) {
+      double old_rate = run_old(in, fanouts[fanout], npackets, &ok);
+      double new_rate = run_new(in, fanouts[fanout], npackets, &ok);
+      fprintf(out, "%u,%c,%u,%.0f,%.0f,%.2f\n", fanouts[fanout], port_id(in), npackets, old_rate, new_rate,
+        new_rate / old_rate);
+    }
+  }
+  if (out != stdout && fclose(out) != 0) {
+    perror(path);
+    return 1;
+  }
+  if (!ok) {
+    fprintf(stderr, "an output did not get every packet\n");
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,299 @@
+/**
+ * @file host/running_status_bench.c
+ * @brief measure the bytes and wire time running status saves on serial MIDI OUTs
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "midi_uart_lib_config.h"
+#include "midi_parser.h"
+#include "midi_merger.h"
+
+static const char usage[] =
+  "usage: running-status-bench [-o <file>] [<raw MIDI file>...]\n"
+  "Sends each stream through a serial MIDI OUT merger with and without running status and\n"
+  "writes the bytes and the wire time at 31250 baud to running-status.csv unless -o names a\n"
+  "file; - is stdout. Without files it uses built-in streams.\n";
+
+#define MAX_STREAM (1024 * 1024)
+#define QUEUE_LEN 32
+
+typedef struct {
+  const char* name;
+  uint8_t* bytes;
+  uint32_t nbytes;
+} stream_t;
+
+// What one pass through the merger wrote
+typedef struct {
+  uint8_t* bytes;
+  uint32_t nbytes;
+  uint32_t messages;
+  uint32_t status_bytes_saved;
+} output_t;
+
+static uint8_t stream_bytes[MAX_STREAM];
+static uint32_t stream_len;
+
+static void put(uint8_t byte)
+{
+  if (stream_len < MAX_STREAM) {
+    stream_bytes[stream_len++] = byte;
+  }
+}
+
+static void put_message(uint8_t status, uint8_t data1, uint8_t data2)
+{
+  put(status);
+  put(data1 & 0x7F);
+  if ((status & 0xE0) != 0xC0) {
+    put(data2 & 0x7F);
+  }
+}
+
+// The built-in streams, each as a USB host would send it: a status byte
+// on every message
+static void make_cc_sweep(void)
+{
+  for (uint32_t idx = 0; idx < 4000; idx++) {
+    uint8_t value = idx % 256 < 128 ? idx % 128 : 127 - idx % 128;
+    put_message(0xB0, 1, value);
+  }
+}
+
+static void make_cc_sweep_16(void)
+{
+  for (uint32_t idx = 0; idx < 4000; idx++) {
+    put_message(0xB0 | (idx % 16), 1, idx / 16);
+  }
+}
+
+static void make_pitch_bend(void)
+{
+  for (uint32_t idx = 0; idx < 4000; idx++) {
+    uint16_t bend = 8192 + (idx % 64) * 64;
+    put_message(0xE0, bend, bend >> 7);
+  }
+}
+
+// Chords played and released; a note off is a note on with velocity 0
+// half the time, as many keyboards send it
+static void make_chords(void)
+{
+  static const uint8_t chord[] = {60, 64, 67, 72};
+  for (uint32_t idx = 0; idx < 500; idx++) {
+    for (uint8_t note = 0; note < sizeof(chord); note++) {
+      put_message(0x90, chord[note] + idx % 12, 100);
+    }
+    for (uint8_t note = 0; note < sizeof(chord); note++) {
+      put_message(idx % 2 ? 0x90 : 0x80, chord[note] + idx % 12, 0);
+    }
+  }
+}
+
+// Notes with controllers, clock and now and then a SysEx message
+static void make_mixed(void)
+{
+  for (uint32_t idx = 0; idx < 4000; idx++) {
+    switch (idx % 8) {
+    case 0:
+      put_message(0x90, 36 + idx % 48, 90);
+      break;
+    case 4:
+      put_message(0x80, 36 + (idx - 4) % 48, 0);
+      break;
+    case 6:
+      put(0xF8);
+      break;
+    default:
+      put_message(0xB0, 74, idx);
+      break;
+    }
+    if (idx % 500 == 0) {
+      static const uint8_t sysex[] = {0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7};
+      for (uint8_t byte = 0; byte < sizeof(sysex); byte++) {
+        put(sysex[byte]);
+      }
+    }
+  }
+}
+
+static const struct {
+  const char* name;
+  void (*make)(void);
+} builtin[] = {
+  {"cc-sweep", make_cc_sweep},
+  {"cc-sweep-16", make_cc_sweep_16},
+  {"pitch-bend", make_pitch_bend},
+  {"chords", make_chords},
+  {"mixed", make_mixed},
+};
+
+static uint32_t write_output(void* handle, const uint8_t* buffer, uint32_t nbytes)
+{
+  output_t* output = handle;
+  memcpy(output->bytes + output->nbytes, buffer, nbytes);
+  output->nbytes += nbytes;
+  return nbytes;
+}
+
+static void count_message(void* context, const uint8_t packet[4], uint32_t timestamp)
+{
+  (void)packet;
+  (void)timestamp;
+  ((output_t*)context)->messages++;
+}
+
+static void push_packet(void* context, const uint8_t packet[4])
+{
+  midi_merger_t* merger = context;
+  midi_merger_push(merger, packet, 0);
+  midi_merger_flush(merger);
+}
+
+// Parse the stream as the firmware parses a MIDI IN and send it through
+// a serial MIDI OUT merger
+static void run(const stream_t* stream, bool running_status, output_t* output)
+{
+  static midi_merger_entry_t queue[QUEUE_LEN];
+  midi_merger_t merger;
+  midi_parser_t parser;
+  output->nbytes = 0;
+  output->messages = 0;
+  midi_merger_init(&merger, write_output, output, queue, QUEUE_LEN);
+  midi_merger_set_running_status(&merger, running_status);
+  midi_merger_set_realtime_between_bytes(&merger, true);
+  midi_merger_set_sent_cb(&merger, count_message, output);
+  midi_parser_init(&parser, 0);
+  midi_parser_parse(&parser, stream->bytes, stream->nbytes, push_packet, &merger);
+  output->status_bytes_saved = merger.status_bytes_saved;
+}
+
+static void collect_packet(void* context, const uint8_t packet[4])
+{
+  output_t* packets = context;
+  memcpy(packets->bytes + packets->nbytes, packet, 4);
+  packets->nbytes += 4;
+}
+
+// Return true if both outputs hold the same messages
+static bool same_messages(const output_t* a, const output_t* b)
+{
+  static uint8_t a_storage[4 * MAX_STREAM];
+  static uint8_t b_storage[4 * MAX_STREAM];
+  output_t a_packets = {a_storage, 0, 0, 0};
+  output_t b_packets = {b_storage, 0, 0, 0};
+  midi_parser_t parser;
+  midi_parser_init(&parser, 0);
+  midi_parser_parse(&parser, a->bytes, a->nbytes, collect_packet, &a_packets);
+  midi_parser_init(&parser, 0);
+  midi_parser_parse(&parser, b->bytes, b->nbytes, collect_packet, &b_packets);
+  return a_packets.nbytes == b_packets.nbytes && memcmp(a_storage, b_storage, a_packets.nbytes) == 0;
+}
+
+static double wire_ms(uint32_t nbytes)
+{
+  return nbytes * 10000.0 / MIDI_UART_LIB_BAUD_RATE;
+}
+
+// Print one CSV row; return false if running status changed the messages
+static bool measure(FILE* out, const stream_t* stream)
+{
+  static uint8_t plain_bytes[2 * MAX_STREAM];
+  static uint8_t running_bytes[2 * MAX_STREAM];
+  output_t plain = {plain_bytes, 0, 0, 0};
+  output_t running = {running_bytes, 0, 0, 0};
+  run(stream, false, &plain);
+  run(stream, true, &running);
+  uint32_t saved = plain.nbytes - running.nbytes;
+  fprintf(out, "%s,%u,%u,%u,%u,%.1f,%.1f,%.1f\n", stream->name, plain.messages, plain.nbytes, running.nbytes,
+    saved, plain.nbytes == 0 ? 0.0 : 100.0 * saved / plain.nbytes, wire_ms(plain.nbytes), wire_ms(running.nbytes));
+  if (saved != running.status_bytes_saved || !same_messages(&plain, &running)) {
+    fprintf(stderr, "%s: running status changed the messages\n", stream->name);
+    return false;
+  }
+  return true;
+}
+
+static bool read_file(const char* path, stream_t* stream)
+{
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    perror(path);
+    return false;
+  }
+  stream_len = fread(stream_bytes, 1, MAX_STREAM, file);
+  bool ok = !ferror(file);
+  fclose(file);
+  if (!ok) {
+    perror(path);
+  }
+  stream->name = path;
+  stream->bytes = stream_bytes;
+  stream->nbytes = stream_len;
+  return ok;
+}
+
+int main(int argc, char* argv[])
+{
+  const char* path = "running-status.csv";
+  int first_file = 1;
+  if (argc > 2 && strcmp(argv[1], "-o") == 0) {
+    path = argv[2];
+    first_file = 3;
+  }
+  for (int idx = first_file; idx < argc; idx++) {
+    if (argv[idx][0] == '-') {
+      fputs(usage, stderr);
+      return 2;
+    }
+  }
+  FILE* out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (out == NULL) {
+    perror(path);
+    return 1;
+  }
+  fprintf(out, "stream,messages,bytes,bytes_running_status,saved_bytes,saved_percent,wire_ms,wire_ms_running_status\n");
+  bool ok = true;
+  if (first_file == argc) {
+    for (size_t idx = 0; idx < sizeof(builtin) / sizeof(builtin[0]); idx++) {
+      stream_len = 0;
+      builtin[idx].make();
+      stream_t stream = {builtin[idx].name, stream_bytes, stream_len};
+      ok = measure(out, &stream) && ok;
+    }
+  }
+  for (int idx = first_file; idx < argc; idx++) {
+    stream_t stream;
+    ok = read_file(argv[idx], &stream) && measure(out, &stream) && ok;
+  }
+  if (out != stdout && fclose(out) != 0) {
+    perror(path);
+    return 1;
+  }
+  return ok ? 0 : 1;
+}
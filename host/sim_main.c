@@ -0,0 +1,261 @@
+/**
+ * @file sim_main.c
+ * @brief run the firmware on the host with the terminal on stdin and stdout
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include "host_sim.h"
+#include "midi_parser.h"
+
+/*
+ * Lines read from stdin go to the CLI, except for these:
+ *   @usb <cable 1-9> <hex bytes>      the host sends MIDI on a cable
+ *   @serial <port A-H> <hex bytes>    MIDI arrives on a MIDI IN
+ *   @wait <ms>                        let time pass before the next line
+ * The terminal output goes to stdout. With -v, what the host receives on
+ * USB and what leaves every MIDI OUT goes to stderr with its time.
+ */
+static const char usage[] =
+  "usage: pico-usb-midi-interface-sim [-f <flash image>] [-r] [-v]\n"
+  "  -f  keep the flash, e.g., the presets, in a file between runs\n"
+  "  -r  run in real time and read stdin as it comes\n"
+  "  -v  print the MIDI the host and the MIDI OUTs receive\n";
+
+// Give the firmware time to say hello before the first line
+#define START_US 1200000
+// A line is done when nothing has happened for this long
+#define QUIET_US 20000
+#define STEP_US 1000
+
+static bool real_time = false;
+static bool verbose = false;
+static uint64_t last_activity_us;
+static uint64_t wait_until_us;
+static bool end_of_input = false;
+static char line[1024];
+static size_t line_len;
+static uint64_t wall_start_ns;
+
+static void usb_in(void* context, const uint8_t packet[4], uint64_t time_us)
+{
+  (void)context;
+  last_activity_us = time_us;
+  if (verbose) {
+    fprintf(stderr, "%10llu us USB %u: %02x %02x %02x %02x\n", (unsigned long long)time_us,
+      (unsigned)midi_packet_cable(packet) + 1, packet[0], packet[1], packet[2], packet[3]);
+  }
+}
+
+static void wire(void* context, char port_id, uint8_t byte, uint64_t time_us)
+{
+  (void)context;
+  last_activity_us = time_us;
+  if (verbose) {
+    fprintf(stderr, "%10llu us OUT %c: %02x\n", (unsigned long long)time_us, port_id, byte);
+  }
+}
+
+static void cdc(void* context, const char* text, uint32_t len)
+{
+  (void)context;
+  last_activity_us = host_sim_now_us();
+  fwrite(text, 1, len, stdout);
+  fflush(stdout);
+}
+
+static void send_usb_packet(void* context, const uint8_t packet[4])
+{
+  (void)context;
+  host_sim_usb_send(packet);
+}
+
+// Parse hex bytes; return how many, or -1 if one is not valid
+static int parse_bytes(char* text, uint8_t* bytes, int max)
+{
+  int nbytes = 0;
+  for (char* token = strtok(text, " \t"); token != NULL; token = strtok(NULL, " \t")) {
+    char* end;
+    unsigned long value = strtoul(token, &end, 16);
+    if (*end != '\0' || value > 0xff || nbytes == max) {
+      return -1;
+    }
+    bytes[nbytes++] = value;
+  }
+  return nbytes;
+}
+
+static void run_command(char* command)
+{
+  uint8_t bytes[sizeof(line)];
+  char* rest = command;
+  while (*rest != '\0' && !isspace((unsigned char)*rest)) {
+    rest++;
+  }
+  if (*rest != '\0') {
+    *rest++ = '\0';
+  }
+  while (isspace((unsigned char)*rest)) {
+    rest++;
+  }
+  char* args = rest;
+  while (*args != '\0' && !isspace((unsigned char)*args)) {
+    args++;
+  }
+  if (*args != '\0') {
+    *args++ = '\0';
+  }
+  if (strcmp(command, "@wait") == 0) {
+    wait_until_us = host_sim_now_us() + 1000 * strtoull(rest, NULL, 10);
+    return;
+  }
+  int nbytes = parse_bytes(args, bytes, sizeof(bytes));
+  if (strcmp(command, "@usb") == 0 && rest[0] >= '1' && rest[0] <= '9' && rest[1] == '\0' && nbytes >= 0) {
+    midi_parser_t parser;
+    midi_parser_init(&parser, rest[0] - '1');
+    midi_parser_parse(&parser, bytes, nbytes, send_usb_packet, NULL);
+  }
+  else if (strcmp(command, "@serial") == 0 && isalpha((unsigned char)rest[0]) && rest[1] == '\0' && nbytes >= 0 &&
+      host_sim_serial_baud(toupper((unsigned char)rest[0])) != 0) {
+    host_sim_serial_send(toupper((unsigned char)rest[0]), bytes, nbytes);
+  }
+  else {
+    fprintf(stderr, "@usb <cable 1-9> <hex bytes> | @serial <port A-H> <hex bytes> | @wait <ms>\n");
+  }
+}
+
+static void run_line(void)
+{
+  line[line_len] = '\0';
+  if (line[0] == '@') {
+    run_command(line);
+  }
+  else {
+    line[line_len++] = '\r';
+    host_sim_cdc_send(line, line_len);
+  }
+  line_len = 0;
+}
+
+// Read what stdin has; return true at a complete line
+static bool read_input(bool wait)
+{
+  while (!end_of_input) {
+    struct pollfd fd = {STDIN_FILENO, POLLIN, 0};
+    if (!wait && poll(&fd, 1, 0) <= 0) {
+      return false;
+    }
+    char c;
+    if (read(STDIN_FILENO, &c, 1) != 1) {
+      end_of_input = true;
+      if (line_len != 0) {
+        return true;
+      }
+      break;
+    }
+    if (c == '\n') {
+      return true;
+    }
+    if (c != '\r' && line_len < sizeof(line) - 2) {
+      line[line_len++] = c;
+    }
+  }
+  return false;
+}
+
+static uint64_t wall_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+static uint64_t step(void* context, uint64_t now_us)
+{
+  (void)context;
+  if (real_time) {
+    uint64_t sim_ns = now_us * 1000;
+    uint64_t elapsed_ns = wall_ns() - wall_start_ns;
+    if (sim_ns > elapsed_ns) {
+      struct timespec pause = {(sim_ns - elapsed_ns) / 1000000000u, (sim_ns - elapsed_ns) % 1000000000u};
+      nanosleep(&pause, NULL);
+    }
+  }
+  bool quiet = host_sim_idle() && now_us - last_activity_us >= QUIET_US;
+  if (now_us < START_US || now_us < wait_until_us || (!real_time && !quiet)) {
+    return now_us + STEP_US;
+  }
+  if (read_input(!real_time)) {
+    run_line();
+    last_activity_us = now_us;
+  }
+  else if (end_of_input && quiet) {
+    return HOST_SIM_STOP;
+  }
+  return now_us + STEP_US;
+}
+
+int main(int argc, char* argv[])
+{
+  const char* flash_file = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:rv")) != -1) {
+    switch (opt) {
+    case 'f':
+      flash_file = optarg;
+      break;
+    case 'r':
+      real_time = true;
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    default:
+      fputs(usage, stderr);
+      return 2;
+    }
+  }
+  host_sim_config_t config = {
+    .step = step,
+    .usb_in = usb_in,
+    .wire = wire,
+    .cdc = cdc,
+    .context = NULL,
+    .start_us = 0,
+    .flash_file = flash_file,
+  };
+  wall_start_ns = wall_ns();
+  if (host_sim_run(&config) != 0) {
+    fprintf(stderr, "cannot use %s\n", flash_file);
+    return 1;
+  }
+  return 0;
+}
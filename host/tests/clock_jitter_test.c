@@ -0,0 +1,256 @@
+/**
+ * @file host/tests/clock_jitter_test.c
+ * @brief measure the jitter MIDI clock picks up through the simulated firmware under controller floods
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+
+#define SERIAL_BYTE_US 320
+#define MAX_RECORDING 65536
+#define MAX_TICKS 1024
+// 24 clocks per quarter note at 120 BPM
+#define TICK_US (60000000.0 / 120 / 24)
+#define PHASE_US 2000000
+#define USB_FLOOD_PERIOD_US 1000
+
+// Times in us; the welcome message comes 1 s after the terminal opens
+enum {
+  T_SET_UP = 1500000,
+  T_CLOCK = 2000000,
+  T_FLOOD = T_CLOCK + PHASE_US + 100000,
+};
+
+typedef enum {
+  CLOCK_ONLY,
+  CLOCK_AND_FLOOD,
+  NUM_PHASES,
+} phase_t;
+
+typedef enum {
+  TO_SERIAL,  // MIDI IN A to MIDI OUT B
+  TO_USB,     // MIDI IN A to USB cable 1
+  NUM_OUTPUTS,
+} output_t;
+
+static const char* const phase_names[NUM_PHASES] = {"clock", "clock+cc-flood"};
+static const char* const output_names[NUM_OUTPUTS] = {"serial", "usb"};
+
+// What MIDI IN A receives in the flood phase, one byte after another at
+// the wire rate: a controller flood with running status and a clock byte
+// wherever a tick falls, as a sequencer sends it
+static uint8_t recording[MAX_RECORDING];
+static uint32_t recording_len;
+
+// When each tick was in at MIDI IN A and when it came out
+static uint64_t in_us[NUM_PHASES][MAX_TICKS];
+static uint32_t num_in[NUM_PHASES];
+static uint64_t out_us[NUM_PHASES][NUM_OUTPUTS][MAX_TICKS];
+static uint32_t num_out[NUM_PHASES][NUM_OUTPUTS];
+
+static void make_recording(void)
+{
+  uint32_t next_tick = 0;
+  uint32_t cc = 0;
+  recording_len = PHASE_US / SERIAL_BYTE_US;
+  for (uint32_t slot = 0; slot < recording_len; slot++) {
+    if (slot == (uint32_t)(next_tick * TICK_US / SERIAL_BYTE_US)) {
+      recording[slot] = 0xF8;
+      next_tick++;
+    }
+    else {
+      recording[slot] = cc == 0 ? 0xB0 : cc % 2 ? 7 : (cc / 2) % 128;
+      cc++;
+    }
+  }
+}
+
+static bool read_recording(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    perror(path);
+    return false;
+  }
+  recording_len = fread(recording, 1, MAX_RECORDING, file);
+  fclose(file);
+  return true;
+}
+
+static phase_t phase_at(uint64_t time_us)
+{
+  return time_us < T_FLOOD ? CLOCK_ONLY : CLOCK_AND_FLOOD;
+}
+
+static void tick_out(output_t output, uint64_t time_us)
+{
+  phase_t phase = phase_at(time_us);
+  if (num_out[phase][output] < MAX_TICKS) {
+    out_us[phase][output][num_out[phase][output]++] = time_us;
+  }
+}
+
+static void wire_byte(void* context, char port_id, uint8_t byte, uint64_t time_us)
+{
+  (void)context;
+  if (port_id == 'B' && byte == 0xF8) {
+    tick_out(TO_SERIAL, time_us);
+  }
+}
+
+static void usb_packet(void* context, const uint8_t packet[4], uint64_t time_us)
+{
+  (void)context;
+  if ((packet[0] >> 4) == 0 && packet[1] == 0xF8) {
+    tick_out(TO_USB, time_us);
+  }
+}
+
+// Flood MIDI OUT B with controllers from USB cable 2 as well, four times
+// faster than the wire takes them
+static void send_usb_flood(uint64_t now_us)
+{
+  uint8_t controllers[12];
+  for (uint8_t idx = 0; idx < sizeof(controllers); idx += 3) {
+    controllers[idx] = 0xB1;
+    controllers[idx + 1] = 10;
+    controllers[idx + 2] = (now_us / USB_FLOOD_PERIOD_US + idx) % 128;
+  }
+  host_test_usb_send(1, controllers, sizeof(controllers));
+}
+
+static uint64_t step(void* context, uint64_t now_us)
+{
+  (void)context;
+  static const uint8_t clock = 0xF8;
+  static uint32_t next_tick = 0;
+  static uint64_t next_flood_us = T_FLOOD;
+  if (now_us == 0) {
+    return T_SET_UP;
+  }
+  if (now_us == T_SET_UP) {
+    host_test_type("connect A B");
+    return T_CLOCK;
+  }
+  if (now_us < T_FLOOD) {
+    // A clock byte alone on the wire is in one byte time after it starts
+    host_sim_serial_send('A', &clock, 1);
+    in_us[CLOCK_ONLY][num_in[CLOCK_ONLY]++] = now_us + SERIAL_BYTE_US;
+    next_tick++;
+    uint64_t next_us = T_CLOCK + (uint64_t)(next_tick * TICK_US);
+    return next_us < T_CLOCK + PHASE_US ? next_us : T_FLOOD;
+  }
+  if (now_us == T_FLOOD) {
+    host_sim_serial_send('A', recording, recording_len);
+    for (uint32_t slot = 0; slot < recording_len; slot++) {
+      if (recording[slot] == 0xF8 && num_in[CLOCK_AND_FLOOD] < MAX_TICKS) {
+        in_us[CLOCK_AND_FLOOD][num_in[CLOCK_AND_FLOOD]++] = now_us + (slot + 1) * SERIAL_BYTE_US;
+      }
+    }
+  }
+  uint64_t flood_end_us = T_FLOOD + (uint64_t)recording_len * SERIAL_BYTE_US;
+  if (now_us > flood_end_us) {
+    return HOST_SIM_STOP;
+  }
+  if (now_us == next_flood_us) {
+    send_usb_flood(now_us);
+    next_flood_us += USB_FLOOD_PERIOD_US;
+  }
+  // Let the last ticks out before the end
+  return next_flood_us < flood_end_us ? next_flood_us : flood_end_us + 100000;
+}
+
+typedef struct {
+  uint64_t max_latency_us;
+  uint64_t jitter_us;
+} result_t;
+
+// Print the latency and the jitter of one output in one phase: how far
+// each interval between ticks out was from the interval between the
+// same ticks in
+static result_t report(phase_t phase, output_t output)
+{
+  uint32_t ticks = num_in[phase];
+  uint64_t min_latency = UINT64_MAX;
+  uint64_t max_latency = 0;
+  uint64_t total = 0;
+  uint64_t jitter = 0;
+  for (uint32_t idx = 0; idx < ticks; idx++) {
+    uint64_t latency = out_us[phase][output][idx] - in_us[phase][idx];
+    min_latency = latency < min_latency ? latency : min_latency;
+    max_latency = latency > max_latency ? latency : max_latency;
+    total += latency;
+    if (idx > 0) {
+      int64_t in_interval = in_us[phase][idx] - in_us[phase][idx - 1];
+      int64_t out_interval = out_us[phase][output][idx] - out_us[phase][output][idx - 1];
+      uint64_t error = llabs(out_interval - in_interval);
+      jitter = error > jitter ? error : jitter;
+    }
+  }
+  printf("%s,%s,%u,%llu,%llu,%llu,%llu\n", phase_names[phase], output_names[output], ticks,
+    (unsigned long long)min_latency, (unsigned long long)(ticks == 0 ? 0 : total / ticks),
+    (unsigned long long)max_latency, (unsigned long long)jitter);
+  result_t result = {max_latency, jitter};
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  // A recording replaces the built-in flood; it plays at the wire rate
+  if (argc > 2 || (argc == 2 && !read_recording(argv[1]))) {
+    fprintf(stderr, "usage: clock_jitter_test [<raw MIDI file>]\n");
+    return 2;
+  }
+  if (argc == 1) {
+    make_recording();
+  }
+  host_sim_config_t config = host_test_config(step, NULL);
+  config.wire = wire_byte;
+  config.usb_in = usb_packet;
+  HOST_TEST_CHECK(host_sim_run(&config) == 0);
+  for (phase_t phase = 0; phase < NUM_PHASES; phase++) {
+    for (output_t output = 0; output < NUM_OUTPUTS; output++) {
+      HOST_TEST_CHECK(num_out[phase][output] == num_in[phase]);
+    }
+  }
+  if (host_test_failures != 0) {
+    return HOST_TEST_RESULT();
+  }
+  // Clock goes ahead of the controllers queued for MIDI OUT B, between
+  // the bytes of a message if need be. It only waits for the few bytes
+  // already in the UART's TX ring, the same number every time, so it
+  // keeps its spacing. USB adds the wait for the host to poll.
+  printf("phase,output,ticks,min_latency_us,mean_latency_us,max_latency_us,jitter_us\n");
+  for (phase_t phase = 0; phase < NUM_PHASES; phase++) {
+    result_t serial = report(phase, TO_SERIAL);
+    HOST_TEST_CHECK(serial.max_latency_us <= 4 * SERIAL_BYTE_US);
+    HOST_TEST_CHECK(serial.jitter_us <= SERIAL_BYTE_US);
+    result_t usb = report(phase, TO_USB);
+    HOST_TEST_CHECK(usb.jitter_us <= 2 * HOST_SIM_USB_POLL_US);
+  }
+  return HOST_TEST_RESULT();
+}
@@ -0,0 +1,203 @@
+/**
+ * @file host/tests/concurrency_test.c
+ * @brief stress spsc_ring and table_publisher with a thread on each side
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include "host_test.h"
+#include "spsc_ring.h"
+#include "table_publisher.h"
+
+#define RING_ELEMENTS 2000000
+#define RING_CAPACITY 64
+#define ELEMENT_WORDS 4
+#define TABLE_VERSIONS 20000
+#define TABLE_WORDS 256
+
+//--------------------------------------------------------------------+
+// spsc_ring: every element arrives once, in order and whole
+//--------------------------------------------------------------------+
+typedef struct {
+  uint32_t word[ELEMENT_WORDS]; // each word holds the sequence number times its index + 1
+} element_t;
+
+static spsc_ring_t ring;
+static element_t ring_storage[RING_CAPACITY];
+
+static void* ring_producer(void* arg)
+{
+  (void)arg;
+  for (uint32_t seq = 0; seq < RING_ELEMENTS; seq++) {
+    element_t element;
+    for (uint32_t idx = 0; idx < ELEMENT_WORDS; idx++) {
+      element.word[idx] = seq * (idx + 1);
+    }
+    while (!spsc_ring_push(&ring, &element)) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+typedef struct {
+  uint32_t out_of_order;
+  uint32_t torn;
+  uint32_t peek_mismatch;
+  uint32_t bad_count;
+} ring_errors_t;
+
+static void* ring_consumer(void* arg)
+{
+  ring_errors_t* errors = arg;
+  for (uint32_t seq = 0; seq < RING_ELEMENTS; seq++) {
+    element_t peeked;
+    element_t element;
+    while (!spsc_ring_peek(&ring, &peeked)) {
+      sched_yield();
+    }
+    errors->bad_count += spsc_ring_count(&ring) == 0 || spsc_ring_count(&ring) > RING_CAPACITY;
+    if (!spsc_ring_pop(&ring, &element)) {
+      errors->peek_mismatch++;
+      continue;
+    }
+    errors->peek_mismatch += memcmp(&peeked, &element, sizeof(element)) != 0;
+    errors->out_of_order += element.word[0] != seq;
+    for (uint32_t idx = 1; idx < ELEMENT_WORDS; idx++) {
+      errors->torn += element.word[idx] != element.word[0] * (idx + 1);
+    }
+  }
+  return NULL;
+}
+
+static void test_ring(void)
+{
+  ring_errors_t errors;
+  memset(&errors, 0, sizeof(errors));
+  spsc_ring_init(&ring, ring_storage, sizeof(element_t), RING_CAPACITY);
+  pthread_t producer;
+  pthread_t consumer;
+  HOST_TEST_CHECK(pthread_create(&consumer, NULL, ring_consumer, &errors) == 0);
+  HOST_TEST_CHECK(pthread_create(&producer, NULL, ring_producer, NULL) == 0);
+  pthread_join(producer, NULL);
+  pthread_join(consumer, NULL);
+  HOST_TEST_CHECK(errors.out_of_order == 0);
+  HOST_TEST_CHECK(errors.torn == 0);
+  HOST_TEST_CHECK(errors.peek_mismatch == 0);
+  HOST_TEST_CHECK(errors.bad_count == 0);
+  HOST_TEST_CHECK(spsc_ring_count(&ring) == 0);
+}
+
+//--------------------------------------------------------------------+
+// table_publisher: the reader only sees whole tables, never goes back to
+// an older one, and the writer never writes the table the reader uses
+//--------------------------------------------------------------------+
+typedef struct {
+  uint32_t version;
+  uint32_t word[TABLE_WORDS]; // each word holds the version
+} table_t;
+
+static table_publisher_t publisher;
+static table_t tables[2];
+static _Atomic(const table_t*) reader_table; // the table the reader is using, or NULL
+static atomic_bool writer_done;
+
+typedef struct {
+  uint32_t torn;
+  uint32_t went_back;
+  uint32_t passes;
+  uint32_t versions_seen;
+} reader_result_t;
+
+static void* table_reader(void* arg)
+{
+  reader_result_t* result = arg;
+  uint32_t last_version = 0;
+  for (;;) {
+    bool done = atomic_load(&writer_done);
+    uint32_t generation;
+    const table_t* table = table_publisher_acquire(&publisher, &generation);
+    atomic_store(&reader_table, table);
+    // Read the table slowly enough for the writer to try to catch up
+    uint32_t version = table->version;
+    for (uint32_t idx = 0; idx < TABLE_WORDS; idx++) {
+      result->torn += table->word[idx] != version;
+      if (idx % 64 == 0) {
+        sched_yield();
+      }
+    }
+    result->torn += table->version != version;
+    result->went_back += version < last_version;
+    result->versions_seen += version != last_version;
+    last_version = version;
+    atomic_store(&reader_table, NULL);
+    table_publisher_release(&publisher, generation);
+    result->passes++;
+    if (done && version == TABLE_VERSIONS) {
+      return NULL;
+    }
+  }
+}
+
+static void test_publisher(void)
+{
+  reader_result_t result;
+  memset(&result, 0, sizeof(result));
+  memset(tables, 0, sizeof(tables));
+  table_publisher_init(&publisher, tables, tables + 1);
+  atomic_init(&reader_table, NULL);
+  atomic_init(&writer_done, false);
+  pthread_t reader;
+  HOST_TEST_CHECK(pthread_create(&reader, NULL, table_reader, &result) == 0);
+  uint32_t overwritten = 0;
+  for (uint32_t version = 1; version <= TABLE_VERSIONS; version++) {
+    while (!table_publisher_spare_is_free(&publisher)) {
+      sched_yield();
+    }
+    table_t* spare = table_publisher_spare(&publisher);
+    for (uint32_t idx = 0; idx < TABLE_WORDS; idx++) {
+      overwritten += atomic_load(&reader_table) == spare;
+      spare->word[idx] = version;
+    }
+    spare->version = version;
+    table_publisher_publish(&publisher);
+  }
+  atomic_store(&writer_done, true);
+  pthread_join(reader, NULL);
+  HOST_TEST_CHECK(overwritten == 0);
+  HOST_TEST_CHECK(result.torn == 0);
+  HOST_TEST_CHECK(result.went_back == 0);
+  // The reader took part in most swaps; the writer waited for it each time
+  HOST_TEST_CHECK(result.versions_seen > 0 && result.passes >= result.versions_seen);
+}
+
+int main(void)
+{
+  test_ring();
+  test_publisher();
+  return HOST_TEST_RESULT();
+}
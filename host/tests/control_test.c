@@ -0,0 +1,203 @@
+/**
+ * @file host/tests/control_test.c
+ * @brief send SysEx control requests to the simulated board and check the replies
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "host_test.h"
+#include "midi_parser.h"
+#include "midi_control.h"
+#include "hardware/pio.h"
+#include "tusb.h"
+
+// The ports of the firmware; see main.c
+#define NUM_USB_PORTS (CFG_TUD_MIDI_NUMCABLES_OUT - 1)
+#define NUM_SERIAL_PORTS ((NUM_PIOS == 2 ? 4 : 6) + 2)
+#define NUM_PORTS (NUM_USB_PORTS + NUM_SERIAL_PORTS)
+#define CONTROL_CABLE NUM_USB_PORTS
+#define SERIAL_B (NUM_USB_PORTS + 1)
+
+// Times in us; the welcome message comes 1 s after the terminal opens
+enum {
+  T_GET_INFO = 1500000,
+  T_CHECK_INFO = 1510000,
+  T_GET_ROUTES = 1520000,
+  T_CHECK_ROUTES = 1530000,
+  T_SET_ROUTES = 1540000,
+  T_CHECK_SET_ROUTES = 1550000,
+  T_CHECK_NOTE = 1560000,
+  T_UNKNOWN = 1570000,
+  T_CHECK_UNKNOWN = 1580000,
+  T_END = 1600000,
+};
+
+// Collect the bytes of the packets on the control cable that came since
+// packet first; return how many
+static uint32_t reply_bytes(uint32_t first, uint8_t* bytes, uint32_t max)
+{
+  uint32_t nbytes = 0;
+  for (uint32_t idx = first; idx < host_test_capture.num_usb; idx++) {
+    const uint8_t* packet = host_test_capture.usb[idx].packet;
+    if (midi_packet_cable(packet) != CONTROL_CABLE) {
+      continue;
+    }
+    for (uint8_t byte = 0; byte < midi_packet_num_bytes(packet) && nbytes < max; byte++) {
+      bytes[nbytes++] = packet[1 + byte];
+    }
+  }
+  return nbytes;
+}
+
+// Send a request with its arguments
+static void request(uint8_t command, uint8_t tag, const uint8_t* args, uint8_t nargs)
+{
+  uint8_t message[MIDI_CONTROL_REQUEST_LEN];
+  message[0] = 0xF0;
+  message[1] = MIDI_CONTROL_MANUFACTURER;
+  message[2] = MIDI_CONTROL_PROTOCOL;
+  message[3] = command;
+  message[4] = tag;
+  if (nargs != 0) {
+    memcpy(message + 5, args, nargs);
+  }
+  message[5 + nargs] = 0xF7;
+  host_test_usb_send(CONTROL_CABLE, message, 6 + nargs);
+}
+
+// Check the reply header and return the first result, or NULL
+static const uint8_t* check_reply(const uint8_t* reply, uint32_t nbytes, uint8_t command, uint8_t tag,
+  uint8_t status, uint32_t nresults)
+{
+  HOST_TEST_CHECK(nbytes == 7 + nresults);
+  if (nbytes != 7 + nresults) {
+    return NULL;
+  }
+  HOST_TEST_CHECK(reply[0] == 0xF0 && reply[1] == MIDI_CONTROL_MANUFACTURER && reply[2] == MIDI_CONTROL_PROTOCOL);
+  HOST_TEST_CHECK(reply[3] == (command | MIDI_CONTROL_REPLY));
+  HOST_TEST_CHECK(reply[4] == tag);
+  HOST_TEST_CHECK(reply[5] == status);
+  HOST_TEST_CHECK(reply[nbytes - 1] == 0xF7);
+  return reply + 6;
+}
+
+static uint16_t get_row(const uint8_t* results, uint8_t in)
+{
+  const uint8_t* row = results + in * 3;
+  return row[0] | row[1] << 7 | row[2] << 14;
+}
+
+// By default each serial port and the USB cable of the same index route
+// to each other
+static uint16_t default_row(uint8_t in)
+{
+  if (in >= NUM_USB_PORTS) {
+    return 1u << (in - NUM_USB_PORTS);
+  }
+  return in < NUM_SERIAL_PORTS ? 1u << (in + NUM_USB_PORTS) : 0;
+}
+
+static uint64_t step(void* context, uint64_t now_us)
+{
+  (void)context;
+  static const uint8_t note_on[] = {0x90, 0x3c, 0x7f};
+  uint8_t reply[MIDI_CONTROL_REPLY_LEN];
+  uint8_t bytes[16];
+  uint64_t times[16];
+  switch (now_us) {
+  case 0:
+    return T_GET_INFO;
+  case T_GET_INFO:
+    host_test_clear();
+    request(MIDI_CONTROL_GET_INFO, 0x11, NULL, 0);
+    return T_CHECK_INFO;
+  case T_CHECK_INFO: {
+    const uint8_t* results = check_reply(reply, reply_bytes(0, reply, sizeof(reply)), MIDI_CONTROL_GET_INFO,
+      0x11, MIDI_CONTROL_OK, 4);
+    if (results != NULL) {
+      HOST_TEST_CHECK(results[0] == MIDI_CONTROL_VERSION);
+      HOST_TEST_CHECK(results[1] == NUM_PORTS);
+      HOST_TEST_CHECK(results[2] == NUM_USB_PORTS);
+      HOST_TEST_CHECK(results[3] == PRESET_STORE_NUM_PRESETS);
+    }
+    return T_GET_ROUTES;
+  }
+  case T_GET_ROUTES:
+    host_test_clear();
+    request(MIDI_CONTROL_GET_ROUTES, 0x22, NULL, 0);
+    return T_CHECK_ROUTES;
+  case T_CHECK_ROUTES: {
+    const uint8_t* results = check_reply(reply, reply_bytes(0, reply, sizeof(reply)), MIDI_CONTROL_GET_ROUTES,
+      0x22, MIDI_CONTROL_OK, NUM_PORTS * 3);
+    if (results != NULL) {
+      for (uint8_t in = 0; in < NUM_PORTS; in++) {
+        HOST_TEST_CHECK(get_row(results, in) == default_row(in));
+      }
+    }
+    return T_SET_ROUTES;
+  }
+  case T_SET_ROUTES: {
+    // Route USB cable 1 to serial port B instead of A
+    uint8_t rows[NUM_PORTS * 3];
+    for (uint8_t in = 0; in < NUM_PORTS; in++) {
+      uint16_t row = in == 0 ? 1u << SERIAL_B : default_row(in);
+      rows[in * 3] = row & 0x7F;
+      rows[in * 3 + 1] = (row >> 7) & 0x7F;
+      rows[in * 3 + 2] = row >> 14;
+    }
+    host_test_clear();
+    request(MIDI_CONTROL_SET_ROUTES, 0x33, rows, sizeof(rows));
+    return T_CHECK_SET_ROUTES;
+  }
+  case T_CHECK_SET_ROUTES:
+    // The reply does not wait for the routing loop to take the new routes
+    check_reply(reply, reply_bytes(0, reply, sizeof(reply)), MIDI_CONTROL_SET_ROUTES, 0x33, MIDI_CONTROL_OK, 0);
+    host_test_clear();
+    host_test_usb_send(0, note_on, sizeof(note_on));
+    return T_CHECK_NOTE;
+  case T_CHECK_NOTE:
+    // The next routing pass uses the new routes
+    HOST_TEST_CHECK(host_test_wire_bytes('A', 0, bytes, times, 16) == 0);
+    HOST_TEST_CHECK(host_test_wire_bytes('B', 0, bytes, times, 16) == 3);
+    HOST_TEST_CHECK(memcmp(bytes, note_on, 3) == 0);
+    return T_UNKNOWN;
+  case T_UNKNOWN:
+    host_test_clear();
+    request(0x3F, 0x44, NULL, 0);
+    return T_CHECK_UNKNOWN;
+  case T_CHECK_UNKNOWN:
+    check_reply(reply, reply_bytes(0, reply, sizeof(reply)), 0x3F, 0x44, MIDI_CONTROL_UNKNOWN_COMMAND, 0);
+    return T_END;
+  default:
+    return HOST_SIM_STOP;
+  }
+}
+
+int main(void)
+{
+  host_sim_config_t config = host_test_config(step, NULL);
+  HOST_TEST_CHECK(host_sim_run(&config) == 0);
+  return HOST_TEST_RESULT();
+}
@@ -0,0 +1,164 @@
+/**
+ * @file firmware_test.c
+ * @brief run main.c on the simulated board: routing, running status and the CLI
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "host_test.h"
+
+#define SERIAL_BYTE_US 320
+
+// Times in us; the welcome message comes 1 s after the terminal opens
+enum {
+  T_USB_NOTE = 1500500,
+  T_CHECK_USB_NOTE = 1520000,
+  T_SERIAL_NOTE = 1550000,
+  T_CHECK_SERIAL_NOTE = 1560000,
+  T_DISCONNECT = 1600000,
+  T_UNROUTED_NOTE = 1700000,
+  T_CHECK_UNROUTED = 1750000,
+  T_CONNECT = 1800000,
+  T_RUNNING_STATUS = 1900000,
+  T_CHECK_RUNNING_STATUS = 2000000,
+  T_CHECK_BAUD = 2100000,
+  T_CHECK_PIO_BAUD = 2200000,
+  T_CLOCK_MASTER = 2300000,
+  T_ROUTED_CLOCK = 2400000,
+  T_CHECK_ROUTED_CLOCK = 2500000,
+  T_CLOCK_OFF = 2600000,
+  T_CHECK_CLOCK_OFF = 2700000,
+  T_END = 2800000,
+};
+
+static uint64_t step(void* context, uint64_t now_us)
+{
+  (void)context;
+  static const uint8_t note_on[] = {0x90, 0x3c, 0x7f};
+  static const uint8_t notes[] = {0x91, 0x3c, 0x7f, 0x91, 0x3e, 0x7f};
+  static const uint8_t running_status[] = {0x91, 0x3c, 0x7f, 0x3e, 0x7f};
+  static const uint8_t clock_and_note[] = {0xF8, 0xFA, 0x90, 0x3c, 0x7f, 0xFC};
+  static const uint8_t clock[] = {0xF8, 0xFA, 0xFC};
+  uint8_t bytes[16];
+  uint64_t times[16];
+  switch (now_us) {
+  case 0:
+    return T_USB_NOTE;
+  case T_USB_NOTE:
+    HOST_TEST_CHECK(strstr(host_test_capture.text, "Cli is running") != NULL);
+    host_test_clear();
+    host_test_usb_send(0, note_on, sizeof(note_on));
+    return T_CHECK_USB_NOTE;
+  case T_CHECK_USB_NOTE:
+    // The host sends at the next frame; the bytes follow each other on the wire
+    HOST_TEST_CHECK(host_test_wire_bytes('A', 0, bytes, times, 16) == 3);
+    HOST_TEST_CHECK(memcmp(bytes, note_on, 3) == 0);
+    HOST_TEST_CHECK(times[0] >= 1501000 && times[0] < 1502000);
+    HOST_TEST_CHECK(times[1] - times[0] == SERIAL_BYTE_US && times[2] - times[1] == SERIAL_BYTE_US);
+    HOST_TEST_CHECK(host_test_capture.num_wire == 3);
+    host_test_clear();
+    return T_SERIAL_NOTE;
+  case T_SERIAL_NOTE:
+    host_sim_serial_send('A', note_on, sizeof(note_on));
+    return T_CHECK_SERIAL_NOTE;
+  case T_CHECK_SERIAL_NOTE: {
+    // Routed to USB cable 1 once the last byte is in; sent within the
+    // aggregation deadline and the next poll
+    HOST_TEST_CHECK(host_test_capture.num_usb == 1);
+    const host_test_usb_packet_t* usb = host_test_capture.usb;
+    static const uint8_t packet[4] = {0x09, 0x90, 0x3c, 0x7f};
+    HOST_TEST_CHECK(memcmp(usb->packet, packet, 4) == 0);
+    HOST_TEST_CHECK(usb->time_us >= T_SERIAL_NOTE + 3 * SERIAL_BYTE_US);
+    HOST_TEST_CHECK(usb->time_us <= T_SERIAL_NOTE + 3 * SERIAL_BYTE_US + 250 + HOST_SIM_USB_POLL_US + 10);
+    host_test_clear();
+    return T_DISCONNECT;
+  }
+  case T_DISCONNECT:
+    host_test_type("disconnect 1 A");
+    return T_UNROUTED_NOTE;
+  case T_UNROUTED_NOTE:
+    host_test_usb_send(0, note_on, sizeof(note_on));
+    return T_CHECK_UNROUTED;
+  case T_CHECK_UNROUTED:
+    HOST_TEST_CHECK(host_test_capture.num_wire == 0);
+    return T_CONNECT;
+  case T_CONNECT:
+    host_test_type("connect 1 A");
+    return T_RUNNING_STATUS;
+  case T_RUNNING_STATUS:
+    host_test_clear();
+    host_test_usb_send(0, notes, sizeof(notes));
+    host_test_type("baud G 62500");
+    return T_CHECK_RUNNING_STATUS;
+  case T_CHECK_RUNNING_STATUS:
+    // A serial MIDI OUT leaves out a repeated status byte
+    HOST_TEST_CHECK(host_test_wire_bytes('A', 0, bytes, NULL, 16) == sizeof(running_status));
+    HOST_TEST_CHECK(memcmp(bytes, running_status, sizeof(running_status)) == 0);
+    return T_CHECK_BAUD;
+  case T_CHECK_BAUD:
+    HOST_TEST_CHECK(host_sim_serial_baud('G') == 62500);
+    HOST_TEST_CHECK(host_sim_serial_baud('A') == 31250);
+    HOST_TEST_CHECK(strstr(host_test_capture.text, "rror") == NULL);
+    host_test_type("baud B 62500");
+    return T_CHECK_PIO_BAUD;
+  case T_CHECK_PIO_BAUD:
+    // A PIO port changes rate by the clock divider of its state machines
+    HOST_TEST_CHECK(host_sim_serial_baud('B') == 62500);
+    HOST_TEST_CHECK(strstr(host_test_capture.text, "B 62500") != NULL);
+    // One master tick on A every 8 s
+    host_test_type("clock output A 96");
+    return T_CLOCK_MASTER;
+  case T_CLOCK_MASTER:
+    host_test_type("clock master 30");
+    return T_ROUTED_CLOCK;
+  case T_ROUTED_CLOCK:
+    host_test_clear();
+    host_test_usb_send(0, clock_and_note, sizeof(clock_and_note));
+    return T_CHECK_ROUTED_CLOCK;
+  case T_CHECK_ROUTED_CLOCK:
+    // The master's outputs do not get the clock of an input as well
+    HOST_TEST_CHECK(host_test_wire_bytes('A', 0, bytes, NULL, 16) == sizeof(note_on));
+    HOST_TEST_CHECK(memcmp(bytes, note_on, sizeof(note_on)) == 0);
+    host_test_type("clock off");
+    return T_CLOCK_OFF;
+  case T_CLOCK_OFF:
+    host_test_clear();
+    host_test_usb_send(0, clock, sizeof(clock));
+    return T_CHECK_CLOCK_OFF;
+  case T_CHECK_CLOCK_OFF:
+    HOST_TEST_CHECK(host_test_wire_bytes('A', 0, bytes, NULL, 16) == sizeof(clock));
+    HOST_TEST_CHECK(memcmp(bytes, clock, sizeof(clock)) == 0);
+    return T_END;
+  default:
+    return HOST_SIM_STOP;
+  }
+}
+
+int main(void)
+{
+  host_sim_config_t config = host_test_config(step, NULL);
+  HOST_TEST_CHECK(host_sim_run(&config) == 0);
+  return HOST_TEST_RESULT();
+}
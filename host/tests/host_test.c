@@ -0,0 +1,126 @@
+/**
+ * @file host_test.c
+ * @brief checks and capture buffers shared by the host tests
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "host_test.h"
+#include "midi_parser.h"
+
+int host_test_failures = 0;
+host_test_capture_t host_test_capture;
+
+static void capture_usb(void* context, const uint8_t packet[4], uint64_t time_us)
+{
+  (void)context;
+  host_test_capture_t* capture = &host_test_capture;
+  if (capture->num_usb < HOST_TEST_MAX_PACKETS) {
+    memcpy(capture->usb[capture->num_usb].packet, packet, 4);
+    capture->usb[capture->num_usb].time_us = time_us;
+  }
+  capture->num_usb++;
+}
+
+static void capture_wire(void* context, char port_id, uint8_t byte, uint64_t time_us)
+{
+  (void)context;
+  host_test_capture_t* capture = &host_test_capture;
+  if (capture->num_wire < HOST_TEST_MAX_BYTES) {
+    host_test_wire_byte_t* entry = capture->wire + capture->num_wire;
+    entry->port_id = port_id;
+    entry->byte = byte;
+    entry->time_us = time_us;
+  }
+  capture->num_wire++;
+}
+
+static void capture_cdc(void* context, const char* text, uint32_t len)
+{
+  (void)context;
+  host_test_capture_t* capture = &host_test_capture;
+  for (uint32_t idx = 0; idx < len && capture->text_len < HOST_TEST_MAX_TEXT; idx++) {
+    capture->text[capture->text_len++] = text[idx];
+  }
+  capture->text[capture->text_len] = '\0';
+}
+
+host_sim_config_t host_test_config(host_sim_step_fn step, void* context)
+{
+  host_sim_config_t config = {
+    .step = step,
+    .usb_in = capture_usb,
+    .wire = capture_wire,
+    .cdc = capture_cdc,
+    .context = context,
+    .start_us = 0,
+    .flash_file = NULL,
+  };
+  return config;
+}
+
+void host_test_type(const char* line)
+{
+  host_sim_cdc_send(line, strlen(line));
+  host_sim_cdc_send("\r", 1);
+}
+
+void host_test_clear(void)
+{
+  host_test_capture.num_wire = 0;
+  host_test_capture.num_usb = 0;
+  host_test_capture.text_len = 0;
+  host_test_capture.text[0] = '\0';
+}
+
+uint32_t host_test_wire_bytes(char port_id, uint32_t first, uint8_t* bytes, uint64_t* times_us, uint32_t max)
+{
+  const host_test_capture_t* capture = &host_test_capture;
+  uint32_t count = 0;
+  uint32_t kept = capture->num_wire < HOST_TEST_MAX_BYTES ? capture->num_wire : HOST_TEST_MAX_BYTES;
+  for (uint32_t idx = first; idx < kept && count < max; idx++) {
+    if (capture->wire[idx].port_id == port_id) {
+      bytes[count] = capture->wire[idx].byte;
+      if (times_us != NULL) {
+        times_us[count] = capture->wire[idx].time_us;
+      }
+      count++;
+    }
+  }
+  return count;
+}
+
+static void send_packet(void* context, const uint8_t packet[4])
+{
+  (void)context;
+  host_sim_usb_send(packet);
+}
+
+void host_test_usb_send(uint8_t cable, const uint8_t* bytes, uint32_t nbytes)
+{
+  midi_parser_t parser;
+  midi_parser_init(&parser, cable);
+  midi_parser_parse(&parser, bytes, nbytes, send_packet, NULL);
+}
@@ -0,0 +1,118 @@
+/**
+ * @file host_test.h
+ * @brief checks and capture buffers shared by the host tests
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "host_sim.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+extern int host_test_failures;
+
+/// report a failed check and carry on
+#define HOST_TEST_CHECK(cond) do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      host_test_failures++; \
+    } \
+  } while (0)
+
+/// the exit status of a test
+#define HOST_TEST_RESULT() (host_test_failures == 0 ? 0 : 1)
+
+#define HOST_TEST_MAX_BYTES 65536
+#define HOST_TEST_MAX_PACKETS 16384
+#define HOST_TEST_MAX_TEXT 65536
+
+typedef struct {
+  char port_id;
+  uint8_t byte;
+  uint64_t time_us;
+} host_test_wire_byte_t;
+
+typedef struct {
+  uint8_t packet[4];
+  uint64_t time_us;
+} host_test_usb_packet_t;
+
+/**
+ * @brief What the simulated host and MIDI OUTs received, oldest first.
+ * Anything past the size of a buffer is counted but not kept.
+ */
+typedef struct {
+  host_test_wire_byte_t wire[HOST_TEST_MAX_BYTES];
+  uint32_t num_wire;
+  host_test_usb_packet_t usb[HOST_TEST_MAX_PACKETS];
+  uint32_t num_usb;
+  char text[HOST_TEST_MAX_TEXT + 1]; // the terminal output, NUL terminated
+  uint32_t text_len;
+} host_test_capture_t;
+
+extern host_test_capture_t host_test_capture;
+
+/**
+ * @brief a configuration that captures everything in host_test_capture
+ *
+ * @param step the test script
+ * @param context passed to step
+ */
+host_sim_config_t host_test_config(host_sim_step_fn step, void* context);
+
+/**
+ * @brief type a line on the terminal
+ */
+void host_test_type(const char* line);
+
+/**
+ * @brief forget what was captured so far
+ */
+void host_test_clear(void);
+
+/**
+ * @brief the bytes one MIDI OUT received, oldest first
+ *
+ * @param first the first captured byte to look at
+ * @return the number of bytes written to bytes, at most max
+ */
+uint32_t host_test_wire_bytes(char port_id, uint32_t first, uint8_t* bytes, uint64_t* times_us, uint32_t max);
+
+/**
+ * @brief send MIDI bytes from the host on a USB cable
+ */
+void host_test_usb_send(uint8_t cable, const uint8_t* bytes, uint32_t nbytes);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
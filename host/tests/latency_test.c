@@ -0,0 +1,223 @@
+/**
+ * @file host/tests/latency_test.c
+ * @brief measure how long the simulated firmware takes to service MIDI input, idle and under load
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "hardware/pio.h"
+
+#define SERIAL_BYTE_US 320
+#define NUM_PROBES 200
+#define PROBE_PERIOD_US 7300
+#define LOAD_PERIOD_US 1000
+// MIDI OUT H and the USB cable routed to it by default carry the USB
+// probes; the PIO ports from C on carry the load
+#define NUM_PIO_PORTS (NUM_PIOS == 2 ? 4 : 6)
+#define PROBE_CABLE (NUM_PIO_PORTS + 1)
+#define LAST_LOAD_ID ('A' + NUM_PIO_PORTS - 1)
+
+// Times in us; the welcome message comes 1 s after the terminal opens
+enum {
+  T_SET_UP = 1500000,
+  T_IDLE = 2000000,
+  T_LOAD = 3900000,
+  T_LOADED = 4000000,
+  T_END = 5600000,
+};
+
+typedef enum {
+  SERIAL_TO_SERIAL, // a note from MIDI IN A to MIDI OUT B
+  SERIAL_TO_USB,    // the same note to USB cable 1
+  USB_TO_SERIAL,    // a note from USB cable 8 (6 with two PIOs) to MIDI OUT H
+  NUM_PATHS,
+} path_t;
+
+static const char* const path_names[NUM_PATHS] = {"serial-to-serial", "serial-to-usb", "usb-to-serial"};
+
+// When each probe was sent and when it came out on each path. A probe
+// ends on the wire when its last byte is in, or on USB at the start of
+// the frame the host sends it in.
+static uint64_t sent_us[NUM_PATHS][2 * NUM_PROBES];
+static uint64_t out_us[NUM_PATHS][2 * NUM_PROBES];
+static uint32_t num_out[NUM_PATHS];
+
+// Probes alternate note on and note off so that running status never
+// hides the status byte that marks the start of each one
+static uint8_t probe_status(uint32_t probe)
+{
+  return probe % 2 ? 0x80 : 0x90;
+}
+
+static void probe_out(path_t path, uint64_t time_us)
+{
+  if (num_out[path] < 2 * NUM_PROBES) {
+    out_us[path][num_out[path]] = time_us;
+  }
+  num_out[path]++;
+}
+
+static void wire_byte(void* context, char port_id, uint8_t byte, uint64_t time_us)
+{
+  (void)context;
+  if ((byte & 0xF0) == 0x80 || (byte & 0xF0) == 0x90) {
+    if (port_id == 'B') {
+      probe_out(SERIAL_TO_SERIAL, time_us);
+    }
+    else if (port_id == 'H') {
+      probe_out(USB_TO_SERIAL, time_us);
+    }
+  }
+}
+
+static void usb_packet(void* context, const uint8_t packet[4], uint64_t time_us)
+{
+  (void)context;
+  if ((packet[0] >> 4) == 0) {
+    probe_out(SERIAL_TO_USB, time_us);
+  }
+}
+
+static uint64_t probe_time(uint32_t probe)
+{
+  uint64_t start = probe < NUM_PROBES ? T_IDLE : T_LOADED;
+  uint32_t idx = probe % NUM_PROBES;
+  // Spread the probes over the USB frame and the poll interval
+  return start + idx * PROBE_PERIOD_US + (idx * 1237) % 1000;
+}
+
+static void send_probe(uint32_t probe, uint64_t now_us)
+{
+  uint8_t note[3] = {probe_status(probe), probe % 128, 0x40};
+  host_sim_serial_send('A', note, sizeof(note));
+  sent_us[SERIAL_TO_SERIAL][probe] = now_us + sizeof(note) * SERIAL_BYTE_US;
+  sent_us[SERIAL_TO_USB][probe] = sent_us[SERIAL_TO_SERIAL][probe];
+  host_test_usb_send(PROBE_CABLE, note, sizeof(note));
+  sent_us[USB_TO_SERIAL][probe] = (now_us + HOST_SIM_USB_FRAME_US - 1) / HOST_SIM_USB_FRAME_US * HOST_SIM_USB_FRAME_US;
+}
+
+// Keep MIDI INs C-F busy with notes to USB and flood MIDI OUTs C-F with
+// controllers from USB; with two PIOs, C and D
+static void send_load(uint64_t now_us)
+{
+  uint8_t note[3] = {0x91, (now_us / LOAD_PERIOD_US) % 128, 0x40};
+  uint8_t controllers[12];
+  for (uint8_t idx = 0; idx < sizeof(controllers); idx += 3) {
+    controllers[idx] = 0xB2;
+    controllers[idx + 1] = 7;
+    controllers[idx + 2] = (now_us / LOAD_PERIOD_US + idx) % 128;
+  }
+  for (char port_id = 'C'; port_id <= LAST_LOAD_ID; port_id++) {
+    host_sim_serial_send(port_id, note, sizeof(note));
+    host_test_usb_send(2 + port_id - 'C', controllers, sizeof(controllers));
+  }
+}
+
+static uint64_t step(void* context, uint64_t now_us)
+{
+  (void)context;
+  static uint32_t next_probe = 0;
+  static uint64_t next_load_us = T_LOAD;
+  if (now_us == 0) {
+    return T_SET_UP;
+  }
+  if (now_us == T_SET_UP) {
+    // MIDI OUT B only gets the probes from MIDI IN A
+    host_test_type("connect A B");
+    host_test_type("disconnect 2 B");
+    return T_IDLE;
+  }
+  if (now_us >= T_END) {
+    return HOST_SIM_STOP;
+  }
+  if (next_probe < 2 * NUM_PROBES && now_us == probe_time(next_probe)) {
+    send_probe(next_probe, now_us);
+    next_probe++;
+  }
+  if (now_us == next_load_us) {
+    send_load(now_us);
+    next_load_us += LOAD_PERIOD_US;
+  }
+  uint64_t next_us = T_END;
+  if (next_probe < 2 * NUM_PROBES && probe_time(next_probe) < next_us) {
+    next_us = probe_time(next_probe);
+  }
+  if (next_load_us < next_us && next_load_us < T_END - 100000) {
+    next_us = next_load_us;
+  }
+  return next_us;
+}
+
+static int compare_us(const void* a, const void* b)
+{
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+// Print the latencies of one path in one phase; return the largest
+static uint64_t report(path_t path, bool loaded)
+{
+  uint64_t latency[NUM_PROBES];
+  uint64_t total = 0;
+  uint32_t first = loaded ? NUM_PROBES : 0;
+  for (uint32_t idx = 0; idx < NUM_PROBES; idx++) {
+    latency[idx] = out_us[path][first + idx] - sent_us[path][first + idx];
+    total += latency[idx];
+  }
+  qsort(latency, NUM_PROBES, sizeof(latency[0]), compare_us);
+  printf("%s,%s,%u,%llu,%llu,%llu,%llu\n", path_names[path], loaded ? "loaded" : "idle", NUM_PROBES,
+    (unsigned long long)latency[0], (unsigned long long)(total / NUM_PROBES),
+    (unsigned long long)latency[NUM_PROBES * 99 / 100], (unsigned long long)latency[NUM_PROBES - 1]);
+  return latency[NUM_PROBES - 1];
+}
+
+int main(void)
+{
+  host_sim_config_t config = host_test_config(step, NULL);
+  config.wire = wire_byte;
+  config.usb_in = usb_packet;
+  HOST_TEST_CHECK(host_sim_run(&config) == 0);
+  for (path_t path = 0; path < NUM_PATHS; path++) {
+    HOST_TEST_CHECK(num_out[path] == 2 * NUM_PROBES);
+  }
+  if (host_test_failures != 0) {
+    return HOST_TEST_RESULT();
+  }
+  // The firmware takes no time in the simulation, so this measures how
+  // long input waits for the loop to notice it: a serial MIDI OUT starts
+  // within a few tud_task() calls. USB adds the 250 us the IN endpoint
+  // waits for more packets and the host polls, which the load delays
+  // by a transfer or two.
+  printf("path,load,probes,min_us,mean_us,p99_us,max_us\n");
+  for (path_t path = 0; path < NUM_PATHS; path++) {
+    uint64_t limit_us = path == SERIAL_TO_USB ? 250 + 3 * HOST_SIM_USB_POLL_US : 5 * HOST_SIM_TASK_US;
+    HOST_TEST_CHECK(report(path, false) <= limit_us);
+    HOST_TEST_CHECK(report(path, true) <= limit_us);
+  }
+  return HOST_TEST_RESULT();
+}
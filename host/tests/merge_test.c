@@ -0,0 +1,386 @@
+/**
+ * @file host/tests/merge_test.c
+ * @brief feed randomized interleaved MIDI streams through the parsers and a merger and check the output
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "midi_parser.h"
+#include "midi_merger.h"
+
+#define NUM_SOURCES 4
+#define MESSAGES_PER_SOURCE 300
+#define MAX_STREAM 8192
+#define MAX_PACKETS 8192
+#define MAX_OUTPUT (NUM_SOURCES * MAX_STREAM * 2)
+#define ROUNDS_PER_CONFIG 8
+
+static uint32_t random_state;
+
+static uint32_t random_below(uint32_t limit)
+{
+  // xorshift32; the seed makes every run the same
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state % limit;
+}
+
+typedef struct {
+  uint8_t bytes[MAX_STREAM];
+  uint32_t nbytes;
+  uint32_t pos;            // the next byte to parse
+  midi_parser_t parser;
+  uint8_t pending[64][4];  // packets parsed but not yet pushed
+  uint8_t npending;
+  uint8_t pushed[MAX_PACKETS][4];
+  uint32_t npushed;
+  uint8_t sent[MAX_PACKETS][4];
+  uint32_t sent_idx[MAX_PACKETS]; // the index in pushed of each packet sent
+  uint32_t nsent;
+  bool dropped[MAX_PACKETS];      // true for each packet in pushed that was dropped
+  uint32_t ndropped;
+} source_t;
+
+// The timestamp of a packet names its source and its index in pushed
+#define TIMESTAMP(source, idx) ((uint32_t)(source) << 16 | (idx))
+#define TIMESTAMP_SOURCE(timestamp) ((timestamp) >> 16)
+#define TIMESTAMP_IDX(timestamp) ((timestamp) & 0xFFFF)
+
+static source_t sources[NUM_SOURCES];
+static uint8_t output[MAX_OUTPUT];
+static uint32_t noutput;
+// Every packet the merger finished writing, in order
+static uint8_t sent[NUM_SOURCES * MAX_PACKETS][4];
+static uint32_t nsent;
+// The packets the output decodes to
+static uint8_t decoded[NUM_SOURCES * MAX_PACKETS][4];
+static uint32_t ndecoded;
+
+static uint8_t data_length(uint8_t status)
+{
+  switch (status & 0xF0) {
+  case 0xC0:
+  case 0xD0:
+    return 1;
+  case 0xF0:
+    return status == 0xF2 ? 2 : status == 0xF6 ? 0 : 1;
+  default:
+    return 2;
+  }
+}
+
+static void put_byte(source_t* source, uint8_t byte)
+{
+  // Real-time bytes may come between any two bytes
+  if (random_below(20) == 0) {
+    static const uint8_t realtime[] = {0xF8, 0xFA, 0xFC, 0xFE};
+    source->bytes[source->nbytes++] = realtime[random_below(sizeof(realtime))];
+  }
+  source->bytes[source->nbytes++] = byte;
+}
+
+// A stream of channel, System Common and SysEx messages that uses
+// running status where it may
+static void make_stream(source_t* source)
+{
+  static const uint8_t common[] = {0xF1, 0xF2, 0xF3, 0xF6};
+  uint8_t running = 0;
+  source->nbytes = 0;
+  for (uint32_t msg = 0; msg < MESSAGES_PER_SOURCE; msg++) {
+    uint32_t kind = random_below(10);
+    if (kind == 0) {
+      uint32_t length = random_below(40);
+      put_byte(source, 0xF0);
+      for (uint32_t idx = 0; idx < length; idx++) {
+        put_byte(source, random_below(0x80));
+      }
+      put_byte(source, 0xF7);
+      running = 0;
+    }
+    else if (kind == 1) {
+      uint8_t status = common[random_below(sizeof(common))];
+      put_byte(source, status);
+      for (uint8_t idx = 0; idx < data_length(status); idx++) {
+        put_byte(source, random_below(0x80));
+      }
+      running = 0;
+    }
+    else {
+      uint8_t status = running != 0 && random_below(2) == 0 ? running : 0x80 + random_below(0x70);
+      if (status != running) {
+        put_byte(source, status);
+      }
+      for (uint8_t idx = 0; idx < data_length(status); idx++) {
+        put_byte(source, random_below(0x80));
+      }
+      running = status;
+    }
+  }
+}
+
+// The destination takes a few bytes at a time, or none
+static uint32_t write_output(void* handle, const uint8_t* buffer, uint32_t nbytes)
+{
+  (void)handle;
+  uint32_t accepted = random_below(6);
+  if (accepted > nbytes) {
+    accepted = nbytes;
+  }
+  memcpy(output + noutput, buffer, accepted);
+  noutput += accepted;
+  return accepted;
+}
+
+static void packet_sent(void* context, const uint8_t packet[4], uint32_t timestamp)
+{
+  (void)context;
+  (void)timestamp;
+  source_t* source = sources + midi_packet_cable(packet);
+  source->sent_idx[source->nsent] = TIMESTAMP_SOURCE(timestamp) == midi_packet_cable(packet) ?
+    TIMESTAMP_IDX(timestamp) : MAX_PACKETS;
+  memcpy(source->sent[source->nsent++], packet, 4);
+  memcpy(sent[nsent++], packet, 4);
+}
+
+static void packet_dropped(void* context, const uint8_t packet[4], uint32_t timestamp)
+{
+  (void)context;
+  source_t* source = sources + midi_packet_cable(packet);
+  HOST_TEST_CHECK(TIMESTAMP_SOURCE(timestamp) == midi_packet_cable(packet));
+  HOST_TEST_CHECK(!source->dropped[TIMESTAMP_IDX(timestamp)]);
+  source->dropped[TIMESTAMP_IDX(timestamp)] = true;
+  source->ndropped++;
+}
+
+static void packet_parsed(void* context, const uint8_t packet[4])
+{
+  source_t* source = context;
+  memcpy(source->pending[source->npending++], packet, 4);
+}
+
+// Push the parsed packets of a source while the merger has room for them
+static void push_pending(midi_merger_t* merger, source_t* source)
+{
+  uint8_t number = source - sources;
+  uint8_t idx = 0;
+  for (; idx < source->npending; idx++) {
+    bool blocks = merger->policy == MIDI_MERGER_BLOCK_SOURCE || midi_merger_holds_back(merger, number);
+    if (blocks && midi_merger_free(merger, number) == 0) {
+      break;
+    }
+    midi_merger_push(merger, source->pending[idx], TIMESTAMP(number, source->npushed));
+    memcpy(source->pushed[source->npushed++], source->pending[idx], 4);
+  }
+  memmove(source->pending, source->pending + idx, (source->npending - idx) * 4);
+  source->npending -= idx;
+}
+
+static bool merger_idle(const midi_merger_t* merger)
+{
+  return merger->count == 0 && merger->realtime_count == 0 && merger->ndeferred == 0 &&
+    merger->pending_idx >= merger->npending && merger->needs_terminator == 0;
+}
+
+// Return the number of problems in a serial MIDI byte stream: a data byte
+// without a status, a message cut short or a SysEx message interrupted
+static uint32_t stream_errors(const uint8_t* bytes, uint32_t nbytes)
+{
+  uint32_t errors = 0;
+  uint8_t running = 0;
+  uint8_t need = 0;
+  bool in_sysex = false;
+  for (uint32_t idx = 0; idx < nbytes; idx++) {
+    uint8_t byte = bytes[idx];
+    if (byte >= 0xF8) {
+      continue;
+    }
+    if (byte == 0xF7) {
+      errors += !in_sysex || need != 0;
+      in_sysex = false;
+    }
+    else if (byte & 0x80) {
+      errors += in_sysex || need != 0;
+      in_sysex = byte == 0xF0;
+      running = byte < 0xF0 ? byte : 0;
+      need = in_sysex ? 0 : data_length(byte);
+    }
+    else if (need > 0) {
+      need--;
+    }
+    else if (running != 0) {
+      need = data_length(running) - 1;
+    }
+    else {
+      errors += !in_sysex;
+    }
+  }
+  return errors + in_sysex + (need != 0);
+}
+
+static void packet_decoded(void* context, const uint8_t packet[4])
+{
+  (void)context;
+  memcpy(decoded[ndecoded++], packet, 4);
+}
+
+static bool same_packet(const uint8_t a[4], const uint8_t b[4])
+{
+  return (a[0] & 0x0F) == (b[0] & 0x0F) && memcmp(a + 1, b + 1, 3) == 0;
+}
+
+static bool is_terminator(const uint8_t packet[4])
+{
+  return midi_packet_cin(packet) == MIDI_CIN_SYSEX_END_1 && packet[1] == 0xF7;
+}
+
+// Check what one source got through: every packet it pushed was either
+// sent or dropped, real-time packets and the others each in the order
+// they were pushed, and the only other packets sent close a truncated
+// SysEx message
+static void check_source(const source_t* source, bool lossless)
+{
+  static bool seen[MAX_PACKETS];
+  memset(seen, 0, sizeof(seen));
+  uint32_t last[2] = {0, 0}; // 1 + the index of the last packet sent of each kind
+  for (uint32_t idx = 0; idx < source->nsent; idx++) {
+    const uint8_t* packet = source->sent[idx];
+    uint32_t pushed = source->sent_idx[idx];
+    if (pushed >= source->npushed || source->dropped[pushed] || seen[pushed] ||
+        !same_packet(source->pushed[pushed], packet)) {
+      // A terminator takes the timestamp of another packet
+      HOST_TEST_CHECK(is_terminator(packet));
+      continue;
+    }
+    bool realtime = midi_packet_is_realtime(packet);
+    HOST_TEST_CHECK(pushed + 1 > last[realtime]);
+    last[realtime] = pushed + 1;
+    seen[pushed] = true;
+  }
+  for (uint32_t pushed = 0; pushed < source->npushed; pushed++) {
+    HOST_TEST_CHECK(seen[pushed] != source->dropped[pushed]);
+  }
+  if (lossless) {
+    HOST_TEST_CHECK(source->ndropped == 0 && source->nsent == source->npushed);
+  }
+}
+
+static void run_round(midi_merger_policy_t policy, bool fair, bool running_status, bool realtime_between_bytes,
+  bool flow_control)
+{
+  static midi_merger_entry_t queue[64];
+  midi_merger_t merger;
+  midi_merger_init(&merger, write_output, NULL, queue, 4 + random_below(61));
+  midi_merger_set_policy(&merger, policy);
+  midi_merger_set_fair(&merger, fair);
+  midi_merger_set_running_status(&merger, running_status);
+  midi_merger_set_realtime_between_bytes(&merger, realtime_between_bytes);
+  midi_merger_set_sysex_flow_control(&merger, flow_control);
+  midi_merger_set_sent_cb(&merger, packet_sent, NULL);
+  midi_merger_set_dropped_cb(&merger, packet_dropped, NULL);
+  memset(sources, 0, sizeof(sources));
+  noutput = 0;
+  nsent = 0;
+  ndecoded = 0;
+  for (uint8_t number = 0; number < NUM_SOURCES; number++) {
+    make_stream(sources + number);
+    midi_parser_init(&sources[number].parser, number);
+    midi_merger_set_weight(&merger, number, 1 + random_below(4));
+  }
+  // Feed the sources a few bytes at a time in random order, draining the
+  // output between them at random
+  for (;;) {
+    uint8_t busy[NUM_SOURCES];
+    uint8_t nbusy = 0;
+    for (uint8_t number = 0; number < NUM_SOURCES; number++) {
+      if (sources[number].pos < sources[number].nbytes || sources[number].npending > 0) {
+        busy[nbusy++] = number;
+      }
+    }
+    if (nbusy == 0) {
+      break;
+    }
+    source_t* source = sources + busy[random_below(nbusy)];
+    push_pending(&merger, source);
+    if (source->npending == 0 && source->pos < source->nbytes) {
+      uint32_t nbytes = 1 + random_below(8);
+      if (nbytes > source->nbytes - source->pos) {
+        nbytes = source->nbytes - source->pos;
+      }
+      midi_parser_parse(&source->parser, source->bytes + source->pos, nbytes, packet_parsed, source);
+      source->pos += nbytes;
+      push_pending(&merger, source);
+    }
+    if (random_below(3) == 0) {
+      midi_merger_flush(&merger);
+    }
+  }
+  for (uint32_t tries = 0; !merger_idle(&merger) && tries < 1000000; tries++) {
+    midi_merger_flush(&merger);
+  }
+  HOST_TEST_CHECK(merger_idle(&merger));
+
+  HOST_TEST_CHECK(stream_errors(output, noutput) == 0);
+  // The output decodes to the packets the merger reports as sent, in order
+  midi_parser_t parser;
+  midi_parser_init(&parser, 0);
+  midi_parser_parse(&parser, output, noutput, packet_decoded, NULL);
+  HOST_TEST_CHECK(ndecoded == nsent);
+  uint32_t idx = 0;
+  while (idx < nsent && idx < ndecoded && same_packet(decoded[idx], sent[idx])) {
+    idx++;
+  }
+  HOST_TEST_CHECK(idx == nsent);
+  bool lossless = policy == MIDI_MERGER_BLOCK_SOURCE;
+  for (uint8_t number = 0; number < NUM_SOURCES; number++) {
+    check_source(sources + number, lossless);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  random_state = argc > 1 ? strtoul(argv[1], NULL, 0) : 0x2545F491;
+  if (random_state == 0) {
+    random_state = 1;
+  }
+  static const midi_merger_policy_t policies[] = {
+    MIDI_MERGER_DROP_NEWEST, MIDI_MERGER_DROP_OLDEST, MIDI_MERGER_BLOCK_SOURCE
+  };
+  for (uint8_t policy = 0; policy < 3; policy++) {
+    for (uint8_t flags = 0; flags < 16; flags++) {
+      for (uint8_t round = 0; round < ROUNDS_PER_CONFIG; round++) {
+        int failures = host_test_failures;
+        run_round(policies[policy], flags & 1, flags & 2, flags & 4, flags & 8);
+        if (host_test_failures != failures) {
+          fprintf(stderr, "policy %u flags %u round %u failed\n", policy, flags, round);
+          return HOST_TEST_RESULT();
+        }
+      }
+    }
+  }
+  return HOST_TEST_RESULT();
+}
@@ -0,0 +1,247 @@
+/**
+ * @file host/tests/midi_clock_test.c
+ * @brief check the tick spacing of the clock master and the lock of the follower
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "midi_clock.h"
+
+#define NUM_PORTS 4
+#define STEP_US 50            // how often the routing loop runs
+#define MAX_SENT 8192
+#define PERIOD_120_Q8 (20833u * 256 + 85) // 120 BPM at 24 PPQN, 20833.33 us
+#define INPUT_JITTER_US 600   // input ticks arrive up to this early or late
+
+typedef struct {
+  uint8_t byte;
+  uint32_t due_us;
+  uint32_t sent_us;
+} sent_t;
+
+static midi_clock_t clock;
+static uint32_t now_us;
+static sent_t sent[NUM_PORTS][MAX_SENT];
+static uint32_t num_sent[NUM_PORTS];
+
+static void record_send(void* context, uint8_t out, uint8_t byte, uint32_t time_us)
+{
+  (void)context;
+  if (num_sent[out] < MAX_SENT) {
+    sent[out][num_sent[out]++] = (sent_t){byte, time_us, now_us};
+  }
+}
+
+static void set_up(void)
+{
+  midi_clock_init(&clock, NUM_PORTS, record_send, NULL);
+  memset(num_sent, 0, sizeof(num_sent));
+  now_us = 1000;
+}
+
+// Run the routing loop until end_us; a stall holds it up for stall_us
+static void run(uint32_t end_us, uint32_t stall_at_us, uint32_t stall_us)
+{
+  for (; (int32_t)(now_us - end_us) < 0; now_us += STEP_US) {
+    if (stall_us != 0 && now_us >= stall_at_us) {
+      now_us += stall_us;
+      stall_us = 0;
+    }
+    midi_clock_task(&clock, now_us, (1u << NUM_PORTS) - 1);
+  }
+}
+
+// The time of tick n on a grid of period_q8 / 256 us from first_us
+static uint32_t grid_us(uint32_t first_us, uint64_t period_q8, uint32_t n)
+{
+  return first_us + (uint32_t)((period_q8 * n) >> 8);
+}
+
+//--------------------------------------------------------------------+
+// The master's ticks stay on the grid of its tempo, at every tempo,
+// through a stalled loop, and each output sends its division and offset
+//--------------------------------------------------------------------+
+static void test_master(void)
+{
+  set_up();
+  midi_clock_set_output(&clock, 1, 2, 0);
+  midi_clock_set_output(&clock, 2, 1, 3000);
+  midi_clock_set_output(&clock, 3, 0, 0);
+  midi_clock_set_mode(&clock, MIDI_CLOCK_MASTER, 0);
+  // 10 s with the loop stalled for 15 ms in the middle
+  run(10001000, 5000000, 15000);
+  uint32_t first_us = sent[0][0].due_us;
+  HOST_TEST_CHECK(num_sent[0] >= 480 && num_sent[0] <= 481);
+  uint32_t max_error = 0;
+  uint32_t max_late = 0;
+  for (uint32_t idx = 0; idx < num_sent[0]; idx++) {
+    const sent_t* tick = &sent[0][idx];
+    HOST_TEST_CHECK(tick->byte == 0xF8);
+    uint32_t error = abs((int32_t)(tick->due_us - grid_us(first_us, PERIOD_120_Q8, idx)));
+    max_error = error > max_error ? error : max_error;
+    uint32_t late = tick->sent_us - tick->due_us;
+    max_late = late > max_late ? late : max_late;
+  }
+  printf("master: %u ticks, %u us off the grid at most, sent up to %u us late\n", num_sent[0], max_error, max_late);
+  HOST_TEST_CHECK(max_error <= 1);
+  // Only the tick due during the stall goes out late
+  HOST_TEST_CHECK(max_late <= 15000 + STEP_US);
+
+  HOST_TEST_CHECK(num_sent[1] == (num_sent[0] + 1) / 2);
+  for (uint32_t idx = 0; idx < num_sent[1]; idx++) {
+    HOST_TEST_CHECK(sent[1][idx].due_us == sent[0][2 * idx].due_us);
+  }
+  HOST_TEST_CHECK(num_sent[2] + 1 >= num_sent[0]);
+  for (uint32_t idx = 0; idx < num_sent[2]; idx++) {
+    HOST_TEST_CHECK(sent[2][idx].due_us == sent[0][idx].due_us + 3000);
+  }
+  HOST_TEST_CHECK(num_sent[3] == 0);
+
+  // A tempo that is no whole number of microseconds per tick does not drift
+  set_up();
+  HOST_TEST_CHECK(midi_clock_set_tempo(&clock, 985, 96));
+  midi_clock_set_mode(&clock, MIDI_CLOCK_MASTER, 0);
+  run(20001000, 0, 0);
+  uint64_t period_q8 = 600000000ull * 256 / (985 * 96);
+  max_error = 0;
+  for (uint32_t idx = 0; idx < num_sent[0]; idx++) {
+    uint32_t error = abs((int32_t)(sent[0][idx].due_us - grid_us(sent[0][0].due_us, period_q8, idx)));
+    max_error = error > max_error ? error : max_error;
+  }
+  HOST_TEST_CHECK(num_sent[0] >= 3151 && num_sent[0] <= 3153);
+  HOST_TEST_CHECK(max_error <= 1);
+  HOST_TEST_CHECK(clock.bpm_x10_now == 985);
+}
+
+static uint32_t random_state = 12345;
+
+static int32_t input_jitter(void)
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return (int32_t)(random_state % (2 * INPUT_JITTER_US + 1)) - INPUT_JITTER_US;
+}
+
+// Send input ticks at a tempo with jitter, running the loop in between;
+// return the arrival times in arrivals
+static uint32_t follow(uint32_t period_us, uint32_t nticks, uint32_t* arrivals)
+{
+  uint32_t start_us = now_us;
+  for (uint32_t idx = 0; idx < nticks; idx++) {
+    uint32_t arrival = start_us + idx * period_us + INPUT_JITTER_US + input_jitter();
+    run(arrival, 0, 0);
+    midi_clock_receive(&clock, 0xF8, arrival);
+    arrivals[idx] = arrival;
+  }
+  run(now_us + period_us, 0, 0);
+  return nticks;
+}
+
+// Return how many ticks it took until every interval after stayed within
+// tolerance_us of period_us, or count if it never did
+static uint32_t lock_ticks(const sent_t* ticks, uint32_t count, uint32_t period_us, uint32_t tolerance_us)
+{
+  uint32_t locked = 1;
+  for (uint32_t idx = 1; idx < count; idx++) {
+    if (abs((int32_t)(ticks[idx].due_us - ticks[idx - 1].due_us - period_us)) > (int32_t)tolerance_us) {
+      locked = idx + 1;
+    }
+  }
+  return locked;
+}
+
+//--------------------------------------------------------------------+
+// The follower locks to a jittered input and sends it on steadily,
+// never before a tick arrived and without losing or adding one; it
+// locks again when the tempo jumps and stops with its input
+//--------------------------------------------------------------------+
+static void test_follower(void)
+{
+  static uint32_t arrivals[1000];
+  set_up();
+  midi_clock_set_mode(&clock, MIDI_CLOCK_FOLLOW, 0);
+  run(now_us + 1000, 0, 0);
+  uint32_t nticks = follow(20833, 480, arrivals);
+  HOST_TEST_CHECK(num_sent[0] == nticks);
+  uint32_t early = 0;
+  for (uint32_t idx = 0; idx < num_sent[0]; idx++) {
+    early += (int32_t)(sent[0][idx].sent_us - arrivals[idx]) < 0;
+  }
+  HOST_TEST_CHECK(early == 0);
+  uint32_t lock = lock_ticks(sent[0], num_sent[0], 20833, INPUT_JITTER_US / 4);
+  uint32_t max_jitter = 0;
+  for (uint32_t idx = lock; idx < num_sent[0]; idx++) {
+    uint32_t jitter = abs((int32_t)(sent[0][idx].due_us - sent[0][idx - 1].due_us - 20833));
+    max_jitter = jitter > max_jitter ? jitter : max_jitter;
+  }
+  printf("follower: input jitter +-%u us, locked after %u ticks, then +-%u us, %u.%u BPM\n", INPUT_JITTER_US, lock,
+    max_jitter, clock.bpm_x10_now / 10, clock.bpm_x10_now % 10);
+  HOST_TEST_CHECK(lock <= 48);
+  HOST_TEST_CHECK(clock.bpm_x10_now >= 1195 && clock.bpm_x10_now <= 1205);
+
+  // A gradual tempo change, from 120 to 140 BPM, the loop follows
+  memset(num_sent, 0, sizeof(num_sent));
+  nticks = follow(17857, 480, arrivals);
+  HOST_TEST_CHECK(num_sent[0] == nticks);
+  early = 0;
+  uint32_t max_late = 0;
+  for (uint32_t idx = 0; idx < num_sent[0]; idx++) {
+    int32_t late = (int32_t)(sent[0][idx].sent_us - arrivals[idx]);
+    early += late < 0;
+    max_late = late > (int32_t)max_late ? (uint32_t)late : max_late;
+  }
+  HOST_TEST_CHECK(early == 0);
+  lock = lock_ticks(sent[0], num_sent[0], 17857, INPUT_JITTER_US / 4);
+  printf("follower: 120 to 140 BPM, locked after %u ticks, up to %u us after the input, %u.%u BPM\n", lock, max_late,
+    clock.bpm_x10_now / 10, clock.bpm_x10_now % 10);
+  HOST_TEST_CHECK(lock <= 240);
+  HOST_TEST_CHECK(max_late <= 2 * MIDI_CLOCK_FOLLOW_DELAY_US + INPUT_JITTER_US * 2 + STEP_US);
+  HOST_TEST_CHECK(clock.bpm_x10_now >= 1395 && clock.bpm_x10_now <= 1405);
+
+  // A jump of more than a tick period, from 140 to 50 BPM, locks again at once
+  memset(num_sent, 0, sizeof(num_sent));
+  nticks = follow(50000, 96, arrivals);
+  HOST_TEST_CHECK(num_sent[0] == nticks);
+  lock = lock_ticks(sent[0], num_sent[0], 50000, INPUT_JITTER_US / 4);
+  printf("follower: 140 to 50 BPM, locked after %u ticks, %u.%u BPM\n", lock, clock.bpm_x10_now / 10,
+    clock.bpm_x10_now % 10);
+  HOST_TEST_CHECK(lock <= 48);
+  HOST_TEST_CHECK(clock.bpm_x10_now >= 495 && clock.bpm_x10_now <= 505);
+
+  // The input stops
+  run(now_us + MIDI_CLOCK_TIMEOUT_US + 1000, 0, 0);
+  HOST_TEST_CHECK(clock.bpm_x10_now == 0);
+  HOST_TEST_CHECK(num_sent[0] == nticks);
+}
+
+int main(void)
+{
+  test_master();
+  test_follower();
+  return HOST_TEST_RESULT();
+}
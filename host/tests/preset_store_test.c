@@ -0,0 +1,283 @@
+/**
+ * @file host/tests/preset_store_test.c
+ * @brief check preset_store on flash kept in a file
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_test.h"
+#include "preset_store.h"
+
+// The preset area of the firmware: the last 64 KB of flash
+#define SECTOR_SIZE 4096
+#define PAGE_SIZE 256
+#define NUM_SECTORS 16
+#define NO_FAILURE UINT32_MAX
+// Each record starts with a 16 byte header
+#define HEADER_BYTES 16
+
+// A NOR flash kept in a file: erasing sets every bit, programming can
+// only clear bits. A power failure can be set to cut a program short.
+typedef struct {
+  FILE* file;
+  uint32_t erases[NUM_SECTORS];
+  uint32_t pages_left; // pages that program before the power fails
+} file_flash_t;
+
+static char path[] = "/tmp/preset_store_test.XXXXXX";
+static file_flash_t file_flash;
+
+static bool flash_read(void* context, uint32_t offset, void* buffer, uint32_t nbytes)
+{
+  file_flash_t* flash = context;
+  return fseek(flash->file, offset, SEEK_SET) == 0 && fread(buffer, 1, nbytes, flash->file) == nbytes;
+}
+
+static bool flash_erase(void* context, uint32_t offset)
+{
+  file_flash_t* flash = context;
+  uint8_t erased[SECTOR_SIZE];
+  HOST_TEST_CHECK(offset % SECTOR_SIZE == 0 && offset < NUM_SECTORS * SECTOR_SIZE);
+  memset(erased, 0xFF, sizeof(erased));
+  flash->erases[offset / SECTOR_SIZE]++;
+  return fseek(flash->file, offset, SEEK_SET) == 0 && fwrite(erased, 1, sizeof(erased), flash->file) == sizeof(erased);
+}
+
+static bool flash_program(void* context, uint32_t offset, const void* data, uint32_t nbytes)
+{
+  file_flash_t* flash = context;
+  HOST_TEST_CHECK(offset % PAGE_SIZE == 0 && nbytes == PAGE_SIZE);
+  uint8_t page[PAGE_SIZE];
+  if (!flash_read(context, offset, page, PAGE_SIZE)) {
+    return false;
+  }
+  // A page cut short by a power failure holds only its first half
+  uint32_t count = PAGE_SIZE;
+  if (flash->pages_left != NO_FAILURE && flash->pages_left-- == 0) {
+    count = PAGE_SIZE / 2;
+  }
+  for (uint32_t idx = 0; idx < count; idx++) {
+    page[idx] &= ((const uint8_t*)data)[idx];
+  }
+  bool ok = fseek(flash->file, offset, SEEK_SET) == 0 && fwrite(page, 1, PAGE_SIZE, flash->file) == PAGE_SIZE;
+  return ok && count == PAGE_SIZE;
+}
+
+static const preset_flash_t flash = {
+  .sector_size = SECTOR_SIZE,
+  .page_size = PAGE_SIZE,
+  .num_sectors = NUM_SECTORS,
+  .read = flash_read,
+  .erase = flash_erase,
+  .program = flash_program,
+  .context = &file_flash,
+};
+
+// Close the file and read the store back from it, as after a power cycle
+static void power_cycle(preset_store_t* store)
+{
+  HOST_TEST_CHECK(fclose(file_flash.file) == 0);
+  file_flash.file = fopen(path, "r+b");
+  HOST_TEST_CHECK(file_flash.file != NULL);
+  file_flash.pages_left = NO_FAILURE;
+  preset_store_init(store, &flash);
+}
+
+static void erase_all(void)
+{
+  for (uint32_t sector = 0; sector < NUM_SECTORS; sector++) {
+    flash_erase(&file_flash, sector * SECTOR_SIZE);
+  }
+  memset(file_flash.erases, 0, sizeof(file_flash.erases));
+}
+
+// Fill data with a pattern that depends on the preset and its version
+static uint32_t make_preset(uint8_t preset, uint32_t version, uint8_t* data)
+{
+  uint32_t nbytes = 1 + (preset * 977u + version * 131u) % 1500;
+  for (uint32_t idx = 0; idx < nbytes; idx++) {
+    data[idx] = (uint8_t)(idx * 7 + preset * 31 + version);
+  }
+  return nbytes;
+}
+
+static bool holds(const preset_store_t* store, uint8_t preset, uint32_t version)
+{
+  uint8_t expected[SECTOR_SIZE];
+  uint8_t loaded[SECTOR_SIZE];
+  uint32_t nbytes = make_preset(preset, version, expected);
+  return preset_store_load(store, preset, loaded, sizeof(loaded)) == nbytes && memcmp(loaded, expected, nbytes) == 0;
+}
+
+static bool save(preset_store_t* store, uint8_t preset, uint32_t version)
+{
+  uint8_t data[SECTOR_SIZE];
+  return preset_store_save(store, preset, data, make_preset(preset, version, data));
+}
+
+//--------------------------------------------------------------------+
+// Presets read back after a power cycle, the newest copy wins
+//--------------------------------------------------------------------+
+static void test_save_load(void)
+{
+  preset_store_t store;
+  erase_all();
+  power_cycle(&store);
+  uint8_t latest;
+  uint32_t length;
+  HOST_TEST_CHECK(!preset_store_latest(&store, &latest));
+  for (uint8_t preset = 0; preset < PRESET_STORE_NUM_PRESETS; preset++) {
+    HOST_TEST_CHECK(!preset_store_get_info(&store, preset, &length));
+    HOST_TEST_CHECK(save(&store, preset, 1));
+  }
+  HOST_TEST_CHECK(save(&store, 3, 2));
+  power_cycle(&store);
+  for (uint8_t preset = 0; preset < PRESET_STORE_NUM_PRESETS; preset++) {
+    HOST_TEST_CHECK(holds(&store, preset, preset == 3 ? 2 : 1));
+  }
+  HOST_TEST_CHECK(preset_store_latest(&store, &latest) && latest == 3);
+  uint8_t data[SECTOR_SIZE];
+  HOST_TEST_CHECK(preset_store_get_info(&store, 3, &length) && length == make_preset(3, 2, data));
+
+  // Out of range and too small a buffer
+  uint32_t max = preset_store_max_length(&store);
+  HOST_TEST_CHECK(max == SECTOR_SIZE - HEADER_BYTES);
+  HOST_TEST_CHECK(preset_store_save(&store, 0, data, max));
+  HOST_TEST_CHECK(!preset_store_save(&store, 0, data, max + 1));
+  HOST_TEST_CHECK(!preset_store_save(&store, PRESET_STORE_NUM_PRESETS, data, 1));
+  HOST_TEST_CHECK(preset_store_load(&store, 1, data, make_preset(1, 1, data) - 1) == 0);
+}
+
+//--------------------------------------------------------------------+
+// A save cut short by a power failure leaves the previous copy, and so
+// does a newest copy that no longer passes its CRC check
+//--------------------------------------------------------------------+
+static void test_power_failure(void)
+{
+  preset_store_t store;
+  erase_all();
+  power_cycle(&store);
+  HOST_TEST_CHECK(save(&store, 5, 1));
+  HOST_TEST_CHECK(save(&store, 6, 1));
+  // The power fails in each page of the record in turn
+  uint8_t data[SECTOR_SIZE];
+  uint32_t num_pages = (HEADER_BYTES + make_preset(5, 2, data) + PAGE_SIZE - 1) / PAGE_SIZE;
+  HOST_TEST_CHECK(num_pages > 1);
+  for (uint32_t pages = 0; pages < num_pages; pages++) {
+    file_flash.pages_left = pages;
+    HOST_TEST_CHECK(!save(&store, 5, 2));
+    HOST_TEST_CHECK(holds(&store, 5, 1));
+    power_cycle(&store);
+    HOST_TEST_CHECK(holds(&store, 5, 1));
+    uint8_t latest;
+    HOST_TEST_CHECK(preset_store_latest(&store, &latest) && latest == 6);
+  }
+
+  HOST_TEST_CHECK(save(&store, 5, 2));
+  uint32_t offset = store.sector[5] * SECTOR_SIZE + 100;
+  uint8_t byte;
+  HOST_TEST_CHECK(flash_read(&file_flash, offset, &byte, 1));
+  byte ^= 0x10;
+  HOST_TEST_CHECK(fseek(file_flash.file, offset, SEEK_SET) == 0 && fwrite(&byte, 1, 1, file_flash.file) == 1);
+  power_cycle(&store);
+  HOST_TEST_CHECK(holds(&store, 5, 1));
+  HOST_TEST_CHECK(holds(&store, 6, 1));
+}
+
+static void erase_spread(uint32_t* min, uint32_t* max, bool skip_unused)
+{
+  *min = UINT32_MAX;
+  *max = 0;
+  for (uint32_t sector = 0; sector < NUM_SECTORS; sector++) {
+    uint32_t erases = file_flash.erases[sector];
+    if (!skip_unused || erases > 1) {
+      *min = erases < *min ? erases : *min;
+      *max = erases > *max ? erases : *max;
+    }
+  }
+}
+
+//--------------------------------------------------------------------+
+// Saves spread their erases over the sectors: one preset saved over and
+// over uses every sector the other presets do not hold, and saving every
+// preset in turn uses all of them
+//--------------------------------------------------------------------+
+static void test_wear_levelling(void)
+{
+  preset_store_t store;
+  uint32_t min;
+  uint32_t max;
+  erase_all();
+  power_cycle(&store);
+  for (uint8_t preset = 1; preset < PRESET_STORE_NUM_PRESETS; preset++) {
+    HOST_TEST_CHECK(save(&store, preset, 1));
+  }
+  for (uint32_t version = 1; version <= 900; version++) {
+    HOST_TEST_CHECK(save(&store, 0, version));
+    // Every so often the power goes off
+    if (version % 97 == 0) {
+      power_cycle(&store);
+    }
+  }
+  // 9 sectors share the 900 saves of preset 0
+  erase_spread(&min, &max, true);
+  HOST_TEST_CHECK(min >= 99 && max <= 102);
+  for (uint8_t preset = 1; preset < PRESET_STORE_NUM_PRESETS; preset++) {
+    HOST_TEST_CHECK(holds(&store, preset, 1));
+  }
+  HOST_TEST_CHECK(holds(&store, 0, 900));
+
+  erase_all();
+  power_cycle(&store);
+  for (uint32_t version = 1; version <= 200; version++) {
+    for (uint8_t preset = 0; preset < PRESET_STORE_NUM_PRESETS; preset++) {
+      HOST_TEST_CHECK(save(&store, preset, version));
+    }
+  }
+  erase_spread(&min, &max, false);
+  HOST_TEST_CHECK(min >= 99 && max <= 101);
+  power_cycle(&store);
+  for (uint8_t preset = 0; preset < PRESET_STORE_NUM_PRESETS; preset++) {
+    HOST_TEST_CHECK(holds(&store, preset, 200));
+  }
+}
+
+int main(void)
+{
+  int fd = mkstemp(path);
+  HOST_TEST_CHECK(fd >= 0);
+  file_flash.file = fdopen(fd, "r+b");
+  if (file_flash.file == NULL) {
+    return 1;
+  }
+  test_save_load();
+  test_power_failure();
+  test_wear_levelling();
+  fclose(file_flash.file);
+  unlink(path);
+  return HOST_TEST_RESULT();
+}
@@ -0,0 +1,251 @@
+/**
+ * @file host/tests/transform_test.c
+ * @brief check route transforms against hand-worked output
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "host_test.h"
+#include "midi_merger.h"
+#include "midi_router.h"
+
+#define NUM_PORTS 16
+#define QUEUE_LEN 32
+#define MAX_OUT 32
+
+static midi_router_t router;
+static midi_merger_t mergers[NUM_PORTS];
+static midi_merger_entry_t queues[NUM_PORTS][QUEUE_LEN];
+static uint8_t written[NUM_PORTS][MAX_OUT][4];
+static uint32_t num_written[NUM_PORTS];
+
+static uint32_t record_write(void* handle, const uint8_t* buffer, uint32_t nbytes)
+{
+  uint8_t port = (uint8_t)(uintptr_t)handle;
+  if (nbytes == 4 && num_written[port] < MAX_OUT) {
+    memcpy(written[port][num_written[port]++], buffer, 4);
+  }
+  return nbytes;
+}
+
+static uint32_t now_us(void)
+{
+  return 0;
+}
+
+// Every kind of message on input 0: clock, channel voice messages on
+// channels 1 and 16 and SysEx
+static const uint8_t input[] = {
+  0xF8,                   // clock, which outputs would send ahead of queued messages
+  0x90, 0x3C, 0x64,       // note on, velocity 100
+  0x90, 0x78, 0x01,       // note on near the top, velocity 1
+  0x80, 0x3C, 0x40,       // note off
+  0x90, 0x3C, 0x00,       // note on velocity 0, a note off
+  0xA0, 0x3C, 0x50,       // poly pressure
+  0xB0, 0x07, 0x00,       // control change at the bottom
+  0xB0, 0x07, 0x7F,       // and top of the range
+  0xB0, 0x40, 0x40,
+  0xC0, 0x05,             // program change
+  0xD0, 0x40,             // channel pressure
+  0xE0, 0x00, 0x40,       // pitch bend
+  0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7,
+  0x9F, 0x05, 0x7F,       // note on near the bottom, channel 16
+};
+
+#define NUM_PACKETS 15
+
+// The same messages as packets from cable 0; transforms leave everything
+// but the channel voice messages alone
+static const uint8_t unchanged[NUM_PACKETS][4] = {
+  {0x0F, 0xF8, 0x00, 0x00}, {0x09, 0x90, 0x3C, 0x64}, {0x09, 0x90, 0x78, 0x01}, {0x08, 0x80, 0x3C, 0x40},
+  {0x09, 0x90, 0x3C, 0x00}, {0x0A, 0xA0, 0x3C, 0x50}, {0x0B, 0xB0, 0x07, 0x00}, {0x0B, 0xB0, 0x07, 0x7F},
+  {0x0B, 0xB0, 0x40, 0x40}, {0x0C, 0xC0, 0x05, 0x00}, {0x0D, 0xD0, 0x40, 0x00}, {0x0E, 0xE0, 0x00, 0x40},
+  {0x04, 0xF0, 0x7E, 0x7F}, {0x07, 0x06, 0x01, 0xF7}, {0x09, 0x9F, 0x05, 0x7F},
+};
+
+static const uint8_t to_channel_10[NUM_PACKETS][4] = {
+  {0x0F, 0xF8, 0x00, 0x00}, {0x09, 0x99, 0x3C, 0x64}, {0x09, 0x99, 0x78, 0x01}, {0x08, 0x89, 0x3C, 0x40},
+  {0x09, 0x99, 0x3C, 0x00}, {0x0A, 0xA9, 0x3C, 0x50}, {0x0B, 0xB9, 0x07, 0x00}, {0x0B, 0xB9, 0x07, 0x7F},
+  {0x0B, 0xB9, 0x40, 0x40}, {0x0C, 0xC9, 0x05, 0x00}, {0x0D, 0xD9, 0x40, 0x00}, {0x0E, 0xE9, 0x00, 0x40},
+  {0x04, 0xF0, 0x7E, 0x7F}, {0x07, 0x06, 0x01, 0xF7}, {0x09, 0x99, 0x05, 0x7F},
+};
+
+// Note 120 + 12 clamps to 127
+static const uint8_t up_octave[NUM_PACKETS][4] = {
+  {0x0F, 0xF8, 0x00, 0x00}, {0x09, 0x90, 0x48, 0x64}, {0x09, 0x90, 0x7F, 0x01}, {0x08, 0x80, 0x48, 0x40},
+  {0x09, 0x90, 0x48, 0x00}, {0x0A, 0xA0, 0x48, 0x50}, {0x0B, 0xB0, 0x07, 0x00}, {0x0B, 0xB0, 0x07, 0x7F},
+  {0x0B, 0xB0, 0x40, 0x40}, {0x0C, 0xC0, 0x05, 0x00}, {0x0D, 0xD0, 0x40, 0x00}, {0x0E, 0xE0, 0x00, 0x40},
+  {0x04, 0xF0, 0x7E, 0x7F}, {0x07, 0x06, 0x01, 0xF7}, {0x09, 0x9F, 0x11, 0x7F},
+};
+
+// Note 5 - 12 clamps to 0
+static const uint8_t down_octave[NUM_PACKETS][4] = {
+  {0x0F, 0xF8, 0x00, 0x00}, {0x09, 0x90, 0x30, 0x64}, {0x09, 0x90, 0x6C, 0x01}, {0x08, 0x80, 0x30, 0x40},
+  {0x09, 0x90, 0x30, 0x00}, {0x0A, 0xA0, 0x30, 0x50}, {0x0B, 0xB0, 0x07, 0x00}, {0x0B, 0xB0, 0x07, 0x7F},
+  {0x0B, 0xB0, 0x40, 0x40}, {0x0C, 0xC0, 0x05, 0x00}, {0x0D, 0xD0, 0x40, 0x00}, {0x0E, 0xE0, 0x00, 0x40},
+  {0x04, 0xF0, 0x7E, 0x7F}, {0x07, 0x06, 0x01, 0xF7}, {0x09, 0x9F, 0x00, 0x7F},
+};
+
+// Velocities round to nearest; velocity 1 stays 1 and 0 stays 0
+static const uint8_t half_velocity[NUM_PACKETS][4] = {
+  {0x0F, 0xF8, 0x00, 0x00}, {0x09, 0x90, 0x3C, 0x32}, {0x09, 0x90, 0x78, 0x01}, {0x08, 0x80, 0x3C, 0x20},
+  {0x09, 0x90, 0x3C, 0x00}, {0x0A, 0xA0, 0x3C, 0x50}, {0x0B, 0xB0, 0x07, 0x00}, {0x0B, 0xB0, 0x07, 0x7F},
+  {0x0B, 0xB0, 0x40, 0x40}, {0x0C, 0xC0, 0x05, 0x00}, {0x0D, 0xD0, 0x40, 0x00}, {0x0E, 0xE0, 0x00, 0x40},
+  {0x04, 0xF0, 0x7E, 0x7F}, {0x07, 0x06, 0x01, 0xF7}, {0x09, 0x9F, 0x05, 0x40},
+};
+
+// Scaling by 0% must not turn note ons into note offs
+static const uint8_t zero_velocity[NUM_PACKETS][4] = {
+  {0x0F, 0xF8, 0x00, 0x00}, {0x09, 0x90, 0x3C, 0x01}, {0x09, 0x90, 0x78, 0x01}, {0x08, 0x80, 0x3C, 0x01},
+  {0x09, 0x90, 0x3C, 0x00}, {0x0A, 0xA0, 0x3C, 0x50}, {0x0B, 0xB0, 0x07, 0x00}, {0x0B, 0xB0, 0x07, 0x7F},
+  {0x0B, 0xB0, 0x40, 0x40}, {0x0C, 0xC0, 0x05, 0x00}, {0x0D, 0xD0, 0x40, 0x00}, {0x0E, 0xE0, 0x00, 0x40},
+  {0x04, 0xF0, 0x7E, 0x7F}, {0x07, 0x06, 0x01, 0xF7}, {0x09, 0x9F, 0x05, 0x01},
+};
+
+// Control change values clamp to 20-100; other data bytes do not
+static const uint8_t cc_clamped[NUM_PACKETS][4] = {
+  {0x0F, 0xF8, 0x00, 0x00}, {0x09, 0x90, 0x3C, 0x64}, {0x09, 0x90, 0x78, 0x01}, {0x08, 0x80, 0x3C, 0x40},
+  {0x09, 0x90, 0x3C, 0x00}, {0x0A, 0xA0, 0x3C, 0x50}, {0x0B, 0xB0, 0x07, 0x14}, {0x0B, 0xB0, 0x07, 0x64},
+  {0x0B, 0xB0, 0x40, 0x40}, {0x0C, 0xC0, 0x05, 0x00}, {0x0D, 0xD0, 0x40, 0x00}, {0x0E, 0xE0, 0x00, 0x40},
+  {0x04, 0xF0, 0x7E, 0x7F}, {0x07, 0x06, 0x01, 0xF7}, {0x09, 0x9F, 0x05, 0x7F},
+};
+
+// Channel 2, up a semitone, double velocity clamped to 127, CC 0-64
+static const uint8_t combined[NUM_PACKETS][4] = {
+  {0x0F, 0xF8, 0x00, 0x00}, {0x09, 0x91, 0x3D, 0x7F}, {0x09, 0x91, 0x79, 0x02}, {0x08, 0x81, 0x3D, 0x7F},
+  {0x09, 0x91, 0x3D, 0x00}, {0x0A, 0xA1, 0x3D, 0x50}, {0x0B, 0xB1, 0x07, 0x00}, {0x0B, 0xB1, 0x07, 0x40},
+  {0x0B, 0xB1, 0x40, 0x40}, {0x0C, 0xC1, 0x05, 0x00}, {0x0D, 0xD1, 0x40, 0x00}, {0x0E, 0xE1, 0x00, 0x40},
+  {0x04, 0xF0, 0x7E, 0x7F}, {0x07, 0x06, 0x01, 0xF7}, {0x09, 0x91, 0x06, 0x7F},
+};
+
+static const struct {
+  const char* name;
+  midi_router_transform_t transform; // channel, transpose, velocity, cc_min, cc_max
+  const uint8_t (*expected)[4];
+} cases[] = {
+  {"none", {0, 0, 100, 0, 127}, unchanged},
+  {"channel 10", {10, 0, 100, 0, 127}, to_channel_10},
+  {"transpose +12", {0, 12, 100, 0, 127}, up_octave},
+  {"transpose -12", {0, -12, 100, 0, 127}, down_octave},
+  {"velocity 50%", {0, 0, 50, 0, 127}, half_velocity},
+  {"velocity 0%", {0, 0, 0, 0, 127}, zero_velocity},
+  {"cc 20-100", {0, 0, 100, 20, 100}, cc_clamped},
+  {"combined", {2, 1, 200, 0, 64}, combined},
+};
+
+#define NUM_CASES (sizeof(cases) / sizeof(cases[0]))
+
+static void set_up(void)
+{
+  midi_router_init(&router, NUM_PORTS, now_us);
+  for (uint8_t port = 0; port < NUM_PORTS; port++) {
+    midi_merger_init(mergers + port, record_write, (void*)(uintptr_t)port, queues[port], QUEUE_LEN);
+    midi_merger_set_packet_output(mergers + port, true);
+    midi_router_set_output(&router, port, mergers + port, false);
+  }
+  memset(num_written, 0, sizeof(num_written));
+}
+
+static void route_input(void)
+{
+  midi_router_pass_t pass;
+  midi_router_begin(&router, &pass, (1u << NUM_PORTS) - 1);
+  midi_router_parse(&pass, 0, input, sizeof(input));
+  for (uint8_t port = 0; port < NUM_PORTS; port++) {
+    midi_merger_flush(mergers + port);
+  }
+  midi_router_end(&pass);
+}
+
+static void check_output(uint8_t out, const char* name, const uint8_t (*expected)[4])
+{
+  bool same = num_written[out] == NUM_PACKETS;
+  for (uint32_t idx = 0; same && idx < NUM_PACKETS; idx++) {
+    same = memcmp(written[out][idx], expected[idx], 4) == 0;
+  }
+  if (!same) {
+    fprintf(stderr, "%s: output %u got", name, out);
+    for (uint32_t idx = 0; idx < num_written[out]; idx++) {
+      fprintf(stderr, " %02X%02X%02X%02X", written[out][idx][0], written[out][idx][1], written[out][idx][2],
+        written[out][idx][3]);
+    }
+    fputc('\n', stderr);
+  }
+  HOST_TEST_CHECK(same);
+}
+
+//--------------------------------------------------------------------+
+// Each transform on its own route from input 0, all in one pass
+//--------------------------------------------------------------------+
+static void test_golden_output(void)
+{
+  set_up();
+  for (uint8_t idx = 0; idx < NUM_CASES; idx++) {
+    midi_router_connect(&router, 0, idx + 1);
+    HOST_TEST_CHECK(midi_router_set_transform(&router, 0, idx + 1, &cases[idx].transform));
+  }
+  midi_router_publish(&router);
+  route_input();
+  for (uint8_t idx = 0; idx < NUM_CASES; idx++) {
+    check_output(idx + 1, cases[idx].name, cases[idx].expected);
+  }
+  HOST_TEST_CHECK(num_written[0] == 0);
+  HOST_TEST_CHECK(num_written[NUM_CASES + 1] == 0);
+}
+
+//--------------------------------------------------------------------+
+// Routes share the tables of equal transforms, and a transform that
+// would need a table past the last is refused without changing anything
+//--------------------------------------------------------------------+
+static void test_transform_limit(void)
+{
+  set_up();
+  uint8_t out = 1;
+  for (uint8_t idx = 1; idx < NUM_CASES; idx++, out++) {
+    midi_router_connect(&router, 0, out);
+    HOST_TEST_CHECK(midi_router_set_transform(&router, 0, out, &cases[idx].transform));
+  }
+  // The same transform on another route needs no table of its own
+  midi_router_connect(&router, 0, out);
+  HOST_TEST_CHECK(midi_router_set_transform(&router, 0, out++, &cases[1].transform));
+  const midi_router_transform_t last = {0, 1, 100, 0, 127};
+  midi_router_connect(&router, 0, out);
+  HOST_TEST_CHECK(midi_router_set_transform(&router, 0, out++, &last));
+  const midi_router_transform_t extra = {0, 2, 100, 0, 127};
+  midi_router_connect(&router, 0, out);
+  HOST_TEST_CHECK(!midi_router_set_transform(&router, 0, out, &extra));
+  HOST_TEST_CHECK(midi_router_transform_is_none(midi_router_get_transform(&router, 0, out)));
+  midi_router_publish(&router);
+  route_input();
+  check_output(NUM_CASES, "shared channel 10", to_channel_10);
+  check_output(out, "refused", unchanged);
+}
+
+int main(void)
+{
+  test_golden_output();
+  test_transform_limit();
+  return HOST_TEST_RESULT();
+}
@@ -0,0 +1,59 @@
+/**
+ * @file host_clock.c
+ * @brief map times sent by the USB host to the local clock
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "host_clock.h"
+
+void host_clock_reset(host_clock_t* clock)
+{
+  clock->valid = false;
+  clock->offset_us = 0;
+  clock->set_host_us = 0;
+}
+
+uint32_t host_clock_to_local(host_clock_t* clock, uint32_t host_us, uint32_t arrival_us)
+{
+  uint32_t offset = arrival_us - host_us;
+  int32_t elapsed = (int32_t)(host_us - clock->set_host_us);
+  if (clock->valid && elapsed >= 0) {
+    uint32_t relaxed = clock->offset_us + ((uint32_t)elapsed >> HOST_CLOCK_RELAX_SHIFT);
+    int32_t diff = (int32_t)(offset - relaxed);
+    if (diff < HOST_CLOCK_RESYNC_US && diff > -HOST_CLOCK_RESYNC_US) {
+      if (diff < 0) {
+        // Keep the offset of the fastest transfer
+        clock->offset_us = offset;
+        clock->set_host_us = host_us;
+        relaxed = offset;
+      }
+      return host_us + relaxed;
+    }
+  }
+  clock->valid = true;
+  clock->offset_us = offset;
+  clock->set_host_us = host_us;
+  return arrival_us;
+}
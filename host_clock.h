@@ -0,0 +1,76 @@
+/**
+ * @file host_clock.h
+ * @brief map times sent by the USB host to the local clock
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef HOST_CLOCK_H
+#define HOST_CLOCK_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// The offset may grow by elapsed host time >> HOST_CLOCK_RELAX_SHIFT,
+// so a host clock up to 244 ppm fast is followed
+#define HOST_CLOCK_RELAX_SHIFT 12
+// A time this far off the current offset means the host clock jumped
+#define HOST_CLOCK_RESYNC_US 100000
+
+/**
+ * @brief Maps the times in microseconds a host puts on its MIDI data to
+ * the local clock. The offset between the clocks is the smallest seen
+ * between a host time and when it arrived, the time of the fastest
+ * transfer, so data that waited for USB keeps its place in time. The
+ * offset slowly gives way in the other direction, so the two clocks
+ * may drift apart.
+ */
+typedef struct {
+  bool valid;
+  uint32_t offset_us;    // local time minus host time
+  uint32_t set_host_us;  // the host time the offset was set at
+} host_clock_t;
+
+/**
+ * @brief forget the offset, e.g., when USB is disconnected
+ */
+void host_clock_reset(host_clock_t* clock);
+
+/**
+ * @brief return the local time of a host time
+ *
+ * @param clock the clock map
+ * @param host_us the time the host put on the data
+ * @param arrival_us the local time the data arrived
+ */
+uint32_t host_clock_to_local(host_clock_t* clock, uint32_t host_us, uint32_t arrival_us);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
@@ -25,6 +25,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -32,9 +33,31 @@
 #include "tusb.h"
 #include "pio_midi_uart_lib.h"
 #include "midi_uart_lib.h"
+#include "midi_uart_lib_config.h"
 #include "midi_device_multistream.h"
 #include "cdc_stdio_lib.h"
 #include "embedded_cli.h"
+#include "midi_parser.h"
+#include "midi_merger.h"
+#include "midi_router.h"
+#include "preset_store.h"
+#include "route_preset.h"
+#include "midi_control.h"
+#include "cli_output.h"
+#include "midi_monitor.h"
+#include "spsc_ring.h"
+#include "usb_aggregator.h"
+#include "host_clock.h"
+#include "midi_clock.h"
+#include "hardware/flash.h"
+#include "hardware/uart.h"
+#include "pico/flash.h"
+#ifndef MIDI_ROUTING_ON_CORE1
+#define MIDI_ROUTING_ON_CORE1 0
+#endif
+#if MIDI_ROUTING_ON_CORE1
+#include "pico/multicore.h"
+#endif
 //--------------------------------------------------------------------+
 // This program routes 5-pin DIN MIDI IN signals A & B to USB MIDI
 // virtual cables 0 & 1 on the USB MIDI Bulk IN endpoint. It also
@@ -68,11 +91,63 @@ enum  {
 
 static uint32_t blink_interval_ms = BLINK_NOT_MOUNTED;
 
+// Work for the main loop. Callbacks set these bits; the main loop only
+// services the sources whose bits are set and sleeps when there is
+// nothing to do.
+#define EVENT_USB_MIDI_RX (1u << 0)
+#define EVENT_CDC_RX (1u << 1)
+static volatile uint32_t pending_events = EVENT_USB_MIDI_RX | EVENT_CDC_RX;
+static volatile bool usb_suspended = false;
+// The serial MIDI receive interrupts belong to the UART libraries, so any
+// wake-up may mean serial data has arrived. The serial ports are polled
+// after every wake-up and on every pass while data keeps arriving.
+static bool serial_rx_active = true;
+#if !MIDI_ROUTING_ON_CORE1
+// True if USB data was left unread because an output that blocks its
+// sources was full; it is read again after the next wake-up
+static bool usb_rx_blocked = false;
+#endif
+// A serial port that was written recently may still be moving bytes from
+// its TX ring to the wire, so the loop must not sleep for long.
+#define SERIAL_BYTE_TIME_US (10 * 1000000 / MIDI_UART_LIB_BAUD_RATE)
+#define SERIAL_TX_DRAIN_US (128 * SERIAL_BYTE_TIME_US)
+static volatile uint32_t last_serial_tx_us;
+// The byte time of the fastest serial port
+static volatile uint32_t serial_min_byte_us = SERIAL_BYTE_TIME_US;
+// The most bytes a serial MIDI OUT at the standard rate may have waiting
+// in its UART TX ring. A faster port may be as far ahead in time, up to
+// SERIAL_TX_MAX_LEAD_BYTES.
+#define SERIAL_TX_LEAD_BYTES 4
+#define SERIAL_TX_MAX_LEAD_BYTES 32
+// The wire rates a serial port may use. A HW UART sets its baud rate
+// divider; a PIO port sets the clock divider of its state machines.
+#define SERIAL_MIN_BAUD 9600
+#define SERIAL_MAX_BAUD 1000000
+typedef struct {
+  void* uart;
+  uint32_t wire_idle_us; // when the bytes written so far will have left the wire
+  volatile uint32_t wanted_baud; // the rate asked for; the routing loop sets it
+  volatile uint32_t set_baud;    // the wanted_baud the port was last set to
+  uint32_t baud;         // the rate the port runs at
+  uint32_t byte_us;      // wire time of one byte
+  uint8_t lead_bytes;    // the most bytes it may have waiting in its UART TX ring
+} serial_out_t;
+
 static void led_blinking_task(void);
+static void wait_for_work(void);
 static void midi_task(void);
 static void cli_task(void);
+static void cli_output_task(void);
 static void cli_init(void);
 static void printWelcome(void);
+static void init_parsers_and_mergers(void);
+static void init_control(void);
+static void control_task(void);
+static bool set_serial_baud(uint8_t port, uint32_t baud);
+#if MIDI_ROUTING_ON_CORE1
+static void core1_main(void);
+#endif
+bool is_connected(uint8_t in, uint8_t out);
 
 static void* pio_midi_uarts[NUM_PIO_MIDI_UARTS]; // MIDI IN A-F and MIDI OUT A-F
 static void* hw_midi_uarts[NUM_HW_MIDI_UARTS];
@@ -102,39 +177,338 @@ static const uint MIDI_IN_H_GPIO = 1;
 static const uint HW_MIDI_UART_H = 0; // hardware UART Number 0 or 1
 #endif
 #define MAX_PORT_NAME 12
+// Ports are numbered USB cables first, then PIO UARTs, then HW UARTs.
+// The port number of an input is also its parser cable number. The last
+// USB cable is for the control protocol, not MIDI data.
+#define NUM_USB_MIDI_PORTS (CFG_TUD_MIDI_NUMCABLES_OUT - 1)
+#define CONTROL_CABLE NUM_USB_MIDI_PORTS
+#define NUM_SERIAL_MIDI_PORTS (NUM_PIO_MIDI_UARTS + NUM_HW_MIDI_UARTS)
+#define NUM_MIDI_PORTS (NUM_USB_MIDI_PORTS + NUM_SERIAL_MIDI_PORTS)
+#define PIO_MIDI_UART_PORT(idx) (NUM_USB_MIDI_PORTS + (idx))
+#define HW_MIDI_UART_PORT(idx) (NUM_USB_MIDI_PORTS + NUM_PIO_MIDI_UARTS + (idx))
+#if NUM_MIDI_PORTS > MIDI_ROUTER_MAX_PORTS
+#error "the route matrix supports at most 16 ports"
+#endif
+// The router owns the route matrix, a parser for every input so only
+// complete messages are routed, and the counters and latency statistics.
+// For serial outputs, data is accepted when it enters the UART TX ring.
+// In dual-core builds both cores update the counters without locking, so
+// a rare lost count is possible.
+static midi_router_t router;
+// Every output has a merger so streams routed to it interleave only
+// at message boundaries
+static midi_merger_t mergers[NUM_MIDI_PORTS];
+static serial_out_t serial_outs[NUM_SERIAL_MIDI_PORTS]; // indexed by port - NUM_USB_MIDI_PORTS
+// The merger queues come from one static pool. A serial output is much
+// slower than USB, so it gets a deeper queue.
+#define USB_MERGER_QUEUE_LEN 32
+// USB MIDI data is read in batches of up to one endpoint buffer: 64 bytes
+// at full speed, 512 at high speed
+#define USB_RX_BATCH_PACKETS (CFG_TUD_MIDI_RX_BUFSIZE / 4)
+// Packets for the USB MIDI IN endpoint wait until they fill one endpoint
+// buffer or until the oldest has waited this long, so at high input
+// rates a transfer carries many packets instead of one. 0 sends every
+// packet at once.
+#ifndef USB_TX_FLUSH_DEADLINE_US
+#define USB_TX_FLUSH_DEADLINE_US 250
+#endif
+#define USB_TX_AGGREGATE_PACKETS (CFG_TUD_MIDI_TX_BUFSIZE / 4)
+static uint8_t usb_tx_storage[USB_TX_AGGREGATE_PACKETS * 4];
+static usb_aggregator_t usb_tx;
+#define SERIAL_MERGER_QUEUE_LEN 128
+static midi_merger_entry_t merger_queue_pool[NUM_USB_MIDI_PORTS * USB_MERGER_QUEUE_LEN +
+  NUM_SERIAL_MIDI_PORTS * SERIAL_MERGER_QUEUE_LEN];
+// A serial output with a delay holds its packets in a timer wheel until
+// they are due. When the wheel is full, the first packets go out early.
+#define SERIAL_WHEEL_LEN 64
+static timer_wheel_entry_t wheel_pool[NUM_SERIAL_MIDI_PORTS][SERIAL_WHEEL_LEN];
+static timer_wheel_t wheels[NUM_SERIAL_MIDI_PORTS];
+// The time messages on the control cable give the USB data that follows
+// them a target time; the data of a burst without one goes at once
+static host_clock_t host_clock;
+static bool host_timed = false;
+static uint32_t host_target;
+// The clock master or follower runs on the routing loop and sends its
+// ticks to the output mergers ahead of the queued data
+static midi_clock_t midi_clock;
+#if MIDI_ROUTING_ON_CORE1
+// Core 1 polls the MIDI UARTs, routes all MIDI data and owns the serial
+// port mergers. Core 0 runs TinyUSB and the CLI and owns the USB parsers
+// and mergers. Parsed USB packets travel to core 1 and packets routed
+// to USB travel back to core 0 through lock-free rings.
 typedef struct {
-  uint8_t pio_uart_number_list[NUM_PIO_MIDI_UARTS];
-  uint8_t hw_uart_number_list[NUM_HW_MIDI_UARTS];
-  uint8_t usb_midi_cable_list[CFG_TUD_MIDI_NUMCABLES_OUT];
-  uint8_t num_pio_uart_routes;
-  uint8_t num_hw_uart_routes;
-  uint8_t num_usb_midi_routes;
-} midi_input_routes_t;
-static midi_input_routes_t usb_routes[CFG_TUD_MIDI_NUMCABLES_IN];
-static midi_input_routes_t pio_routes[NUM_PIO_MIDI_UARTS];
-static midi_input_routes_t hw_routes[NUM_HW_MIDI_UARTS];
+  uint8_t packet[4];
+  uint8_t port; // the destination USB cable for packets routed to core 0
+  uint32_t timestamp;
+  uint32_t target; // when packets routed to core 1 are meant to go out
+} routed_packet_t;
+#define ROUTED_PACKET_RING_LEN 256
+static routed_packet_t to_router_storage[ROUTED_PACKET_RING_LEN];
+static routed_packet_t from_router_storage[ROUTED_PACKET_RING_LEN];
+static spsc_ring_t to_router;
+static spsc_ring_t from_router;
+static volatile bool usb_midi_connected = false;
+#endif
 static volatile bool cdc_state_has_changed = false;
 static volatile bool cli_up_message_pending = false;
 static absolute_time_t previous_timestamp;
 static EmbeddedCli* cli;
+// CLI output collects here and the main loop sends it to the CDC port a
+// FIFO full at a time between MIDI passes, so printing never makes MIDI
+// wait for the host to read
+#define CLI_OUTPUT_SIZE 4096
+// How long printing waits for room in a full ring before it drops the
+// text, e.g., when a terminal stops reading without closing the port
+#define CLI_OUTPUT_STALL_MS 100
+// The longest text one cli_printf() call prints
+#define CLI_PRINTF_MAX 256
+static char cli_output_storage[CLI_OUTPUT_SIZE];
+static cli_output_t cli_output;
+// True while a CLI command runs; preset switches wait until it is done
+static bool cli_command_running = false;
+// The show command renders one line of its table per pass of the main
+// loop. show_line is the next line to render or -1 when it is done.
+static int show_line = -1;
+static bool show_compact;
+// What the CLI library writes while show renders, i.e., the prompt, is
+// held until the table is done
+#define CLI_HELD_SIZE 16
+static char cli_held[CLI_HELD_SIZE];
+static uint8_t cli_held_len = 0;
+// The routing loop copies the packets from the monitored inputs to the
+// capture ring; the CLI turns them into text. monitor_inputs is 0 when
+// the monitor is off.
+#define CAPTURE_RING_LEN 256
+// The most captured packets the CLI describes in one pass
+#define MONITOR_LINES_PER_PASS 4
+static midi_router_capture_t capture_storage[CAPTURE_RING_LEN];
+static spsc_ring_t capture_ring;
+static uint16_t monitor_inputs = 0;
+static uint32_t monitor_start_us;
+static uint32_t monitor_dropped; // midi_router_capture_dropped() already reported
+
+// Presets live in the last sectors of the flash, far past the program.
+// Each save uses the next free sector, so 16 sectors spread the wear of
+// up to 8 presets.
+#define PRESET_FLASH_SECTORS 16
+#define PRESET_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - PRESET_FLASH_SECTORS * FLASH_SECTOR_SIZE)
+static preset_store_t presets;
+static uint8_t preset_buffer[FLASH_SECTOR_SIZE]; // one preset while it is saved or loaded
+// The settings of the preset restored at power up; the mergers that use
+// the output policies are created later
+static route_preset_settings_t boot_settings;
+// The SysEx control protocol on CONTROL_CABLE
+static midi_control_t control;
+// The preset a Program Change on the trigger input asked for, or -1. The
+// routing loop sets it and the main loop on core 0 loads the preset.
+static volatile int8_t requested_preset = -1;
+
+#if MIDI_ROUTING_ON_CORE1
+static void compile_routes(void)
+{
+  // Wait until the routing loop has stopped using the previous table
+  while (!midi_router_publish(&router)) {
+    __sev(); // core 1 may be waiting for an event
+    tight_loop_contents();
+  }
+}
+#else
+// The routing loop runs on this core and cannot make progress while
+// anything here waits for it, so a change only marks the routes changed.
+// The next midi_task() publishes them before its pass, when the previous
+// table is always free.
+static bool routes_changed = false;
+
+static void compile_routes(void)
+{
+  routes_changed = true;
+}
+
+static void publish_routes(void)
+{
+  if (routes_changed && midi_router_publish(&router)) {
+    routes_changed = false;
+  }
+}
+#endif
+
+static uint32_t now_us(void)
+{
+  return time_us_32();
+}
+
+static void program_change(void* context, uint8_t program);
+
+// The clock's bytes go out as packets from the input it follows or, from
+// a master, from the input of the output's own port, and count in the
+// statistics of that route
+static void send_clock(void* context, uint8_t out, uint8_t byte, uint32_t time_us)
+{
+  (void)context;
+  uint8_t in = midi_clock.mode == MIDI_CLOCK_FOLLOW ? midi_clock.input : out;
+  uint8_t packet[4] = {(uint8_t)((in << 4) | MIDI_CIN_REALTIME), byte, 0, 0};
+  (void)midi_router_inject(&router, out, packet, time_us); // the router counts a drop
+}
+
+static void clock_sync(void* context, uint8_t byte, uint32_t timestamp)
+{
+  (void)context;
+  midi_clock_receive(&midi_clock, byte, timestamp);
+}
+
 void init_routes()
 {
-  memset(usb_routes, 0, sizeof(usb_routes));
-  memset(pio_routes, 0, sizeof(pio_routes));
-  memset(hw_routes, 0, sizeof(hw_routes));
+  midi_router_init(&router, NUM_MIDI_PORTS, now_us);
+  midi_router_set_program_cb(&router, program_change, NULL);
+  midi_clock_init(&midi_clock, NUM_MIDI_PORTS, send_clock, NULL);
+  midi_router_set_sync_cb(&router, clock_sync, NULL);
+  spsc_ring_init(&capture_ring, capture_storage, sizeof(midi_router_capture_t), CAPTURE_RING_LEN);
+  midi_router_set_capture_ring(&router, &capture_ring);
+  for (size_t idx=0; idx < NUM_SERIAL_MIDI_PORTS; idx++) {
+    midi_router_connect(&router, idx, idx + NUM_USB_MIDI_PORTS);
+    midi_router_connect(&router, idx + NUM_USB_MIDI_PORTS, idx);
+  }
+}
+
+static bool preset_flash_read(void* context, uint32_t offset, void* buffer, uint32_t nbytes)
+{
+  (void)context;
+  memcpy(buffer, (const void*)(uintptr_t)(XIP_BASE + PRESET_FLASH_OFFSET + offset), nbytes);
+  return true;
+}
+
+typedef struct {
+  uint32_t offset;
+  const void* data;
+  uint32_t nbytes;
+} flash_op_t;
+
+static void erase_preset_sector(void* param)
+{
+  const flash_op_t* op = param;
+  flash_range_erase(PRESET_FLASH_OFFSET + op->offset, FLASH_SECTOR_SIZE);
+}
+
+static void program_preset_pages(void* param)
+{
+  const flash_op_t* op = param;
+  flash_range_program(PRESET_FLASH_OFFSET + op->offset, op->data, op->nbytes);
+}
+
+// No code may run from flash while it is erased or programmed, so
+// flash_safe_execute() pauses the other core and disables interrupts
+// until the flash is done. MIDI stops for up to about 50 ms.
+static bool preset_flash_erase(void* context, uint32_t offset)
+{
+  (void)context;
+  flash_op_t op = {offset, NULL, 0};
+  return flash_safe_execute(erase_preset_sector, &op, 100) == PICO_OK;
+}
+
+static bool preset_flash_program(void* context, uint32_t offset, const void* data, uint32_t nbytes)
+{
+  (void)context;
+  flash_op_t op = {offset, data, nbytes};
+  return flash_safe_execute(program_preset_pages, &op, 100) == PICO_OK;
+}
+
+static const preset_flash_t preset_flash = {
+  .sector_size = FLASH_SECTOR_SIZE,
+  .page_size = FLASH_PAGE_SIZE,
+  .num_sectors = PRESET_FLASH_SECTORS,
+  .read = preset_flash_read,
+  .erase = preset_flash_erase,
+  .program = preset_flash_program,
+  .context = NULL,
+};
+
+// Replace the routes with the ones in a preset; set settings to its other settings
+static bool read_preset(uint8_t preset, route_preset_settings_t* settings)
+{
+  uint32_t nbytes = preset_store_load(&presets, preset, preset_buffer, sizeof(preset_buffer));
+  return nbytes != 0 && route_preset_decode(&router, settings, preset_buffer, nbytes);
+}
+
+// Restore the preset saved last. Only the flash is read, so this runs
+// before USB starts and the host never sees the default routes.
+static void restore_preset(void)
+{
+  preset_store_init(&presets, &preset_flash);
+  for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+    boot_settings.policies[port] = MIDI_MERGER_DROP_NEWEST;
+  }
+  boot_settings.trigger_in = MIDI_ROUTER_NO_TRIGGER;
+  boot_settings.trigger_channel = 0;
+  memset(boot_settings.baud, 0, sizeof(boot_settings.baud));
+  uint8_t preset;
+  // A preset that is not valid leaves the default routes in place
+  if (preset_store_latest(&presets, &preset) && read_preset(preset, &boot_settings)) {
+    midi_router_set_trigger(&router, boot_settings.trigger_in, boot_settings.trigger_channel);
+  }
+}
+
+// Switch to a preset at run time. The whole routing setup changes at once
+// when the routing loop starts its next pass. The trigger stays as it is,
+// so a preset cannot turn off preset switching.
+static bool load_preset(uint8_t preset)
+{
+  route_preset_settings_t settings;
+  if (!read_preset(preset, &settings)) {
+    return false;
+  }
+  for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+    midi_merger_set_policy(mergers + port, settings.policies[port]);
+  }
+  for (uint8_t port = NUM_USB_MIDI_PORTS; port < NUM_MIDI_PORTS; port++) {
+    (void)set_serial_baud(port, settings.baud[port]);
+  }
+  compile_routes();
+  return true;
+}
+
+// Save the routing setup; return NULL on success or why it failed
+static const char* save_preset(uint8_t preset)
+{
+  route_preset_settings_t settings;
+  for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+    settings.policies[port] = mergers[port].policy;
+    settings.baud[port] = port < NUM_USB_MIDI_PORTS ? 0 : serial_outs[port - NUM_USB_MIDI_PORTS].baud;
+  }
+  uint8_t trigger_in;
+  settings.trigger_in = MIDI_ROUTER_NO_TRIGGER;
+  settings.trigger_channel = 0;
+  if (midi_router_get_trigger(&router, &trigger_in, &settings.trigger_channel)) {
+    settings.trigger_in = trigger_in;
+  }
+  uint32_t nbytes = route_preset_encode(&router, &settings, preset_buffer, preset_store_max_length(&presets));
+  if (nbytes == 0) {
+    return "Too many filters and transforms to fit in a preset";
+  }
+  if (!preset_store_save(&presets, preset, preset_buffer, nbytes)) {
+    return "Could not write the preset to flash";
+  }
+  return NULL;
+}
 
-  for (size_t idx=0; idx < NUM_PIO_MIDI_UARTS; idx++) {
-    usb_routes[idx].pio_uart_number_list[0] = idx +'A';
-    usb_routes[idx].num_pio_uart_routes = 1;
-    pio_routes[idx].usb_midi_cable_list[0] = idx + '1';
-    pio_routes[idx].num_usb_midi_routes = 1;
+// Called by the routing loop; programs 0-7 select presets 1-8
+static void program_change(void* context, uint8_t program)
+{
+  (void)context;
+  if (program < PRESET_STORE_NUM_PRESETS) {
+    requested_preset = program;
+#if MIDI_ROUTING_ON_CORE1
+    __sev(); // wake core 0 to load it
+#endif
   }
-  for (size_t idx=0; idx < NUM_HW_MIDI_UARTS; idx++) {
-    size_t jdx = idx + NUM_PIO_MIDI_UARTS;
-    usb_routes[jdx].hw_uart_number_list[0] = idx + 'G';
-    usb_routes[jdx].num_hw_uart_routes = 1;
-    hw_routes[idx].usb_midi_cable_list[0] = jdx + '1';
-    hw_routes[idx].num_usb_midi_routes = 1;
+}
+
+static void switch_preset_task(void)
+{
+  int8_t preset = requested_preset;
+  // A CLI command may be printing from the middle of a change
+  if (preset >= 0 && !cli_command_running) {
+    requested_preset = -1;
+    (void)load_preset(preset);
   }
 }
 
@@ -142,7 +516,7 @@ bool is_port_valid(uint8_t port)
 {
   bool valid = false;
   if (port >= '1' && port <= '8') {
-    valid = (port-'1') < CFG_TUD_MIDI_NUMCABLES_IN;
+    valid = (port-'1') < NUM_USB_MIDI_PORTS;
   }
   else {
     port = toupper(port);
@@ -152,101 +526,41 @@ bool is_port_valid(uint8_t port)
   return valid;
 }
 
-static bool route(midi_input_routes_t* route, uint8_t out)
+/**
+ * @brief convert a valid port ID character to a port number
+ *
+ * @param port '1'-'8' are USB cable numbers 0-7; 'A'-'F' are PIO UARTS; 'G'-'H' are HW UARTS
+ * @return the port number used to index the route matrix
+ */
+static uint8_t port_id_to_port(uint8_t port)
 {
-  if (out <='8') {
-    for (size_t idx=0; idx < route->num_usb_midi_routes; idx++) {
-      if (route->usb_midi_cable_list[idx] == out) {
-        return true; // already in the list
-      }
-    }
-    if (route->num_usb_midi_routes >= CFG_TUD_MIDI_NUMCABLES_IN) {
-      return false; // should never happen
-    }
-    route->usb_midi_cable_list[route->num_usb_midi_routes++]=out;
-  }
-  else if (out <='F') {
-    for (size_t idx=0; idx < route->num_pio_uart_routes; idx++) {
-      if (route->pio_uart_number_list[idx] == out) {
-        return true; // already in the list
-      }
-    }
-    if (route->num_pio_uart_routes >= NUM_PIO_MIDI_UARTS) {
-      return false; // should never happen
-    }
-    route->pio_uart_number_list[route->num_pio_uart_routes++]=out;
-  }
-  else if (out <='H') {
-    for (size_t idx=0; idx < route->num_hw_uart_routes; idx++) {
-      if (route->hw_uart_number_list[idx] == out) {
-        return true; // already in the list
-      }
-    }
-    if (route->num_hw_uart_routes >= NUM_HW_MIDI_UARTS) {
-      return false; // should never happen
-    }
-    route->hw_uart_number_list[route->num_hw_uart_routes++]=out;
+  if (port <= '8') {
+    return port - '1';
   }
-  else {
-    return false;
+  port = toupper(port);
+  if (port <= 'F') {
+    return PIO_MIDI_UART_PORT(port - 'A');
   }
-  return true; // successfully added the route 
+  return HW_MIDI_UART_PORT(port - 'G');
 }
 
-static bool unroute(midi_input_routes_t* route, uint8_t out)
+/**
+ * @brief convert a port number to its port ID character
+ *
+ * @param port the port number used to index the route matrix
+ * @return '1'-'8' for USB cables, 'A'-'F' for PIO UARTS, 'G'-'H' for HW UARTS
+ */
+static char port_to_port_id(uint8_t port)
 {
-  if (out <='8') {
-    for (size_t idx=0; idx < route->num_usb_midi_routes; idx++) {
-      if (route->usb_midi_cable_list[idx] == out) {
-        route->usb_midi_cable_list[idx] = route->usb_midi_cable_list[route->num_usb_midi_routes--];
-        return true;
-      }
-    }
-  }
-  else if (out <='F') {
-    for (size_t idx=0; idx < route->num_pio_uart_routes; idx++) {
-      if (route->pio_uart_number_list[idx] == out) {
-        route->pio_uart_number_list[idx] = route->pio_uart_number_list[route->num_pio_uart_routes--];
-        return true;
-      }
-    }
+  if (port < NUM_USB_MIDI_PORTS) {
+    return '1' + port;
   }
-  else if (out <='H') {
-    for (size_t idx=0; idx < route->num_hw_uart_routes; idx++) {
-      if (route->hw_uart_number_list[idx] == out) {
-        route->hw_uart_number_list[idx] = route->hw_uart_number_list[route->num_hw_uart_routes--];
-        return true;
-      }
-    }
+  if (port < HW_MIDI_UART_PORT(0)) {
+    return 'A' + port - PIO_MIDI_UART_PORT(0);
   }
-  return false; // not routed
+  return 'G' + port - HW_MIDI_UART_PORT(0);
 }
 
-static bool is_routed(midi_input_routes_t* route, uint8_t out)
-{
-  if (out <='8') {
-    for (size_t idx=0; idx < route->num_usb_midi_routes; idx++) {
-      if (route->usb_midi_cable_list[idx] == out) {
-        return true;
-      }
-    }
-  }
-  else if (out <='F') {
-    for (size_t idx=0; idx < route->num_pio_uart_routes; idx++) {
-      if (route->pio_uart_number_list[idx] == out) {
-        return true;
-      }
-    }
-  }
-  else if (out <='H') {
-    for (size_t idx=0; idx < route->num_hw_uart_routes; idx++) {
-      if (route->hw_uart_number_list[idx] == out) {
-        return true;
-      }
-    }
-  }
-  return false; // not routed
-}
 /**
  * @brief route the MIDI in to MIDI out
  * 
@@ -257,32 +571,18 @@ bool connect(uint8_t in, uint8_t out)
 {
   bool result = is_port_valid(in) && is_port_valid(out);
   if (result) {
-    if (in <= '8') {
-      result = route(usb_routes + (in-'1'), out);
-    }
-    else if (in <= 'F') {
-      result = route(pio_routes + (in - 'A'), out);
-    }
-    else {
-      result = route(hw_routes + (in-'G'), out);
-    }
+    midi_router_connect(&router, port_id_to_port(in), port_id_to_port(out));
+    compile_routes();
   }
   return result;
 }
 
 bool disconnect(uint8_t in, uint8_t out)
 {
-  bool result = is_port_valid(in) && is_port_valid(out);
+  bool result = is_connected(in, out);
   if (result) {
-    if (in <= '8') {
-      result = unroute(usb_routes + (in-'1'), out);
-    }
-    else if (in <= 'F') {
-      result = unroute(pio_routes + (in - 'A'), out);
-    }
-    else {
-      result = unroute(hw_routes + (in-'G'), out);
-    }
+    midi_router_disconnect(&router, port_id_to_port(in), port_id_to_port(out));
+    compile_routes();
   }
   return result;
 }
@@ -291,28 +591,13 @@ bool is_connected(uint8_t in, uint8_t out)
 {
   bool result = is_port_valid(in) && is_port_valid(out);
   if (result) {
-    if (in <= '8') {
-      result = is_routed(usb_routes + (in-'1'), out);
-    }
-    else if (in <= 'F') {
-      result = is_routed(pio_routes + (in - 'A'), out);
-    }
-    else {
-      result = is_routed(hw_routes + (in-'G'), out);
-    }
+    result = midi_router_is_connected(&router, port_id_to_port(in), port_id_to_port(out));
   }
   return result;
 }
 
-/*------------- MAIN -------------*/
-int main(void)
+static void create_midi_uarts(void)
 {
-  board_init();
-  init_routes();
-  // init device stack on configured roothub port
-  tud_init(BOARD_TUD_RHPORT);
-  cdc_stdio_lib_init();
-  cli_init();
   // Create the MIDI UARTs and MIDI OUTs
   pio_midi_uarts[0] = pio_midi_uart_create(MIDI_OUT_A_GPIO, MIDI_IN_A_GPIO);
   assert(pio_midi_uarts[0] != NULL);
@@ -334,6 +619,29 @@ int main(void)
   hw_midi_uarts[1] = midi_uart_configure(HW_MIDI_UART_H, MIDI_OUT_H_GPIO, MIDI_IN_H_GPIO);
   assert(hw_midi_uarts[0] != NULL);
   #endif
+}
+
+/*------------- MAIN -------------*/
+int main(void)
+{
+  board_init();
+  init_routes();
+  restore_preset();
+  init_control();
+  // init device stack on configured roothub port
+  tud_init(BOARD_TUD_RHPORT);
+  cdc_stdio_lib_init();
+  cli_init();
+#if MIDI_ROUTING_ON_CORE1
+  spsc_ring_init(&to_router, to_router_storage, sizeof(routed_packet_t), ROUTED_PACKET_RING_LEN);
+  spsc_ring_init(&from_router, from_router_storage, sizeof(routed_packet_t), ROUTED_PACKET_RING_LEN);
+  multicore_launch_core1(core1_main);
+  // wait for core 1 to create the MIDI UARTs
+  (void)multicore_fifo_pop_blocking();
+#else
+  create_midi_uarts();
+  init_parsers_and_mergers();
+#endif
 
 #if NUM_PIOS > 2
   printf("8-IN 8-OUT USB MIDI Device adapter\r\n");
@@ -346,6 +654,7 @@ int main(void)
     tud_task(); // tinyusb device task
     led_blinking_task();
     midi_task();
+    control_task();
     cli_task();
     if (cli_up_message_pending)
     {
@@ -357,6 +666,8 @@ int main(void)
         printWelcome();
       }
     }
+    cli_output_task();
+    wait_for_work();
   }
 }
 
@@ -385,304 +696,1806 @@ void tud_suspend_cb(bool remote_wakeup_en)
 {
   (void) remote_wakeup_en;
   blink_interval_ms = BLINK_SUSPENDED;
+  usb_suspended = true;
 }
 
 // Invoked when usb bus is resumed
 void tud_resume_cb(void)
 {
   blink_interval_ms = BLINK_MOUNTED;
+  usb_suspended = false;
 }
 
-//--------------------------------------------------------------------+
-// MIDI Task
-//--------------------------------------------------------------------+
-static void send_to_connected(midi_input_routes_t* routes, uint8_t *rx, uint8_t nread, bool connected)
-{
-  if (nread > 0)
-  {
-    for (size_t cable = 0; connected && cable < routes->num_usb_midi_routes; cable++) {
-      uint32_t nwritten = tud_midi_stream_write(routes->usb_midi_cable_list[cable] - '1', rx, nread);
-      if (nwritten != nread) {
-        TU_LOG1("Warning: Dropped %lu bytes sending to port %c\r\n", nread - nwritten, routes->usb_midi_cable_list[cable]);
-      }
-    }
-    for (size_t idx = 0; idx < routes->num_pio_uart_routes; idx++) {
-      uint32_t nwritten = pio_midi_uart_write_tx_buffer(pio_midi_uarts[routes->pio_uart_number_list[idx] - 'A'], rx, nread);
-      if (nwritten != nread) {
-        TU_LOG1("Warning: Dropped %lu bytes sending to port %c\r\n", nread - nwritten, routes->pio_uart_number_list[idx]);
-      }
-    }
-    for (size_t idx = 0; idx < routes->num_hw_uart_routes; idx++) {
-      uint32_t nwritten = midi_uart_write_tx_buffer(hw_midi_uarts[routes->hw_uart_number_list[idx] - 'G'], rx, nread);
-      if (nwritten != nread) {
-        TU_LOG1("Warning: Dropped %lu bytes sending to port %c\r\n", nread - nwritten, routes->hw_uart_number_list[idx]);
-      }
-    }
-  }
-}
-static void poll_midi_uarts_rx(bool connected)
+// Invoked when the MIDI OUT endpoint has received data from the host
+void tud_midi_rx_cb(uint8_t itf)
 {
-  uint8_t rx[48];
-  // Pull any bytes received on the MIDI UARTs out of the receive buffers and
-  // send them out via USB MIDI on the corresponding virtual cable
-  for (uint8_t idx = 0; idx < NUM_PIO_MIDI_UARTS; idx++) {
-    uint8_t nread = pio_midi_uart_poll_rx_buffer(pio_midi_uarts[idx], rx, sizeof(rx));
-    send_to_connected(pio_routes+idx, rx, nread, connected);
-  }
-  for (uint8_t idx = 0; idx < NUM_HW_MIDI_UARTS; idx++) {
-    uint8_t nread = midi_uart_poll_rx_buffer(hw_midi_uarts[idx], rx, sizeof(rx));
-    send_to_connected(hw_routes+idx, rx, nread, connected);
-  }    
+  (void) itf;
+  pending_events |= EVENT_USB_MIDI_RX;
 }
 
-static void poll_usb_rx(bool connected)
+// Return true if a scheduled packet or a clock tick waits for its time
+// and set due_us to the first of them
+static bool next_timed_output(uint32_t* due_us)
 {
-    // device must be attached and have the endpoint ready to receive a message
-    if (!connected)
-    {
-        return;
-    }
-    uint8_t rx[48];
-    uint8_t cable_num;
-    uint32_t nread =  tud_midi_demux_stream_read(&cable_num, rx, sizeof(rx));
-    while (nread > 0) {
-      send_to_connected(usb_routes+cable_num,rx, nread, connected);
-      nread =  tud_midi_demux_stream_read(&cable_num, rx, sizeof(rx));
-    }
+  uint32_t clock_due_us;
+  bool found = midi_router_next_due(&router, due_us);
+  if (midi_clock_next_due(&midi_clock, &clock_due_us) && (!found || (int32_t)(clock_due_us - *due_us) < 0)) {
+    *due_us = clock_due_us;
+    found = true;
+  }
+  return found;
 }
 
-static void drain_serial_port_tx_buffers()
+/**
+ * @brief sleep until an interrupt or until a timed job is due
+ *
+ * Returns immediately if any source already has work. Otherwise, sleep
+ * with WFE; any interrupt wakes the CPU. The timeout covers the LED, the
+ * CLI welcome message, and serial ports that are still transmitting.
+ */
+static void wait_for_work(void)
 {
-    uint8_t cable;
-    for (cable = 0; cable < NUM_PIO_MIDI_UARTS; cable++) {
-        pio_midi_uart_drain_tx_buffer(pio_midi_uarts[cable]);
+#if MIDI_ROUTING_ON_CORE1
+  bool busy = spsc_ring_count(&from_router) != 0;
+#else
+  bool busy = serial_rx_active || routes_changed;
+#endif
+  if (busy || pending_events != 0 || requested_preset >= 0 || midi_control_busy(&control) || show_line >= 0 ||
+      (monitor_inputs != 0 && spsc_ring_count(&capture_ring) != 0) || tud_task_event_ready()) {
+    return;
+  }
+  // While suspended, wake just often enough to keep the LED blink accurate
+  uint32_t timeout_us = usb_suspended ? 100000 : 1000;
+  // Wake up in time to send the packets waiting for USB. If they are
+  // already due, the driver is full and a USB interrupt will wake us.
+  uint32_t usb_tx_due_us = usb_aggregator_due_us(&usb_tx, time_us_32());
+  if (usb_tx_due_us != 0 && usb_tx_due_us < timeout_us) {
+    timeout_us = usb_tx_due_us;
+  }
+#if !MIDI_ROUTING_ON_CORE1
+  if (time_us_32() - last_serial_tx_us < SERIAL_TX_DRAIN_US) {
+    timeout_us = serial_min_byte_us;
+  }
+  // Wake up in time to release the packets of the scheduled outputs and
+  // to send the clock ticks
+  uint32_t due_us;
+  if (next_timed_output(&due_us)) {
+    int32_t wait_us = (int32_t)(due_us - time_us_32());
+    if (wait_us <= 0) {
+      return;
     }
-    for (cable = 0; cable < NUM_HW_MIDI_UARTS; cable++) {
-        midi_uart_drain_tx_buffer(hw_midi_uarts[cable]);
+    if ((uint32_t)wait_us < timeout_us) {
+      timeout_us = wait_us;
     }
-}
-static void midi_task(void)
-{
-    bool connected = tud_midi_mounted();
-    poll_midi_uarts_rx(connected);
-    poll_usb_rx(connected);
-    drain_serial_port_tx_buffers();
+  }
+#endif
+  best_effort_wfe_or_timeout(make_timeout_time_us(timeout_us));
+#if !MIDI_ROUTING_ON_CORE1
+  serial_rx_active = true;
+  if (usb_rx_blocked) {
+    pending_events |= EVENT_USB_MIDI_RX;
+  }
+#endif
 }
 
 //--------------------------------------------------------------------+
-// BLINKING TASK
+// MIDI Task
 //--------------------------------------------------------------------+
-static void led_blinking_task(void)
+// The USB mergers write whole event packets; put the output cable number
+// in the packet header in place of the source port number
+static uint32_t usb_midi_write(void* handle, const uint8_t* packet, uint32_t nbytes)
 {
-  static uint32_t start_ms = 0;
-  static bool led_state = false;
-
-  // Blink every interval ms
-  if ( board_millis() - start_ms < blink_interval_ms) return; // not enough time
-  start_ms += blink_interval_ms;
-
-  board_led_write(led_state);
-  led_state = 1 - led_state; // toggle
+  const uint8_t out[4] = {(uint8_t)(((uintptr_t)handle << 4) | midi_packet_cin(packet)), packet[1], packet[2], packet[3]};
+  return usb_aggregator_add(&usb_tx, out, time_us_32()) ? nbytes : 0;
 }
 
-//--------------------------------------------------------------------+
-// CLI TASK
-//--------------------------------------------------------------------+
-static void cli_task(void)
+// tud_midi_packet_write() starts a transfer after every packet, so on an
+// idle endpoint the first packet of a batch would go alone. Write the
+// batch to the driver FIFO and start one transfer for all of it.
+static uint32_t usb_tx_write(void* context, const uint8_t* packets, uint32_t npackets)
 {
-  if (cdc_state_has_changed) {
-    cdc_state_has_changed = false;
-    cli_up_message_pending = tud_cdc_connected();
-    previous_timestamp = get_absolute_time();
-  }
-  int c = getchar_timeout_us(0);
-  if (c != PICO_ERROR_TIMEOUT)
-  {
-    embeddedCliReceiveChar(cli, c);
-    embeddedCliProcess(cli);
-  }
+  (void)context;
+  return tud_midi_packet_write_n(packets, npackets);
 }
-/*
-* The following 3 functions are required by the EmbeddedCli library
-*/
-static void onCommand(const char *name, char *tokens)
-{
-  printf("Received command: %s\r\n", name);
 
-  for (int i = 0; i < embeddedCliGetTokenCount(tokens); ++i)
-  {
-    printf("Arg %d : %s\r\n", i, embeddedCliGetToken(tokens, i + 1));
+// Return how many of nbytes may be written to a serial port now. Bytes in
+// the UART library TX ring cannot be overtaken, so a port is only allowed
+// a few bytes ahead of the wire. The rest wait in the merger, where
+// real-time bytes can go ahead of them.
+static uint32_t paced_length(serial_out_t* out, uint32_t nbytes)
+{
+  uint32_t now = time_us_32();
+  last_serial_tx_us = now;
+  if ((int32_t)(out->wire_idle_us - now) < 0) {
+    out->wire_idle_us = now;
   }
+  uint32_t nahead = (out->wire_idle_us - now + out->byte_us - 1) / out->byte_us;
+  uint32_t room = nahead < out->lead_bytes ? out->lead_bytes - nahead : 0;
+  return nbytes < room ? nbytes : room;
 }
 
-static void onCommandFn(EmbeddedCli *embeddedCli, CliCommand *command)
+static uint32_t pio_midi_uart_write(void* handle, const uint8_t* buffer, uint32_t nbytes)
 {
-  (void)embeddedCli;
-  embeddedCliTokenizeArgs(command->args);
-  onCommand(command->name == NULL ? "" : command->name, command->args);
+  serial_out_t* out = (serial_out_t*)handle;
+  nbytes = paced_length(out, nbytes);
+  uint32_t nwritten = nbytes == 0 ? 0 : pio_midi_uart_write_tx_buffer(out->uart, buffer, nbytes);
+  out->wire_idle_us += nwritten * out->byte_us;
+  return nwritten;
 }
 
-static void writeCharFn(EmbeddedCli *embeddedCli, char c)
+static uint32_t hw_midi_uart_write(void* handle, const uint8_t* buffer, uint32_t nbytes)
 {
-  (void)embeddedCli;
-  putchar(c);
+  serial_out_t* out = (serial_out_t*)handle;
+  nbytes = paced_length(out, nbytes);
+  uint32_t nwritten = nbytes == 0 ? 0 : midi_uart_write_tx_buffer(out->uart, buffer, nbytes);
+  out->wire_idle_us += nwritten * out->byte_us;
+  return nwritten;
 }
 
-static void show_connected_row(int in)
+static void set_wire_rate(serial_out_t* out, uint32_t baud)
 {
-  for (int cable = 0; cable < CFG_TUD_MIDI_NUMCABLES_OUT; cable++) {
-    char connection_mark = is_connected(in, cable+'1') ? 'X' : ' ';
-    printf(" %c |", connection_mark);
-  }
-  for (int cable = 0; cable < NUM_PIO_MIDI_UARTS; cable++) {
-    char connection_mark = is_connected(in, cable+'A') ? 'X' : ' ';
-    printf(" %c |", connection_mark);
-  }
-  for (int cable = 0; cable < NUM_HW_MIDI_UARTS; cable++) {
-    char connection_mark = is_connected(in, cable+'G') ? 'X' : ' ';
-    printf(" %c |", connection_mark);
+  out->baud = baud;
+  out->byte_us = (10 * 1000000 + baud - 1) / baud;
+  uint32_t lead = SERIAL_TX_LEAD_BYTES * SERIAL_BYTE_TIME_US / out->byte_us;
+  out->lead_bytes = lead < SERIAL_TX_LEAD_BYTES ? SERIAL_TX_LEAD_BYTES :
+    lead > SERIAL_TX_MAX_LEAD_BYTES ? SERIAL_TX_MAX_LEAD_BYTES : lead;
+  uint32_t min_byte_us = UINT32_MAX;
+  for (uint8_t idx = 0; idx < NUM_SERIAL_MIDI_PORTS; idx++) {
+    if (serial_outs[idx].byte_us != 0 && serial_outs[idx].byte_us < min_byte_us) {
+      min_byte_us = serial_outs[idx].byte_us;
+    }
   }
-  printf("\r\n------------+");
-  for (size_t col = 0; col < CFG_TUD_MIDI_NUMCABLES_IN+NUM_PIO_MIDI_UARTS+NUM_HW_MIDI_UARTS; col++)
+  serial_min_byte_us = min_byte_us;
+}
+
+// Called by the routing loop, which owns the serial ports; set the ports
+// to the rates set_serial_baud() asked for
+static void serial_baud_task(void)
+{
+  for (uint8_t idx = 0; idx < NUM_SERIAL_MIDI_PORTS; idx++) {
+    serial_out_t* out = serial_outs + idx;
+    uint32_t baud = out->wanted_baud;
+    if (baud == out->set_baud) {
+      continue; // do not disturb a port that is already right
+    }
+    out->set_baud = baud;
+    uint8_t port = NUM_USB_MIDI_PORTS + idx;
+    if (port < HW_MIDI_UART_PORT(0)) {
+      set_wire_rate(out, pio_midi_uart_set_baudrate(out->uart, baud));
+    }
+    else {
+      uint uart_num = port == HW_MIDI_UART_PORT(0) ? HW_MIDI_UART_G : HW_MIDI_UART_H;
+      set_wire_rate(out, uart_set_baudrate(uart_get_instance(uart_num), baud));
+    }
+  }
+}
+
+// Ask the routing loop to set the wire rate of a serial port; return
+// false if the port cannot run at that rate
+static bool want_serial_baud(uint8_t port, uint32_t baud)
+{
+  if (baud == 0) {
+    baud = MIDI_UART_LIB_BAUD_RATE;
+  }
+  if (baud < SERIAL_MIN_BAUD || baud > SERIAL_MAX_BAUD) {
+    return false;
+  }
+  serial_outs[port - NUM_USB_MIDI_PORTS].wanted_baud = baud;
+  return true;
+}
+
+/**
+ * @brief set the wire rate of a serial port
+ *
+ * Called on core 0. The change takes effect before this returns and may
+ * garble a byte that is on the wire. In dual-core builds core 1 owns the
+ * serial ports, so this waits for the routing loop to make the change.
+ *
+ * @param port a serial port number
+ * @param baud the rate, or 0 for MIDI_UART_LIB_BAUD_RATE
+ * @return false if the port cannot run at that rate
+ */
+static bool set_serial_baud(uint8_t port, uint32_t baud)
+{
+  if (!want_serial_baud(port, baud)) {
+    return false;
+  }
+#if MIDI_ROUTING_ON_CORE1
+  serial_out_t* out = serial_outs + port - NUM_USB_MIDI_PORTS;
+  while (out->set_baud != out->wanted_baud) {
+    __sev(); // core 1 may be waiting for an event
+    tight_loop_contents();
+  }
+#else
+  // The routing loop runs on this core between CLI and control requests
+  serial_baud_task();
+#endif
+  return true;
+}
+
+#if MIDI_ROUTING_ON_CORE1
+// Core 1 sends packets routed to USB to core 0, which pushes them to the
+// USB mergers
+static bool forward_to_usb(void* context, uint8_t out, const uint8_t packet[4], uint32_t timestamp)
+{
+  (void)context;
+  routed_packet_t routed = {{packet[0], packet[1], packet[2], packet[3]}, out, timestamp, timestamp};
+  return spsc_ring_push(&from_router, &routed);
+}
+
+static uint16_t usb_room(void* context, uint8_t out, uint8_t in)
+{
+  (void)context;
+  (void)out;
+  (void)in;
+  // Core 0 stops taking packets from the ring when the USB output is full
+  return spsc_ring_free(&from_router);
+}
+#endif
+
+// A scheduled serial output releases a packet from its wheel to its merger
+static void release_to_merger(void* context, const midi_merger_entry_t* entry)
+{
+  midi_router_push(&router, (uint8_t)(uintptr_t)context, entry->packet, entry->timestamp);
+}
+
+static void init_parsers_and_mergers(void)
+{
+  usb_aggregator_init(&usb_tx, usb_tx_storage, USB_TX_AGGREGATE_PACKETS, USB_TX_FLUSH_DEADLINE_US, usb_tx_write, NULL);
+  midi_merger_entry_t* queue = merger_queue_pool;
+  for (uint8_t cable = 0; cable < NUM_USB_MIDI_PORTS; cable++) {
+    midi_merger_init(mergers + cable, usb_midi_write, (void*)(uintptr_t)cable, queue, USB_MERGER_QUEUE_LEN);
+    midi_merger_set_packet_output(mergers + cable, true);
+    queue += USB_MERGER_QUEUE_LEN;
+  }
+  for (uint8_t idx = 0; idx < NUM_PIO_MIDI_UARTS; idx++) {
+    serial_out_t* out = serial_outs + PIO_MIDI_UART_PORT(idx) - NUM_USB_MIDI_PORTS;
+    out->uart = pio_midi_uarts[idx];
+    out->wire_idle_us = time_us_32();
+    midi_merger_init(mergers + PIO_MIDI_UART_PORT(idx), pio_midi_uart_write, out, queue, SERIAL_MERGER_QUEUE_LEN);
+    queue += SERIAL_MERGER_QUEUE_LEN;
+  }
+  for (uint8_t idx = 0; idx < NUM_HW_MIDI_UARTS; idx++) {
+    serial_out_t* out = serial_outs + HW_MIDI_UART_PORT(idx) - NUM_USB_MIDI_PORTS;
+    out->uart = hw_midi_uarts[idx];
+    out->wire_idle_us = time_us_32();
+    midi_merger_init(mergers + HW_MIDI_UART_PORT(idx), hw_midi_uart_write, out, queue, SERIAL_MERGER_QUEUE_LEN);
+    queue += SERIAL_MERGER_QUEUE_LEN;
+  }
+  for (uint8_t port = NUM_USB_MIDI_PORTS; port < NUM_MIDI_PORTS; port++) {
+    serial_out_t* out = serial_outs + port - NUM_USB_MIDI_PORTS;
+    out->wanted_baud = out->set_baud = MIDI_UART_LIB_BAUD_RATE;
+    set_wire_rate(out, MIDI_UART_LIB_BAUD_RATE);
+  }
+  for (uint8_t port = NUM_USB_MIDI_PORTS; port < NUM_MIDI_PORTS; port++) {
+    // A rate the port cannot use leaves it at the standard rate
+    (void)want_serial_baud(port, boot_settings.baud[port]);
+    // A serial MIDI OUT is a plain byte stream
+    midi_merger_set_running_status(mergers + port, true);
+    midi_merger_set_realtime_between_bytes(mergers + port, true);
+    // Slow a SysEx dump down to the wire speed instead of cutting it short
+    midi_merger_set_sysex_flow_control(mergers + port, true);
+    // Share the wire among the inputs merged into it
+    midi_merger_set_fair(mergers + port, true);
+    timer_wheel_t* wheel = wheels + port - NUM_USB_MIDI_PORTS;
+    timer_wheel_init(wheel, wheel_pool[port - NUM_USB_MIDI_PORTS], SERIAL_WHEEL_LEN, release_to_merger,
+      (void*)(uintptr_t)port, time_us_32());
+    midi_router_set_wheel(&router, port, wheel);
+  }
+  for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+    midi_merger_set_policy(mergers + port, boot_settings.policies[port]);
+  }
+  for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+    // In dual-core builds, core 0 owns the USB mergers
+    midi_router_set_output(&router, port, mergers + port, MIDI_ROUTING_ON_CORE1 && port < NUM_USB_MIDI_PORTS);
+  }
+#if MIDI_ROUTING_ON_CORE1
+  midi_router_set_remote(&router, forward_to_usb, usb_room, NULL);
+#endif
+  // This runs on the routing core, before the routing loop starts
+  serial_baud_task();
+  compile_routes();
+}
+
+// Called from control_task(). In single-core builds compile_routes()
+// only marks the routes changed, so the reply goes out at once and the
+// next midi_task() routes with the new table.
+static void control_publish(void* context)
+{
+  (void)context;
+  compile_routes();
+}
+
+static bool control_save_preset(void* context, uint8_t preset)
+{
+  (void)context;
+  return save_preset(preset) == NULL;
+}
+
+static bool control_load_preset(void* context, uint8_t preset)
+{
+  (void)context;
+  return load_preset(preset);
+}
+
+static const midi_control_config_t control_config = {
+  .num_usb_ports = NUM_USB_MIDI_PORTS,
+  .cable = CONTROL_CABLE,
+  .write = usb_midi_write,
+  .handle = (void*)(uintptr_t)CONTROL_CABLE,
+  .publish = control_publish,
+  .save_preset = control_save_preset,
+  .load_preset = control_load_preset,
+  .context = NULL,
+};
+
+static void init_control(void)
+{
+  midi_control_init(&control, &router, &presets, &control_config);
+}
+
+// Control requests run on core 0 between passes of the MIDI task, never
+// inside the routing loop
+static void control_task(void)
+{
+  if (tud_midi_mounted()) {
+    midi_control_task(&control);
+  }
+  else {
+    midi_control_reset(&control);
+  }
+}
+
+// Return a bit per output that may receive data; nothing goes to USB
+// while the device is not mounted
+static uint16_t enabled_outputs(bool connected)
+{
+  uint16_t all = (1u << NUM_MIDI_PORTS) - 1;
+  return connected ? all : all & ~((1u << NUM_USB_MIDI_PORTS) - 1);
+}
+
+// Send the clock bytes that are due. A follower sends its clock where
+// the routes would send the clock of its input.
+static void clock_task(const midi_router_pass_t* pass)
+{
+  uint16_t outputs = pass->enabled_outputs;
+  if (midi_clock.mode == MIDI_CLOCK_FOLLOW) {
+    outputs = midi_router_outputs_of(pass, midi_clock.input, MIDI_ROUTER_SYSTEM_CLASS(0xF8));
+  }
+  midi_clock_task(&midi_clock, time_us_32(), outputs);
+  // The outputs of the master get its clock and not the clock of an
+  // input as well; the next pass routes with the new set
+  midi_router_set_sync_outputs(&router, midi_clock.mode == MIDI_CLOCK_MASTER ? midi_clock.outputs : 0);
+}
+
+static void poll_midi_uarts_rx(midi_router_pass_t* pass)
+{
+  if (!serial_rx_active) {
+    return;
+  }
+  bool received = false;
+  uint8_t rx[48];
+  // Pull any bytes received on the MIDI UARTs out of the receive buffers and
+  // send them out via USB MIDI on the corresponding virtual cable. An input
+  // routed to a full output that blocks its sources is left unread.
+  for (uint8_t idx = 0; idx < NUM_PIO_MIDI_UARTS; idx++) {
+    uint8_t port = PIO_MIDI_UART_PORT(idx);
+    uint32_t limit = midi_router_read_limit(pass, port, port, sizeof(rx));
+    uint8_t nread = limit == 0 ? 0 : pio_midi_uart_poll_rx_buffer(pio_midi_uarts[idx], rx, limit);
+    midi_router_parse(pass, port, rx, nread);
+    received |= nread > 0;
+  }
+  for (uint8_t idx = 0; idx < NUM_HW_MIDI_UARTS; idx++) {
+    uint8_t port = HW_MIDI_UART_PORT(idx);
+    uint32_t limit = midi_router_read_limit(pass, port, port, sizeof(rx));
+    uint8_t nread = limit == 0 ? 0 : midi_uart_poll_rx_buffer(hw_midi_uarts[idx], rx, limit);
+    midi_router_parse(pass, port, rx, nread);
+    received |= nread > 0;
+  }
+  serial_rx_active = received;
+}
+
+/**
+ * @brief read up to max_packets USB MIDI event packets and parse them
+ *
+ * The packets are read whole, so data routed from USB to USB is never
+ * converted to a byte stream and back.
+ *
+ * @param arrival_us when the packets were read
+ * @param target set before each packet is passed to cb to when it is
+ * meant to go out: the time of the time message before it, or arrival_us
+ * @return the number of packets read
+ */
+static uint32_t read_usb_packets(uint32_t max_packets, midi_parser_packet_cb cb, void* context,
+  uint32_t arrival_us, uint32_t* target)
+{
+  uint8_t nbytes[NUM_USB_MIDI_PORTS] = {0};
+  uint8_t packet[4];
+  uint32_t npackets = 0;
+  while (npackets < max_packets) {
+    if (!tud_midi_packet_read(packet)) {
+      host_timed = false; // the end of the burst
+      break;
+    }
+    npackets++;
+    uint8_t cable = midi_packet_cable(packet);
+    if (cable < NUM_USB_MIDI_PORTS) {
+      nbytes[cable] += midi_packet_num_bytes(packet);
+      *target = host_timed ? host_target : arrival_us;
+      midi_parser_parse_packet(router.parsers + cable, packet, cb, context);
+    }
+    else if (cable == CONTROL_CABLE) {
+      // Only collected here; control_task() runs the request
+      midi_control_receive(&control, packet);
+      uint32_t host_us;
+      if (midi_control_take_time(&control, &host_us)) {
+        host_target = host_clock_to_local(&host_clock, host_us, arrival_us);
+        host_timed = true;
+      }
+    }
+  }
+  for (uint8_t cable = 0; cable < NUM_USB_MIDI_PORTS; cable++) {
+    if (nbytes[cable] != 0) {
+      midi_router_count_received(&router, cable, nbytes[cable]);
+    }
+  }
+  return npackets;
+}
+
+static void drain_serial_port_tx_buffers()
+{
+    uint8_t cable;
+    for (cable = 0; cable < NUM_PIO_MIDI_UARTS; cable++) {
+        midi_merger_flush(mergers + PIO_MIDI_UART_PORT(cable));
+        pio_midi_uart_drain_tx_buffer(pio_midi_uarts[cable]);
+    }
+    for (cable = 0; cable < NUM_HW_MIDI_UARTS; cable++) {
+        midi_merger_flush(mergers + HW_MIDI_UART_PORT(cable));
+        midi_uart_drain_tx_buffer(hw_midi_uarts[cable]);
+    }
+}
+
+static void flush_usb_tx(bool connected)
+{
+    uint8_t cable;
+    for (cable = 0; cable < NUM_USB_MIDI_PORTS; cable++) {
+        if (connected) {
+            midi_merger_flush(mergers + cable);
+        }
+        else {
+            midi_merger_reset(mergers + cable);
+        }
+    }
+    if (connected) {
+        usb_aggregator_poll(&usb_tx, time_us_32());
+    }
+    else {
+        usb_aggregator_reset(&usb_tx);
+    }
+}
+
+#if MIDI_ROUTING_ON_CORE1
+static void queue_for_router(void* context, const uint8_t packet[4])
+{
+  routed_packet_t* routed = (routed_packet_t*)context;
+  memcpy(routed->packet, packet, sizeof(routed->packet));
+  // poll_usb_rx() made sure there is room
+  spsc_ring_push(&to_router, routed);
+}
+
+static void poll_usb_rx(bool connected)
+{
+    // device must be attached and have the endpoint ready to receive a message
+    if (!connected)
+    {
+        host_clock_reset(&host_clock);
+        return;
+    }
+    if (!(pending_events & EVENT_USB_MIDI_RX)) {
+        return;
+    }
+    pending_events &= ~EVENT_USB_MIDI_RX;
+    // Parsing k packets produces at most 3k+1 packets. If core 1 falls
+    // behind, leave the data in the USB FIFO so the host waits.
+    while (true) {
+      uint32_t max_packets = spsc_ring_free(&to_router) / 4;
+      if (max_packets == 0) {
+        pending_events |= EVENT_USB_MIDI_RX; // try again next pass
+        break;
+      }
+      if (max_packets > USB_RX_BATCH_PACKETS) {
+        max_packets = USB_RX_BATCH_PACKETS;
+      }
+      routed_packet_t routed = {{0, 0, 0, 0}, 0, time_us_32(), 0};
+      uint32_t npackets = read_usb_packets(max_packets, queue_for_router, &routed, routed.timestamp, &routed.target);
+      if (npackets != 0) {
+        __sev(); // wake core 1
+      }
+      if (npackets < max_packets) {
+        break;
+      }
+    }
+}
+
+static void receive_routed_usb_packets(bool connected)
+{
+  routed_packet_t routed;
+  while (spsc_ring_peek(&from_router, &routed)) {
+    midi_merger_t* merger = mergers + routed.port;
+    uint8_t source = midi_packet_cable(routed.packet);
+    if (connected && midi_merger_holds_back(merger, source) && midi_merger_free(merger, source) == 0) {
+      // Leave it in the ring so core 1 stops reading the inputs routed here
+      break;
+    }
+    spsc_ring_pop(&from_router, &routed);
+    if (connected) {
+      midi_router_push(&router, routed.port, routed.packet, routed.timestamp);
+    }
+  }
+}
+
+// Core 0 side of the MIDI task: USB only
+static void midi_task(void)
+{
+    bool connected = tud_midi_mounted();
+    usb_midi_connected = connected;
+    poll_usb_rx(connected);
+    receive_routed_usb_packets(connected);
+    flush_usb_tx(connected);
+    switch_preset_task();
+}
+
+static void router_task(void)
+{
+    midi_router_pass_t pass;
+    serial_baud_task();
+    midi_router_begin(&router, &pass, enabled_outputs(usb_midi_connected));
+    serial_rx_active = true;
+    poll_midi_uarts_rx(&pass);
+    bool busy = serial_rx_active;
+    routed_packet_t routed;
+    while (spsc_ring_peek(&to_router, &routed)) {
+      uint8_t cable = midi_packet_cable(routed.packet);
+      if (midi_router_room(&pass, cable, cable) == 0) {
+        break; // an output that blocks its sources is full
+      }
+      spsc_ring_pop(&to_router, &routed);
+      pass.timestamp = routed.timestamp;
+      pass.target = routed.target;
+      midi_router_route(&pass, routed.packet);
+      busy = true;
+    }
+    clock_task(&pass);
+    uint32_t nfrom_router = spsc_ring_count(&from_router);
+    midi_router_release(&router, time_us_32());
+    drain_serial_port_tx_buffers();
+    midi_router_end(&pass);
+    if (nfrom_router != 0) {
+      __sev(); // wake core 0 to send the data to USB
+    }
+    // Core 1 handles the UART interrupts and core 0 signals an event when
+    // it queues data, so core 1 only needs to poll while transmitting.
+    // A timer alarm wakes it when a scheduled packet or clock tick is due.
+    if (!busy && time_us_32() - last_serial_tx_us >= SERIAL_TX_DRAIN_US) {
+      uint32_t due_us;
+      if (!next_timed_output(&due_us)) {
+        __wfe();
+      }
+      else {
+        int32_t wait_us = (int32_t)(due_us - time_us_32());
+        if (wait_us > 0) {
+          best_effort_wfe_or_timeout(make_timeout_time_us(wait_us));
+        }
+      }
+    }
+}
+
+static void core1_main(void)
+{
+  // Let core 0 pause this core while it writes a preset to flash
+  flash_safe_execute_core_init();
+  // Create the UARTs here so their interrupts are handled on core 1
+  create_midi_uarts();
+  init_parsers_and_mergers();
+  multicore_fifo_push_blocking(0);
+  while (1) {
+    router_task();
+  }
+}
+#else
+// The cable of the next USB data is not known until it has been read, so
+// read only as much as every USB input may route
+static uint32_t usb_read_limit(const midi_router_pass_t* pass, uint32_t max)
+{
+  uint32_t limit = max;
+  for (uint8_t cable = 0; cable < NUM_USB_MIDI_PORTS; cable++) {
+    uint32_t cable_limit = midi_router_read_limit(pass, cable, MIDI_MERGER_NO_OWNER, max);
+    limit = cable_limit < limit ? cable_limit : limit;
+  }
+  return limit;
+}
+
+static void poll_usb_rx(midi_router_pass_t* pass, bool connected)
+{
+    // device must be attached and have the endpoint ready to receive a message
+    if (!connected)
+    {
+        host_clock_reset(&host_clock);
+        return;
+    }
+    if (!(pending_events & EVENT_USB_MIDI_RX)) {
+        return;
+    }
+    pending_events &= ~EVENT_USB_MIDI_RX;
+    uint32_t max_packets;
+    uint32_t npackets;
+    do {
+      // A packet holds at most 3 MIDI bytes
+      max_packets = usb_read_limit(pass, USB_RX_BATCH_PACKETS * 3) / 3;
+      pass->timestamp = time_us_32();
+      npackets = read_usb_packets(max_packets, midi_router_route, pass, pass->timestamp, &pass->target);
+    } while (npackets != 0 && npackets == max_packets);
+    // Leave the rest in the USB FIFO so the host waits; try again next wake-up
+    usb_rx_blocked = max_packets == 0;
+}
+
+static void midi_task(void)
+{
+    // A Program Change in the last pass and every change made since then
+    // take effect in this one
+    switch_preset_task();
+    publish_routes();
+    bool connected = tud_midi_mounted();
+    midi_router_pass_t pass;
+    midi_router_begin(&router, &pass, enabled_outputs(connected));
+    poll_midi_uarts_rx(&pass);
+    poll_usb_rx(&pass, connected);
+    clock_task(&pass);
+    flush_usb_tx(connected);
+    midi_router_release(&router, time_us_32());
+    drain_serial_port_tx_buffers();
+    midi_router_end(&pass);
+}
+#endif
+
+//--------------------------------------------------------------------+
+// BLINKING TASK
+//--------------------------------------------------------------------+
+static void led_blinking_task(void)
+{
+  static uint32_t start_ms = 0;
+  static bool led_state = false;
+
+  // Blink every interval ms
+  if ( board_millis() - start_ms < blink_interval_ms) return; // not enough time
+  start_ms += blink_interval_ms;
+
+  board_led_write(led_state);
+  led_state = 1 - led_state; // toggle
+}
+
+//--------------------------------------------------------------------+
+// CLI TASK
+//--------------------------------------------------------------------+
+static void show_task(void);
+static void monitor_task(void);
+
+static uint32_t cdc_write(void* context, const char* text, uint32_t len)
+{
+  (void)context;
+  return tud_cdc_write(text, len);
+}
+
+/**
+ * @brief send as much CLI output as the CDC FIFO takes
+ *
+ * This is the only place CLI text goes to USB, and it never waits.
+ */
+static void cli_output_task(void)
+{
+  if (!tud_cdc_connected()) {
+    cli_output_clear(&cli_output);
+    return;
+  }
+  if (cli_output_drain(&cli_output, cdc_write, NULL) != 0) {
+    tud_cdc_write_flush();
+  }
+}
+
+/**
+ * @brief add text to the CLI output
+ *
+ * If the ring is full, keep USB and MIDI running while the host reads.
+ * If the host stops reading, drop the text.
+ */
+static void cli_write(const char* text, uint32_t len)
+{
+  if (cli_output_write(&cli_output, text, len)) {
+    return;
+  }
+  absolute_time_t give_up = make_timeout_time_ms(CLI_OUTPUT_STALL_MS);
+  do {
+    if (!tud_cdc_connected() || time_reached(give_up)) {
+      return;
+    }
+    tud_task();
+    midi_task();
+    cli_output_task();
+  } while (!cli_output_write(&cli_output, text, len));
+}
+
+// printf() for the CLI; text past CLI_PRINTF_MAX - 1 characters is cut off
+static void __attribute__((format(printf, 1, 2))) cli_printf(const char* format, ...)
+{
+  char text[CLI_PRINTF_MAX];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  if (len > 0) {
+    cli_write(text, len < (int)sizeof(text) ? (uint32_t)len : sizeof(text) - 1);
+  }
+}
+
+static void cli_task(void)
+{
+  if (cdc_state_has_changed) {
+    cdc_state_has_changed = false;
+    cli_up_message_pending = tud_cdc_connected();
+    previous_timestamp = get_absolute_time();
+  }
+  if (show_line >= 0) {
+    // The next command waits until the table is done
+    show_task();
+    return;
+  }
+  if (monitor_inputs != 0) {
+    // The next command waits until the monitor stops
+    monitor_task();
+    return;
+  }
+  if (!(pending_events & EVENT_CDC_RX)) {
+    return;
+  }
+  int c = getchar_timeout_us(0);
+  if (c != PICO_ERROR_TIMEOUT)
   {
-    printf("---+");
+    embeddedCliReceiveChar(cli, c);
+    cli_command_running = true;
+    embeddedCliProcess(cli);
+    cli_command_running = false;
+  }
+  else {
+    pending_events &= ~EVENT_CDC_RX;
+  }
+}
+/*
+* The following 3 functions are required by the EmbeddedCli library
+*/
+static void onCommand(const char *name, char *tokens)
+{
+  cli_printf("Received command: %s\r\n", name);
+
+  for (int i = 0; i < embeddedCliGetTokenCount(tokens); ++i)
+  {
+    cli_printf("Arg %d : %s\r\n", i, embeddedCliGetToken(tokens, i + 1));
+  }
+}
+
+static void onCommandFn(EmbeddedCli *embeddedCli, CliCommand *command)
+{
+  (void)embeddedCli;
+  embeddedCliTokenizeArgs(command->args);
+  onCommand(command->name == NULL ? "" : command->name, command->args);
+}
+
+static void writeCharFn(EmbeddedCli *embeddedCli, char c)
+{
+  (void)embeddedCli;
+  if ((show_line >= 0 || monitor_inputs != 0) && cli_held_len < CLI_HELD_SIZE) {
+    cli_held[cli_held_len++] = c;
+    return;
+  }
+  cli_write(&c, 1);
+}
+
+// 'X' marks a route, 'F' a route with a filter, 'T' a route with a
+// transform and 'B' a route with both
+static char connection_mark(int in, int out)
+{
+  if (!is_connected(in, out)) {
+    return ' ';
+  }
+  const midi_router_filter_t* filter = midi_router_get_filter(&router, port_id_to_port(in), port_id_to_port(out));
+  bool filtered = false;
+  for (uint8_t idx = 0; idx < MIDI_ROUTER_NUM_CLASSES / 32; idx++) {
+    filtered |= filter->bits[idx] != 0;
+  }
+  bool transformed = !midi_router_transform_is_none(midi_router_get_transform(&router, port_id_to_port(in), port_id_to_port(out)));
+  if (filtered) {
+    return transformed ? 'B' : 'F';
+  }
+  return transformed ? 'T' : 'X';
+}
+
+// The full table has 12 header lines and a separator, then a line and
+// a separator for every input. Its lines are at most 12 characters
+// wide plus 4 for every output, a '|' and CR LF.
+#define SHOW_HEADER_LINES 12
+#define SHOW_LINE_MAX (12 + 4 * MIDI_ROUTER_MAX_PORTS + 3)
+#define SHOW_NUM_LINES (SHOW_HEADER_LINES + 1 + 2 * NUM_MIDI_PORTS)
+// The compact table has a header line and a line for every input
+#define SHOW_COMPACT_NUM_LINES (1 + NUM_MIDI_PORTS)
+
+static char* show_cell(char* pos, char c)
+{
+  pos[0] = ' ';
+  pos[1] = c;
+  pos[2] = ' ';
+  pos[3] = '|';
+  return pos + 4;
+}
+
+/**
+ * @brief render one line of the full show table
+ *
+ * @param line SHOW_LINE_MAX characters for the line
+ * @param idx the line number, 0 to SHOW_NUM_LINES - 1
+ * @return the number of characters in the line
+ */
+static uint32_t render_show_line(char* line, int idx)
+{
+  char* pos = line;
+  if (idx < SHOW_HEADER_LINES) {
+    const char* prefix = "            |";
+    if (idx == 0)
+      prefix = "        TO->|";
+    else if (idx == 7)
+      prefix = "  FROM |    |";
+    else if (idx == 8)
+      prefix = "       v    |";
+    memcpy(pos, prefix, 13);
+    pos += 13;
+    for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+      char nickname[] = "SERIAL OUT ?";
+      if (port < NUM_USB_MIDI_PORTS) {
+        memcpy(nickname, "   USB", 6);
+      }
+      nickname[11] = port_to_port_id(port);
+      pos = show_cell(pos, nickname[idx]);
+    }
+  }
+  else if (idx > SHOW_HEADER_LINES && (idx - SHOW_HEADER_LINES) % 2 == 1) {
+    uint8_t in = (idx - SHOW_HEADER_LINES) / 2;
+    char nickname[] = " SERIAL IN ?|";
+    if (in < NUM_USB_MIDI_PORTS) {
+      memcpy(nickname, "    USB", 7);
+    }
+    nickname[11] = port_to_port_id(in);
+    memcpy(pos, nickname, 13);
+    pos += 13;
+    for (uint8_t out = 0; out < NUM_MIDI_PORTS; out++) {
+      pos = show_cell(pos, connection_mark(port_to_port_id(in), port_to_port_id(out)));
+    }
+  }
+  else {
+    memcpy(pos, "------------+", 13);
+    pos += 13;
+    for (uint8_t out = 0; out < NUM_MIDI_PORTS; out++) {
+      memcpy(pos, "---+", 4);
+      pos += 4;
+    }
+  }
+  *pos++ = '\r';
+  *pos++ = '\n';
+  return pos - line;
+}
+
+/**
+ * @brief render one line of the compact show table
+ *
+ * Each route is one character and '.' means no route.
+ *
+ * @param line SHOW_LINE_MAX characters for the line
+ * @param idx the line number, 0 to SHOW_COMPACT_NUM_LINES - 1
+ * @return the number of characters in the line
+ */
+static uint32_t render_compact_line(char* line, int idx)
+{
+  char* pos = line;
+  if (idx == 0) {
+    memcpy(pos, "IN\\OUT ", 7);
+    pos += 7;
+    for (uint8_t out = 0; out < NUM_MIDI_PORTS; out++) {
+      *pos++ = port_to_port_id(out);
+    }
+  }
+  else {
+    uint8_t in = idx - 1;
+    memcpy(pos, "     ? ", 7);
+    pos[5] = port_to_port_id(in);
+    pos += 7;
+    for (uint8_t out = 0; out < NUM_MIDI_PORTS; out++) {
+      char mark = connection_mark(port_to_port_id(in), port_to_port_id(out));
+      *pos++ = mark == ' ' ? '.' : mark;
+    }
+  }
+  *pos++ = '\r';
+  *pos++ = '\n';
+  return pos - line;
+}
+
+static void release_held_output(void)
+{
+  cli_write(cli_held, cli_held_len);
+  cli_held_len = 0;
+}
+
+// Render the next line of the show table if the whole line fits in the
+// CLI output, so printing a table costs each pass one line at most
+static void show_task(void)
+{
+  if (cli_output_space(&cli_output) < SHOW_LINE_MAX) {
+    return;
+  }
+  char line[SHOW_LINE_MAX];
+  uint32_t len = show_compact ? render_compact_line(line, show_line) : render_show_line(line, show_line);
+  (void)cli_output_write(&cli_output, line, len);
+  show_line++;
+  if (show_line == (show_compact ? SHOW_COMPACT_NUM_LINES : SHOW_NUM_LINES)) {
+    show_line = -1;
+    release_held_output();
+  }
+}
+
+static void showFn(EmbeddedCli *cli, char *args, void *context)
+{
+  (void)cli;
+  (void)context;
+  uint16_t ntokens = embeddedCliGetTokenCount(args);
+  if (ntokens > 1 || (ntokens == 1 && strcmp(embeddedCliGetToken(args, 1), "-c") != 0)) {
+    cli_printf("show [-c]\r\n");
+    return;
+  }
+  // cli_task() renders the table
+  show_compact = ntokens == 1;
+  show_line = 0;
+}
+
+void print_port_id_description(void)
+{
+  cli_printf("The single character port ID to use in commands can be\r\n"
+    "1-%d for USB MIDI ",NUM_USB_MIDI_PORTS);
+#if (NUM_PIO_MIDI_UARTS  == 4)
+  cli_printf("and can be A-D, G-H for Serial MIDI\r\n");
+#else
+  cli_printf("\tand can be A-H for Serial MIDI \r\n");
+#endif
+}
+void print_port_range_error_message(const char* src, char port)
+{
+#if NUM_PIO_MIDI_UARTS == 6
+  cli_printf("%s %c not valid. Can be 1-%d or A-H\r\n", src, port, NUM_USB_MIDI_PORTS);
+#else
+  cli_printf("%s %c not valid. Can be 1-%d or A-D, G-H\r\n", src, port, NUM_USB_MIDI_PORTS);
+#endif
+}
+void connectFn(EmbeddedCli *cli, char *args, void *context)
+{
+  (void)cli;
+  (void)context;
+  if (embeddedCliGetTokenCount(args) != 2) {
+    cli_printf("connect <FROM port ID> <TO port ID>\r\n");
+    return;
+  }
+  const char* from = embeddedCliGetToken(args, 1);
+  const char* to = embeddedCliGetToken(args, 2);
+  if (!is_port_valid(*from)) {
+    print_port_range_error_message("From Input", *from);
+  }
+  else if (!is_port_valid(*to)) {
+    print_port_range_error_message("To Output", *to);
+  }
+  else if (!connect(*from, *to)) {
+    cli_printf("Connect from %c to %c failed\r\n",*from, *to);
+  }
+  else {
+    cli_printf("Connected %c to %c\r\n", *from, *to);
+  }
+}
+
+void disconnectFn(EmbeddedCli *cli, char *args, void *context)
+{
+  (void)cli;
+  (void)context;
+  if (embeddedCliGetTokenCount(args) != 2) {
+    cli_printf("disconnect <FROM port ID> <TO port ID>\r\n");
+    return;
+  }
+  const char* from = embeddedCliGetToken(args, 1);
+  const char* to = embeddedCliGetToken(args, 2);
+  if (!is_port_valid(*from)) {
+    print_port_range_error_message("From Input", *from);
+  }
+  else if (!is_port_valid(*to)) {
+    print_port_range_error_message("To Output", *to);
+  }
+  else if (!disconnect(*from, *to)) {
+    cli_printf("Disconnect from %c to %c failed\r\n",*from, *to);
+  }
+  else {
+    cli_printf("Disconnected %c from %c\r\n", *from, *to);
+  }
+}
+
+// Print one line of the stats table and its histogram
+static void print_stats_row(const char* label, const route_stats_t* stats)
+{
+  cli_printf("%s %6lu %7lu %7lu %7lu\r\n", label, (unsigned long)stats->count, (unsigned long)stats->min_us,
+    (unsigned long)route_stats_mean_us(stats), (unsigned long)stats->max_us);
+  // Print the latency histogram as <floor of bin in us>:<count>
+  cli_printf("        ");
+  for (uint8_t bin = 0; bin < ROUTE_STATS_NUM_BINS; bin++) {
+    if (stats->histogram[bin] != 0) {
+      cli_printf(" >=%lu:%u", (unsigned long)route_stats_bin_floor_us(bin), stats->histogram[bin]);
+    }
+  }
+  cli_printf("\r\n");
+}
+
+void statsFn(EmbeddedCli *cli, char *args, void *context)
+{
+  (void)cli;
+  (void)context;
+  uint16_t ntokens = embeddedCliGetTokenCount(args);
+  if (ntokens == 1 && strcmp(embeddedCliGetToken(args, 1), "reset") == 0) {
+    // In dual-core builds, core 1 may record a sample into a route while
+    // it is being reset; the statistics are diagnostic, so that is tolerated.
+    midi_router_reset_stats(&router);
+    route_stats_reset(&usb_tx.waits);
+    cli_printf("Latency statistics reset\r\n");
+    return;
+  }
+  if (ntokens != 0) {
+    cli_printf("stats [reset]\r\n");
+    return;
+  }
+  cli_printf("FROM TO  COUNT     MIN    MEAN     MAX (us)\r\n");
+  bool any = false;
+  for (uint8_t in = 0; in < NUM_MIDI_PORTS; in++) {
+    for (uint8_t out = 0; out < NUM_MIDI_PORTS; out++) {
+      const route_stats_t* stats = &router.latency[in][out];
+      if (stats->count == 0) {
+        continue;
+      }
+      any = true;
+      char label[8];
+      snprintf(label, sizeof(label), "   %c  %c", port_to_port_id(in), port_to_port_id(out));
+      print_stats_row(label, stats);
+    }
+  }
+  // Packets for USB wait in a batch after their route is done
+  if (usb_tx.waits.count != 0) {
+    any = true;
+    print_stats_row(" USB IN", &usb_tx.waits);
+  }
+  if (!any) {
+    cli_printf("No MIDI data has been routed\r\n");
+  }
+}
+
+static void print_counters_table(const char* title, const midi_router_counters_t* counters, const char* high_water_units)
+{
+  cli_printf("%s\r\nPORT    OFFERED    WRITTEN    DROPPED  PEAK (%s)\r\n", title, high_water_units);
+  for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+    const midi_router_counters_t* c = counters + port;
+    cli_printf("   %c %10lu %10lu %10lu %5u\r\n", port_to_port_id(port), (unsigned long)c->offered,
+      (unsigned long)c->written, (unsigned long)c->dropped, c->high_water);
+  }
+}
+
+static void print_counters_json(const char* name, const midi_router_counters_t* counters)
+{
+  cli_printf("\"%s\":[", name);
+  for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+    const midi_router_counters_t* c = counters + port;
+    cli_printf("%s{\"port\":\"%c\",\"offered\":%lu,\"written\":%lu,\"dropped\":%lu,\"peak\":%u}",
+      port == 0 ? "" : ",", port_to_port_id(port), (unsigned long)c->offered,
+      (unsigned long)c->written, (unsigned long)c->dropped, c->high_water);
+  }
+  cli_printf("]");
+}
+
+void countersFn(EmbeddedCli *cli, char *args, void *context)
+{
+  (void)cli;
+  (void)context;
+  uint16_t ntokens = embeddedCliGetTokenCount(args);
+  const char* option = ntokens == 1 ? embeddedCliGetToken(args, 1) : "";
+  if (ntokens == 0) {
+    print_counters_table("Inputs", router.source_counters, "bytes per read");
+    print_counters_table("Outputs", router.dest_counters, "packets queued");
+  }
+  else if (strcmp(option, "reset") == 0) {
+    midi_router_reset_counters(&router);
+    cli_printf("Counters reset\r\n");
+  }
+  else if (strcmp(option, "json") == 0) {
+    cli_printf("{");
+    print_counters_json("inputs", router.source_counters);
+    cli_printf(",");
+    print_counters_json("outputs", router.dest_counters);
+    cli_printf("}\r\n");
+  }
+  else {
+    cli_printf("counters [reset|json]\r\n");
+  }
+}
+
+static const char* const policy_names[] = {"drop-newest", "drop-oldest", "block"};
+
+static void print_policy(uint8_t port)
+{
+  cli_printf("%c %s\r\n", port_to_port_id(port), policy_names[mergers[port].policy]);
+}
+
+void policyFn(EmbeddedCli *cli, char *args, void *context)
+{
+  (void)cli;
+  (void)context;
+  uint16_t ntokens = embeddedCliGetTokenCount(args);
+  if (ntokens == 0) {
+    for (uint8_t port = 0; port < NUM_MIDI_PORTS; port++) {
+      print_policy(port);
+    }
+    return;
+  }
+  const char* to = embeddedCliGetToken(args, 1);
+  if (ntokens > 2) {
+    cli_printf("policy [<TO port ID> [drop-newest|drop-oldest|block]]\r\n");
+  }
+  else if (!is_port_valid(*to)) {
+    print_port_range_error_message("To Output", *to);
+  }
+  else if (ntokens == 1) {
+    print_policy(port_id_to_port(*to));
+  }
+  else {
+    const char* name = embeddedCliGetToken(args, 2);
+    for (uint8_t policy = 0; policy < sizeof(policy_names) / sizeof(policy_names[0]); policy++) {
+      if (strcmp(name, policy_names[policy]) == 0) {
+        // One aligned store, so it is safe even if the other core owns the output
+        midi_merger_set_policy(mergers + port_id_to_port(*to), (midi_merger_policy_t)policy);
+        print_policy(port_id_to_port(*to));
+        return;
+      }
+    }
+    cli_printf("Unknown policy %s. Use drop-newest, drop-oldest or block\r\n", name);
+  }
+}
+
+static void print_baud(uint8_t port)
+{
+  cli_printf("%c %lu\r\n", port_to_port_id(port), (unsigned long)serial_outs[port - NUM_USB_MIDI_PORTS].baud);
+}
+
+void baudFn(EmbeddedCli *cli, char *args, void *context)
+{
+  (void)cli;
+  (void)context;
+  uint16_t ntokens = embeddedCliGetTokenCount(args);
+  if (ntokens == 0) {
+    for (uint8_t port = NUM_USB_MIDI_PORTS; port < NUM_MIDI_PORTS; port++) {
+      print_baud(port);
+    }
+    return;
+  }
+  const char* id = embeddedCliGetToken(args, 1);
+  if (ntokens > 2) {
+    cli_printf("baud [<Serial port ID> [<rate>]]\r\n");
+  }
+  else if (!is_port_valid(*id) || port_id_to_port(*id) < NUM_USB_MIDI_PORTS) {
+    cli_printf("Serial port %c not valid\r\n", *id);
+  }
+  else if (ntokens == 1) {
+    print_baud(port_id_to_port(*id));
+  }
+  else {
+    uint8_t port = port_id_to_port(*id);
+    const char* rate = embeddedCliGetToken(args, 2);
+    char* end;
+    unsigned long baud = strtoul(rate, &end, 10);
+    if (*end != '\0' || !isdigit((unsigned char)*rate) || !set_serial_baud(port, baud)) {
+      cli_printf("Rate %s not valid. Can be %u-%u\r\n", rate, SERIAL_MIN_BAUD, SERIAL_MAX_BAUD);
+      return;
+    }
+    print_baud(port);
+  }
+}
+
+static void print_delay(uint8_t port)
+{
+  uint32_t delay_us = router.delay_us[port];
+  if (delay_us == 0) {
+    cli_printf("%c off\r\n", port_to_port_id(port));
+  }
+  else {
+    cli_printf("%c %lu us\r\n", port_to_port_id(port), (unsigned long)delay_us);
   }
-  printf("\r\n");
 }
 
-static void showFn(EmbeddedCli *cli, char *args, void *context)
+void delayFn(EmbeddedCli *cli, char *args, void *context)
 {
   (void)cli;
-  (void)args;
   (void)context;
-  // Print the top header
-  for (size_t line = 0; line < 12; line++)
-  {
-    if (line == 0)
-        printf("        TO->|");
-    else if (line == 7)
-        printf("  FROM |    |");
-    else if (line == 8)
-        printf("       v    |");
-    else
-        printf("            |");
-
-    for (size_t idx = 0; idx < CFG_TUD_MIDI_NUMCABLES_IN; idx++)
-    {
-      char nickname[] = "   USB OUT 1";
-      nickname[11] += idx;
-      printf(" %c |", nickname[line]);
-    }
-    for (size_t idx = 0; idx < NUM_PIO_MIDI_UARTS; idx++)
-    {
-      char nickname[] = "SERIAL OUT A";
-      nickname[11] += idx;
-      printf(" %c |", nickname[line]);
-    }
-    for (size_t idx = 0; idx < NUM_HW_MIDI_UARTS; idx++)
-    {
-      char nickname[] = "SERIAL OUT G";
-      nickname[11] += idx;
-      printf(" %c |", nickname[line]);
+  uint16_t ntokens = embeddedCliGetTokenCount(args);
+  if (ntokens == 0) {
+    for (uint8_t port = NUM_USB_MIDI_PORTS; port < NUM_MIDI_PORTS; port++) {
+      print_delay(port);
     }
-    printf("\r\n");
+    return;
   }
-  printf("------------+");
-  for (size_t col = 0; col < CFG_TUD_MIDI_NUMCABLES_IN+NUM_PIO_MIDI_UARTS+NUM_HW_MIDI_UARTS; col++)
-  {
-    printf("---+");
+  const char* id = embeddedCliGetToken(args, 1);
+  if (ntokens > 2) {
+    cli_printf("delay [<Serial port ID> [<us>|off]]\r\n");
   }
-  printf("\r\n");
-
-  for (size_t idx = 0; idx < CFG_TUD_MIDI_NUMCABLES_IN; idx++)
-  {
-    char nickname[] = "    USB IN 1";
-    nickname[11] += idx;
-    printf("%-12s|", nickname);
-    show_connected_row(idx+'1');
+  else if (!is_port_valid(*id) || port_id_to_port(*id) < NUM_USB_MIDI_PORTS) {
+    cli_printf("Serial port %c not valid\r\n", *id);
   }
-  for (size_t idx = 0; idx < NUM_PIO_MIDI_UARTS; idx++)
-  {
-    char nickname[] = " SERIAL IN A";
-    nickname[11] += idx;
-    printf("%-12s|", nickname);
-    show_connected_row(idx+'A');
+  else if (ntokens == 1) {
+    print_delay(port_id_to_port(*id));
   }
-  for (size_t idx = 0; idx < NUM_HW_MIDI_UARTS; idx++)
-  {
-    char nickname[] = " SERIAL IN G";
-    nickname[11] += idx;
-    printf("%-12s|", nickname);
-    show_connected_row(idx+'G');
+  else {
+    uint8_t port = port_id_to_port(*id);
+    const char* value = embeddedCliGetToken(args, 2);
+    char* end;
+    unsigned long delay_us = strcmp(value, "off") == 0 ? 0 : strtoul(value, &end, 10);
+    if (strcmp(value, "off") != 0 && (*end != '\0' || !isdigit((unsigned char)*value))) {
+      delay_us = MIDI_ROUTER_MAX_DELAY_US + 1;
+    }
+    // One aligned store, so it is safe even if the other core owns the output
+    if (!midi_router_set_delay(&router, port, delay_us)) {
+      cli_printf("Delay %s not valid. Can be off or 1-%u us\r\n", value, MIDI_ROUTER_MAX_DELAY_US);
+      return;
+    }
+    print_delay(port);
   }
 }
 
-void print_port_id_description(void)
-{
-  printf("The single character port ID to use in commands can be\r\n"
-    "1-%d for USB MIDI ",CFG_TUD_MIDI_NUMCABLES_IN);
-#if (NUM_PIO_MIDI_UARTS  == 4)
-  printf("and can be A-D, G-H for Serial MIDI\r\n");
-#else
-  printf("\tand can be A-H for Serial MIDI \r\n");
-#endif
-}
-void print_port_range_error_message(const char* src, char port)
+// The message classes a route filter can name. The first ones name one
+// message type each and are the ones the filter command prints.
+typedef struct {
+  const char* name;
+  uint8_t first_class;
+  uint8_t nclasses;
+} filter_type_t;
+#define NUM_FILTER_PRINT_TYPES 18
+static const filter_type_t filter_types[] = {
+  {"note-off", MIDI_ROUTER_CHANNEL_CLASS(0x80), 16},
+  {"note-on", MIDI_ROUTER_CHANNEL_CLASS(0x90), 16},
+  {"poly-pressure", MIDI_ROUTER_CHANNEL_CLASS(0xA0), 16},
+  {"control-change", MIDI_ROUTER_CHANNEL_CLASS(0xB0), 16},
+  {"program-change", MIDI_ROUTER_CHANNEL_CLASS(0xC0), 16},
+  {"channel-pressure", MIDI_ROUTER_CHANNEL_CLASS(0xD0), 16},
+  {"pitch-bend", MIDI_ROUTER_CHANNEL_CLASS(0xE0), 16},
+  {"sysex", MIDI_ROUTER_SYSTEM_CLASS(0xF0), 1},
+  {"mtc", MIDI_ROUTER_SYSTEM_CLASS(0xF1), 1},
+  {"song-position", MIDI_ROUTER_SYSTEM_CLASS(0xF2), 1},
+  {"song-select", MIDI_ROUTER_SYSTEM_CLASS(0xF3), 1},
+  {"tune-request", MIDI_ROUTER_SYSTEM_CLASS(0xF6), 1},
+  {"clock", MIDI_ROUTER_SYSTEM_CLASS(0xF8), 1},
+  {"start", MIDI_ROUTER_SYSTEM_CLASS(0xFA), 1},
+  {"continue", MIDI_ROUTER_SYSTEM_CLASS(0xFB), 1},
+  {"stop", MIDI_ROUTER_SYSTEM_CLASS(0xFC), 1},
+  {"active-sensing", MIDI_ROUTER_SYSTEM_CLASS(0xFE), 1},
+  {"reset", MIDI_ROUTER_SYSTEM_CLASS(0xFF), 1},
+  {"voice", 0, MIDI_ROUTER_SYSTEM_CLASS(0xF0)},
+  {"realtime", MIDI_ROUTER_SYSTEM_CLASS(0xF8), 8},
+  {"all", 0, MIDI_ROUTER_NUM_CLASSES},
+};
+
+static void print_filter(uint8_t in, uint8_t out)
 {
-#if NUM_PIO_MIDI_UARTS == 6
-  printf("%s %c not valid. Can be 1-%d or A-H\r\n", src, port, CFG_TUD_MIDI_NUMCABLES_IN);
-#else
-  printf("%s %c not valid. Can be 1-%d or A-D, G-H\r\n", src, port, CFG_TUD_MIDI_NUMCABLES_IN);
-#endif
+  const midi_router_filter_t* filter = midi_router_get_filter(&router, in, out);
+  cli_printf("%c to %c blocks:", port_to_port_id(in), port_to_port_id(out));
+  bool any = false;
+  for (uint8_t idx = 0; idx < NUM_FILTER_PRINT_TYPES; idx++) {
+    const filter_type_t* type = filter_types + idx;
+    uint8_t nblocked = 0;
+    for (uint8_t offset = 0; offset < type->nclasses; offset++) {
+      nblocked += midi_router_filter_blocks(filter, type->first_class + offset);
+    }
+    if (nblocked == 0) {
+      continue;
+    }
+    any = true;
+    cli_printf(" %s", type->name);
+    if (nblocked < type->nclasses) {
+      // Some channels of a channel voice message type
+      cli_printf(" (channel");
+      for (uint8_t channel = 0; channel < 16; channel++) {
+        if (midi_router_filter_blocks(filter, type->first_class + channel)) {
+          cli_printf(" %u", channel + 1);
+        }
+      }
+      cli_printf(")");
+    }
+  }
+  cli_printf("%s\r\n", any ? "" : " nothing");
 }
-void connectFn(EmbeddedCli *cli, char *args, void *context)
+
+void filterFn(EmbeddedCli *cli, char *args, void *context)
 {
   (void)cli;
   (void)context;
-  if (embeddedCliGetTokenCount(args) != 2) {
-    printf("connect <FROM port ID> <TO port ID>\r\n");
+  uint16_t ntokens = embeddedCliGetTokenCount(args);
+  if (ntokens != 2 && ntokens != 3 && ntokens != 4 && ntokens != 5) {
+    cli_printf("filter <FROM port ID> <TO port ID> [clear|block <type> [<channel>]|pass <type> [<channel>]]\r\n");
     return;
   }
   const char* from = embeddedCliGetToken(args, 1);
   const char* to = embeddedCliGetToken(args, 2);
   if (!is_port_valid(*from)) {
     print_port_range_error_message("From Input", *from);
+    return;
   }
-  else if (!is_port_valid(*to)) {
+  if (!is_port_valid(*to)) {
     print_port_range_error_message("To Output", *to);
+    return;
   }
-  else if (!connect(*from, *to)) {
-    printf("Connect from %c to %c failed\r\n",*from, *to);
+  uint8_t in = port_id_to_port(*from);
+  uint8_t out = port_id_to_port(*to);
+  if (ntokens == 2) {
+    print_filter(in, out);
+    return;
+  }
+  midi_router_filter_t filter = *midi_router_get_filter(&router, in, out);
+  const char* action = embeddedCliGetToken(args, 3);
+  if (ntokens == 3 && strcmp(action, "clear") == 0) {
+    memset(&filter, 0, sizeof(filter));
+  }
+  else if (ntokens >= 4 && (strcmp(action, "block") == 0 || strcmp(action, "pass") == 0)) {
+    const char* name = embeddedCliGetToken(args, 4);
+    const filter_type_t* type = NULL;
+    for (uint8_t idx = 0; idx < sizeof(filter_types) / sizeof(filter_types[0]); idx++) {
+      if (strcmp(name, filter_types[idx].name) == 0) {
+        type = filter_types + idx;
+        break;
+      }
+    }
+    if (type == NULL) {
+      cli_printf("Unknown message type %s\r\n", name);
+      return;
+    }
+    int channel = ntokens == 5 ? atoi(embeddedCliGetToken(args, 5)) : 0;
+    if (ntokens == 5 && (channel < 1 || channel > 16 || type->first_class >= MIDI_ROUTER_SYSTEM_CLASS(0xF0))) {
+      cli_printf("The channel must be 1-16 and needs a channel voice message type\r\n");
+      return;
+    }
+    for (uint8_t offset = 0; offset < type->nclasses; offset++) {
+      uint8_t msg_class = type->first_class + offset;
+      if (channel == 0 || (msg_class < MIDI_ROUTER_SYSTEM_CLASS(0xF0) && (msg_class & 0xf) == channel - 1)) {
+        midi_router_filter_set(&filter, msg_class, action[0] == 'b');
+      }
+    }
   }
   else {
-    printf("Connected %c to %c\r\n", *from, *to);
+    cli_printf("filter <FROM port ID> <TO port ID> [clear|block <type> [<channel>]|pass <type> [<channel>]]\r\n");
+    return;
   }
+  midi_router_set_filter(&router, in, out, &filter);
+  compile_routes();
+  print_filter(in, out);
 }
 
-void disconnectFn(EmbeddedCli *cli, char *args, void *context)
+static void print_transform(uint8_t in, uint8_t out)
+{
+  const midi_router_transform_t* transform = midi_router_get_transform(&router, in, out);
+  cli_printf("%c to %c:", port_to_port_id(in), port_to_port_id(out));
+  if (midi_router_transform_is_none(transform)) {
+    cli_printf(" no transform");
+  }
+  if (transform->channel != 0) {
+    cli_printf(" channel %u", transform->channel);
+  }
+  if (transform->transpose != 0) {
+    cli_printf(" transpose %+d", transform->transpose);
+  }
+  if (transform->velocity != 100) {
+    cli_printf(" velocity %u%%", transform->velocity);
+  }
+  if (transform->cc_min != 0 || transform->cc_max != 127) {
+    cli_printf(" cc-range %u-%u", transform->cc_min, transform->cc_max);
+  }
+  cli_printf("\r\n");
+}
+
+void transformFn(EmbeddedCli *cli, char *args, void *context)
 {
   (void)cli;
   (void)context;
-  if (embeddedCliGetTokenCount(args) != 2) {
-    printf("disconnect <FROM port ID> <TO port ID>\r\n");
+  static const char* const usage = "transform <FROM port ID> <TO port ID> "
+    "[clear|channel <1-16|keep>|transpose <semitones>|velocity <percent>|cc-range <min> <max>]\r\n";
+  uint16_t ntokens = embeddedCliGetTokenCount(args);
+  if (ntokens < 2 || ntokens > 5) {
+    cli_printf("%s", usage);
     return;
   }
   const char* from = embeddedCliGetToken(args, 1);
   const char* to = embeddedCliGetToken(args, 2);
   if (!is_port_valid(*from)) {
     print_port_range_error_message("From Input", *from);
+    return;
   }
-  else if (!is_port_valid(*to)) {
+  if (!is_port_valid(*to)) {
     print_port_range_error_message("To Output", *to);
+    return;
   }
-  else if (!disconnect(*from, *to)) {
-    printf("Disconnect from %c to %c failed\r\n",*from, *to);
+  uint8_t in = port_id_to_port(*from);
+  uint8_t out = port_id_to_port(*to);
+  if (ntokens == 2) {
+    print_transform(in, out);
+    return;
+  }
+  midi_router_transform_t transform = *midi_router_get_transform(&router, in, out);
+  const char* what = embeddedCliGetToken(args, 3);
+  const char* arg = ntokens >= 4 ? embeddedCliGetToken(args, 4) : "";
+  int value = atoi(arg);
+  bool ok = true;
+  if (ntokens == 3 && strcmp(what, "clear") == 0) {
+    transform = midi_router_no_transform;
+  }
+  else if (ntokens == 4 && strcmp(what, "channel") == 0) {
+    ok = strcmp(arg, "keep") == 0 || (value >= 1 && value <= 16);
+    transform.channel = strcmp(arg, "keep") == 0 ? 0 : value;
+  }
+  else if (ntokens == 4 && strcmp(what, "transpose") == 0) {
+    ok = value >= -127 && value <= 127;
+    transform.transpose = value;
+  }
+  else if (ntokens == 4 && strcmp(what, "velocity") == 0) {
+    ok = value >= 1 && value <= 255;
+    transform.velocity = value;
+  }
+  else if (ntokens == 5 && strcmp(what, "cc-range") == 0) {
+    int max = atoi(embeddedCliGetToken(args, 5));
+    ok = value >= 0 && value <= max && max <= 127;
+    transform.cc_min = value;
+    transform.cc_max = max;
+  }
+  else {
+    cli_printf("%s", usage);
+    return;
+  }
+  if (!ok) {
+    cli_printf("Value out of range\r\n");
+  }
+  else if (!midi_router_set_transform(&router, in, out, &transform)) {
+    cli_printf("All %u transforms are in use; clear one first\r\n", MIDI_ROUTER_NUM_TRANSFORMS);
+  }
+  else {
+    compile_routes();
+    print_transform(in, out);
+  }
+}
+
+// Return true if token is a preset number 1-8; set preset to 0-7
+static bool parse_preset(const char* token, uint8_t* preset)
+{
+  int number = atoi(token);
+  if (number < 1 || number > PRESET_STORE_NUM_PRESETS) {
+    cli_printf("Preset numbers are 1-%u\r\n", PRESET_STORE_NUM_PRESETS);
+    return false;
+  }
+  *preset = number - 1;
+  return true;
+}
+
+void saveFn(EmbeddedCli *cli, char *args, void *context)
+{
+  (void)cli;
+  (void)context;
+  uint8_t preset;
+  if (embeddedCliGetTokenCount(args) != 1) {
+    cli_printf("save <preset 1-%u>\r\n", PRESET_STORE_NUM_PRESETS);
+    return;
+  }
+  if (!parse_preset(embeddedCliGetToken(args, 1), &preset)) {
+    return;
+  }
+  const char* error = save_preset(preset);
+  if (error != NULL) {
+    cli_printf("%s\r\n", error);
+  }
+  else {
+    cli_printf("Saved preset %u; it loads at power up\r\n", preset + 1);
+  }
+}
+
+void loadFn(EmbeddedCli *cli, char *args, void *context)
+{
+  (void)cli;
+  (void)context;
+  uint8_t preset;
+  if (embeddedCliGetTokenCount(args) != 1) {
+    cli_printf("load <preset 1-%u>\r\n", PRESET_STORE_NUM_PRESETS);
+    return;
+  }
+  if (!parse_preset(embeddedCliGetToken(args, 1), &preset)) {
+    return;
+  }
+  uint32_t length;
+  if (!preset_store_get_info(&presets, preset, &length)) {
+    cli_printf("Preset %u is empty\r\n", preset + 1);
+  }
+  else if (!load_preset(preset)) {
+    cli_printf("Preset %u is not valid\r\n", preset + 1);
+  }
+  else {
+    cli_printf("Loaded preset %u\r\n", preset + 1);
+  }
+}
+
+void presetsFn(EmbeddedCli *cli, char *args, void *context)
+{
+  (void)cli;
+  (void)args;
+  (void)context;
+  uint8_t latest = PRESET_STORE_NUM_PRESETS;
+  (void)preset_store_latest(&presets, &latest);
+  for (uint8_t preset = 0; preset < PRESET_STORE_NUM_PRESETS; preset++) {
+    uint32_t length;
+    if (!preset_store_get_info(&presets, preset, &length)) {
+      cli_printf("%u empty\r\n", preset + 1);
+    }
+    else {
+      cli_printf("%u %lu bytes%s\r\n", preset + 1, (unsigned long)length, preset == latest ? ", loads at power up" : "");
+    }
+  }
+}
+
+static void print_trigger(void)
+{
+  uint8_t in;
+  uint8_t channel;
+  if (midi_router_get_trigger(&router, &in, &channel)) {
+    cli_printf("Program Change 1-%u on %c channel %u loads presets 1-%u\r\n", PRESET_STORE_NUM_PRESETS,
+      port_to_port_id(in), channel + 1, PRESET_STORE_NUM_PRESETS);
+  }
+  else {
+    cli_printf("Program Change does not load presets\r\n");
+  }
+}
+
+void triggerFn(EmbeddedCli *cli, char *args, void *context)
+{
+  (void)cli;
+  (void)context;
+  uint16_t ntokens = embeddedCliGetTokenCount(args);
+  if (ntokens == 1 && strcmp(embeddedCliGetToken(args, 1), "off") == 0) {
+    midi_router_set_trigger(&router, MIDI_ROUTER_NO_TRIGGER, 0);
+  }
+  else if (ntokens == 2) {
+    const char* from = embeddedCliGetToken(args, 1);
+    int channel = atoi(embeddedCliGetToken(args, 2));
+    if (!is_port_valid(*from)) {
+      print_port_range_error_message("From Input", *from);
+      return;
+    }
+    if (channel < 1 || channel > 16) {
+      cli_printf("Channel numbers are 1-16\r\n");
+      return;
+    }
+    midi_router_set_trigger(&router, port_id_to_port(*from), channel - 1);
+  }
+  else if (ntokens != 0) {
+    cli_printf("trigger [off|<From port ID> <channel 1-16>]\r\n");
+    return;
+  }
+  print_trigger();
+}
+
+// Return true if token is a tempo such as 120 or 98.5; set bpm_x10 to 10
+// times it
+static bool parse_bpm(const char* token, uint16_t* bpm_x10)
+{
+  char* end;
+  unsigned long whole = strtoul(token, &end, 10);
+  unsigned long tenths = 0;
+  if (!isdigit((unsigned char)*token) || whole > MIDI_CLOCK_MAX_BPM_X10 / 10) {
+    return false;
+  }
+  if (*end == '.') {
+    if (!isdigit((unsigned char)end[1]) || end[2] != '\0') {
+      return false;
+    }
+    tenths = end[1] - '0';
+  }
+  else if (*end != '\0') {
+    return false;
+  }
+  *bpm_x10 = whole * 10 + tenths;
+  return true;
+}
+
+static void print_clock(void)
+{
+  uint16_t mode = midi_clock.wanted_mode;
+  uint32_t tempo = midi_clock.wanted_tempo;
+  uint16_t bpm_x10 = midi_clock.bpm_x10_now;
+  if ((mode >> 8) == MIDI_CLOCK_MASTER) {
+    cli_printf("Clock master at %u.%u BPM, %u PPQN\r\n", (unsigned)(tempo >> 8) / 10, (unsigned)(tempo >> 8) % 10,
+      (unsigned)(tempo & 0xff));
+  }
+  else if ((mode >> 8) == MIDI_CLOCK_FOLLOW && bpm_x10 == 0) {
+    cli_printf("Clock follows %c, no clock from it\r\n", port_to_port_id(mode & 0xff));
+  }
+  else if ((mode >> 8) == MIDI_CLOCK_FOLLOW) {
+    cli_printf("Clock follows %c at %u.%u BPM\r\n", port_to_port_id(mode & 0xff), bpm_x10 / 10, bpm_x10 % 10);
+  }
+  else {
+    cli_printf("Clock off\r\n");
+  }
+  for (uint8_t out = 0; out < NUM_MIDI_PORTS; out++) {
+    uint32_t wanted = midi_clock.wanted_output[out];
+    if ((wanted >> 24) == 0) {
+      cli_printf("%c off\r\n", port_to_port_id(out));
+    }
+    else {
+      cli_printf("%c division %lu, %lu us late\r\n", port_to_port_id(out), (unsigned long)(wanted >> 24),
+        (unsigned long)(wanted & 0xffffff));
+    }
+  }
+}
+
+void clockFn(EmbeddedCli *cli, char *args, void *context)
+{
+  (void)cli;
+  (void)context;
+  static const char usage[] = "clock [off|master [<BPM> [<PPQN>]]|follow <From port ID>|start|continue|stop|"
+    "output <To port ID> <division|off> [<offset us>]]\r\n";
+  uint16_t ntokens = embeddedCliGetTokenCount(args);
+  const char* what = ntokens == 0 ? "" : embeddedCliGetToken(args, 1);
+  bool master = (midi_clock.wanted_mode >> 8) == MIDI_CLOCK_MASTER;
+  if (ntokens == 0) {
+    print_clock();
+  }
+  else if (ntokens == 1 && strcmp(what, "off") == 0) {
+    midi_router_set_sync_input(&router, MIDI_ROUTER_NO_SYNC);
+    midi_clock_set_mode(&midi_clock, MIDI_CLOCK_OFF, 0);
+    print_clock();
+  }
+  else if (ntokens <= 3 && strcmp(what, "master") == 0) {
+    uint16_t bpm_x10 = midi_clock.wanted_tempo >> 8;
+    int ppqn = ntokens == 3 ? atoi(embeddedCliGetToken(args, 3)) : (int)(midi_clock.wanted_tempo & 0xff);
+    if ((ntokens >= 2 && !parse_bpm(embeddedCliGetToken(args, 2), &bpm_x10)) || ppqn > 0xff ||
+        !midi_clock_set_tempo(&midi_clock, bpm_x10, ppqn)) {
+      cli_printf("BPM can be %u-%u with one decimal and PPQN 24, 48, 72 or 96\r\n", MIDI_CLOCK_MIN_BPM_X10 / 10,
+        MIDI_CLOCK_MAX_BPM_X10 / 10);
+      return;
+    }
+    midi_router_set_sync_input(&router, MIDI_ROUTER_NO_SYNC);
+    midi_clock_set_mode(&midi_clock, MIDI_CLOCK_MASTER, 0);
+    print_clock();
+  }
+  else if (ntokens == 2 && strcmp(what, "follow") == 0) {
+    const char* from = embeddedCliGetToken(args, 2);
+    if (!is_port_valid(*from)) {
+      print_port_range_error_message("From Input", *from);
+      return;
+    }
+    // The input's clock goes to the follower from the next routing pass
+    midi_clock_set_mode(&midi_clock, MIDI_CLOCK_FOLLOW, port_id_to_port(*from));
+    midi_router_set_sync_input(&router, port_id_to_port(*from));
+    print_clock();
+  }
+  else if (ntokens == 1 && (strcmp(what, "start") == 0 || strcmp(what, "continue") == 0 || strcmp(what, "stop") == 0)) {
+    if (!master) {
+      cli_printf("Only the clock master starts and stops; a follower passes on its input's\r\n");
+      return;
+    }
+    uint8_t byte = strcmp(what, "start") == 0 ? 0xFA : strcmp(what, "continue") == 0 ? 0xFB : 0xFC;
+    midi_clock_transport(&midi_clock, byte);
+  }
+  else if ((ntokens == 3 || ntokens == 4) && strcmp(what, "output") == 0) {
+    const char* to = embeddedCliGetToken(args, 2);
+    const char* division = embeddedCliGetToken(args, 3);
+    if (!is_port_valid(*to)) {
+      print_port_range_error_message("To Output", *to);
+      return;
+    }
+    int value = strcmp(division, "off") == 0 ? 0 : atoi(division);
+    long offset_us = ntokens == 4 ? atol(embeddedCliGetToken(args, 4)) : 0;
+    if ((value == 0 && strcmp(division, "off") != 0) || value < 0 || offset_us < 0 ||
+        !midi_clock_set_output(&midi_clock, port_id_to_port(*to), value, offset_us)) {
+      cli_printf("Division can be off or 1-%u and offset 0-%u us\r\n", MIDI_CLOCK_MAX_DIVISION, MIDI_CLOCK_MAX_OFFSET_US);
+      return;
+    }
+    print_clock();
   }
   else {
-    printf("Disconnected %c from %c\r\n", *from, *to);
+    cli_printf("%s", usage);
+  }
+}
+
+/**
+ * @brief describe a few captured packets, then stop if a key was pressed
+ *
+ * A line is only described when it fits in the CLI output. If the host
+ * reads too slowly, the capture ring fills and the routing loop drops
+ * the packets that do not fit; the monitor says how many.
+ */
+static void monitor_task(void)
+{
+  bool stop = !tud_cdc_connected();
+  if (pending_events & EVENT_CDC_RX) {
+    if (getchar_timeout_us(0) != PICO_ERROR_TIMEOUT) {
+      stop = true;
+    }
+    else {
+      pending_events &= ~EVENT_CDC_RX;
+    }
+  }
+  for (int count = 0; count < MONITOR_LINES_PER_PASS && !stop; count++) {
+    if (cli_output_space(&cli_output) < MIDI_MONITOR_LINE_MAX) {
+      break;
+    }
+    uint32_t dropped = midi_router_capture_dropped(&router);
+    if (dropped != monitor_dropped) {
+      cli_printf("(%lu messages not shown)\r\n", (unsigned long)(dropped - monitor_dropped));
+      monitor_dropped = dropped;
+      continue;
+    }
+    midi_router_capture_t entry;
+    if (!spsc_ring_pop(&capture_ring, &entry)) {
+      break;
+    }
+    uint8_t in = midi_packet_cable(entry.packet);
+    // A packet captured just before an earlier monitor stopped may be left
+    if (monitor_inputs & (1u << in)) {
+      char line[MIDI_MONITOR_LINE_MAX];
+      size_t len = midi_monitor_format(&entry, monitor_start_us, port_to_port_id(in), line);
+      (void)cli_output_write(&cli_output, line, len);
+    }
+  }
+  if (stop) {
+    midi_router_monitor(&router, 0);
+    monitor_inputs = 0;
+    cli_printf("Monitor stopped\r\n");
+    release_held_output();
   }
 }
 
+void monitorFn(EmbeddedCli *cli, char *args, void *context)
+{
+  (void)cli;
+  (void)context;
+  uint16_t ntokens = embeddedCliGetTokenCount(args);
+  if (ntokens == 0) {
+    cli_printf("monitor <From port ID> [<From port ID> ...]\r\n");
+    return;
+  }
+  uint16_t inputs = 0;
+  for (uint16_t idx = 1; idx <= ntokens; idx++) {
+    const char* in = embeddedCliGetToken(args, idx);
+    if (!is_port_valid(*in)) {
+      print_port_range_error_message("Input", *in);
+      return;
+    }
+    inputs |= 1u << port_id_to_port(*in);
+  }
+  midi_router_capture_t entry;
+  while (spsc_ring_pop(&capture_ring, &entry)) {
+    // discard what an earlier monitor left
+  }
+  monitor_dropped = midi_router_capture_dropped(&router);
+  monitor_start_us = time_us_32();
+  cli_printf("Press any key to stop\r\n   time us IN  bytes     message\r\n");
+  // cli_task() describes the packets until a key is pressed
+  monitor_inputs = inputs;
+  midi_router_monitor(&router, inputs);
+}
+
 static void cli_init(void)
 {
   EmbeddedCliConfig cli_config = {
@@ -690,11 +2503,12 @@ static void cli_init(void)
     .rxBufferSize = 64,
     .cmdBufferSize = 64,
     .historyBufferSize = 128,
-    .maxBindingCount = 10,
+    .maxBindingCount = 20,
     .cliBuffer = NULL,
     .cliBufferSize = 0,
     .enableAutoComplete = true,
   };
+  cli_output_init(&cli_output, cli_output_storage, CLI_OUTPUT_SIZE);
   cli = embeddedCliNew(&cli_config);
   cli->onCommand = onCommandFn;
   cli->writeChar = writeCharFn;
@@ -714,23 +2528,116 @@ static void cli_init(void)
   result = embeddedCliAddBinding(cli, cmd);
   assert(result);
   cmd.name = "show";
-  cmd.help = "Show MIDI stream routing. usage: show";
-  cmd.tokenizeArgs = false;
+  cmd.help = "Show MIDI stream routing. usage: show [-c]";
+  cmd.tokenizeArgs = true;
   cmd.context = NULL;
   cmd.binding = showFn;
   result = embeddedCliAddBinding(cli, cmd);
   assert(result);
+  cmd.name = "stats";
+  cmd.help = "Show per-route latency statistics. usage: stats [reset]";
+  cmd.tokenizeArgs = true;
+  cmd.context = NULL;
+  cmd.binding = statsFn;
+  result = embeddedCliAddBinding(cli, cmd);
+  assert(result);
+  cmd.name = "counters";
+  cmd.help = "Show byte counters for every port. usage: counters [reset|json]";
+  cmd.tokenizeArgs = true;
+  cmd.context = NULL;
+  cmd.binding = countersFn;
+  result = embeddedCliAddBinding(cli, cmd);
+  assert(result);
+  cmd.name = "policy";
+  cmd.help = "Show or set what an output does when full. usage: policy [<TO port ID> [drop-newest|drop-oldest|block]]";
+  cmd.tokenizeArgs = true;
+  cmd.context = NULL;
+  cmd.binding = policyFn;
+  result = embeddedCliAddBinding(cli, cmd);
+  assert(result);
+  cmd.name = "baud";
+  cmd.help = "Show or set the wire rate of serial ports. usage: baud [<Serial port ID> [<rate>]]";
+  cmd.tokenizeArgs = true;
+  cmd.context = NULL;
+  cmd.binding = baudFn;
+  result = embeddedCliAddBinding(cli, cmd);
+  assert(result);
+  cmd.name = "delay";
+  cmd.help = "Show or set how long serial ports hold data to send it with its timing. usage: delay [<Serial port ID> [<us>|off]]";
+  cmd.tokenizeArgs = true;
+  cmd.context = NULL;
+  cmd.binding = delayFn;
+  result = embeddedCliAddBinding(cli, cmd);
+  assert(result);
+  cmd.name = "filter";
+  cmd.help = "Show or change what a route blocks. usage: filter <From port ID> <To port ID> [clear|block <type> [<channel>]|pass <type> [<channel>]]";
+  cmd.tokenizeArgs = true;
+  cmd.context = NULL;
+  cmd.binding = filterFn;
+  result = embeddedCliAddBinding(cli, cmd);
+  assert(result);
+  cmd.name = "transform";
+  cmd.help = "Show or change how a route changes channel messages. usage: transform <From port ID> <To port ID> "
+    "[clear|channel <1-16|keep>|transpose <semitones>|velocity <percent>|cc-range <min> <max>]";
+  cmd.tokenizeArgs = true;
+  cmd.context = NULL;
+  cmd.binding = transformFn;
+  result = embeddedCliAddBinding(cli, cmd);
+  assert(result);
+  cmd.name = "save";
+  cmd.help = "Save the routes, filters, transforms and policies in flash. usage: save <preset 1-8>";
+  cmd.tokenizeArgs = true;
+  cmd.context = NULL;
+  cmd.binding = saveFn;
+  result = embeddedCliAddBinding(cli, cmd);
+  assert(result);
+  cmd.name = "load";
+  cmd.help = "Load the routes, filters, transforms and policies from flash. usage: load <preset 1-8>";
+  cmd.tokenizeArgs = true;
+  cmd.context = NULL;
+  cmd.binding = loadFn;
+  result = embeddedCliAddBinding(cli, cmd);
+  assert(result);
+  cmd.name = "presets";
+  cmd.help = "List the presets saved in flash. usage: presets";
+  cmd.tokenizeArgs = false;
+  cmd.context = NULL;
+  cmd.binding = presetsFn;
+  result = embeddedCliAddBinding(cli, cmd);
+  assert(result);
+  cmd.name = "trigger";
+  cmd.help = "Show or set where Program Change loads presets. usage: trigger [off|<From port ID> <channel 1-16>]";
+  cmd.tokenizeArgs = true;
+  cmd.context = NULL;
+  cmd.binding = triggerFn;
+  result = embeddedCliAddBinding(cli, cmd);
+  assert(result);
+  cmd.name = "monitor";
+  cmd.help = "Show the messages that arrive on inputs until a key is pressed. usage: monitor <From port ID> [<From port ID> ...]";
+  cmd.tokenizeArgs = true;
+  cmd.context = NULL;
+  cmd.binding = monitorFn;
+  result = embeddedCliAddBinding(cli, cmd);
+  assert(result);
+  cmd.name = "clock";
+  cmd.help = "Show or set the MIDI clock master or follower. usage: clock [off|master [<BPM> [<PPQN>]]|"
+    "follow <From port ID>|start|continue|stop|output <To port ID> <division|off> [<offset us>]]";
+  cmd.tokenizeArgs = true;
+  cmd.context = NULL;
+  cmd.binding = clockFn;
+  result = embeddedCliAddBinding(cli, cmd);
+  assert(result);
 
   (void)result;
 }
 
 void printWelcome(void)
 {
-    printf("\r\n\r\n");
-    printf("Cli is running.\r\n");
-    printf("Type \"help\" for a list of commands\r\n");
-    printf("Use backspace and tab to remove chars and autocomplete\r\n");
-    printf("Use up and down arrows to recall previous commands\r\n\r\n");
+    cli_printf("\r\n\r\n");
+    cli_printf("Cli is running.\r\n");
+    cli_printf("Type \"help\" for a list of commands\r\n");
+    cli_printf("Use backspace and tab to remove chars and autocomplete\r\n");
+    cli_printf("Use up and down arrows to recall previous commands\r\n\r\n");
     print_port_id_description();
     embeddedCliReceiveChar(cli, '\r');
     embeddedCliProcess(cli);
@@ -752,4 +2659,5 @@ void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts)
 void tud_cdc_rx_cb(uint8_t itf)
 {
   (void) itf;
+  pending_events |= EVENT_CDC_RX;
 }
@@ -0,0 +1,594 @@
+/**
+ * @file midi_bench.c
+ * @brief replay synthetic MIDI workloads through the router and measure it
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "midi_bench.h"
+
+// The simulated main loop runs once per tick
+#define MIDI_BENCH_TICK_US 100
+// How long the workloads that do not end on their own generate data
+#define MIDI_BENCH_DURATION_US 1000000
+// Give up on draining the queues after this long
+#define MIDI_BENCH_MAX_DURATION_US 30000000
+#define MIDI_BENCH_SYSEX_LEN 65536
+// The USB IN model: like TinyUSB, the driver starts a transfer of what is
+// in its FIFO, up to one full speed endpoint buffer, as soon as the
+// endpoint is free. The host completes one transfer on the endpoint at
+// a time, at most one per poll interval; a full speed host fits a few
+// bulk transactions in each 1 ms frame.
+#define MIDI_BENCH_USB_POLL_US 200
+#define MIDI_BENCH_USB_FIFO_PACKETS 16
+// Packets that USB outputs accepted and the host has not received yet
+#define MIDI_BENCH_USB_UNSENT_LEN 64
+// The data a sender has ready that the input has not read yet
+#define MIDI_BENCH_PENDING_LEN 128
+// The most bytes read from one input per tick, as in the firmware
+#define MIDI_BENCH_READ_LEN 48
+
+/**
+ * @brief make the next message of a source
+ *
+ * @param in the input port
+ * @param seq the number of messages the source made before this one
+ * @param message the message bytes
+ * @return the number of bytes in message, or 0 if the source is done
+ */
+typedef uint8_t (*bench_message_fn)(uint8_t in, uint32_t seq, uint8_t message[3]);
+
+typedef struct {
+  bench_message_fn message; // NULL if the input is idle
+  uint32_t period_us;
+  uint32_t next_us;         // when the next message is due
+  uint32_t seq;
+  // The sender holds its messages and sends them every burst_us
+  // (0 for at once). A timed sender tells when each message is meant to
+  // go out; its messages must all be 3 bytes long.
+  uint32_t burst_us;
+  bool timed;
+  uint32_t nread;           // timed sender: messages read
+  uint32_t jitter_us;       // each message goes out up to this much after its time
+  bool done;
+  uint8_t pending[MIDI_BENCH_PENDING_LEN];
+  uint16_t head;
+  uint16_t count;
+} bench_source_t;
+
+typedef struct {
+  // Serial outputs only
+  uint32_t wire_idle_us; // when the bytes written so far will have left the wire
+  uint32_t byte_us;
+  uint8_t lead_bytes;
+} bench_output_t;
+
+static const char* const workload_names[MIDI_BENCH_NUM_WORKLOADS] = {
+  "cc-sweep", "mpe-bend", "sysex-dump", "clock-24", "clock-96", "merge", "cc-filter", "merge-flood",
+  "timed-burst", "clock-master", "clock-follow",
+};
+
+static const midi_bench_config_t* bench_config;
+static midi_router_t bench_router;
+static midi_merger_t bench_mergers[MIDI_ROUTER_MAX_PORTS];
+static bench_source_t sources[MIDI_ROUTER_MAX_PORTS];
+static bench_output_t outputs[MIDI_ROUTER_MAX_PORTS];
+static timer_wheel_t bench_wheels[MIDI_ROUTER_MAX_PORTS];
+static uint32_t simulated_us;
+static midi_clock_t bench_clock;
+// The ticks on the measured clock output
+static route_stats_t* clock_jitter;
+static uint8_t clock_output;
+static uint32_t clock_period_us;
+static uint32_t last_tick_us;
+static bool ticked;
+static usb_aggregator_t usb_aggregator;
+static uint8_t usb_aggregator_storage[MIDI_BENCH_USB_FIFO_PACKETS * 4];
+static struct {
+  uint16_t fifo;      // packets in the driver FIFO
+  uint16_t in_flight; // packets in the transfer the host has not completed
+  uint32_t accepted_us[MIDI_BENCH_USB_UNSENT_LEN]; // when each unsent packet was accepted, oldest first
+  uint16_t head;
+  uint16_t count;
+} usb;
+
+static uint32_t simulated_clock(void)
+{
+  return simulated_us;
+}
+
+static uint8_t cc_sweep_message(uint8_t in, uint32_t seq, uint8_t message[3])
+{
+  (void)in;
+  message[0] = 0xB0 | (seq & 0xf);
+  message[1] = 1; // modulation wheel
+  message[2] = (seq >> 4) & 0x7f;
+  return 3;
+}
+
+static uint8_t mpe_bend_message(uint8_t in, uint32_t seq, uint8_t message[3])
+{
+  (void)in;
+  // Channel 1 is the MPE manager channel; 2-16 carry one note each
+  uint8_t channel = 1 + seq % 15;
+  uint32_t step = seq / 15;
+  if (step % 50 == 0) {
+    message[0] = ((step / 50) & 1 ? 0x80 : 0x90) | channel;
+    message[1] = 48 + channel;
+    message[2] = 100;
+  }
+  else {
+    uint16_t bend = (step * 331) & 0x3fff;
+    message[0] = 0xE0 | channel;
+    message[1] = bend & 0x7f;
+    message[2] = bend >> 7;
+  }
+  return 3;
+}
+
+static uint8_t sysex_dump_message(uint8_t in, uint32_t seq, uint8_t message[3])
+{
+  (void)in;
+  uint8_t nbytes = 0;
+  for (uint32_t pos = seq * 3; nbytes < 3 && pos < MIDI_BENCH_SYSEX_LEN; pos++) {
+    if (pos == 0) {
+      message[nbytes++] = 0xF0;
+    }
+    else if (pos == 1) {
+      message[nbytes++] = 0x7D; // non-commercial manufacturer ID
+    }
+    else if (pos == MIDI_BENCH_SYSEX_LEN - 1) {
+      message[nbytes++] = 0xF7;
+    }
+    else {
+      message[nbytes++] = pos & 0x7f;
+    }
+  }
+  return nbytes;
+}
+
+static uint8_t clock_message(uint8_t in, uint32_t seq, uint8_t message[3])
+{
+  (void)in;
+  (void)seq;
+  message[0] = 0xF8;
+  return 1;
+}
+
+static uint8_t note_message(uint8_t in, uint32_t seq, uint8_t message[3])
+{
+  message[0] = (seq & 1 ? 0x80 : 0x90) | (in & 0xf);
+  message[1] = 36 + in;
+  message[2] = 100;
+  return 3;
+}
+
+static void set_source(uint8_t in, bench_message_fn message, uint32_t period_us)
+{
+  sources[in].message = message;
+  sources[in].period_us = period_us;
+}
+
+// Return how late a jittery source sends its message seq; a hash keeps
+// the delays random-looking but the same every run
+static uint32_t source_jitter(const bench_source_t* src, uint32_t seq)
+{
+  return src->jitter_us == 0 ? 0 : ((seq * 2654435761u) >> 16) % src->jitter_us;
+}
+
+static void send_clock(void* context, uint8_t out, uint8_t byte, uint32_t time_us)
+{
+  (void)context;
+  uint8_t in = bench_clock.mode == MIDI_CLOCK_FOLLOW ? bench_clock.input : out;
+  uint8_t packet[4] = {(uint8_t)((in << 4) | MIDI_CIN_REALTIME), byte, 0, 0};
+  (void)midi_router_inject(&bench_router, out, packet, time_us);
+}
+
+static void clock_sync(void* context, uint8_t byte, uint32_t timestamp)
+{
+  (void)context;
+  midi_clock_receive(&bench_clock, byte, timestamp);
+}
+
+// Measure the clock ticks on an output
+static void measure_clock(uint8_t out, uint32_t period_us)
+{
+  clock_output = out;
+  clock_period_us = period_us;
+}
+
+// Set the sources and routes of a workload. Port usb0 and usb1 are the
+// first two USB ports; serial0 and serial1 the serial ports of the config.
+static void set_up_workload(midi_bench_workload_t workload)
+{
+  uint8_t usb0 = 0;
+  uint8_t usb1 = 1;
+  uint8_t serial0 = bench_config->serial_ports[0];
+  uint8_t serial1 = bench_config->serial_ports[1];
+  switch (workload) {
+  case MIDI_BENCH_CC_FILTER: {
+    midi_router_filter_t filter = {{0}};
+    for (uint8_t channel = 8; channel < 16; channel++) {
+      midi_router_filter_set(&filter, MIDI_ROUTER_CHANNEL_CLASS(0xB0 | channel), true);
+    }
+    midi_router_set_filter(&bench_router, usb0, serial0, &filter);
+  }
+  // fall through
+  case MIDI_BENCH_CC_SWEEP:
+  case MIDI_BENCH_MPE_BEND:
+  case MIDI_BENCH_SYSEX_DUMP:
+    if (workload == MIDI_BENCH_CC_SWEEP || workload == MIDI_BENCH_CC_FILTER) {
+      set_source(usb0, cc_sweep_message, 250);
+    }
+    else if (workload == MIDI_BENCH_MPE_BEND) {
+      set_source(usb0, mpe_bend_message, 133); // each note is bent every 2 ms
+    }
+    else {
+      set_source(usb0, sysex_dump_message, 63); // 16 packets per USB frame
+    }
+    midi_router_connect(&bench_router, usb0, usb1);
+    midi_router_connect(&bench_router, usb0, serial0);
+    break;
+  case MIDI_BENCH_CLOCK_24:
+  case MIDI_BENCH_CLOCK_96:
+    // One clock tick every 60 s / (120 BPM * PPQN)
+    set_source(serial0, clock_message, workload == MIDI_BENCH_CLOCK_24 ? 20833 : 5208);
+    set_source(usb0, note_message, 1000);
+    midi_router_connect(&bench_router, serial0, usb1);
+    midi_router_connect(&bench_router, serial0, serial1);
+    midi_router_connect(&bench_router, usb0, usb1);
+    midi_router_connect(&bench_router, usb0, serial1);
+    measure_clock(serial1, sources[serial0].period_us);
+    break;
+  case MIDI_BENCH_CLOCK_MASTER:
+    // The clock-24 notes, with the clock made here instead of routed
+    set_source(usb0, note_message, 1000);
+    midi_router_connect(&bench_router, usb0, serial1);
+    for (uint8_t out = 0; out < bench_config->num_ports; out++) {
+      (void)midi_clock_set_output(&bench_clock, out, out == serial1 ? 1 : 0, 0);
+    }
+    midi_clock_set_mode(&bench_clock, MIDI_CLOCK_MASTER, 0);
+    midi_clock_transport(&bench_clock, 0xFA);
+    measure_clock(serial1, 20833);
+    break;
+  case MIDI_BENCH_CLOCK_FOLLOW:
+    // The clock-24 clock arrives up to 1 ms late, as if merged with other
+    // data upstream; the follower sends it where serial0 is routed
+    set_source(serial0, clock_message, 20833);
+    sources[serial0].jitter_us = MIDI_CLOCK_FOLLOW_DELAY_US;
+    set_source(usb0, note_message, 1000);
+    midi_router_connect(&bench_router, serial0, serial1);
+    midi_router_connect(&bench_router, usb0, serial1);
+    midi_router_set_sync_input(&bench_router, serial0);
+    midi_clock_set_mode(&bench_clock, MIDI_CLOCK_FOLLOW, serial0);
+    measure_clock(serial1, 20833);
+    break;
+  case MIDI_BENCH_MERGE_FLOOD:
+    // USB IN 1 offers ten times what the wire carries; the other inputs
+    // send a note message every 50 ms, less than a third of the wire
+    set_source(usb0, cc_sweep_message, 100);
+    midi_router_connect(&bench_router, usb0, serial0);
+    for (uint8_t in = 1; in < bench_config->num_ports; in++) {
+      set_source(in, note_message, 50000);
+      midi_router_connect(&bench_router, in, serial0);
+    }
+    break;
+  case MIDI_BENCH_TIMED_BURST:
+    // A sequencer plays a controller every 1.25 ms but its driver sends
+    // them to USB 5 ms at a time, each with the time it was meant for
+    set_source(usb0, cc_sweep_message, 1250);
+    sources[usb0].burst_us = 5000;
+    sources[usb0].timed = true;
+    midi_router_connect(&bench_router, usb0, serial0);
+    break;
+  case MIDI_BENCH_MERGE:
+  default:
+    for (uint8_t in = 0; in < bench_config->num_ports; in++) {
+      set_source(in, note_message, 25000);
+      midi_router_connect(&bench_router, in, serial0);
+    }
+    break;
+  }
+}
+
+static void start_usb_transfer(void)
+{
+  usb.in_flight = usb.fifo;
+  usb.fifo = 0;
+}
+
+// The driver takes what fits in its FIFO. tud_midi_packet_write_n(), which
+// the firmware uses, starts one transfer for the whole batch;
+// tud_midi_packet_write() starts one after every packet, so on an idle
+// endpoint the first packet of a batch goes alone.
+static uint32_t usb_driver_write(void* context, const uint8_t* packets, uint32_t npackets)
+{
+  (void)context;
+  (void)packets;
+  uint32_t room = MIDI_BENCH_USB_FIFO_PACKETS - usb.fifo;
+  npackets = npackets < room ? npackets : room;
+  for (uint32_t idx = 0; idx < npackets; idx++) {
+    usb.fifo++;
+    if (bench_config->usb_write_per_packet && usb.in_flight == 0) {
+      start_usb_transfer();
+    }
+  }
+  if (usb.in_flight == 0) {
+    start_usb_transfer();
+  }
+  return npackets;
+}
+
+// The host completes the transfer in flight once per poll interval
+static void poll_usb_host(midi_bench_result_t* result)
+{
+  if (simulated_us % MIDI_BENCH_USB_POLL_US != 0 || usb.in_flight == 0) {
+    return;
+  }
+  result->usb_transfers++;
+  for (uint16_t idx = 0; idx < usb.in_flight; idx++) {
+    route_stats_record(&result->usb_delivery, simulated_us - usb.accepted_us[usb.head]);
+    usb.head = (usb.head + 1) % MIDI_BENCH_USB_UNSENT_LEN;
+    usb.count--;
+  }
+  usb.in_flight = 0;
+  if (usb.fifo != 0) {
+    start_usb_transfer();
+  }
+}
+
+static uint32_t usb_write(void* handle, const uint8_t* packet, uint32_t nbytes)
+{
+  (void)handle;
+  if (!usb_aggregator_add(&usb_aggregator, packet, simulated_us)) {
+    return 0;
+  }
+  usb.accepted_us[(usb.head + usb.count++) % MIDI_BENCH_USB_UNSENT_LEN] = simulated_us;
+  return nbytes;
+}
+
+// The same pacing as the firmware: a serial port may run only a few
+// bytes ahead of the wire
+static uint32_t serial_write(void* handle, const uint8_t* buffer, uint32_t nbytes)
+{
+  bench_output_t* out = (bench_output_t*)handle;
+  uint32_t byte_us = out->byte_us;
+  if ((int32_t)(out->wire_idle_us - simulated_us) < 0) {
+    out->wire_idle_us = simulated_us;
+  }
+  uint32_t nahead = (out->wire_idle_us - simulated_us + byte_us - 1) / byte_us;
+  uint32_t room = nahead < out->lead_bytes ? out->lead_bytes - nahead : 0;
+  nbytes = nbytes < room ? nbytes : room;
+  for (uint32_t idx = 0; idx < nbytes && clock_period_us != 0 && out == outputs + clock_output; idx++) {
+    if (buffer[idx] == 0xF8) {
+      uint32_t tick_us = out->wire_idle_us + idx * byte_us;
+      uint32_t interval_us = tick_us - last_tick_us;
+      if (ticked) {
+        route_stats_record(clock_jitter, interval_us > clock_period_us ? interval_us - clock_period_us :
+          clock_period_us - interval_us);
+      }
+      last_tick_us = tick_us;
+      ticked = true;
+    }
+  }
+  out->wire_idle_us += nbytes * byte_us;
+  return nbytes;
+}
+
+static void release_to_merger(void* context, const midi_merger_entry_t* entry)
+{
+  midi_router_push(&bench_router, (uint8_t)(uintptr_t)context, entry->packet, entry->timestamp);
+}
+
+static void init_outputs(void)
+{
+  midi_merger_entry_t* queue = bench_config->queue_pool;
+  timer_wheel_entry_t* wheel_pool = bench_config->wheel_pool;
+  for (uint8_t port = 0; port < bench_config->num_ports; port++) {
+    midi_merger_t* merger = bench_mergers + port;
+    bench_output_t* out = outputs + port;
+    out->wire_idle_us = 0;
+    out->byte_us = bench_config->serial_byte_us[port];
+    out->lead_bytes = bench_config->serial_tx_lead_bytes[port];
+    if (port < bench_config->num_usb_ports) {
+      midi_merger_init(merger, usb_write, out, queue, bench_config->usb_queue_len);
+      midi_merger_set_packet_output(merger, true);
+      queue += bench_config->usb_queue_len;
+    }
+    else {
+      midi_merger_init(merger, serial_write, out, queue, bench_config->serial_queue_len);
+      midi_merger_set_running_status(merger, true);
+      midi_merger_set_realtime_between_bytes(merger, true);
+      midi_merger_set_sysex_flow_control(merger, bench_config->serial_sysex_flow_control);
+      midi_merger_set_fair(merger, bench_config->serial_fair);
+      queue += bench_config->serial_queue_len;
+      timer_wheel_init(bench_wheels + port, wheel_pool, bench_config->wheel_len, release_to_merger,
+        (void*)(uintptr_t)port, simulated_us);
+      midi_router_set_wheel(&bench_router, port, bench_wheels + port);
+      (void)midi_router_set_delay(&bench_router, port, bench_config->serial_delay_us);
+      wheel_pool += bench_config->wheel_len;
+    }
+    midi_merger_set_policy(merger, bench_config->policy[port]);
+    midi_router_set_output(&bench_router, port, merger, false);
+  }
+}
+
+// Move the messages that are due from each source to its pending data
+static void generate(bool generating)
+{
+  for (uint8_t in = 0; in < bench_config->num_ports; in++) {
+    bench_source_t* src = sources + in;
+    if (src->message == NULL || src->done) {
+      continue;
+    }
+    if (!generating && src->message != sysex_dump_message) {
+      src->done = true;
+      continue;
+    }
+    uint32_t send_us = src->burst_us == 0 ? simulated_us : simulated_us - simulated_us % src->burst_us;
+    while ((int32_t)(src->next_us + source_jitter(src, src->seq) - send_us) <= 0) {
+      uint8_t message[3];
+      uint8_t nbytes = src->message(in, src->seq, message);
+      if (nbytes == 0) {
+        src->done = true;
+        break;
+      }
+      if (src->count + nbytes > MIDI_BENCH_PENDING_LEN) {
+        break; // the sender waits for the input, like a USB host does
+      }
+      for (uint8_t idx = 0; idx < nbytes; idx++) {
+        src->pending[(src->head + src->count++) % MIDI_BENCH_PENDING_LEN] = message[idx];
+      }
+      src->seq++;
+      src->next_us += src->period_us;
+    }
+  }
+}
+
+// Route the messages of a timed sender one at a time, each at the time
+// it was meant for, like the firmware does with USB data after a time
+// message
+static void read_timed_input(midi_router_pass_t* pass, uint8_t in)
+{
+  bench_source_t* src = sources + in;
+  uint32_t max = src->count < MIDI_BENCH_READ_LEN ? src->count : MIDI_BENCH_READ_LEN;
+  uint32_t nread = max == 0 ? 0 : midi_router_read_limit(pass, in, in, max);
+  nread -= nread % 3;
+  if (nread != 0) {
+    midi_router_count_received(&bench_router, in, nread);
+  }
+  for (uint32_t pos = 0; pos < nread; pos += 3) {
+    uint8_t message[3];
+    for (uint8_t idx = 0; idx < 3; idx++) {
+      message[idx] = src->pending[src->head];
+      src->head = (src->head + 1) % MIDI_BENCH_PENDING_LEN;
+    }
+    src->count -= 3;
+    pass->timestamp = src->nread++ * src->period_us;
+    pass->target = pass->timestamp;
+    midi_parser_parse(bench_router.parsers + in, message, 3, midi_router_route, pass);
+  }
+}
+
+// Read each input as far as the routes allow, like the firmware does
+static void read_inputs(midi_router_pass_t* pass)
+{
+  for (uint8_t in = 0; in < bench_config->num_ports; in++) {
+    bench_source_t* src = sources + in;
+    if (src->timed) {
+      read_timed_input(pass, in);
+      continue;
+    }
+    uint32_t contiguous = MIDI_BENCH_PENDING_LEN - src->head;
+    uint32_t max = src->count < contiguous ? src->count : contiguous;
+    max = max < MIDI_BENCH_READ_LEN ? max : MIDI_BENCH_READ_LEN;
+    uint32_t nread = max == 0 ? 0 : midi_router_read_limit(pass, in, in, max);
+    midi_router_parse(pass, in, src->pending + src->head, nread);
+    src->head = (src->head + nread) % MIDI_BENCH_PENDING_LEN;
+    src->count -= nread;
+  }
+}
+
+static bool is_idle(void)
+{
+  for (uint8_t port = 0; port < bench_config->num_ports; port++) {
+    const bench_source_t* src = sources + port;
+    const midi_merger_t* merger = bench_mergers + port;
+    if ((src->message != NULL && !src->done) || src->count != 0 || merger->count != 0 ||
+        merger->ndeferred != 0 || merger->realtime_count != 0 || merger->pending_idx < merger->npending ||
+        (port >= bench_config->num_usb_ports && bench_wheels[port].count != 0)) {
+      return false;
+    }
+  }
+  uint32_t due_us;
+  return usb.count == 0 && !midi_clock_next_due(&bench_clock, &due_us);
+}
+
+const char* midi_bench_workload_name(midi_bench_workload_t workload)
+{
+  return workload < MIDI_BENCH_NUM_WORKLOADS ? workload_names[workload] : "";
+}
+
+bool midi_bench_find_workload(const char* name, midi_bench_workload_t* workload)
+{
+  for (uint8_t idx = 0; idx < MIDI_BENCH_NUM_WORKLOADS; idx++) {
+    if (strcmp(name, workload_names[idx]) == 0) {
+      *workload = (midi_bench_workload_t)idx;
+      return true;
+    }
+  }
+  return false;
+}
+
+void midi_bench_run(const midi_bench_config_t* config, midi_bench_workload_t workload, midi_bench_result_t* result)
+{
+  bench_config = config;
+  simulated_us = 0;
+  memset(&usb, 0, sizeof(usb));
+  usb_aggregator_init(&usb_aggregator, usb_aggregator_storage, MIDI_BENCH_USB_FIFO_PACKETS, config->usb_flush_deadline_us,
+    usb_driver_write, NULL);
+  result->usb_transfers = 0;
+  route_stats_reset(&result->usb_delivery);
+  memset(sources, 0, sizeof(sources));
+  route_stats_reset(&result->clock_jitter);
+  clock_jitter = &result->clock_jitter;
+  clock_period_us = 0;
+  ticked = false;
+  midi_router_init(&bench_router, config->num_ports, simulated_clock);
+  midi_clock_init(&bench_clock, config->num_ports, send_clock, NULL);
+  midi_router_set_sync_cb(&bench_router, clock_sync, NULL);
+  init_outputs();
+  set_up_workload(workload);
+  midi_router_publish(&bench_router);
+  // Apply the clock settings of the workload before its first input
+  midi_clock_task(&bench_clock, simulated_us, (1u << config->num_ports) - 1);
+  uint32_t start_us = config->cpu_clock();
+  do {
+    simulated_us += MIDI_BENCH_TICK_US;
+    poll_usb_host(result);
+    generate(simulated_us < MIDI_BENCH_DURATION_US);
+    midi_router_pass_t pass;
+    midi_router_begin(&bench_router, &pass, (1u << config->num_ports) - 1);
+    read_inputs(&pass);
+    if (simulated_us >= MIDI_BENCH_DURATION_US && bench_clock.mode == MIDI_CLOCK_MASTER) {
+      midi_clock_set_mode(&bench_clock, MIDI_CLOCK_OFF, 0);
+    }
+    uint16_t clock_outputs = pass.enabled_outputs;
+    if (bench_clock.mode == MIDI_CLOCK_FOLLOW) {
+      clock_outputs = midi_router_outputs_of(&pass, bench_clock.input, MIDI_ROUTER_SYSTEM_CLASS(0xF8));
+    }
+    midi_clock_task(&bench_clock, simulated_us, clock_outputs);
+    midi_router_release(&bench_router, simulated_us);
+    for (uint8_t port = 0; port < config->num_ports; port++) {
+      midi_merger_flush(bench_mergers + port);
+    }
+    usb_aggregator_poll(&usb_aggregator, simulated_us);
+    midi_router_end(&pass);
+  } while (!is_idle() && simulated_us < MIDI_BENCH_MAX_DURATION_US);
+  result->cpu_us = config->cpu_clock() - start_us;
+  result->duration_us = simulated_us;
+  result->router = &bench_router;
+  result->clock_output = clock_output;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file midi_bench.h
+ * @brief replay synthetic MIDI workloads through the router and measure it
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MIDI_BENCH_H
+#define MIDI_BENCH_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "midi_merger.h"
+#include "midi_router.h"
+#include "usb_aggregator.h"
+#include "timer_wheel.h"
+#include "midi_clock.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+typedef enum {
+  MIDI_BENCH_CC_SWEEP,   // 16 channels of controller sweeps from one USB input
+  MIDI_BENCH_MPE_BEND,   // MPE-style per-note pitch bend on 15 member channels
+  MIDI_BENCH_SYSEX_DUMP, // one 64 KB SysEx patch dump
+  MIDI_BENCH_CLOCK_24,   // 24 PPQN clock at 120 BPM merged with dense notes
+  MIDI_BENCH_CLOCK_96,   // 96 PPQN clock at 120 BPM merged with dense notes
+  MIDI_BENCH_MERGE,      // every input merged into one serial output
+  MIDI_BENCH_CC_FILTER,  // cc-sweep with half the channels filtered from the serial route
+  MIDI_BENCH_MERGE_FLOOD, // one input floods a serial output that other inputs send sparse notes to
+  MIDI_BENCH_TIMED_BURST, // evenly timed controllers that arrive in bursts, sent to a serial output
+  MIDI_BENCH_CLOCK_MASTER, // the clock master at 120 BPM sends to a serial output shared with dense notes
+  MIDI_BENCH_CLOCK_FOLLOW, // the clock follower re-sends a jittery 120 BPM clock to that output
+  MIDI_BENCH_NUM_WORKLOADS
+} midi_bench_workload_t;
+
+/**
+ * @brief The ports and queues to model. Ports 0 to num_usb_ports-1
+ * behave like USB cables: whole packets that share one endpoint. The
+ * rest behave like serial MIDI OUTs with running status and a short TX
+ * ring, each at its own wire rate. At least two ports of each kind are
+ * needed.
+ */
+typedef struct {
+  uint8_t num_ports;
+  uint8_t num_usb_ports;
+  uint16_t usb_queue_len;
+  uint16_t serial_queue_len;
+  // room for num_usb_ports * usb_queue_len plus
+  // (num_ports - num_usb_ports) * serial_queue_len entries
+  midi_merger_entry_t* queue_pool;
+  uint32_t serial_byte_us[MIDI_ROUTER_MAX_PORTS];      // wire time of one byte on each serial port
+  uint8_t serial_tx_lead_bytes[MIDI_ROUTER_MAX_PORTS]; // the most bytes each serial port may have ahead of the wire
+  uint8_t serial_ports[2];      // the two serial ports the workloads use
+  midi_merger_policy_t policy[MIDI_ROUTER_MAX_PORTS]; // of each output
+  bool serial_sysex_flow_control; // see midi_merger_set_sysex_flow_control()
+  bool serial_fair;               // see midi_merger_set_fair()
+  uint32_t serial_delay_us;       // see midi_router_set_delay(); 0 sends at once
+  // room for (num_ports - num_usb_ports) * wheel_len entries
+  timer_wheel_entry_t* wheel_pool;
+  uint16_t wheel_len;
+  uint32_t usb_flush_deadline_us; // the longest a packet waits to share a USB transfer; see usb_aggregator_t
+  bool usb_write_per_packet;      // hand the driver one packet at a time, as tud_midi_packet_write() does
+  midi_router_clock_fn cpu_clock; // a real clock to time the run
+} midi_bench_config_t;
+
+/**
+ * Route latency is counted from when an input read a packet, except for
+ * the timed-burst workload, where it is counted from when the sender
+ * meant the packet to go out; its spread is then the timing error.
+ *
+ * The clock workloads measure the tick jitter on one serial output: how
+ * far each interval between the wire times of two ticks is from the
+ * period of the tempo. Its resolution is the 100 us of the simulated
+ * main loop.
+ */
+typedef struct {
+  uint32_t duration_us; // simulated time until the workload was done and every queue was empty
+  uint32_t cpu_us;      // real time the run took
+  uint32_t usb_transfers; // USB IN transfers the host completed
+  // Latency of each packet sent to USB from the time its USB output
+  // accepted it until the host received it
+  route_stats_t usb_delivery;
+  uint8_t clock_output;       // the output whose ticks were measured
+  route_stats_t clock_jitter; // empty for workloads without clock
+  // The counters and latency statistics of the run; valid until the next run
+  const midi_router_t* router;
+} midi_bench_result_t;
+
+/**
+ * @brief return the name of a workload, e.g., "cc-sweep"
+ */
+const char* midi_bench_workload_name(midi_bench_workload_t workload);
+
+/**
+ * @brief find a workload by name
+ *
+ * @return true if name names a workload
+ */
+bool midi_bench_find_workload(const char* name, midi_bench_workload_t* workload);
+
+/**
+ * @brief run one workload to completion
+ *
+ * The workload runs on a private router with private mergers and a
+ * simulated clock, so the results do not depend on the live routes or
+ * on real MIDI traffic and the same workload always produces the same
+ * counters and latencies. Only cpu_us depends on the processor.
+ *
+ * @param config the ports and queues to model
+ * @param workload the workload to run
+ * @param result the results of the run
+ */
+void midi_bench_run(const midi_bench_config_t* config, midi_bench_workload_t workload, midi_bench_result_t* result);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
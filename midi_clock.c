@@ -0,0 +1,316 @@
+/**
+ * @file midi_clock.c
+ * @brief generate MIDI clock, or follow an incoming one, and send it to outputs
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "midi_clock.h"
+
+#define NO_TRANSPORT 0
+
+void midi_clock_init(midi_clock_t* clock, uint8_t num_ports, midi_clock_send_fn send, void* context)
+{
+  memset(clock, 0, sizeof(*clock));
+  clock->send = send;
+  clock->context = context;
+  clock->num_ports = num_ports;
+  clock->wanted_mode = MIDI_CLOCK_OFF << 8;
+  clock->wanted_tempo = 1200 << 8 | MIDI_CLOCK_WIRE_PPQN;
+  for (uint8_t out = 0; out < MIDI_CLOCK_MAX_PORTS; out++) {
+    clock->wanted_output[out] = 1u << 24;
+  }
+  clock->wanted_transport = NO_TRANSPORT;
+  clock->mode = MIDI_CLOCK_OFF;
+}
+
+void midi_clock_set_mode(midi_clock_t* clock, midi_clock_mode_t mode, uint8_t input)
+{
+  clock->wanted_mode = (uint16_t)(mode << 8 | input);
+}
+
+bool midi_clock_set_tempo(midi_clock_t* clock, uint16_t bpm_x10, uint8_t ppqn)
+{
+  if (bpm_x10 < MIDI_CLOCK_MIN_BPM_X10 || bpm_x10 > MIDI_CLOCK_MAX_BPM_X10 || ppqn == 0 ||
+      ppqn % MIDI_CLOCK_WIRE_PPQN != 0 || ppqn > 96) {
+    return false;
+  }
+  clock->wanted_tempo = (uint32_t)bpm_x10 << 8 | ppqn;
+  return true;
+}
+
+bool midi_clock_set_output(midi_clock_t* clock, uint8_t out, uint8_t division, uint32_t offset_us)
+{
+  if (out >= clock->num_ports || division > MIDI_CLOCK_MAX_DIVISION || offset_us > MIDI_CLOCK_MAX_OFFSET_US) {
+    return false;
+  }
+  clock->wanted_output[out] = (uint32_t)division << 24 | offset_us;
+  return true;
+}
+
+void midi_clock_transport(midi_clock_t* clock, uint8_t byte)
+{
+  clock->wanted_transport = byte;
+}
+
+// Make the next tick an output sends the first one on or after tick
+// that is a whole number of divisions after the start
+static void align_output(midi_clock_t* clock, uint8_t out, uint32_t tick)
+{
+  uint8_t division = clock->division[out];
+  uint32_t since_start = tick - clock->start_tick;
+  clock->next[out] = tick + (division - since_start % division) % division;
+}
+
+// Return true if a tick is waiting for its time and set due_us to it.
+// A follower's tick waits for the input tick.
+static bool tick_due(const midi_clock_t* clock, uint32_t* due_us)
+{
+  if (clock->mode == MIDI_CLOCK_MASTER) {
+    *due_us = clock->due_us;
+    return true;
+  }
+  uint32_t index = clock->ticks - clock->base;
+  if (clock->mode == MIDI_CLOCK_OFF || index >= clock->received) {
+    return false;
+  }
+  if (index + 1 < clock->received) {
+    *due_us = clock->last_in_us; // the next one is in already: no time to wait
+  }
+  else {
+    *due_us = clock->expected_us[index % MIDI_CLOCK_HISTORY] + MIDI_CLOCK_FOLLOW_DELAY_US;
+  }
+  return true;
+}
+
+// Make the ticks that are due; with all, also the ones a follower has
+// received and the master's next one
+static void make_ticks(midi_clock_t* clock, uint32_t now_us, bool all)
+{
+  uint32_t due_us;
+  while (tick_due(clock, &due_us) && (all || (int32_t)(due_us - now_us) <= 0)) {
+    if ((int32_t)(due_us - now_us) > 0) {
+      due_us = now_us;
+    }
+    clock->tick_us[clock->ticks % MIDI_CLOCK_HISTORY] = due_us;
+    clock->ticks++;
+    if (clock->mode == MIDI_CLOCK_MASTER) {
+      uint32_t step = clock->due_frac + clock->period_q8;
+      clock->due_us = due_us + (step >> 8);
+      clock->due_frac = step & 0xff;
+      if ((int32_t)(now_us - clock->due_us) > (int32_t)(clock->period_q8 >> 8) * MIDI_CLOCK_HISTORY) {
+        clock->due_us = now_us; // far behind, e.g., after flash was written: skip the missed ticks
+      }
+      if (all) {
+        break;
+      }
+    }
+  }
+}
+
+// Return when an output's next tick is due
+static uint32_t output_due(const midi_clock_t* clock, uint8_t out)
+{
+  return clock->tick_us[clock->next[out] % MIDI_CLOCK_HISTORY] + clock->offset_us[out];
+}
+
+// Send the ticks of the outputs that are due, or with all, every tick made
+static void send_ticks(midi_clock_t* clock, uint32_t now_us, bool all)
+{
+  for (uint8_t out = 0; out < clock->num_ports; out++) {
+    if (!(clock->outputs & (1u << out))) {
+      continue;
+    }
+    if ((int32_t)(clock->ticks - clock->next[out]) > MIDI_CLOCK_HISTORY) {
+      align_output(clock, out, clock->ticks - MIDI_CLOCK_HISTORY); // too far behind to know the times
+    }
+    while ((int32_t)(clock->ticks - clock->next[out]) > 0) {
+      uint32_t due_us = output_due(clock, out);
+      if ((int32_t)(due_us - now_us) > 0) {
+        if (!all) {
+          break;
+        }
+        due_us = now_us;
+      }
+      clock->send(clock->context, out, 0xF8, due_us);
+      clock->next[out] += clock->division[out];
+    }
+  }
+}
+
+static void send_transport(midi_clock_t* clock, uint8_t byte, uint32_t now_us)
+{
+  // Keep the byte in its place after the ticks before it
+  make_ticks(clock, now_us, clock->mode == MIDI_CLOCK_FOLLOW);
+  send_ticks(clock, now_us, true);
+  for (uint8_t out = 0; out < clock->num_ports; out++) {
+    if (clock->outputs & (1u << out)) {
+      clock->send(clock->context, out, byte, now_us);
+    }
+  }
+  if (byte == 0xFA) {
+    // The song starts with the next tick
+    clock->start_tick = clock->ticks;
+    for (uint8_t out = 0; out < clock->num_ports; out++) {
+      if (clock->division[out] != 0) {
+        align_output(clock, out, clock->ticks);
+      }
+    }
+  }
+}
+
+static void start_following(midi_clock_t* clock)
+{
+  clock->received = 0;
+  clock->locked = false;
+  clock->bpm_x10_now = 0;
+}
+
+// Send the ticks received so far and lock to the input again
+static void follow_again(midi_clock_t* clock, uint32_t now_us)
+{
+  make_ticks(clock, now_us, true);
+  start_following(clock);
+}
+
+// Apply the settings changed since the last pass
+static void apply_settings(midi_clock_t* clock, uint32_t now_us, uint16_t enabled)
+{
+  uint16_t wanted_mode = clock->wanted_mode;
+  uint32_t tempo = clock->wanted_tempo;
+  if ((wanted_mode >> 8) != clock->mode || (wanted_mode & 0xff) != clock->input) {
+    clock->mode = (midi_clock_mode_t)(wanted_mode >> 8);
+    clock->input = wanted_mode & 0xff;
+    clock->tempo = 0;
+    clock->due_us = now_us;
+    clock->due_frac = 0;
+    start_following(clock);
+  }
+  if (clock->mode == MIDI_CLOCK_MASTER && tempo != clock->tempo) {
+    // A new tempo takes effect after the tick that is due
+    clock->tempo = tempo;
+    clock->bpm_x10 = tempo >> 8;
+    clock->ppqn = tempo & 0xff;
+    clock->period_q8 = (uint32_t)(600000000ull * 256 / ((uint32_t)clock->bpm_x10 * clock->ppqn));
+    clock->bpm_x10_now = clock->bpm_x10;
+  }
+  uint16_t outputs = 0;
+  for (uint8_t out = 0; out < clock->num_ports; out++) {
+    uint32_t wanted = clock->wanted_output[out];
+    uint8_t division = wanted >> 24;
+    if (clock->mode == MIDI_CLOCK_OFF || division == 0 || !(enabled & (1u << out))) {
+      continue;
+    }
+    outputs |= 1u << out;
+    clock->offset_us[out] = wanted & 0xffffff;
+    if (division != clock->division[out] || !(clock->outputs & (1u << out))) {
+      clock->division[out] = division;
+      align_output(clock, out, clock->ticks);
+    }
+  }
+  clock->outputs = outputs;
+  uint8_t transport = clock->wanted_transport;
+  if (transport != NO_TRANSPORT) {
+    clock->wanted_transport = NO_TRANSPORT;
+    if (clock->mode == MIDI_CLOCK_MASTER) {
+      send_transport(clock, transport, now_us);
+    }
+  }
+}
+
+void midi_clock_receive(midi_clock_t* clock, uint8_t byte, uint32_t time_us)
+{
+  if (clock->mode != MIDI_CLOCK_FOLLOW) {
+    return;
+  }
+  if (byte != 0xF8) {
+    send_transport(clock, byte, time_us);
+    return;
+  }
+  if (clock->received != 0 && time_us - clock->last_in_us > MIDI_CLOCK_TIMEOUT_US) {
+    follow_again(clock, time_us); // the input stopped for a while
+  }
+  uint32_t index = clock->received;
+  uint32_t* expected = clock->expected_us;
+  if (index == 0) {
+    clock->base = clock->ticks;
+    expected[0] = time_us;
+  }
+  else if (!clock->locked) {
+    // The second tick gives the period
+    clock->period_q8 = (time_us - clock->last_in_us) << 8;
+    clock->locked = true;
+    expected[1] = time_us;
+  }
+  else {
+    // A phase-locked loop: move the expected time of this tick part of
+    // the way to when it came, and the period a smaller part
+    int32_t error = (int32_t)(time_us - expected[index % MIDI_CLOCK_HISTORY]);
+    int32_t period = (int32_t)(clock->period_q8 >> 8);
+    if (error > period || error < -period) {
+      // The tempo jumped: lock again from this tick
+      follow_again(clock, time_us);
+      midi_clock_receive(clock, byte, time_us);
+      return;
+    }
+    clock->period_q8 += (uint32_t)((error * 256) >> MIDI_CLOCK_KI_SHIFT);
+    expected[index % MIDI_CLOCK_HISTORY] += (uint32_t)(error >> MIDI_CLOCK_KP_SHIFT);
+    if ((int32_t)(expected[index % MIDI_CLOCK_HISTORY] - time_us) > MIDI_CLOCK_FOLLOW_DELAY_US) {
+      // The input sped up: send no more than twice the delay late
+      expected[index % MIDI_CLOCK_HISTORY] = time_us + MIDI_CLOCK_FOLLOW_DELAY_US;
+    }
+  }
+  if (index != 0) {
+    expected[(index + 1) % MIDI_CLOCK_HISTORY] = expected[index % MIDI_CLOCK_HISTORY] + (clock->period_q8 >> 8);
+    clock->bpm_x10_now = (uint16_t)(600000000ull * 256 / ((uint64_t)clock->period_q8 * MIDI_CLOCK_WIRE_PPQN));
+  }
+  clock->received++;
+  clock->last_in_us = time_us;
+}
+
+void midi_clock_task(midi_clock_t* clock, uint32_t now_us, uint16_t enabled)
+{
+  apply_settings(clock, now_us, enabled);
+  if (clock->mode == MIDI_CLOCK_FOLLOW && clock->received != 0 && now_us - clock->last_in_us > MIDI_CLOCK_TIMEOUT_US) {
+    follow_again(clock, now_us);
+  }
+  make_ticks(clock, now_us, false);
+  send_ticks(clock, now_us, false);
+}
+
+bool midi_clock_next_due(const midi_clock_t* clock, uint32_t* due_us)
+{
+  bool found = tick_due(clock, due_us);
+  for (uint8_t out = 0; out < clock->num_ports; out++) {
+    if ((clock->outputs & (1u << out)) && (int32_t)(clock->ticks - clock->next[out]) > 0) {
+      uint32_t due = output_due(clock, out);
+      if (!found || (int32_t)(due - *due_us) < 0) {
+        *due_us = due;
+        found = true;
+      }
+    }
+  }
+  return found;
+}
@@ -0,0 +1,195 @@
+/**
+ * @file midi_clock.h
+ * @brief generate MIDI clock, or follow an incoming one, and send it to outputs
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MIDI_CLOCK_H
+#define MIDI_CLOCK_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define MIDI_CLOCK_MAX_PORTS 16
+// MIDI clock is 24 pulses per quarter note on the wire
+#define MIDI_CLOCK_WIRE_PPQN 24
+#define MIDI_CLOCK_MIN_BPM_X10 200
+#define MIDI_CLOCK_MAX_BPM_X10 3000
+#define MIDI_CLOCK_MAX_DIVISION 96
+#define MIDI_CLOCK_MAX_OFFSET_US 20000
+// The times of the most recent ticks, for the outputs with an offset
+#define MIDI_CLOCK_HISTORY 16
+// The follower's loop gains are 2^-KP_SHIFT for the phase and
+// 2^-KI_SHIFT for the period
+#define MIDI_CLOCK_KP_SHIFT 3
+#define MIDI_CLOCK_KI_SHIFT 7
+// The follower stops after this long without a clock from its input
+#define MIDI_CLOCK_TIMEOUT_US 500000
+// The follower sends each tick this long after it expects it, so input
+// ticks up to this late still give steady output ticks
+#define MIDI_CLOCK_FOLLOW_DELAY_US 1000
+
+typedef enum {
+  MIDI_CLOCK_OFF,
+  MIDI_CLOCK_MASTER,   // generate clock at a set tempo
+  MIDI_CLOCK_FOLLOW,   // lock to the clock of an input and send a steady copy
+} midi_clock_mode_t;
+
+/**
+ * @brief called from midi_clock_task() for every byte to send
+ *
+ * @param context the context passed to midi_clock_init()
+ * @param out the output port
+ * @param byte F8 for a tick, or FA, FB or FC
+ * @param time_us when the byte was due
+ */
+typedef void (*midi_clock_send_fn)(void* context, uint8_t out, uint8_t byte, uint32_t time_us);
+
+/**
+ * @brief A clock that sends ticks to outputs at their due time, ahead of
+ * the data queued for them.
+ *
+ * As master, the tick times come from the tempo and the microsecond
+ * clock, so a late routing loop delays a tick but not the ones after it.
+ * As follower, a phase-locked loop predicts when each tick of an input
+ * arrives, and the tick goes out MIDI_CLOCK_FOLLOW_DELAY_US after that
+ * rather than when it arrived. A tick never goes out before the input
+ * tick, so no tick is lost or added and Start, Continue and Stop keep
+ * their place between the ticks. Each output sends every division-th
+ * tick, offset_us later.
+ *
+ * The settings may be changed from any core. The routing loop applies
+ * them the next time it calls midi_clock_task(); that and
+ * midi_clock_receive() must run on the routing loop.
+ */
+typedef struct {
+  midi_clock_send_fn send;
+  void* context;
+  uint8_t num_ports;
+  // Settings: mode << 8 | input, bpm_x10 << 8 | ppqn, division << 24 | offset_us
+  volatile uint16_t wanted_mode;
+  volatile uint32_t wanted_tempo;
+  volatile uint32_t wanted_output[MIDI_CLOCK_MAX_PORTS];
+  volatile uint8_t wanted_transport; // FA, FB or FC to send, or 0
+  // The state of the routing loop
+  midi_clock_mode_t mode;
+  uint8_t input;
+  uint16_t bpm_x10;
+  uint8_t ppqn;
+  uint32_t tempo;               // the wanted_tempo in effect
+  uint32_t ticks;               // ticks so far
+  uint32_t tick_us[MIDI_CLOCK_HISTORY]; // the time of tick n is tick_us[n % MIDI_CLOCK_HISTORY]
+  uint32_t start_tick;          // the first tick after the last start; divisions count from it
+  uint16_t outputs;             // bit per output that sends ticks
+  uint8_t division[MIDI_CLOCK_MAX_PORTS];
+  uint32_t offset_us[MIDI_CLOCK_MAX_PORTS];
+  uint32_t next[MIDI_CLOCK_MAX_PORTS]; // the next tick each output sends
+  uint32_t period_q8;           // 256 times the tick period in us
+  // Master
+  uint32_t due_us;              // when the next tick is due
+  uint8_t due_frac;             // and 1/256 us
+  // Follower
+  uint32_t received;            // ticks received since it started to lock
+  uint32_t base;                // the tick sent for the first one received
+  uint32_t last_in_us;          // when the last tick was received
+  uint32_t expected_us[MIDI_CLOCK_HISTORY]; // when received tick n was expected
+  bool locked;                  // the period is known
+  volatile uint16_t bpm_x10_now; // the tempo the clock runs at, 0 if it does not
+} midi_clock_t;
+
+/**
+ * @brief initialize the clock off, at 120 BPM and 24 PPQN, with every
+ * output sending every tick
+ *
+ * @param clock the clock
+ * @param num_ports the number of outputs
+ * @param send the function that sends a byte to an output
+ * @param context passed unchanged to send
+ */
+void midi_clock_init(midi_clock_t* clock, uint8_t num_ports, midi_clock_send_fn send, void* context);
+
+/**
+ * @brief turn the clock off, make it the master or make it follow an input
+ *
+ * @param input the input a follower locks to
+ */
+void midi_clock_set_mode(midi_clock_t* clock, midi_clock_mode_t mode, uint8_t input);
+
+/**
+ * @brief set the tempo of the master
+ *
+ * @param bpm_x10 beats per minute times 10, MIDI_CLOCK_MIN_BPM_X10 to
+ * MIDI_CLOCK_MAX_BPM_X10
+ * @param ppqn ticks per quarter note, MIDI_CLOCK_WIRE_PPQN or a multiple
+ * of it up to 96; an output with a division of ppqn / 24 sends standard
+ * MIDI clock
+ * @return false if a value is out of range
+ */
+bool midi_clock_set_tempo(midi_clock_t* clock, uint16_t bpm_x10, uint8_t ppqn);
+
+/**
+ * @brief set which ticks an output sends
+ *
+ * @param division send every division-th tick, 1 to MIDI_CLOCK_MAX_DIVISION;
+ * 0 sends no clock to the output
+ * @param offset_us send each tick this much later, up to MIDI_CLOCK_MAX_OFFSET_US
+ * @return false if a value is out of range
+ */
+bool midi_clock_set_output(midi_clock_t* clock, uint8_t out, uint8_t division, uint32_t offset_us);
+
+/**
+ * @brief send Start (FA), Continue (FB) or Stop (FC) to the outputs
+ *
+ * After a Start, divisions count from the next tick.
+ */
+void midi_clock_transport(midi_clock_t* clock, uint8_t byte);
+
+/**
+ * @brief take an F8, FA, FB or FC from the input a follower locks to
+ *
+ * @param time_us when it arrived
+ */
+void midi_clock_receive(midi_clock_t* clock, uint8_t byte, uint32_t time_us);
+
+/**
+ * @brief apply new settings and send the bytes that are due
+ *
+ * @param enabled bit per output that can take data now
+ */
+void midi_clock_task(midi_clock_t* clock, uint32_t now_us, uint16_t enabled);
+
+/**
+ * @brief return true if a tick will be due and set due_us to when
+ */
+bool midi_clock_next_due(const midi_clock_t* clock, uint32_t* due_us);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
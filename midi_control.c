@@ -0,0 +1,363 @@
+/**
+ * @file midi_control.c
+ * @brief a binary SysEx protocol for reading and changing the routing setup
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "midi_control.h"
+
+#define FILTER_BITS MIDI_ROUTER_NUM_CLASSES
+#define FILTER_GROUPS ((FILTER_BITS + 6) / 7)
+
+void midi_control_init(midi_control_t* control, midi_router_t* router, const preset_store_t* presets,
+  const midi_control_config_t* config)
+{
+  control->router = router;
+  control->presets = presets;
+  control->config = config;
+  midi_control_reset(control);
+}
+
+void midi_control_reset(midi_control_t* control)
+{
+  control->request_len = 0;
+  control->receiving = false;
+  control->overflow = false;
+  control->request_ready = false;
+  control->reply_len = 0;
+  control->reply_pos = 0;
+  control->time_len = 0xFF;
+  control->time_ready = false;
+}
+
+// Return true if the byte ends a time message
+static bool receive_time(midi_control_t* control, uint8_t byte)
+{
+  if (byte == 0xF0) {
+    control->time_len = 0;
+  }
+  else if (control->time_len == 0xFF) {
+    return false;
+  }
+  else if (byte == 0xF7) {
+    const uint8_t* time = control->time;
+    bool ok = control->time_len == MIDI_CONTROL_TIME_LEN && time[0] == MIDI_CONTROL_MANUFACTURER &&
+      time[1] == MIDI_CONTROL_PROTOCOL && time[2] == MIDI_CONTROL_SET_TIME;
+    control->time_len = 0xFF;
+    if (ok) {
+      control->host_us = time[4] | (uint32_t)time[5] << 7 | (uint32_t)time[6] << 14 |
+        (uint32_t)time[7] << 21 | (uint32_t)time[8] << 28;
+      control->time_ready = true;
+    }
+    return ok;
+  }
+  else if ((byte & 0x80) || control->time_len == MIDI_CONTROL_TIME_LEN) {
+    control->time_len = 0xFF; // not a time message
+  }
+  else {
+    control->time[control->time_len++] = byte;
+  }
+  return false;
+}
+
+void midi_control_receive(midi_control_t* control, const uint8_t packet[4])
+{
+  uint8_t nbytes = midi_packet_num_bytes(packet);
+  for (uint8_t idx = 1; idx <= nbytes; idx++) {
+    uint8_t byte = packet[idx];
+    if (byte >= 0xF8) {
+      continue;
+    }
+    if (receive_time(control, byte)) {
+      control->receiving = false; // not a request
+      continue;
+    }
+    if (control->request_ready) {
+      continue; // busy with the previous request
+    }
+    if (byte == 0xF0) {
+      control->receiving = true;
+      control->request_len = 0;
+      control->overflow = false;
+    }
+    else if (!control->receiving) {
+      continue;
+    }
+    else if (byte == 0xF7) {
+      control->receiving = false;
+      control->request_ready = true;
+    }
+    else if (byte & 0x80) {
+      control->receiving = false; // not a complete SysEx message
+    }
+    else if (control->request_len < MIDI_CONTROL_REQUEST_LEN) {
+      control->request[control->request_len++] = byte;
+    }
+    else {
+      control->overflow = true;
+    }
+  }
+}
+
+static void put(midi_control_t* control, uint8_t byte)
+{
+  control->reply[control->reply_len++] = byte;
+}
+
+// Put a number as ngroups 7-bit groups, least significant first
+static void put_number(midi_control_t* control, uint32_t value, uint8_t ngroups)
+{
+  for (uint8_t group = 0; group < ngroups; group++) {
+    put(control, value & 0x7f);
+    value >>= 7;
+  }
+}
+
+static uint32_t get_number(const uint8_t* bytes, uint8_t ngroups)
+{
+  uint32_t value = 0;
+  for (uint8_t group = ngroups; group > 0; group--) {
+    value = value << 7 | bytes[group - 1];
+  }
+  return value;
+}
+
+static midi_control_status_t get_routes(midi_control_t* control, uint8_t nargs)
+{
+  if (nargs != 0) {
+    return MIDI_CONTROL_BAD_ARGUMENTS;
+  }
+  for (uint8_t in = 0; in < control->router->num_ports; in++) {
+    put_number(control, control->router->matrix[in], 3);
+  }
+  return MIDI_CONTROL_OK;
+}
+
+static midi_control_status_t set_routes(midi_control_t* control, const uint8_t* args, uint8_t nargs)
+{
+  midi_router_t* router = control->router;
+  uint32_t all = (1u << router->num_ports) - 1;
+  if (nargs != 3 * router->num_ports) {
+    return MIDI_CONTROL_BAD_ARGUMENTS;
+  }
+  for (uint8_t in = 0; in < router->num_ports; in++) {
+    if (get_number(args + 3 * in, 3) & ~all) {
+      return MIDI_CONTROL_BAD_ARGUMENTS;
+    }
+  }
+  for (uint8_t in = 0; in < router->num_ports; in++) {
+    uint32_t row = get_number(args + 3 * in, 3);
+    for (uint8_t out = 0; out < router->num_ports; out++) {
+      if (row & (1u << out)) {
+        midi_router_connect(router, in, out);
+      }
+      else {
+        midi_router_disconnect(router, in, out);
+      }
+    }
+  }
+  control->config->publish(control->config->context);
+  return MIDI_CONTROL_OK;
+}
+
+static midi_control_status_t get_filter(midi_control_t* control, const uint8_t* args, uint8_t nargs)
+{
+  uint8_t num_ports = control->router->num_ports;
+  if (nargs != 2 || args[0] >= num_ports || args[1] >= num_ports) {
+    return MIDI_CONTROL_BAD_ARGUMENTS;
+  }
+  const midi_router_filter_t* filter = midi_router_get_filter(control->router, args[0], args[1]);
+  put(control, args[0]);
+  put(control, args[1]);
+  for (uint8_t group = 0; group < FILTER_GROUPS; group++) {
+    uint8_t bits = 0;
+    for (uint8_t bit = 0; bit < 7 && group * 7 + bit < FILTER_BITS; bit++) {
+      bits |= midi_router_filter_blocks(filter, group * 7 + bit) << bit;
+    }
+    put(control, bits);
+  }
+  return MIDI_CONTROL_OK;
+}
+
+static midi_control_status_t set_filter(midi_control_t* control, const uint8_t* args, uint8_t nargs)
+{
+  uint8_t num_ports = control->router->num_ports;
+  if (nargs != 2 + FILTER_GROUPS || args[0] >= num_ports || args[1] >= num_ports) {
+    return MIDI_CONTROL_BAD_ARGUMENTS;
+  }
+  midi_router_filter_t filter;
+  memset(&filter, 0, sizeof(filter));
+  for (uint8_t msg_class = 0; msg_class < FILTER_BITS; msg_class++) {
+    midi_router_filter_set(&filter, msg_class, (args[2 + msg_class / 7] >> (msg_class % 7)) & 1);
+  }
+  midi_router_set_filter(control->router, args[0], args[1], &filter);
+  control->config->publish(control->config->context);
+  return MIDI_CONTROL_OK;
+}
+
+static void put_counters(midi_control_t* control, const midi_router_counters_t* counters)
+{
+  put_number(control, counters->offered, 5);
+  put_number(control, counters->written, 5);
+  put_number(control, counters->dropped, 5);
+  put_number(control, counters->high_water, 3);
+}
+
+static midi_control_status_t get_counters(midi_control_t* control, const uint8_t* args, uint8_t nargs)
+{
+  midi_router_t* router = control->router;
+  if (nargs != 1) {
+    return MIDI_CONTROL_BAD_ARGUMENTS;
+  }
+  for (uint8_t port = 0; port < router->num_ports; port++) {
+    put_counters(control, router->source_counters + port);
+    put_counters(control, router->dest_counters + port);
+  }
+  if (args[0] & 1) {
+    midi_router_reset_counters(router);
+  }
+  return MIDI_CONTROL_OK;
+}
+
+static midi_control_status_t get_presets(midi_control_t* control, uint8_t nargs)
+{
+  if (nargs != 0) {
+    return MIDI_CONTROL_BAD_ARGUMENTS;
+  }
+  uint8_t latest = 0x7F;
+  (void)preset_store_latest(control->presets, &latest);
+  put(control, latest);
+  for (uint8_t preset = 0; preset < PRESET_STORE_NUM_PRESETS; preset++) {
+    uint32_t length = 0;
+    (void)preset_store_get_info(control->presets, preset, &length);
+    put_number(control, length, 3);
+  }
+  return MIDI_CONTROL_OK;
+}
+
+static midi_control_status_t run_preset(midi_control_t* control, const uint8_t* args, uint8_t nargs,
+  bool (*fn)(void* context, uint8_t preset))
+{
+  if (nargs != 1 || args[0] >= PRESET_STORE_NUM_PRESETS) {
+    return MIDI_CONTROL_BAD_ARGUMENTS;
+  }
+  return fn(control->config->context, args[0]) ? MIDI_CONTROL_OK : MIDI_CONTROL_FAILED;
+}
+
+static midi_control_status_t run_command(midi_control_t* control, uint8_t command, const uint8_t* args, uint8_t nargs)
+{
+  const midi_control_config_t* config = control->config;
+  switch (command) {
+  case MIDI_CONTROL_GET_INFO:
+    if (nargs != 0) {
+      return MIDI_CONTROL_BAD_ARGUMENTS;
+    }
+    put(control, MIDI_CONTROL_VERSION);
+    put(control, control->router->num_ports);
+    put(control, config->num_usb_ports);
+    put(control, PRESET_STORE_NUM_PRESETS);
+    return MIDI_CONTROL_OK;
+  case MIDI_CONTROL_GET_ROUTES:
+    return get_routes(control, nargs);
+  case MIDI_CONTROL_SET_ROUTES:
+    return set_routes(control, args, nargs);
+  case MIDI_CONTROL_GET_FILTER:
+    return get_filter(control, args, nargs);
+  case MIDI_CONTROL_SET_FILTER:
+    return set_filter(control, args, nargs);
+  case MIDI_CONTROL_GET_COUNTERS:
+    return get_counters(control, args, nargs);
+  case MIDI_CONTROL_GET_PRESETS:
+    return get_presets(control, nargs);
+  case MIDI_CONTROL_SAVE_PRESET:
+    return run_preset(control, args, nargs, config->save_preset);
+  case MIDI_CONTROL_LOAD_PRESET:
+    return run_preset(control, args, nargs, config->load_preset);
+  default:
+    return MIDI_CONTROL_UNKNOWN_COMMAND;
+  }
+}
+
+// Build the reply to the request; SysEx messages for other devices get none
+static void run_request(midi_control_t* control)
+{
+  const uint8_t* request = control->request;
+  control->reply_len = 0;
+  control->reply_pos = 0;
+  if (control->request_len < 4 || request[0] != MIDI_CONTROL_MANUFACTURER || request[1] != MIDI_CONTROL_PROTOCOL) {
+    return;
+  }
+  uint8_t command = request[2];
+  put(control, 0xF0);
+  put(control, MIDI_CONTROL_MANUFACTURER);
+  put(control, MIDI_CONTROL_PROTOCOL);
+  put(control, command | MIDI_CONTROL_REPLY);
+  put(control, request[3]);
+  put(control, MIDI_CONTROL_OK);
+  midi_control_status_t status = control->overflow ? MIDI_CONTROL_BAD_ARGUMENTS :
+    run_command(control, command, request + 4, control->request_len - 4);
+  if (status != MIDI_CONTROL_OK) {
+    control->reply_len = 6; // no results
+    control->reply[5] = status;
+  }
+  put(control, 0xF7);
+}
+
+void midi_control_task(midi_control_t* control)
+{
+  if (control->request_ready && control->reply_pos == control->reply_len) {
+    run_request(control);
+    control->request_ready = false;
+  }
+  const midi_control_config_t* config = control->config;
+  while (control->reply_pos < control->reply_len) {
+    // The last packet of the reply ends with the F7
+    uint16_t remaining = control->reply_len - control->reply_pos;
+    uint8_t nbytes = remaining > 3 ? 3 : remaining;
+    uint8_t cin = remaining > 3 ? MIDI_CIN_SYSEX : MIDI_CIN_SYSEX_END_1 + nbytes - 1;
+    uint8_t packet[4] = {(uint8_t)(config->cable << 4 | cin), 0, 0, 0};
+    memcpy(packet + 1, control->reply + control->reply_pos, nbytes);
+    if (config->write(config->handle, packet, sizeof(packet)) == 0) {
+      break;
+    }
+    control->reply_pos += nbytes;
+  }
+}
+
+bool midi_control_take_time(midi_control_t* control, uint32_t* host_us)
+{
+  if (!control->time_ready) {
+    return false;
+  }
+  control->time_ready = false;
+  *host_us = control->host_us;
+  return true;
+}
+
+bool midi_control_busy(const midi_control_t* control)
+{
+  return control->request_ready || control->reply_pos < control->reply_len;
+}
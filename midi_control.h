@@ -0,0 +1,193 @@
+/**
+ * @file midi_control.h
+ * @brief a binary SysEx protocol for reading and changing the routing setup
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MIDI_CONTROL_H
+#define MIDI_CONTROL_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "midi_router.h"
+#include "midi_merger.h"
+#include "preset_store.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/*
+ * Every request is one SysEx message and gets one reply:
+ *
+ *   request: F0 7D 52 <command> <tag> <arguments> F7
+ *   reply:   F0 7D 52 <command | 0x40> <tag> <status> <results> F7
+ *
+ * 7D is the non-commercial manufacturer ID and 52 ('R') names this
+ * protocol. The tag is any value 0-127; the reply repeats it. Numbers are
+ * sent 7 bits at a time, least significant group first: a 16-bit number
+ * takes 3 bytes and a 32-bit number 5. A set of bits is sent the same
+ * way, bit 0 first. Ports are numbered as in the route matrix: USB cables
+ * first, then the serial ports.
+ *
+ * Send one request at a time and wait for its reply; a request that
+ * arrives while another one is being handled is ignored. The time
+ * message is the exception: it gets no reply and may be sent at any
+ * time, even while a request is being handled.
+ */
+#define MIDI_CONTROL_MANUFACTURER 0x7D
+#define MIDI_CONTROL_PROTOCOL 0x52
+#define MIDI_CONTROL_VERSION 1
+#define MIDI_CONTROL_REPLY 0x40
+
+typedef enum {
+  // reply: version, number of ports, number of USB ports, number of presets
+  MIDI_CONTROL_GET_INFO = 0x00,
+  // reply: the route matrix row of every input (16 bits each); bit n of
+  // row in is set if in routes to output n
+  MIDI_CONTROL_GET_ROUTES = 0x01,
+  // arguments: the route matrix row of every input; replaces all routes at once
+  MIDI_CONTROL_SET_ROUTES = 0x02,
+  // arguments: input, output; reply: input, output, filter (128 bits,
+  // one per message class; see midi_router_message_class())
+  MIDI_CONTROL_GET_FILTER = 0x03,
+  // arguments: input, output, filter
+  MIDI_CONTROL_SET_FILTER = 0x04,
+  // arguments: flags, bit 0 set to reset the counters after reading them;
+  // reply: for every port, the input offered, written, dropped (32 bits
+  // each) and high_water (16 bits), then the same for the output
+  MIDI_CONTROL_GET_COUNTERS = 0x05,
+  // reply: the preset that loads at power up or 0x7F for none, then the
+  // length of every preset (16 bits; 0 if it is empty)
+  MIDI_CONTROL_GET_PRESETS = 0x06,
+  // arguments: preset 0-7
+  MIDI_CONTROL_SAVE_PRESET = 0x07,
+  // arguments: preset 0-7
+  MIDI_CONTROL_LOAD_PRESET = 0x08,
+  // arguments: the host time in microseconds (32 bits) of the USB MIDI
+  // data that follows, up to the next time message or until the host
+  // stops sending; no reply. Scheduled outputs send the data at that
+  // time plus their delay.
+  MIDI_CONTROL_SET_TIME = 0x09,
+} midi_control_command_t;
+
+typedef enum {
+  MIDI_CONTROL_OK = 0,
+  MIDI_CONTROL_UNKNOWN_COMMAND = 1,
+  MIDI_CONTROL_BAD_ARGUMENTS = 2, // wrong length or a value out of range
+  MIDI_CONTROL_FAILED = 3,        // e.g., the preset could not be saved
+} midi_control_status_t;
+
+// F0 and F7 not counted
+#define MIDI_CONTROL_TIME_LEN 9
+
+// Room for the longest request and the longest reply
+#define MIDI_CONTROL_REQUEST_LEN 64
+#define MIDI_CONTROL_REPLY_LEN (7 + MIDI_ROUTER_MAX_PORTS * 36)
+
+/**
+ * @brief how the control protocol reaches the rest of the system
+ */
+typedef struct {
+  uint8_t num_usb_ports;
+  uint8_t cable;               // the cable number of the reply packets
+  // called with one USB MIDI packet of the reply; returns 4 if it took
+  // the packet and 0 if the destination is full
+  midi_merger_write_fn write;
+  void* handle;                // passed unchanged to write
+  // start using the changed routes and filters; must not wait for the
+  // routing loop, so where it runs on the same core publish only queues
+  // the change and the next routing pass applies it
+  void (*publish)(void* context);
+  // return false if the preset could not be saved or loaded
+  bool (*save_preset)(void* context, uint8_t preset);
+  bool (*load_preset)(void* context, uint8_t preset);
+  void* context;               // passed unchanged to publish, save_preset and load_preset
+} midi_control_config_t;
+
+/**
+ * @brief Collects a request from the packets of the control cable, runs
+ * it outside the routing loop and sends the reply a packet at a time as
+ * the destination takes it.
+ */
+typedef struct {
+  midi_router_t* router;
+  const preset_store_t* presets;
+  const midi_control_config_t* config;
+  uint8_t request[MIDI_CONTROL_REQUEST_LEN];
+  uint8_t request_len;
+  bool receiving;        // inside a SysEx message on the control cable
+  bool overflow;         // the request did not fit
+  bool request_ready;    // a complete request waits to be run
+  uint8_t reply[MIDI_CONTROL_REPLY_LEN];
+  uint16_t reply_len;
+  uint16_t reply_pos;    // the next byte of the reply to send
+  // Time messages are collected apart from requests so they take effect
+  // in order with the data around them
+  uint8_t time[MIDI_CONTROL_TIME_LEN];
+  uint8_t time_len;      // 0xFF outside a message that may be a time message
+  bool time_ready;
+  uint32_t host_us;      // the time of the last time message
+} midi_control_t;
+
+/**
+ * @brief initialize the control protocol
+ *
+ * @param config must stay valid while the control protocol is in use
+ */
+void midi_control_init(midi_control_t* control, midi_router_t* router, const preset_store_t* presets,
+  const midi_control_config_t* config);
+
+/**
+ * @brief take one packet from the control cable; only copies it
+ */
+void midi_control_receive(midi_control_t* control, const uint8_t packet[4]);
+
+/**
+ * @brief return true if the packets passed to midi_control_receive()
+ * ended a time message since the last call, and set host_us to its time
+ */
+bool midi_control_take_time(midi_control_t* control, uint32_t* host_us);
+
+/**
+ * @brief run a complete request if the previous reply is sent, then
+ * send as much of the reply as the destination takes
+ */
+void midi_control_task(midi_control_t* control);
+
+/**
+ * @brief return true if a request waits to be run or a reply to be sent
+ */
+bool midi_control_busy(const midi_control_t* control);
+
+/**
+ * @brief forget any partial request and unsent reply
+ */
+void midi_control_reset(midi_control_t* control);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
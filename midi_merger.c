@@ -0,0 +1,537 @@
+/**
+ * @file midi_merger.c
+ * @brief merge complete MIDI messages from several sources onto one output
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "midi_merger.h"
+#include "midi_parser.h"
+
+void midi_merger_init(midi_merger_t* merger, midi_merger_write_fn write, void* handle,
+  midi_merger_entry_t* queue, uint16_t queue_len)
+{
+  merger->write = write;
+  merger->handle = handle;
+  merger->queue = queue;
+  merger->queue_len = queue_len;
+  merger->running_status = false;
+  merger->realtime_between_bytes = false;
+  merger->packet_output = false;
+  merger->sysex_flow_control = false;
+  merger->status_bytes_saved = 0;
+  merger->fair = false;
+  memset(merger->weight, MIDI_MERGER_DEFAULT_WEIGHT, sizeof(merger->weight));
+  merger->policy = MIDI_MERGER_DROP_NEWEST;
+  merger->sent_cb = NULL;
+  merger->sent_context = NULL;
+  merger->dropped_cb = NULL;
+  merger->dropped_context = NULL;
+  midi_merger_reset(merger);
+}
+
+void midi_merger_set_sent_cb(midi_merger_t* merger, midi_merger_packet_cb cb, void* context)
+{
+  merger->sent_cb = cb;
+  merger->sent_context = context;
+}
+
+void midi_merger_set_dropped_cb(midi_merger_t* merger, midi_merger_packet_cb cb, void* context)
+{
+  merger->dropped_cb = cb;
+  merger->dropped_context = context;
+}
+
+void midi_merger_set_policy(midi_merger_t* merger, midi_merger_policy_t policy)
+{
+  merger->policy = policy;
+}
+
+void midi_merger_set_realtime_between_bytes(midi_merger_t* merger, bool enable)
+{
+  merger->realtime_between_bytes = enable;
+}
+
+void midi_merger_set_packet_output(midi_merger_t* merger, bool enable)
+{
+  merger->packet_output = enable;
+}
+
+void midi_merger_set_sysex_flow_control(midi_merger_t* merger, bool enable)
+{
+  merger->sysex_flow_control = enable;
+}
+
+bool midi_merger_holds_back(const midi_merger_t* merger, uint8_t source)
+{
+  if (merger->policy == MIDI_MERGER_BLOCK_SOURCE) {
+    return true;
+  }
+  // A SysEx message that has already lost a packet is not worth waiting for
+  uint16_t source_bit = 1u << source;
+  return merger->sysex_flow_control && source < MIDI_MERGER_MAX_SOURCES &&
+    (merger->open_sysex & source_bit) && !(merger->discarding & source_bit);
+}
+
+void midi_merger_set_fair(midi_merger_t* merger, bool enable)
+{
+  merger->fair = enable;
+  // Every source starts with no credit and no debt
+  for (uint8_t source = 0; source < MIDI_MERGER_MAX_SOURCES; source++) {
+    merger->finish[source] = merger->virtual_time;
+  }
+}
+
+void midi_merger_set_weight(midi_merger_t* merger, uint8_t source, uint8_t weight)
+{
+  if (source < MIDI_MERGER_MAX_SOURCES && weight != 0) {
+    merger->weight[source] = weight;
+  }
+}
+
+void midi_merger_set_running_status(midi_merger_t* merger, bool enable)
+{
+  merger->running_status = enable;
+  merger->last_status = 0;
+}
+
+void midi_merger_reset(midi_merger_t* merger)
+{
+  merger->head = 0;
+  merger->count = 0;
+  merger->realtime_head = 0;
+  merger->realtime_count = 0;
+  merger->ndeferred = 0;
+  memset(merger->deferred_per_source, 0, sizeof(merger->deferred_per_source));
+  merger->sysex_owner = MIDI_MERGER_NO_OWNER;
+  merger->open_sysex = 0;
+  merger->discarding = 0;
+  merger->needs_terminator = 0;
+  merger->npending = 0;
+  merger->pending_idx = 0;
+  merger->last_status = 0;
+  memset(merger->queued, 0, sizeof(merger->queued));
+  merger->virtual_time = 0;
+  memset(merger->finish, 0, sizeof(merger->finish));
+}
+
+static bool finishes_before(uint32_t a, uint32_t b)
+{
+  return (int32_t)(a - b) < 0;
+}
+
+// The last slot in each queue is reserved for the end of a SysEx message
+// whose start was accepted, so every accepted SysEx start can be terminated
+static bool may_use_reserve(midi_merger_t* merger, const uint8_t packet[4])
+{
+  return midi_packet_is_sysex_end(packet) && (merger->open_sysex & (1u << midi_packet_cable(packet)));
+}
+
+static void drop(midi_merger_t* merger, const midi_merger_entry_t* entry)
+{
+  if (merger->dropped_cb) {
+    merger->dropped_cb(merger->dropped_context, entry->packet, entry->timestamp);
+  }
+}
+
+// Dropping a message that is not part of a SysEx message cannot corrupt
+// the output stream
+static bool is_evictable(const uint8_t packet[4])
+{
+  return midi_packet_cin(packet) != MIDI_CIN_SYSEX && !midi_packet_is_sysex_end(packet);
+}
+
+// Remove the entry idx places from the head of the queue
+static void remove_from_queue(midi_merger_t* merger, uint16_t idx)
+{
+  uint16_t pos = (merger->head + idx) % merger->queue_len;
+  merger->queued[midi_packet_cable(merger->queue[pos].packet)]--;
+  // close the gap by moving the older entries toward the tail
+  for (; idx > 0; idx--) {
+    uint16_t prev = (merger->head + idx - 1) % merger->queue_len;
+    merger->queue[pos] = merger->queue[prev];
+    pos = prev;
+  }
+  merger->head = (merger->head + 1) % merger->queue_len;
+  merger->count--;
+}
+
+// Drop the oldest or the newest evictable message of a source, or of any
+// source if source is MIDI_MERGER_NO_OWNER
+static bool evict_from_queue(midi_merger_t* merger, uint8_t source, bool newest)
+{
+  for (uint16_t n = 0; n < merger->count; n++) {
+    uint16_t idx = newest ? merger->count - 1 - n : n;
+    const midi_merger_entry_t* entry = merger->queue + (merger->head + idx) % merger->queue_len;
+    if (is_evictable(entry->packet) &&
+        (source == MIDI_MERGER_NO_OWNER || midi_packet_cable(entry->packet) == source)) {
+      drop(merger, entry);
+      remove_from_queue(merger, idx);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Make room in a full queue for a new packet from source, as the policy allows
+static bool make_room(midi_merger_t* merger, uint8_t source)
+{
+  if (merger->fair && merger->policy != MIDI_MERGER_BLOCK_SOURCE) {
+    // The source with the most packets queued for its weight pays
+    uint8_t victim = source;
+    for (uint8_t other = 0; other < MIDI_MERGER_MAX_SOURCES; other++) {
+      if ((uint32_t)merger->queued[other] * merger->weight[victim] >
+          (uint32_t)merger->queued[victim] * merger->weight[other]) {
+        victim = other;
+      }
+    }
+    if (victim != source) {
+      return evict_from_queue(merger, victim, merger->policy == MIDI_MERGER_DROP_NEWEST);
+    }
+    return merger->policy == MIDI_MERGER_DROP_OLDEST && evict_from_queue(merger, source, false);
+  }
+  return merger->policy == MIDI_MERGER_DROP_OLDEST && evict_from_queue(merger, MIDI_MERGER_NO_OWNER, false);
+}
+
+static bool evict_from_deferred(midi_merger_t* merger)
+{
+  for (uint8_t idx = 0; idx < merger->ndeferred; idx++) {
+    midi_merger_entry_t* entry = merger->deferred + idx;
+    if (is_evictable(entry->packet)) {
+      drop(merger, entry);
+      merger->deferred_per_source[midi_packet_cable(entry->packet)]--;
+      memmove(entry, entry + 1, (merger->ndeferred - idx - 1) * sizeof(*entry));
+      merger->ndeferred--;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool enqueue(midi_merger_t* merger, const midi_merger_entry_t* entry, bool may_evict)
+{
+  const uint8_t* packet = entry->packet;
+  if (merger->count >= merger->queue_len - (may_use_reserve(merger, packet) ? 0 : 1) &&
+      !(may_evict && make_room(merger, midi_packet_cable(packet)))) {
+    return false;
+  }
+  uint16_t tail = (merger->head + merger->count) % merger->queue_len;
+  merger->queue[tail] = *entry;
+  merger->count++;
+  uint8_t source = midi_packet_cable(packet);
+  if (merger->queued[source]++ == 0 && finishes_before(merger->finish[source], merger->virtual_time)) {
+    // A source that was idle gets no credit for the time it was idle
+    merger->finish[source] = merger->virtual_time;
+  }
+  if (midi_packet_is_sysex_start(packet)) {
+    merger->sysex_owner = midi_packet_cable(packet);
+  }
+  else if (midi_packet_is_sysex_end(packet) && merger->sysex_owner == midi_packet_cable(packet)) {
+    merger->sysex_owner = MIDI_MERGER_NO_OWNER;
+  }
+  return true;
+}
+
+static bool defer(midi_merger_t* merger, const midi_merger_entry_t* entry)
+{
+  if (merger->ndeferred >= MIDI_MERGER_DEFERRED_LEN - (may_use_reserve(merger, entry->packet) ? 0 : 1) &&
+      !(merger->policy == MIDI_MERGER_DROP_OLDEST && evict_from_deferred(merger))) {
+    return false;
+  }
+  merger->deferred[merger->ndeferred++] = *entry;
+  merger->deferred_per_source[midi_packet_cable(entry->packet)]++;
+  return true;
+}
+
+static bool source_may_enqueue(const midi_merger_t* merger, uint8_t source)
+{
+  return merger->sysex_owner == MIDI_MERGER_NO_OWNER || merger->sysex_owner == source;
+}
+
+/**
+ * @brief move held back packets to the queue in arrival order
+ *
+ * Once a source has a packet that must stay held back, all later packets
+ * from that source stay held back too so each source's order is preserved.
+ */
+static void release_deferred(midi_merger_t* merger)
+{
+  bool progress = true;
+  while (progress && merger->ndeferred > 0) {
+    progress = false;
+    uint16_t blocked = 0;
+    uint8_t nkept = 0;
+    for (uint8_t idx = 0; idx < merger->ndeferred; idx++) {
+      midi_merger_entry_t* entry = merger->deferred + idx;
+      uint8_t source = midi_packet_cable(entry->packet);
+      if (!(blocked & (1u << source)) && source_may_enqueue(merger, source) && enqueue(merger, entry, false)) {
+        merger->deferred_per_source[source]--;
+        progress = true;
+      }
+      else {
+        blocked |= (1u << source);
+        if (nkept != idx) {
+          merger->deferred[nkept] = *entry;
+        }
+        nkept++;
+      }
+    }
+    merger->ndeferred = nkept;
+  }
+}
+
+static bool push_in_order(midi_merger_t* merger, const midi_merger_entry_t* entry)
+{
+  uint8_t source = midi_packet_cable(entry->packet);
+  if (merger->deferred_per_source[source] == 0 && source_may_enqueue(merger, source)) {
+    bool result = enqueue(merger, entry, true);
+    if (result && merger->ndeferred > 0 && merger->sysex_owner == MIDI_MERGER_NO_OWNER) {
+      release_deferred(merger);
+    }
+    return result;
+  }
+  return defer(merger, entry);
+}
+
+static bool terminate_sysex(midi_merger_t* merger, uint8_t source, uint32_t timestamp)
+{
+  const midi_merger_entry_t terminator = {{(uint8_t)((source << 4) | MIDI_CIN_SYSEX_END_1), 0xF7, 0, 0}, timestamp};
+  if (!push_in_order(merger, &terminator)) {
+    return false;
+  }
+  merger->needs_terminator &= ~(1u << source);
+  merger->open_sysex &= ~(1u << source);
+  return true;
+}
+
+static bool push_realtime(midi_merger_t* merger, const midi_merger_entry_t* entry)
+{
+  if (merger->realtime_count == MIDI_MERGER_REALTIME_LEN) {
+    if (merger->policy != MIDI_MERGER_DROP_OLDEST) {
+      return false;
+    }
+    drop(merger, merger->realtime + merger->realtime_head);
+    merger->realtime_head = (merger->realtime_head + 1) % MIDI_MERGER_REALTIME_LEN;
+    merger->realtime_count--;
+  }
+  merger->realtime[(merger->realtime_head + merger->realtime_count) % MIDI_MERGER_REALTIME_LEN] = *entry;
+  merger->realtime_count++;
+  return true;
+}
+
+static bool push_message(midi_merger_t* merger, const midi_merger_entry_t* entry)
+{
+  const uint8_t* packet = entry->packet;
+  uint32_t timestamp = entry->timestamp;
+  uint8_t source = midi_packet_cable(packet);
+  uint16_t source_bit = 1u << source;
+  bool sysex_end = midi_packet_is_sysex_end(packet);
+  if (merger->discarding & source_bit) {
+    if (sysex_end) {
+      merger->discarding &= ~source_bit;
+      if (merger->open_sysex & source_bit) {
+        merger->needs_terminator |= source_bit;
+        terminate_sysex(merger, source, timestamp);
+      }
+    }
+    return false;
+  }
+  bool result = false;
+  if (!(merger->needs_terminator & source_bit) || terminate_sysex(merger, source, timestamp)) {
+    result = push_in_order(merger, entry);
+  }
+  if (midi_packet_cin(packet) == MIDI_CIN_SYSEX) {
+    if (!result) {
+      merger->discarding |= source_bit;
+    }
+    else if (midi_packet_is_sysex_start(packet)) {
+      merger->open_sysex |= source_bit;
+    }
+  }
+  else if (sysex_end && (merger->open_sysex & source_bit)) {
+    if (result) {
+      merger->open_sysex &= ~source_bit;
+    }
+    else {
+      merger->needs_terminator |= source_bit;
+    }
+  }
+  return result;
+}
+
+bool midi_merger_push(midi_merger_t* merger, const uint8_t packet[4], uint32_t timestamp)
+{
+  const midi_merger_entry_t entry = {{packet[0], packet[1], packet[2], packet[3]}, timestamp};
+  // Real-time bytes may be inserted anywhere, even inside SysEx
+  bool result = midi_packet_is_realtime(packet) ? push_realtime(merger, &entry) : push_message(merger, &entry);
+  if (!result) {
+    drop(merger, &entry);
+  }
+  return result;
+}
+
+uint16_t midi_merger_free(const midi_merger_t* merger, uint8_t source)
+{
+  // The last slot of the queue and of the deferred list is reserved
+  uint16_t nfree;
+  if (source != MIDI_MERGER_NO_OWNER &&
+      (merger->deferred_per_source[source] != 0 || !source_may_enqueue(merger, source))) {
+    nfree = merger->ndeferred + 1 < MIDI_MERGER_DEFERRED_LEN ? MIDI_MERGER_DEFERRED_LEN - merger->ndeferred - 1 : 0;
+  }
+  else {
+    nfree = merger->count + 1 < merger->queue_len ? merger->queue_len - merger->count - 1 : 0;
+  }
+  uint16_t realtime_free = MIDI_MERGER_REALTIME_LEN - merger->realtime_count;
+  return nfree < realtime_free ? nfree : realtime_free;
+}
+
+// Write the queued real-time bytes; return false if the destination is full
+static bool write_realtime(midi_merger_t* merger)
+{
+  while (merger->realtime_count > 0) {
+    const midi_merger_entry_t* entry = merger->realtime + merger->realtime_head;
+    if (merger->packet_output ? merger->write(merger->handle, entry->packet, 4) != 4 :
+        merger->write(merger->handle, entry->packet + 1, 1) == 0) {
+      return false;
+    }
+    if (merger->sent_cb) {
+      merger->sent_cb(merger->sent_context, entry->packet, entry->timestamp);
+    }
+    merger->realtime_head = (merger->realtime_head + 1) % MIDI_MERGER_REALTIME_LEN;
+    merger->realtime_count--;
+  }
+  return true;
+}
+
+// Return the number of bytes a packet puts on the wire
+static uint8_t wire_bytes(const midi_merger_t* merger, const uint8_t packet[4])
+{
+  if (merger->packet_output) {
+    return 4;
+  }
+  uint8_t nbytes = midi_packet_num_bytes(packet);
+  return merger->running_status && packet[1] == merger->last_status ? nbytes - 1 : nbytes;
+}
+
+/**
+ * @brief return how many places from the head of the queue the packet
+ * to write next is, and charge its source for it
+ *
+ * Of the oldest queued packet of each source, pick the one with the
+ * earliest virtual finish time: the finish time of the last packet of
+ * its source plus its cost. No packet may pass a SysEx packet, so
+ * nothing goes out inside a SysEx message.
+ */
+static uint16_t select_fair(midi_merger_t* merger)
+{
+  uint16_t waiting = 0;
+  for (uint8_t source = 0; source < MIDI_MERGER_MAX_SOURCES; source++) {
+    if (merger->queued[source] != 0) {
+      waiting |= 1u << source;
+    }
+    else if (finishes_before(merger->finish[source], merger->virtual_time)) {
+      // keep the finish times of idle sources from falling a wrap behind
+      merger->finish[source] = merger->virtual_time;
+    }
+  }
+  uint16_t seen = 0;
+  uint16_t best = 0;
+  uint32_t best_finish = 0;
+  for (uint16_t idx = 0; idx < merger->count && seen != waiting; idx++) {
+    const uint8_t* packet = merger->queue[(merger->head + idx) % merger->queue_len].packet;
+    bool in_order = !is_evictable(packet);
+    if (in_order && idx != 0) {
+      break;
+    }
+    uint8_t source = midi_packet_cable(packet);
+    if (seen & (1u << source)) {
+      continue;
+    }
+    seen |= 1u << source;
+    uint32_t finish = merger->finish[source] + (uint32_t)wire_bytes(merger, packet) * MIDI_MERGER_FAIR_SCALE / merger->weight[source];
+    if (idx == 0 || finishes_before(finish, best_finish)) {
+      best = idx;
+      best_finish = finish;
+    }
+    if (in_order) {
+      break;
+    }
+  }
+  const uint8_t* packet = merger->queue[(merger->head + best) % merger->queue_len].packet;
+  merger->finish[midi_packet_cable(packet)] = best_finish;
+  merger->virtual_time = best_finish;
+  return best;
+}
+
+void midi_merger_flush(midi_merger_t* merger)
+{
+  for (;;) {
+    if (merger->pending_idx < merger->npending) {
+      if (merger->realtime_between_bytes && !write_realtime(merger)) {
+        return;
+      }
+      const uint8_t* bytes = merger->packet_output ? merger->current.packet : merger->current.packet + 1;
+      merger->pending_idx += merger->write(merger->handle, bytes + merger->pending_idx,
+        merger->npending - merger->pending_idx);
+      if (merger->pending_idx < merger->npending) {
+        return; // the destination is full
+      }
+      if (merger->sent_cb) {
+        merger->sent_cb(merger->sent_context, merger->current.packet, merger->current.timestamp);
+      }
+    }
+    for (uint8_t source = 0; merger->needs_terminator != 0 && source < MIDI_MERGER_MAX_SOURCES; source++) {
+      if (merger->needs_terminator & (1u << source)) {
+        terminate_sysex(merger, source, merger->current.timestamp);
+      }
+    }
+    if (merger->ndeferred > 0) {
+      release_deferred(merger);
+    }
+    // Real-time bytes do not affect running status
+    if (!write_realtime(merger) || merger->count == 0) {
+      return;
+    }
+    merger->pending_idx = 0;
+    uint16_t idx = merger->fair ? select_fair(merger) : 0;
+    merger->current = merger->queue[(merger->head + idx) % merger->queue_len];
+    remove_from_queue(merger, idx);
+    const uint8_t* packet = merger->current.packet;
+    merger->npending = merger->packet_output ? 4 : midi_packet_num_bytes(packet);
+    if (merger->running_status && !merger->packet_output && (packet[1] & 0x80)) {
+      uint8_t status = packet[1];
+      if (status < 0xF0) {
+        if (status == merger->last_status) {
+          merger->pending_idx = 1; // skip the redundant status byte
+          merger->status_bytes_saved++;
+        }
+        merger->last_status = status;
+      }
+      else if (status < 0xF8) {
+        merger->last_status = 0;
+      }
+    }
+  }
+}
@@ -0,0 +1,324 @@
+/**
+ * @file midi_merger.h
+ * @brief merge complete MIDI messages from several sources onto one output
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MIDI_MERGER_H
+#define MIDI_MERGER_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// Number of real-time packets that may wait to go ahead of other data
+#ifndef MIDI_MERGER_REALTIME_LEN
+#define MIDI_MERGER_REALTIME_LEN 16
+#endif
+// Number of event packets held back while another source owns the output
+#ifndef MIDI_MERGER_DEFERRED_LEN
+#define MIDI_MERGER_DEFERRED_LEN 32
+#endif
+#define MIDI_MERGER_MAX_SOURCES 16
+#define MIDI_MERGER_NO_OWNER 0xFF
+// The weight of every source until midi_merger_set_weight() changes it
+#define MIDI_MERGER_DEFAULT_WEIGHT 1
+// Virtual time one wire byte takes at weight 1
+#define MIDI_MERGER_FAIR_SCALE 65536
+
+/**
+ * @brief write up to nbytes to the destination
+ *
+ * @param handle the destination handle passed to midi_merger_init()
+ * @param buffer the bytes to write
+ * @param nbytes the number of bytes to write
+ * @return the number of bytes the destination accepted
+ */
+typedef uint32_t (*midi_merger_write_fn)(void* handle, const uint8_t* buffer, uint32_t nbytes);
+
+/**
+ * @brief called after the destination has accepted every byte of a packet,
+ * or when a packet is dropped
+ *
+ * @param context the context passed to midi_merger_set_sent_cb() or
+ * midi_merger_set_dropped_cb()
+ * @param packet the packet that was sent or dropped
+ * @param timestamp the timestamp passed to midi_merger_push() with the packet
+ */
+typedef void (*midi_merger_packet_cb)(void* context, const uint8_t packet[4], uint32_t timestamp);
+
+/**
+ * @brief what to do with a new packet when the output queue is full
+ */
+typedef enum {
+  MIDI_MERGER_DROP_NEWEST,  // drop the new packet
+  MIDI_MERGER_DROP_OLDEST,  // drop the oldest queued message that is not part of a SysEx message
+  MIDI_MERGER_BLOCK_SOURCE, // the caller stops reading sources while midi_merger_free() is 0
+} midi_merger_policy_t;
+
+typedef struct {
+  uint8_t packet[4];
+  uint32_t timestamp;
+} midi_merger_entry_t;
+
+/**
+ * @brief The merger queues complete event packets from any number of
+ * sources and writes them to a single destination byte stream.
+ *
+ * The source of each packet is the cable number nibble of the packet
+ * header. Real-time packets wait in their own queue and are written
+ * ahead of any other queued packets, at the next packet boundary or, if
+ * enabled, at the next byte boundary. Once a source
+ * starts a SysEx message, packets from other sources are held back
+ * until that SysEx message ends. If a SysEx packet has to be dropped,
+ * the rest of that message is dropped too and the message is closed
+ * with a bare F7 so the destination never sees a broken message.
+ *
+ * By default packets go out in the order they were pushed. With fair
+ * sharing enabled, sources that have packets queued share the
+ * destination in proportion to their weights, counted in the bytes each
+ * packet puts on the wire, so a source that pushes data faster than the
+ * destination takes it only delays itself. A full queue then makes room
+ * for a new packet by dropping a message of the source that has the most
+ * queued for its weight.
+ */
+typedef struct {
+  midi_merger_write_fn write;
+  void* handle;
+  midi_merger_entry_t* queue;
+  uint16_t queue_len;
+  uint16_t head;
+  uint16_t count;
+  midi_merger_entry_t realtime[MIDI_MERGER_REALTIME_LEN];
+  uint8_t realtime_head;
+  uint8_t realtime_count;
+  midi_merger_entry_t deferred[MIDI_MERGER_DEFERRED_LEN];
+  uint8_t ndeferred;
+  uint8_t deferred_per_source[MIDI_MERGER_MAX_SOURCES];
+  uint8_t sysex_owner;
+  uint16_t open_sysex;   // bit per source that has queued a SysEx start but not its end
+  uint16_t discarding;   // bit per source whose current SysEx message lost a packet
+  uint16_t needs_terminator; // bit per source whose truncated SysEx still needs an F7
+  midi_merger_entry_t current; // the packet being written to the destination
+  uint8_t npending;      // number of bytes of the current packet to write
+  uint8_t pending_idx;   // the next byte to write is current.packet[1 + pending_idx]
+  bool running_status;   // true to omit status bytes that repeat the last one sent
+  bool realtime_between_bytes; // true to write real-time bytes inside other messages
+  bool packet_output;    // true to write whole event packets instead of MIDI bytes
+  bool sysex_flow_control; // true to hold back a source while its SysEx message is open
+  uint8_t last_status;   // last channel status byte sent, or 0 if none is in effect
+  uint32_t status_bytes_saved;
+  bool fair;             // true to share the destination among sources by weight
+  uint8_t weight[MIDI_MERGER_MAX_SOURCES];
+  uint16_t queued[MIDI_MERGER_MAX_SOURCES]; // packets each source has in the queue
+  uint32_t finish[MIDI_MERGER_MAX_SOURCES]; // virtual finish time of the last packet sent from each source
+  uint32_t virtual_time; // virtual finish time of the current packet
+  midi_merger_policy_t policy;
+  midi_merger_packet_cb sent_cb;
+  void* sent_context;
+  midi_merger_packet_cb dropped_cb;
+  void* dropped_context;
+} midi_merger_t;
+
+/**
+ * @brief initialize the merger
+ *
+ * @param merger the merger to initialize
+ * @param write the function that writes bytes to the destination
+ * @param handle passed unchanged to write
+ * @param queue storage for the queue of packets waiting for the destination
+ * @param queue_len the number of entries in queue
+ */
+void midi_merger_init(midi_merger_t* merger, midi_merger_write_fn write, void* handle,
+  midi_merger_entry_t* queue, uint16_t queue_len);
+
+/**
+ * @brief queue an event packet for the destination
+ *
+ * @param merger the merger for the destination
+ * @param packet the complete event packet; the cable number is the source number
+ * @param timestamp passed to the sent callback when the packet has been sent
+ * @return true if the packet was queued; false if it was dropped
+ */
+bool midi_merger_push(midi_merger_t* merger, const uint8_t packet[4], uint32_t timestamp);
+
+/**
+ * @brief return the number of packets from one source that may be pushed
+ * without any being dropped
+ *
+ * A source whose packets are held back behind another source's SysEx
+ * message has less room than the others. The room of the other sources
+ * only depends on how fast the destination accepts data, so a caller that
+ * blocks sources never waits on a SysEx message that cannot finish.
+ *
+ * @param merger the merger for the destination
+ * @param source the source number, or MIDI_MERGER_NO_OWNER for the room
+ * of a source that is not held back
+ */
+uint16_t midi_merger_free(const midi_merger_t* merger, uint8_t source);
+
+/**
+ * @brief write as many queued bytes to the destination as it will accept
+ *
+ * @param merger the merger for the destination
+ */
+void midi_merger_flush(midi_merger_t* merger);
+
+/**
+ * @brief set the function to call after each packet has been sent
+ *
+ * @param merger the merger for the destination
+ * @param cb the function to call, or NULL for none
+ * @param context passed unchanged to cb
+ */
+void midi_merger_set_sent_cb(midi_merger_t* merger, midi_merger_packet_cb cb, void* context);
+
+/**
+ * @brief set the function to call for each packet that is dropped
+ *
+ * @param merger the merger for the destination
+ * @param cb the function to call, or NULL for none
+ * @param context passed unchanged to cb
+ */
+void midi_merger_set_dropped_cb(midi_merger_t* merger, midi_merger_packet_cb cb, void* context);
+
+/**
+ * @brief set what to do with new packets when the queue is full
+ *
+ * @param merger the merger for the destination
+ * @param policy the overflow policy; the default is MIDI_MERGER_DROP_NEWEST.
+ * With MIDI_MERGER_BLOCK_SOURCE, a packet pushed while there is no room is
+ * dropped as with MIDI_MERGER_DROP_NEWEST.
+ */
+void midi_merger_set_policy(midi_merger_t* merger, midi_merger_policy_t policy);
+
+/**
+ * @brief share the destination fairly among sources instead of writing
+ * packets in the order they were pushed
+ *
+ * Each time the destination can take another packet, the merger picks,
+ * of the oldest queued packet of each source, the one that would finish
+ * first if the destination were shared by weight byte by byte
+ * (self-clocked fair queueing). The cost of a packet is the number of
+ * bytes it puts on the wire, less a status byte running status omits,
+ * so the share is a share of the wire time whatever the rate. A source
+ * with weight w of the total weight W of the busy sources gets at least
+ * w/W of the destination, and its packets wait at most about one
+ * packet of every other busy source more than its own queue needs.
+ * SysEx messages and real-time packets are not reordered. With the
+ * MIDI_MERGER_DROP_NEWEST or MIDI_MERGER_DROP_OLDEST policy, a full
+ * queue drops the newest or the oldest message of the source that has
+ * the most packets queued for its weight instead of the new packet.
+ *
+ * @param merger the merger for the destination
+ * @param enable true to share the destination by weight
+ */
+void midi_merger_set_fair(midi_merger_t* merger, bool enable);
+
+/**
+ * @brief set the share of the destination a source gets when fair
+ * sharing is enabled
+ *
+ * @param merger the merger for the destination
+ * @param source the source number
+ * @param weight 1-255; the default is MIDI_MERGER_DEFAULT_WEIGHT
+ */
+void midi_merger_set_weight(midi_merger_t* merger, uint8_t source, uint8_t weight);
+
+/**
+ * @brief enable or disable running status compression on the output
+ *
+ * A serial MIDI OUT only needs to send a channel message status byte
+ * when it differs from the previous one. System Common and SysEx
+ * messages cancel running status; real-time messages do not.
+ *
+ * @param merger the merger for the destination
+ * @param enable true to omit redundant status bytes
+ */
+void midi_merger_set_running_status(midi_merger_t* merger, bool enable);
+
+/**
+ * @brief enable or disable writing real-time bytes between the bytes of
+ * other messages
+ *
+ * MIDI 1.0 allows a real-time byte anywhere in a serial MIDI stream, even
+ * inside a SysEx message or between a status byte and its data. Enable
+ * this for byte stream outputs; leave it disabled for outputs such as
+ * tud_midi_stream_write() that only accept real-time bytes between messages.
+ *
+ * @param merger the merger for the destination
+ * @param enable true to write real-time bytes ahead of the rest of a
+ * partly written message
+ */
+void midi_merger_set_realtime_between_bytes(midi_merger_t* merger, bool enable);
+
+/**
+ * @brief write whole 4-byte event packets to the destination instead of
+ * the MIDI bytes they hold
+ *
+ * The write function is called with nbytes equal to 4 and must accept
+ * either the whole packet or nothing. The cable number in each packet is
+ * the source number; the write function may replace it.
+ *
+ * @param merger the merger for the destination
+ * @param enable true to write event packets
+ */
+void midi_merger_set_packet_output(midi_merger_t* merger, bool enable);
+
+/**
+ * @brief hold back the source of an open SysEx message instead of
+ * dropping its packets, whatever the policy
+ *
+ * A long SysEx dump that arrives faster than the destination accepts it
+ * then slows down to the speed of the destination instead of being cut
+ * short. The merger only records the setting; a caller that checks
+ * midi_merger_holds_back() before reading a source enforces it.
+ *
+ * @param merger the merger for the destination
+ * @param enable true to hold back the sources of open SysEx messages
+ */
+void midi_merger_set_sysex_flow_control(midi_merger_t* merger, bool enable);
+
+/**
+ * @brief return true if a caller should stop reading a source while
+ * midi_merger_free() for it is 0 instead of pushing and dropping packets
+ *
+ * @param merger the merger for the destination
+ * @param source the source number
+ */
+bool midi_merger_holds_back(const midi_merger_t* merger, uint8_t source);
+
+/**
+ * @brief discard all queued data and SysEx ownership (e.g., on USB disconnect)
+ */
+void midi_merger_reset(midi_merger_t* merger);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
@@ -0,0 +1,115 @@
+/**
+ * @file midi_monitor.c
+ * @brief describe captured MIDI messages as text for the monitor
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include "midi_monitor.h"
+
+static const char* system_name(uint8_t status)
+{
+  switch (status) {
+  case 0xF6:
+    return "Tune Request";
+  case 0xF8:
+    return "Clock";
+  case 0xFA:
+    return "Start";
+  case 0xFB:
+    return "Continue";
+  case 0xFC:
+    return "Stop";
+  case 0xFE:
+    return "Active Sensing";
+  case 0xFF:
+    return "Reset";
+  default:
+    return "Undefined";
+  }
+}
+
+// Describe the message in the packet; return the number of characters
+static int describe(const uint8_t packet[4], char* text, size_t size)
+{
+  uint8_t cin = midi_packet_cin(packet);
+  uint8_t status = packet[1];
+  unsigned channel = (status & 0xf) + 1;
+  switch (cin) {
+  case 0x8:
+    return snprintf(text, size, "Note Off ch %u note %u vel %u", channel, packet[2], packet[3]);
+  case 0x9:
+    return snprintf(text, size, "Note On ch %u note %u vel %u", channel, packet[2], packet[3]);
+  case 0xA:
+    return snprintf(text, size, "Poly Pressure ch %u note %u value %u", channel, packet[2], packet[3]);
+  case 0xB:
+    return snprintf(text, size, "Control Change ch %u cc %u value %u", channel, packet[2], packet[3]);
+  case 0xC:
+    return snprintf(text, size, "Program Change ch %u program %u", channel, packet[2]);
+  case 0xD:
+    return snprintf(text, size, "Channel Pressure ch %u value %u", channel, packet[2]);
+  case 0xE:
+    return snprintf(text, size, "Pitch Bend ch %u value %d", channel, (int)(packet[2] | packet[3] << 7) - 8192);
+  case MIDI_CIN_SYSCOMMON_2:
+    if (status == 0xF1) {
+      return snprintf(text, size, "MTC Quarter Frame %u", packet[2]);
+    }
+    return snprintf(text, size, "Song Select %u", packet[2]);
+  case MIDI_CIN_SYSCOMMON_3:
+    return snprintf(text, size, "Song Position %u", packet[2] | packet[3] << 7);
+  case MIDI_CIN_SYSEX:
+    return snprintf(text, size, status == 0xF0 ? "SysEx start" : "SysEx");
+  case MIDI_CIN_SYSEX_END_1:
+    if (status != 0xF7) {
+      return snprintf(text, size, "%s", system_name(status));
+    }
+    // fall through
+  case MIDI_CIN_SYSEX_END_2:
+  case MIDI_CIN_SYSEX_END_3:
+    return snprintf(text, size, status == 0xF0 ? "SysEx" : "SysEx end");
+  default:
+    return snprintf(text, size, "%s", system_name(status));
+  }
+}
+
+size_t midi_monitor_format(const midi_router_capture_t* entry, uint32_t start_us, char port_id, char* text)
+{
+  uint8_t nbytes = midi_packet_num_bytes(entry->packet);
+  int len = snprintf(text, MIDI_MONITOR_LINE_MAX, "%10lu %c ", (unsigned long)(entry->timestamp - start_us), port_id);
+  for (uint8_t idx = 1; idx <= 3; idx++) {
+    if (idx <= nbytes) {
+      len += snprintf(text + len, MIDI_MONITOR_LINE_MAX - len, " %02X", entry->packet[idx]);
+    }
+    else {
+      len += snprintf(text + len, MIDI_MONITOR_LINE_MAX - len, "   ");
+    }
+  }
+  len += snprintf(text + len, MIDI_MONITOR_LINE_MAX - len, "  ");
+  // Leave room for CR LF
+  int desc = describe(entry->packet, text + len, MIDI_MONITOR_LINE_MAX - 2 - len);
+  len += desc < MIDI_MONITOR_LINE_MAX - 3 - len ? desc : MIDI_MONITOR_LINE_MAX - 3 - len;
+  len += snprintf(text + len, MIDI_MONITOR_LINE_MAX - len, "\r\n");
+  return len;
+}
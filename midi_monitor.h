@@ -0,0 +1,62 @@
+/**
+ * @file midi_monitor.h
+ * @brief describe captured MIDI messages as text for the monitor
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MIDI_MONITOR_H
+#define MIDI_MONITOR_H
+#include <stdint.h>
+#include <stddef.h>
+#include "midi_router.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// The longest line midi_monitor_format() writes, including CR LF and
+// the terminating NUL
+#define MIDI_MONITOR_LINE_MAX 80
+
+/**
+ * @brief describe one captured packet as a line of text
+ *
+ * The line holds the capture time in microseconds since start_us, the
+ * port ID, the MIDI bytes in hex and what the message means, e.g.,
+ * "   1234567 A  90 3C 64  Note On ch 1 note 60 vel 100\r\n".
+ *
+ * @param entry the captured packet
+ * @param start_us the time the monitor started
+ * @param port_id the character that names the input
+ * @param text MIDI_MONITOR_LINE_MAX characters for the line
+ * @return the number of characters in the line, not counting the NUL
+ */
+size_t midi_monitor_format(const midi_router_capture_t* entry, uint32_t start_us, char port_id, char* text);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
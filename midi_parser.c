@@ -0,0 +1,248 @@
+/**
+ * @file midi_parser.c
+ * @brief convert a MIDI 1.0 byte stream to complete USB MIDI event packets
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "midi_parser.h"
+
+void midi_parser_init(midi_parser_t* parser, uint8_t cable)
+{
+  parser->cable = cable & 0xf;
+  parser->status = 0;
+  parser->idx = 0;
+  parser->expected = 0;
+  parser->in_sysex = false;
+}
+
+uint8_t midi_packet_num_bytes(const uint8_t packet[4])
+{
+  static const uint8_t cin_to_nbytes[16] = {0, 0, 2, 3, 3, 1, 2, 3, 3, 3, 3, 3, 2, 2, 3, 1};
+  return cin_to_nbytes[midi_packet_cin(packet)];
+}
+
+static void emit(midi_parser_t* parser, uint8_t cin, midi_parser_packet_cb cb, void* context)
+{
+  uint8_t packet[4] = {(uint8_t)((parser->cable << 4) | cin), 0, 0, 0};
+  for (uint8_t idx = 0; idx < parser->idx; idx++) {
+    packet[idx+1] = parser->buffer[idx];
+  }
+  parser->idx = 0;
+  cb(context, packet);
+}
+
+static void end_sysex(midi_parser_t* parser, midi_parser_packet_cb cb, void* context)
+{
+  parser->buffer[parser->idx++] = 0xF7;
+  emit(parser, MIDI_CIN_SYSEX_END_1 + parser->idx - 1, cb, context);
+  parser->in_sysex = false;
+}
+
+static uint8_t channel_message_length(uint8_t status)
+{
+  uint8_t type = status & 0xf0;
+  return (type == 0xC0 || type == 0xD0) ? 2 : 3;
+}
+
+static void parse_byte(midi_parser_t* parser, uint8_t byte, midi_parser_packet_cb cb, void* context)
+{
+  if (byte >= 0xF8) {
+    // Real-time messages may appear anywhere and do not affect running status
+    if (byte != 0xF9 && byte != 0xFD) {
+      uint8_t packet[4] = {(uint8_t)((parser->cable << 4) | MIDI_CIN_REALTIME), byte, 0, 0};
+      cb(context, packet);
+    }
+    return;
+  }
+  if (parser->in_sysex) {
+    if (byte == 0xF7) {
+      end_sysex(parser, cb, context);
+      return;
+    }
+    if (byte & 0x80) {
+      // Any status byte other than real-time terminates SysEx
+      end_sysex(parser, cb, context);
+    }
+    else {
+      parser->buffer[parser->idx++] = byte;
+      if (parser->idx == 3) {
+        emit(parser, MIDI_CIN_SYSEX, cb, context);
+      }
+      return;
+    }
+  }
+  if (byte & 0x80) {
+    parser->idx = 0;
+    parser->expected = 0;
+    if (byte < 0xF0) {
+      parser->status = byte;
+      parser->buffer[parser->idx++] = byte;
+      parser->expected = channel_message_length(byte);
+      return;
+    }
+    // System Common and SysEx messages cancel running status
+    parser->status = 0;
+    switch (byte) {
+    case 0xF0:
+      parser->in_sysex = true;
+      parser->buffer[parser->idx++] = byte;
+      break;
+    case 0xF1:
+    case 0xF3:
+      parser->buffer[parser->idx++] = byte;
+      parser->expected = 2;
+      break;
+    case 0xF2:
+      parser->buffer[parser->idx++] = byte;
+      parser->expected = 3;
+      break;
+    case 0xF6:
+      parser->buffer[parser->idx++] = byte;
+      emit(parser, MIDI_CIN_SYSEX_END_1, cb, context);
+      break;
+    default:
+      // undefined F4 & F5 and unexpected F7 are ignored
+      break;
+    }
+    return;
+  }
+  // data byte
+  if (parser->idx == 0) {
+    if (parser->status == 0) {
+      return; // no status for this byte; discard it
+    }
+    parser->buffer[parser->idx++] = parser->status;
+    parser->expected = channel_message_length(parser->status);
+  }
+  parser->buffer[parser->idx++] = byte;
+  if (parser->idx == parser->expected) {
+    uint8_t status = parser->buffer[0];
+    uint8_t cin = status < 0xF0 ? (status >> 4) : (parser->expected == 2 ? MIDI_CIN_SYSCOMMON_2 : MIDI_CIN_SYSCOMMON_3);
+    emit(parser, cin, cb, context);
+  }
+}
+
+void midi_parser_parse(midi_parser_t* parser, const uint8_t* bytes, size_t nbytes, midi_parser_packet_cb cb, void* context)
+{
+  for (size_t idx = 0; idx < nbytes; idx++) {
+    parse_byte(parser, bytes[idx], cb, context);
+  }
+}
+
+// Return true if the packet holds one complete message whose status byte
+// matches its code index number and whose data bytes are all valid
+static bool is_complete_message(const uint8_t packet[4])
+{
+  uint8_t cin = midi_packet_cin(packet);
+  uint8_t status = packet[1];
+  bool status_ok;
+  if (cin >= 0x8 && cin <= 0xE) {
+    status_ok = (status >> 4) == cin;
+  }
+  else if (cin == MIDI_CIN_SYSCOMMON_2) {
+    status_ok = status == 0xF1 || status == 0xF3;
+  }
+  else if (cin == MIDI_CIN_SYSCOMMON_3) {
+    status_ok = status == 0xF2;
+  }
+  else {
+    status_ok = cin == MIDI_CIN_SYSEX_END_1 && status == 0xF6;
+  }
+  if (!status_ok) {
+    return false;
+  }
+  uint8_t nbytes = midi_packet_num_bytes(packet);
+  for (uint8_t idx = 1; idx < nbytes; idx++) {
+    if (packet[1 + idx] & 0x80) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Return true if the packet continues the SysEx message the parser is in,
+// or starts one in an idle parser, with only valid data bytes in between.
+// The parser state after passing such a packet through is the same as
+// after parsing its bytes one at a time.
+static bool is_sysex_packet(const midi_parser_t* parser, const uint8_t packet[4])
+{
+  uint8_t cin = midi_packet_cin(packet);
+  uint8_t nbytes = midi_packet_num_bytes(packet);
+  if (parser->idx != 0 || (cin != MIDI_CIN_SYSEX && cin != MIDI_CIN_SYSEX_END_1 &&
+      cin != MIDI_CIN_SYSEX_END_2 && cin != MIDI_CIN_SYSEX_END_3)) {
+    return false;
+  }
+  uint8_t first = 1;
+  uint8_t last = nbytes;
+  if (!parser->in_sysex) {
+    // Only a start that leaves the message open; F0 F7 and F0 xx F7 are parsed
+    if (cin != MIDI_CIN_SYSEX || packet[1] != 0xF0) {
+      return false;
+    }
+    first = 2;
+  }
+  if (cin != MIDI_CIN_SYSEX) {
+    if (packet[nbytes] != 0xF7) {
+      return false;
+    }
+    last = nbytes - 1;
+  }
+  for (uint8_t idx = first; idx <= last; idx++) {
+    if (packet[idx] & 0x80) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void midi_parser_parse_packet(midi_parser_t* parser, const uint8_t packet[4], midi_parser_packet_cb cb, void* context)
+{
+  uint8_t cin = midi_packet_cin(packet);
+  bool pass_through = false;
+  if (cin == MIDI_CIN_REALTIME && packet[1] >= 0xF8) {
+    // Real-time messages may appear anywhere and do not affect running status
+    if (packet[1] == 0xF9 || packet[1] == 0xFD) {
+      return;
+    }
+    pass_through = true;
+  }
+  else if (parser->idx == 0 && !parser->in_sysex && is_complete_message(packet)) {
+    parser->status = packet[1] < 0xF0 ? packet[1] : 0;
+    pass_through = true;
+  }
+  else if (is_sysex_packet(parser, packet)) {
+    // Long SysEx dumps move three bytes per packet without being re-parsed
+    parser->status = 0;
+    parser->in_sysex = cin == MIDI_CIN_SYSEX;
+    pass_through = true;
+  }
+  if (pass_through) {
+    uint8_t out[4] = {(uint8_t)((parser->cable << 4) | cin), packet[1], packet[2], packet[3]};
+    cb(context, out);
+  }
+  else {
+    midi_parser_parse(parser, packet + 1, midi_packet_num_bytes(packet), cb, context);
+  }
+}
@@ -0,0 +1,158 @@
+/**
+ * @file midi_parser.h
+ * @brief convert a MIDI 1.0 byte stream to complete USB MIDI event packets
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MIDI_PARSER_H
+#define MIDI_PARSER_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// USB MIDI 1.0 Code Index Numbers (the low nibble of the event packet header)
+enum {
+  MIDI_CIN_SYSCOMMON_2 = 0x2,  // 2-byte System Common (F1, F3)
+  MIDI_CIN_SYSCOMMON_3 = 0x3,  // 3-byte System Common (F2)
+  MIDI_CIN_SYSEX = 0x4,        // SysEx starts or continues
+  MIDI_CIN_SYSEX_END_1 = 0x5,  // SysEx ends with 1 byte or 1-byte System Common (F6)
+  MIDI_CIN_SYSEX_END_2 = 0x6,  // SysEx ends with 2 bytes
+  MIDI_CIN_SYSEX_END_3 = 0x7,  // SysEx ends with 3 bytes
+  MIDI_CIN_REALTIME = 0xF,     // Single byte
+};
+
+/**
+ * @brief The parser keeps enough state for one MIDI input stream to
+ * expand running status and to split SysEx into 3-byte packets.
+ *
+ * Every packet the parser emits is a complete message (or a complete
+ * SysEx segment) with its status byte present, so packets from different
+ * parsers can be merged onto one output without corrupting either stream.
+ */
+typedef struct {
+  uint8_t cable;      // value placed in the cable number nibble of each packet
+  uint8_t status;     // running status, or 0 if there is none
+  uint8_t buffer[3];  // message (or SysEx segment) under construction
+  uint8_t idx;        // number of bytes in buffer
+  uint8_t expected;   // total number of bytes in the message under construction
+  bool in_sysex;
+} midi_parser_t;
+
+/**
+ * @brief called once for every complete event packet the parser produces
+ *
+ * @param context the context pointer passed to midi_parser_parse()
+ * @param packet the 4-byte USB MIDI event packet
+ */
+typedef void (*midi_parser_packet_cb)(void* context, const uint8_t packet[4]);
+
+/**
+ * @brief initialize the parser state
+ *
+ * @param parser the parser to initialize
+ * @param cable the cable number (0-15) to encode in every packet
+ */
+void midi_parser_init(midi_parser_t* parser, uint8_t cable);
+
+/**
+ * @brief parse nbytes of MIDI 1.0 stream data
+ *
+ * Partial messages are held in the parser until the rest of the
+ * message arrives in a later call. Real-time bytes are emitted
+ * immediately, even from within a SysEx message or other message.
+ * A SysEx message that is interrupted by a status byte is
+ * terminated with an F7 so that the output stream stays valid.
+ *
+ * @param parser the parser for this stream
+ * @param bytes the bytes to parse
+ * @param nbytes the number of bytes to parse
+ * @param cb the function to call for each complete event packet
+ * @param context passed unchanged to cb
+ */
+void midi_parser_parse(midi_parser_t* parser, const uint8_t* bytes, size_t nbytes, midi_parser_packet_cb cb, void* context);
+
+/**
+ * @brief parse one USB MIDI event packet
+ *
+ * A packet that holds one complete, well-formed message while no other
+ * message is under construction is passed to cb with only the cable
+ * number changed. Any other packet is parsed byte by byte as with
+ * midi_parser_parse(), so the packets passed to cb follow the same rules.
+ *
+ * @param parser the parser for this stream
+ * @param packet the 4-byte USB MIDI event packet; its cable number is ignored
+ * @param cb the function to call for each complete event packet
+ * @param context passed unchanged to cb
+ */
+void midi_parser_parse_packet(midi_parser_t* parser, const uint8_t packet[4], midi_parser_packet_cb cb, void* context);
+
+/**
+ * @brief return the number of MIDI bytes (0-3) in a USB MIDI event packet
+ */
+uint8_t midi_packet_num_bytes(const uint8_t packet[4]);
+
+static inline uint8_t midi_packet_cin(const uint8_t packet[4])
+{
+  return packet[0] & 0xf;
+}
+
+static inline uint8_t midi_packet_cable(const uint8_t packet[4])
+{
+  return packet[0] >> 4;
+}
+
+static inline bool midi_packet_is_realtime(const uint8_t packet[4])
+{
+  return midi_packet_cin(packet) == MIDI_CIN_REALTIME;
+}
+
+/**
+ * @brief return true if the packet is the first segment of a SysEx
+ * message that continues in later packets
+ */
+static inline bool midi_packet_is_sysex_start(const uint8_t packet[4])
+{
+  return midi_packet_cin(packet) == MIDI_CIN_SYSEX && packet[1] == 0xF0;
+}
+
+/**
+ * @brief return true if the packet is the last segment of a SysEx message
+ */
+static inline bool midi_packet_is_sysex_end(const uint8_t packet[4])
+{
+  uint8_t cin = midi_packet_cin(packet);
+  return cin == MIDI_CIN_SYSEX_END_2 || cin == MIDI_CIN_SYSEX_END_3 ||
+    (cin == MIDI_CIN_SYSEX_END_1 && packet[1] == 0xF7);
+}
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
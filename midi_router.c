@@ -0,0 +1,655 @@
+/**
+ * @file midi_router.c
+ * @brief route MIDI data from any input port to any set of output ports
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "midi_router.h"
+
+#define IDENTITY_16(first) first, first + 1, first + 2, first + 3, first + 4, first + 5, first + 6, first + 7, \
+  first + 8, first + 9, first + 10, first + 11, first + 12, first + 13, first + 14, first + 15
+static const uint8_t identity[128] = {
+  IDENTITY_16(0), IDENTITY_16(16), IDENTITY_16(32), IDENTITY_16(48),
+  IDENTITY_16(64), IDENTITY_16(80), IDENTITY_16(96), IDENTITY_16(112),
+};
+
+const midi_router_transform_t midi_router_no_transform = {0, 0, 100, 0, 127};
+
+static void packet_sent(void* context, const uint8_t packet[4], uint32_t timestamp)
+{
+  midi_router_output_t* output = (midi_router_output_t*)context;
+  midi_router_t* router = output->router;
+  uint8_t in = midi_packet_cable(packet);
+  uint8_t nbytes = midi_packet_num_bytes(packet);
+  route_stats_record(&router->latency[in][output->port], router->now_us() - timestamp);
+  router->source_counters[in].written += nbytes;
+  router->dest_counters[output->port].written += nbytes;
+}
+
+static void packet_dropped(void* context, const uint8_t packet[4], uint32_t timestamp)
+{
+  (void)timestamp;
+  midi_router_output_t* output = (midi_router_output_t*)context;
+  midi_router_count_dropped(output->router, output->port, packet);
+}
+
+void midi_router_init(midi_router_t* router, uint8_t num_ports, midi_router_clock_fn now_us)
+{
+  router->num_ports = num_ports;
+  router->now_us = now_us;
+  memset(router->matrix, 0, sizeof(router->matrix));
+  memset(router->filters, 0, sizeof(router->filters));
+  for (uint8_t in = 0; in < MIDI_ROUTER_MAX_PORTS; in++) {
+    for (uint8_t out = 0; out < MIDI_ROUTER_MAX_PORTS; out++) {
+      router->transforms[in][out] = midi_router_no_transform;
+    }
+  }
+  memset(router->mergers, 0, sizeof(router->mergers));
+  router->remote_outputs = 0;
+  router->forward = NULL;
+  router->remote_room = NULL;
+  router->remote_context = NULL;
+  for (uint8_t port = 0; port < num_ports; port++) {
+    midi_parser_init(router->parsers + port, port);
+    router->outputs[port].router = router;
+    router->outputs[port].port = port;
+  }
+  table_publisher_init(&router->publisher, router->tables + 0, router->tables + 1);
+  memset(router->tables, 0, sizeof(router->tables));
+  router->trigger = MIDI_ROUTER_NO_TRIGGER;
+  router->program = NULL;
+  router->program_context = NULL;
+  router->monitor_inputs = 0;
+  router->capture = NULL;
+  router->capture_dropped = 0;
+  router->sync_input = MIDI_ROUTER_NO_SYNC;
+  router->sync_outputs = 0;
+  router->sync = NULL;
+  router->sync_context = NULL;
+  memset(router->wheels, 0, sizeof(router->wheels));
+  for (uint8_t port = 0; port < MIDI_ROUTER_MAX_PORTS; port++) {
+    router->delay_us[port] = 0;
+    router->last_due_us[port] = 0;
+  }
+  router->active = NULL;
+  router->sysex_open = 0;
+  memset(router->sysex_outputs, 0, sizeof(router->sysex_outputs));
+  memset(router->unterminated, 0, sizeof(router->unterminated));
+  router->unterminated_inputs = 0;
+  midi_router_reset_counters(router);
+  midi_router_reset_stats(router);
+}
+
+void midi_router_set_output(midi_router_t* router, uint8_t out, midi_merger_t* merger, bool remote)
+{
+  router->mergers[out] = merger;
+  if (remote) {
+    router->remote_outputs |= 1u << out;
+  }
+  else {
+    router->remote_outputs &= ~(1u << out);
+  }
+  midi_merger_set_sent_cb(merger, packet_sent, router->outputs + out);
+  midi_merger_set_dropped_cb(merger, packet_dropped, router->outputs + out);
+}
+
+void midi_router_set_wheel(midi_router_t* router, uint8_t out, timer_wheel_t* wheel)
+{
+  router->wheels[out] = wheel;
+}
+
+bool midi_router_set_delay(midi_router_t* router, uint8_t out, uint32_t delay_us)
+{
+  if (router->wheels[out] == NULL || delay_us > MIDI_ROUTER_MAX_DELAY_US) {
+    return false;
+  }
+  router->delay_us[out] = delay_us;
+  return true;
+}
+
+void midi_router_release(midi_router_t* router, uint32_t now_us)
+{
+  for (uint8_t out = 0; out < router->num_ports; out++) {
+    timer_wheel_t* wheel = router->wheels[out];
+    if (wheel != NULL && wheel->count != 0) {
+      timer_wheel_poll(wheel, now_us);
+    }
+  }
+}
+
+bool midi_router_next_due(const midi_router_t* router, uint32_t* due_us)
+{
+  bool found = false;
+  for (uint8_t out = 0; out < router->num_ports; out++) {
+    uint32_t due;
+    const timer_wheel_t* wheel = router->wheels[out];
+    if (wheel != NULL && timer_wheel_next_due(wheel, &due) && (!found || (int32_t)(due - *due_us) < 0)) {
+      *due_us = due;
+      found = true;
+    }
+  }
+  return found;
+}
+
+void midi_router_set_remote(midi_router_t* router, midi_router_forward_fn forward, midi_router_room_fn room, void* context)
+{
+  router->forward = forward;
+  router->remote_room = room;
+  router->remote_context = context;
+}
+
+void midi_router_set_program_cb(midi_router_t* router, midi_router_program_fn program, void* context)
+{
+  router->program = program;
+  router->program_context = context;
+}
+
+void midi_router_set_trigger(midi_router_t* router, uint16_t in, uint8_t channel)
+{
+  // One aligned store, so it is safe while another core routes
+  router->trigger = in == MIDI_ROUTER_NO_TRIGGER ? MIDI_ROUTER_NO_TRIGGER :
+    (uint16_t)(in << 8 | MIDI_ROUTER_CHANNEL_CLASS(0xC0 | (channel & 0xf)));
+}
+
+void midi_router_set_sync_cb(midi_router_t* router, midi_router_sync_fn sync, void* context)
+{
+  router->sync = sync;
+  router->sync_context = context;
+}
+
+void midi_router_set_sync_input(midi_router_t* router, uint8_t in)
+{
+  router->sync_input = in;
+}
+
+void midi_router_set_sync_outputs(midi_router_t* router, uint16_t outputs)
+{
+  router->sync_outputs = outputs;
+}
+
+bool midi_router_get_trigger(const midi_router_t* router, uint8_t* in, uint8_t* channel)
+{
+  uint16_t trigger = router->trigger;
+  if (trigger == MIDI_ROUTER_NO_TRIGGER) {
+    return false;
+  }
+  *in = trigger >> 8;
+  *channel = trigger & 0xf;
+  return true;
+}
+
+void midi_router_set_capture_ring(midi_router_t* router, spsc_ring_t* capture)
+{
+  router->capture = capture;
+}
+
+void midi_router_monitor(midi_router_t* router, uint16_t inputs)
+{
+  // One aligned store, so it is safe while another core routes
+  router->monitor_inputs = router->capture == NULL ? 0 : inputs;
+}
+
+uint32_t midi_router_capture_dropped(const midi_router_t* router)
+{
+  return router->capture_dropped;
+}
+
+static void capture_packet(midi_router_t* router, const uint8_t packet[4], uint32_t timestamp)
+{
+  midi_router_capture_t entry = {timestamp, {packet[0], packet[1], packet[2], packet[3]}};
+  if (!spsc_ring_push(router->capture, &entry)) {
+    router->capture_dropped++;
+  }
+}
+
+void midi_router_connect(midi_router_t* router, uint8_t in, uint8_t out)
+{
+  router->matrix[in] |= 1u << out;
+}
+
+void midi_router_disconnect(midi_router_t* router, uint8_t in, uint8_t out)
+{
+  router->matrix[in] &= ~(1u << out);
+}
+
+bool midi_router_is_connected(const midi_router_t* router, uint8_t in, uint8_t out)
+{
+  return (router->matrix[in] & (1u << out)) != 0;
+}
+
+const midi_router_filter_t* midi_router_get_filter(const midi_router_t* router, uint8_t in, uint8_t out)
+{
+  return &router->filters[in][out];
+}
+
+void midi_router_set_filter(midi_router_t* router, uint8_t in, uint8_t out, const midi_router_filter_t* filter)
+{
+  router->filters[in][out] = *filter;
+}
+
+const midi_router_transform_t* midi_router_get_transform(const midi_router_t* router, uint8_t in, uint8_t out)
+{
+  return &router->transforms[in][out];
+}
+
+bool midi_router_transform_is_none(const midi_router_transform_t* transform)
+{
+  return memcmp(transform, &midi_router_no_transform, sizeof(*transform)) == 0;
+}
+
+// Return the index of transform in slots, adding it if there is room;
+// return nslots if it is not there and there is no room
+static uint8_t find_transform(midi_router_transform_t* slots, uint8_t* nslots, const midi_router_transform_t* transform)
+{
+  uint8_t slot;
+  for (slot = 0; slot < *nslots; slot++) {
+    if (memcmp(slots + slot, transform, sizeof(*transform)) == 0) {
+      return slot;
+    }
+  }
+  if (slot < MIDI_ROUTER_NUM_TRANSFORMS) {
+    slots[(*nslots)++] = *transform;
+  }
+  return slot;
+}
+
+bool midi_router_set_transform(midi_router_t* router, uint8_t in, uint8_t out, const midi_router_transform_t* transform)
+{
+  // Count the different transforms every route would have, connected or not
+  midi_router_transform_t slots[MIDI_ROUTER_NUM_TRANSFORMS];
+  uint8_t nslots = 0;
+  for (uint8_t from = 0; from < MIDI_ROUTER_MAX_PORTS; from++) {
+    for (uint8_t to = 0; to < MIDI_ROUTER_MAX_PORTS; to++) {
+      const midi_router_transform_t* route = (from == in && to == out) ? transform : &router->transforms[from][to];
+      if (!midi_router_transform_is_none(route) && find_transform(slots, &nslots, route) == MIDI_ROUTER_NUM_TRANSFORMS) {
+        return false;
+      }
+    }
+  }
+  router->transforms[in][out] = *transform;
+  return true;
+}
+
+static uint8_t clamp(int value, int min, int max)
+{
+  return value < min ? min : (value > max ? max : value);
+}
+
+static void compile_transform(const midi_router_transform_t* transform, midi_router_lut_t* lut)
+{
+  for (uint8_t channel = 0; channel < 16; channel++) {
+    lut->channel[channel] = transform->channel == 0 ? channel : transform->channel - 1;
+  }
+  for (int value = 0; value < 128; value++) {
+    lut->note[value] = clamp(value + transform->transpose, 0, 127);
+    lut->velocity[value] = value == 0 ? 0 : clamp((value * transform->velocity + 50) / 100, 1, 127);
+    lut->cc_value[value] = clamp(value, transform->cc_min, transform->cc_max);
+  }
+  // Note off, note on, poly pressure, control change, program change,
+  // channel pressure, pitch bend
+  const uint8_t* data1[7] = {lut->note, lut->note, lut->note, identity, identity, identity, identity};
+  const uint8_t* data2[7] = {lut->velocity, lut->velocity, identity, lut->cc_value, identity, identity, identity};
+  memcpy(lut->data1, data1, sizeof(data1));
+  memcpy(lut->data2, data2, sizeof(data2));
+}
+
+bool midi_router_publish(midi_router_t* router)
+{
+  if (!table_publisher_spare_is_free(&router->publisher)) {
+    return false;
+  }
+  midi_router_table_t* table = table_publisher_spare(&router->publisher);
+  midi_router_transform_t slots[MIDI_ROUTER_NUM_TRANSFORMS];
+  uint8_t nslots = 0;
+  for (uint8_t in = 0; in < router->num_ports; in++) {
+    midi_router_fanout_t* fan = table->fanout + in;
+    fan->outputs = 0;
+    fan->nlocal = 0;
+    fan->nremote = 0;
+    memset(fan->blocked, 0, sizeof(fan->blocked));
+    for (uint8_t out = 0; out < router->num_ports; out++) {
+      if (!(router->matrix[in] & (1u << out)) || router->mergers[out] == NULL) {
+        continue;
+      }
+      fan->outputs |= 1u << out;
+      const midi_router_filter_t* filter = &router->filters[in][out];
+      for (uint8_t msg_class = 0; msg_class < MIDI_ROUTER_NUM_CLASSES; msg_class++) {
+        if (midi_router_filter_blocks(filter, msg_class)) {
+          fan->blocked[msg_class] |= 1u << out;
+        }
+      }
+      const midi_router_transform_t* transform = &router->transforms[in][out];
+      const midi_router_lut_t* lut = NULL;
+      if (!midi_router_transform_is_none(transform)) {
+        // midi_router_set_transform() made sure there is a slot
+        uint8_t nused = nslots;
+        uint8_t slot = find_transform(slots, &nslots, transform);
+        if (nslots != nused) {
+          compile_transform(transform, table->luts + slot);
+        }
+        lut = table->luts + slot;
+      }
+      if (router->remote_outputs & (1u << out)) {
+        fan->remote_lut[fan->nremote] = lut;
+        fan->remote[fan->nremote++] = out;
+      }
+      else {
+        fan->local_port[fan->nlocal] = out;
+        fan->local_lut[fan->nlocal] = lut;
+        fan->local[fan->nlocal++] = router->mergers[out];
+      }
+    }
+  }
+  table_publisher_publish(&router->publisher);
+  return true;
+}
+
+/**
+ * @brief push a packet to a local output, or to its timer wheel if the
+ * output is scheduled or still holds packets
+ */
+static void deliver(midi_router_t* router, uint8_t out, const uint8_t packet[4], uint32_t timestamp, uint32_t target)
+{
+  timer_wheel_t* wheel = router->wheels[out];
+  uint32_t delay = router->delay_us[out];
+  if (wheel == NULL || (delay == 0 && wheel->count == 0)) {
+    midi_router_push(router, out, packet, timestamp);
+    return;
+  }
+  uint32_t now = router->now_us();
+  uint32_t due = target + delay;
+  if ((int32_t)(due - (now + MIDI_ROUTER_MAX_DELAY_US)) > 0) {
+    due = now + MIDI_ROUTER_MAX_DELAY_US; // a target too far ahead
+  }
+  if ((int32_t)(due - router->last_due_us[out]) < 0 && wheel->count != 0) {
+    due = router->last_due_us[out];
+  }
+  router->last_due_us[out] = due;
+  const midi_merger_entry_t entry = {{packet[0], packet[1], packet[2], packet[3]}, timestamp};
+  while (!timer_wheel_add(wheel, due, &entry)) {
+    // Full: send the first packets early rather than lose any
+    uint32_t first;
+    timer_wheel_next_due(wheel, &first);
+    timer_wheel_poll(wheel, first);
+  }
+}
+
+// Send a packet to one output; return false if a remote output dropped it
+static bool send(midi_router_t* router, uint8_t out, const uint8_t packet[4], uint32_t timestamp)
+{
+  if (router->remote_outputs & (1u << out)) {
+    if (!router->forward(router->remote_context, out, packet, timestamp)) {
+      router->dest_counters[out].offered += midi_packet_num_bytes(packet);
+      midi_router_count_dropped(router, out, packet);
+      return false;
+    }
+  }
+  else {
+    deliver(router, out, packet, timestamp, timestamp);
+  }
+  return true;
+}
+
+// End the open SysEx messages on the outputs the new table no longer sends
+// them to, so those outputs do not wait for the rest of the message. A
+// remote output that is full gets its F7 in a later pass.
+static void end_cut_off_sysex(midi_router_t* router, const midi_router_table_t* table, uint32_t timestamp)
+{
+  for (uint8_t in = 0; in < router->num_ports; in++) {
+    if (table != router->active && (router->sysex_open & (1u << in))) {
+      const midi_router_fanout_t* fan = table->fanout + in;
+      uint16_t lost = router->sysex_outputs[in] & ~(fan->outputs & ~fan->blocked[MIDI_ROUTER_SYSTEM_CLASS(0xF0)]);
+      router->sysex_outputs[in] &= ~lost;
+      router->unterminated[in] |= lost;
+      router->unterminated_inputs |= lost != 0 ? 1u << in : 0;
+    }
+    uint16_t outputs = router->unterminated[in];
+    if (outputs == 0) {
+      continue;
+    }
+    const uint8_t end[4] = {(uint8_t)(in << 4 | MIDI_CIN_SYSEX_END_1), 0xF7, 0, 0};
+    for (uint8_t out = 0; out < router->num_ports; out++) {
+      if ((outputs & (1u << out)) && send(router, out, end, timestamp)) {
+        outputs &= ~(1u << out);
+      }
+    }
+    router->unterminated[in] = outputs;
+    if (outputs == 0) {
+      router->unterminated_inputs &= ~(1u << in);
+    }
+  }
+}
+
+void midi_router_begin(midi_router_t* router, midi_router_pass_t* pass, uint16_t enabled_outputs)
+{
+  pass->router = router;
+  const midi_router_table_t* table = table_publisher_acquire(&router->publisher, &pass->generation);
+  pass->fanout = table->fanout;
+  pass->enabled_outputs = enabled_outputs;
+  pass->timestamp = router->now_us();
+  pass->target = pass->timestamp;
+  if (table != router->active || router->unterminated_inputs != 0) {
+    end_cut_off_sysex(router, table, pass->timestamp);
+    router->active = table;
+  }
+}
+
+void midi_router_end(midi_router_pass_t* pass)
+{
+  table_publisher_release(&pass->router->publisher, pass->generation);
+}
+
+uint16_t midi_router_outputs_of(const midi_router_pass_t* pass, uint8_t in, uint8_t msg_class)
+{
+  const midi_router_fanout_t* fan = pass->fanout + in;
+  return fan->outputs & ~fan->blocked[msg_class] & pass->enabled_outputs;
+}
+
+bool midi_router_inject(midi_router_t* router, uint8_t out, const uint8_t packet[4], uint32_t timestamp)
+{
+  if (router->remote_outputs & (1u << out)) {
+    return send(router, out, packet, timestamp);
+  }
+  midi_router_push(router, out, packet, timestamp);
+  return true;
+}
+
+void midi_router_push(midi_router_t* router, uint8_t out, const uint8_t packet[4], uint32_t timestamp)
+{
+  midi_merger_t* merger = router->mergers[out];
+  midi_router_counters_t* counters = router->dest_counters + out;
+  counters->offered += midi_packet_num_bytes(packet);
+  midi_merger_push(merger, packet, timestamp); // the merger reports drops to packet_dropped()
+  uint16_t nqueued = merger->count + merger->ndeferred;
+  if (nqueued > counters->high_water) {
+    counters->high_water = nqueued;
+  }
+}
+
+void midi_router_count_dropped(midi_router_t* router, uint8_t out, const uint8_t packet[4])
+{
+  uint8_t nbytes = midi_packet_num_bytes(packet);
+  router->source_counters[midi_packet_cable(packet)].dropped += nbytes;
+  router->dest_counters[out].dropped += nbytes;
+}
+
+// Return the packet to send on a route: the packet itself, or a copy in
+// buffer with the route transform applied to its channel voice message
+static const uint8_t* transform_packet(const midi_router_lut_t* lut, bool channel_voice, const uint8_t packet[4], uint8_t buffer[4])
+{
+  if (lut == NULL || !channel_voice) {
+    return packet;
+  }
+  uint8_t status = packet[1];
+  uint8_t type = (status >> 4) - 0x8;
+  buffer[0] = packet[0];
+  buffer[1] = (status & 0xf0) | lut->channel[status & 0xf];
+  buffer[2] = lut->data1[type][packet[2]];
+  buffer[3] = lut->data2[type][packet[3]];
+  return buffer;
+}
+
+// Return the outputs a SysEx packet goes to: a message that is already
+// open only goes on to the outputs it started on
+static uint16_t sysex_route_outputs(midi_router_t* router, const midi_router_fanout_t* fan, uint8_t in,
+  const uint8_t packet[4], uint16_t outputs)
+{
+  uint16_t in_bit = 1u << in;
+  if (midi_packet_is_sysex_start(packet)) {
+    router->sysex_open |= in_bit;
+    router->sysex_outputs[in] = outputs & fan->outputs;
+  }
+  else if (router->sysex_open & in_bit) {
+    outputs &= router->sysex_outputs[in];
+    if (midi_packet_is_sysex_end(packet)) {
+      router->sysex_open &= ~in_bit;
+    }
+  }
+  return outputs;
+}
+
+void midi_router_route(void* context, const uint8_t packet[4])
+{
+  midi_router_pass_t* pass = (midi_router_pass_t*)context;
+  midi_router_t* router = pass->router;
+  uint8_t in = midi_packet_cable(packet);
+  const midi_router_fanout_t* fan = pass->fanout + in;
+  if (router->monitor_inputs & (1u << in)) {
+    capture_packet(router, packet, pass->timestamp);
+  }
+  bool sync = midi_packet_cin(packet) == MIDI_CIN_REALTIME &&
+    (packet[1] == 0xF8 || (packet[1] >= 0xFA && packet[1] <= 0xFC));
+  if (sync && in == router->sync_input) {
+    router->sync(router->sync_context, packet[1], pass->timestamp);
+    return;
+  }
+  // Filter once per message; the route filters only take outputs away
+  uint8_t msg_class = midi_router_message_class(packet);
+  uint16_t outputs = pass->enabled_outputs & ~fan->blocked[msg_class];
+  if (sync) {
+    outputs &= ~router->sync_outputs;
+  }
+  if (msg_class == MIDI_ROUTER_SYSTEM_CLASS(0xF0)) {
+    outputs = sysex_route_outputs(router, fan, in, packet, outputs);
+  }
+  else if ((in << 8 | msg_class) == router->trigger && router->program != NULL) {
+    router->program(router->program_context, packet[2]);
+  }
+  bool channel_voice = msg_class < MIDI_ROUTER_SYSTEM_CLASS(0xF0);
+  uint8_t buffer[4];
+  for (uint8_t idx = 0; idx < fan->nlocal; idx++) {
+    uint8_t out = fan->local_port[idx];
+    if (outputs & (1u << out)) {
+      deliver(router, out, transform_packet(fan->local_lut[idx], channel_voice, packet, buffer), pass->timestamp, pass->target);
+    }
+  }
+  for (uint8_t idx = 0; idx < fan->nremote; idx++) {
+    uint8_t out = fan->remote[idx];
+    if (outputs & (1u << out)) {
+      (void)send(router, out, transform_packet(fan->remote_lut[idx], channel_voice, packet, buffer), pass->timestamp);
+    }
+  }
+}
+
+void midi_router_count_received(midi_router_t* router, uint8_t in, uint32_t nbytes)
+{
+  midi_router_counters_t* counters = router->source_counters + in;
+  counters->offered += nbytes;
+  if (nbytes > counters->high_water) {
+    counters->high_water = nbytes;
+  }
+}
+
+void midi_router_parse(midi_router_pass_t* pass, uint8_t in, const uint8_t* bytes, uint32_t nbytes)
+{
+  if (nbytes > 0) {
+    pass->timestamp = pass->router->now_us();
+    pass->target = pass->timestamp;
+    midi_router_count_received(pass->router, in, nbytes);
+    midi_parser_parse(pass->router->parsers + in, bytes, nbytes, midi_router_route, pass);
+  }
+}
+
+// Return the room of one output for input in, or UINT16_MAX if it drops
+// packets from in instead of holding in back
+static uint16_t output_room(const midi_router_t* router, uint8_t out, uint8_t in, uint8_t room_source)
+{
+  const midi_merger_t* merger = router->mergers[out];
+  if (!midi_merger_holds_back(merger, in)) {
+    return UINT16_MAX;
+  }
+  if (router->remote_outputs & (1u << out)) {
+    return router->remote_room(router->remote_context, out, room_source);
+  }
+  return midi_merger_free(merger, room_source);
+}
+
+uint16_t midi_router_room(const midi_router_pass_t* pass, uint8_t in, uint8_t room_source)
+{
+  const midi_router_t* router = pass->router;
+  const midi_router_fanout_t* fan = pass->fanout + in;
+  uint16_t room = UINT16_MAX;
+  for (uint8_t idx = 0; idx < fan->nlocal; idx++) {
+    uint8_t out = fan->local_port[idx];
+    if (pass->enabled_outputs & (1u << out)) {
+      uint16_t out_room = output_room(router, out, in, room_source);
+      room = out_room < room ? out_room : room;
+    }
+  }
+  for (uint8_t idx = 0; idx < fan->nremote; idx++) {
+    uint8_t out = fan->remote[idx];
+    if (pass->enabled_outputs & (1u << out)) {
+      uint16_t out_room = output_room(router, out, in, room_source);
+      room = out_room < room ? out_room : room;
+    }
+  }
+  return room;
+}
+
+uint32_t midi_router_read_limit(const midi_router_pass_t* pass, uint8_t in, uint8_t room_source, uint32_t max)
+{
+  uint16_t room = midi_router_room(pass, in, room_source);
+  // Parsing n bytes produces at most n + 1 packets
+  if (room == 0) {
+    return 0;
+  }
+  return room - 1u < max ? room - 1u : max;
+}
+
+void midi_router_reset_counters(midi_router_t* router)
+{
+  memset(router->source_counters, 0, sizeof(router->source_counters));
+  memset(router->dest_counters, 0, sizeof(router->dest_counters));
+}
+
+void midi_router_reset_stats(midi_router_t* router)
+{
+  for (uint8_t in = 0; in < MIDI_ROUTER_MAX_PORTS; in++) {
+    for (uint8_t out = 0; out < MIDI_ROUTER_MAX_PORTS; out++) {
+      route_stats_reset(&router->latency[in][out]);
+    }
+  }
+}
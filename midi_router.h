@@ -0,0 +1,599 @@
+/**
+ * @file midi_router.h
+ * @brief route MIDI data from any input port to any set of output ports
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MIDI_ROUTER_H
+#define MIDI_ROUTER_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "midi_parser.h"
+#include "midi_merger.h"
+#include "table_publisher.h"
+#include "route_stats.h"
+#include "spsc_ring.h"
+#include "timer_wheel.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define MIDI_ROUTER_MAX_PORTS 16
+
+// Every message falls in one of 128 classes that a route filter can
+// block: one per channel voice message type (8n-En) and channel, and one
+// per system status byte (F0-FF). Every segment of a SysEx message is in
+// the class of F0.
+#define MIDI_ROUTER_NUM_CLASSES 128
+#define MIDI_ROUTER_CHANNEL_CLASS(status) ((uint8_t)((((status) >> 4) - 0x8) << 4 | ((status) & 0xf)))
+#define MIDI_ROUTER_SYSTEM_CLASS(status) ((uint8_t)(112 + ((status) & 0xf)))
+
+/**
+ * @brief return the filter class of a packet the parser produced
+ */
+static inline uint8_t midi_router_message_class(const uint8_t packet[4])
+{
+  uint8_t cin = midi_packet_cin(packet);
+  if (cin >= 0x8 && cin <= 0xE) {
+    return MIDI_ROUTER_CHANNEL_CLASS(packet[1]);
+  }
+  if (cin >= MIDI_CIN_SYSEX && cin <= MIDI_CIN_SYSEX_END_3 && packet[1] != 0xF6) {
+    return MIDI_ROUTER_SYSTEM_CLASS(0xF0);
+  }
+  return MIDI_ROUTER_SYSTEM_CLASS(packet[1]);
+}
+
+// A bit per message class; a set bit blocks the class on the route
+typedef struct {
+  uint32_t bits[MIDI_ROUTER_NUM_CLASSES / 32];
+} midi_router_filter_t;
+
+static inline bool midi_router_filter_blocks(const midi_router_filter_t* filter, uint8_t msg_class)
+{
+  return (filter->bits[msg_class >> 5] >> (msg_class & 31)) & 1u;
+}
+
+static inline void midi_router_filter_set(midi_router_filter_t* filter, uint8_t msg_class, bool block)
+{
+  if (block) {
+    filter->bits[msg_class >> 5] |= 1u << (msg_class & 31);
+  }
+  else {
+    filter->bits[msg_class >> 5] &= ~(1u << (msg_class & 31));
+  }
+}
+
+/**
+ * @brief return the current time in microseconds; may wrap
+ */
+typedef uint32_t (*midi_router_clock_fn)(void);
+
+/**
+ * @brief send a packet to an output whose merger the routing loop does
+ * not own (e.g., one that another core flushes)
+ *
+ * @param context the context passed to midi_router_set_remote()
+ * @param out the output port
+ * @param packet the packet; its cable number is the input port
+ * @param timestamp when the data was read from its input
+ * @return true if the packet was accepted; false if it was dropped
+ */
+typedef bool (*midi_router_forward_fn)(void* context, uint8_t out, const uint8_t packet[4], uint32_t timestamp);
+
+/**
+ * @brief return the number of packets from an input that a remote output
+ * can take without dropping any
+ *
+ * @param context the context passed to midi_router_set_remote()
+ * @param out the output port
+ * @param in the input port, or MIDI_MERGER_NO_OWNER for any input that
+ * is not held back behind another input's SysEx message
+ */
+typedef uint16_t (*midi_router_room_fn)(void* context, uint8_t out, uint8_t in);
+
+/**
+ * @brief called by the routing loop when the trigger input sends a
+ * Program Change on the trigger channel
+ *
+ * @param context the context passed to midi_router_set_program_cb()
+ * @param program the program number, 0-127
+ */
+typedef void (*midi_router_program_fn)(void* context, uint8_t program);
+
+// The trigger value when no input is the trigger input
+#define MIDI_ROUTER_NO_TRIGGER 0xFFFF
+
+/**
+ * @brief called by the routing loop when the sync input sends Timing
+ * Clock, Start, Continue or Stop
+ *
+ * @param context the context passed to midi_router_set_sync_cb()
+ * @param byte F8, FA, FB or FC
+ * @param timestamp when the message was read from the input
+ */
+typedef void (*midi_router_sync_fn)(void* context, uint8_t byte, uint32_t timestamp);
+
+// The sync input when there is none
+#define MIDI_ROUTER_NO_SYNC 0xFF
+
+// Byte counters for finding the port that is the bottleneck. For an input,
+// offered counts bytes read from the port, and written and dropped count
+// the bytes of its messages each output accepted or dropped, so with
+// fan-out they can exceed offered. For an output, all three count message
+// bytes routed to it; running status may put fewer bytes on the wire.
+typedef struct {
+  uint32_t offered;
+  uint32_t written;
+  uint32_t dropped;
+  uint16_t high_water; // most bytes read in one poll, or most packets queued
+} midi_router_counters_t;
+
+// The longest an output may hold data back to send it on time
+#define MIDI_ROUTER_MAX_DELAY_US 50000
+
+// The most distinct transforms the routes may use at the same time
+#define MIDI_ROUTER_NUM_TRANSFORMS 8
+
+/**
+ * @brief what a route changes in the channel voice messages it carries;
+ * other messages pass unchanged
+ */
+typedef struct {
+  uint8_t channel;   // 0 keeps the channel; 1-16 moves every message to that channel
+  int8_t transpose;  // semitones added to note numbers; the result is clamped to 0-127
+  uint8_t velocity;  // percent to scale note velocities by; a note on never becomes a note off
+  uint8_t cc_min;    // control change values are clamped to cc_min-cc_max
+  uint8_t cc_max;
+} midi_router_transform_t;
+
+// The transform that changes nothing
+extern const midi_router_transform_t midi_router_no_transform;
+
+// A transform compiled to lookup tables. The data1 and data2 tables of a
+// channel voice message are indexed by its status type, (status >> 4) - 8.
+typedef struct {
+  uint8_t channel[16];
+  uint8_t note[128];
+  uint8_t velocity[128];
+  uint8_t cc_value[128];
+  const uint8_t* data1[7];
+  const uint8_t* data2[7];
+} midi_router_lut_t;
+
+// The outputs of one input, compiled from the route matrix so routing a
+// packet does not have to decode the matrix
+typedef struct {
+  uint16_t outputs; // bit per output the input is routed to
+  uint8_t nlocal;
+  uint8_t nremote;
+  uint8_t local_port[MIDI_ROUTER_MAX_PORTS];
+  midi_merger_t* local[MIDI_ROUTER_MAX_PORTS];
+  const midi_router_lut_t* local_lut[MIDI_ROUTER_MAX_PORTS]; // NULL for no transform
+  uint8_t remote[MIDI_ROUTER_MAX_PORTS];
+  const midi_router_lut_t* remote_lut[MIDI_ROUTER_MAX_PORTS];
+  uint16_t blocked[MIDI_ROUTER_NUM_CLASSES]; // bit per output whose route filter blocks the class
+} midi_router_fanout_t;
+
+// Everything the routing loop reads, published as one table
+typedef struct {
+  midi_router_fanout_t fanout[MIDI_ROUTER_MAX_PORTS];
+  midi_router_lut_t luts[MIDI_ROUTER_NUM_TRANSFORMS];
+} midi_router_table_t;
+
+struct midi_router_s;
+
+typedef struct {
+  struct midi_router_s* router;
+  uint8_t port;
+} midi_router_output_t;
+
+/**
+ * @brief a message the monitor captured: a packet an input produced and
+ * when the data was read from the input
+ */
+typedef struct {
+  uint32_t timestamp;
+  uint8_t packet[4];
+} midi_router_capture_t;
+
+/**
+ * @brief The router owns a parser for every input port and the route
+ * matrix. It sends every packet an input produces to the merger of each
+ * output the input is connected to, and it keeps the byte counters and
+ * the latency statistics of every route.
+ *
+ * Nothing here depends on the hardware. The caller reads the inputs,
+ * flushes the mergers and supplies the clock.
+ */
+typedef struct midi_router_s {
+  uint8_t num_ports;
+  midi_router_clock_fn now_us;
+  uint16_t matrix[MIDI_ROUTER_MAX_PORTS]; // bit n of matrix[in] is set if in routes to output n
+  midi_router_filter_t filters[MIDI_ROUTER_MAX_PORTS][MIDI_ROUTER_MAX_PORTS]; // [input][output]
+  midi_router_transform_t transforms[MIDI_ROUTER_MAX_PORTS][MIDI_ROUTER_MAX_PORTS];
+  midi_parser_t parsers[MIDI_ROUTER_MAX_PORTS];
+  midi_merger_t* mergers[MIDI_ROUTER_MAX_PORTS];
+  uint16_t remote_outputs; // bit per output that is reached through forward
+  midi_router_output_t outputs[MIDI_ROUTER_MAX_PORTS];
+  midi_router_forward_fn forward;
+  midi_router_room_fn remote_room;
+  void* remote_context;
+  midi_router_table_t tables[2];
+  table_publisher_t publisher;
+  // The trigger input << 8 | the message class of a Program Change on
+  // the trigger channel, so the routing loop reads it with one load
+  uint16_t trigger;
+  midi_router_program_fn program;
+  void* program_context;
+  volatile uint8_t sync_input; // the input whose clock goes to sync instead of the routes
+  volatile uint16_t sync_outputs; // bit per output that takes no routed clock
+  midi_router_sync_fn sync;
+  void* sync_context;
+  // Every packet from the monitored inputs is copied to the capture
+  // ring. The routing loop is the producer; when the ring is full it
+  // counts the packet as dropped.
+  volatile uint16_t monitor_inputs; // bit per monitored input
+  spsc_ring_t* capture;
+  volatile uint32_t capture_dropped;
+  // A scheduled output holds every packet in its timer wheel until the
+  // packet's target time plus the output's delay. Owned by the routing
+  // loop, except that delay may be changed at any time.
+  timer_wheel_t* wheels[MIDI_ROUTER_MAX_PORTS]; // NULL if the output cannot be scheduled
+  volatile uint32_t delay_us[MIDI_ROUTER_MAX_PORTS]; // 0 if the output is not scheduled
+  uint32_t last_due_us[MIDI_ROUTER_MAX_PORTS]; // keeps the packets of each output in order
+  // Owned by the routing loop. A SysEx message only goes to the outputs
+  // it started on, even if the routes change before it ends.
+  const midi_router_table_t* active; // the table the last pass used
+  uint16_t sysex_open;               // bit per input that is inside a SysEx message
+  uint16_t sysex_outputs[MIDI_ROUTER_MAX_PORTS]; // outputs the open SysEx message of each input goes to
+  uint16_t unterminated[MIDI_ROUTER_MAX_PORTS];  // outputs still owed an F7 because a route went away
+  uint16_t unterminated_inputs;      // bit per input with unterminated outputs
+  midi_router_counters_t source_counters[MIDI_ROUTER_MAX_PORTS];
+  midi_router_counters_t dest_counters[MIDI_ROUTER_MAX_PORTS];
+  // Latency from the time data is read from an input until the output
+  // accepts it, indexed [input port][output port]
+  route_stats_t latency[MIDI_ROUTER_MAX_PORTS][MIDI_ROUTER_MAX_PORTS];
+} midi_router_t;
+
+/**
+ * @brief The routing state for one pass of the routing loop. The route
+ * table cannot change during a pass.
+ */
+typedef struct {
+  midi_router_t* router;
+  const midi_router_fanout_t* fanout;
+  uint32_t generation;
+  uint16_t enabled_outputs; // bit per output that may receive data now
+  uint32_t timestamp;       // when the data being routed was read from its input
+  // when the data being routed is meant to go out, before the delay of
+  // a scheduled output: the timestamp unless the sender supplied a time
+  uint32_t target;
+} midi_router_pass_t;
+
+/**
+ * @brief initialize the router with no routes and no outputs
+ *
+ * @param router the router to initialize
+ * @param num_ports the number of ports; input and output n are port n
+ * @param now_us the clock used to timestamp data
+ */
+void midi_router_init(midi_router_t* router, uint8_t num_ports, midi_router_clock_fn now_us);
+
+/**
+ * @brief attach the merger of an output port
+ *
+ * The router sets the merger's sent and dropped callbacks to keep its
+ * counters and latency statistics.
+ *
+ * @param router the router
+ * @param out the output port
+ * @param merger the merger for the output
+ * @param remote true if the routing loop must send packets to this
+ * output with the forward function instead of pushing them to the merger
+ */
+void midi_router_set_output(midi_router_t* router, uint8_t out, midi_merger_t* merger, bool remote);
+
+/**
+ * @brief set the functions that reach remote outputs
+ */
+void midi_router_set_remote(midi_router_t* router, midi_router_forward_fn forward, midi_router_room_fn room, void* context);
+
+/**
+ * @brief set the function called when the trigger input sends a Program Change
+ */
+void midi_router_set_program_cb(midi_router_t* router, midi_router_program_fn program, void* context);
+
+/**
+ * @brief make Program Changes on one input and channel call the program callback
+ *
+ * Takes effect immediately. The Program Change is also routed as usual.
+ *
+ * @param in the trigger input, or MIDI_ROUTER_NO_TRIGGER for none
+ * @param channel the trigger channel, 0-15
+ */
+void midi_router_set_trigger(midi_router_t* router, uint16_t in, uint8_t channel);
+
+/**
+ * @brief return true if there is a trigger input; set in and channel to it
+ */
+bool midi_router_get_trigger(const midi_router_t* router, uint8_t* in, uint8_t* channel);
+
+/**
+ * @brief set the function called when the sync input sends clock
+ */
+void midi_router_set_sync_cb(midi_router_t* router, midi_router_sync_fn sync, void* context);
+
+/**
+ * @brief send the Timing Clock, Start, Continue and Stop messages of one
+ * input to the sync callback instead of routing them
+ *
+ * Takes effect immediately.
+ *
+ * @param in the sync input, or MIDI_ROUTER_NO_SYNC for none
+ */
+void midi_router_set_sync_input(midi_router_t* router, uint8_t in);
+
+/**
+ * @brief route no Timing Clock, Start, Continue or Stop to some outputs
+ *
+ * For the outputs of a clock master, so they do not also get the clock
+ * of an input. Takes effect immediately.
+ *
+ * @param outputs bit per output
+ */
+void midi_router_set_sync_outputs(midi_router_t* router, uint16_t outputs);
+
+/**
+ * @brief set the ring of midi_router_capture_t the monitor fills
+ *
+ * Set it before any input is monitored.
+ */
+void midi_router_set_capture_ring(midi_router_t* router, spsc_ring_t* capture);
+
+/**
+ * @brief copy every packet from some inputs to the capture ring
+ *
+ * Takes effect immediately. The packets are also routed as usual.
+ *
+ * @param inputs a bit per input to monitor; 0 stops the monitor
+ */
+void midi_router_monitor(midi_router_t* router, uint16_t inputs);
+
+/**
+ * @brief return how many captured packets did not fit in the capture ring
+ *
+ * The count only goes up; compare it with an earlier value.
+ */
+uint32_t midi_router_capture_dropped(const midi_router_t* router);
+
+/**
+ * @brief set the timer wheel that holds the packets of a scheduled output
+ *
+ * The wheel must be empty, and its release function must push each
+ * packet with midi_router_push(). Only local outputs can be scheduled.
+ */
+void midi_router_set_wheel(midi_router_t* router, uint8_t out, timer_wheel_t* wheel);
+
+/**
+ * @brief send every packet routed to an output at its target time plus a
+ * fixed delay instead of at once
+ *
+ * A burst of data that arrived at once then goes out with the timing it
+ * was sent with, delay later. Packets to an output never pass each
+ * other, so a packet whose time comes before one already waiting goes
+ * right after it. Takes effect immediately; packets that wait when the
+ * delay changes keep their time.
+ *
+ * @param router the router
+ * @param out an output with a timer wheel
+ * @param delay_us the delay, at most MIDI_ROUTER_MAX_DELAY_US; 0 sends
+ * packets at once
+ * @return false if the output has no wheel or the delay is too long
+ */
+bool midi_router_set_delay(midi_router_t* router, uint8_t out, uint32_t delay_us);
+
+/**
+ * @brief release the packets of the scheduled outputs that are due
+ *
+ * The routing loop calls this before it flushes the mergers.
+ */
+void midi_router_release(midi_router_t* router, uint32_t now_us);
+
+/**
+ * @brief return true if a scheduled output holds a packet and set due_us
+ * to the time the first one is due
+ */
+bool midi_router_next_due(const midi_router_t* router, uint32_t* due_us);
+
+/**
+ * @brief route input in to output out; takes effect at midi_router_publish()
+ */
+void midi_router_connect(midi_router_t* router, uint8_t in, uint8_t out);
+
+/**
+ * @brief stop routing input in to output out; takes effect at midi_router_publish()
+ */
+void midi_router_disconnect(midi_router_t* router, uint8_t in, uint8_t out);
+
+/**
+ * @brief return true if input in routes to output out
+ */
+bool midi_router_is_connected(const midi_router_t* router, uint8_t in, uint8_t out);
+
+/**
+ * @brief return the filter of the route from input in to output out
+ */
+const midi_router_filter_t* midi_router_get_filter(const midi_router_t* router, uint8_t in, uint8_t out);
+
+/**
+ * @brief replace the filter of the route from input in to output out;
+ * takes effect at midi_router_publish()
+ *
+ * The filter stays with the route when it is disconnected.
+ */
+void midi_router_set_filter(midi_router_t* router, uint8_t in, uint8_t out, const midi_router_filter_t* filter);
+
+/**
+ * @brief return the transform of the route from input in to output out
+ */
+const midi_router_transform_t* midi_router_get_transform(const midi_router_t* router, uint8_t in, uint8_t out);
+
+/**
+ * @brief replace the transform of the route from input in to output out;
+ * takes effect at midi_router_publish()
+ *
+ * Routes with the same transform share its lookup tables. The transform
+ * stays with the route when it is disconnected. The filter of the route
+ * sees messages before they are transformed.
+ *
+ * @return false if the routes would need more than
+ * MIDI_ROUTER_NUM_TRANSFORMS different transforms; nothing is changed
+ */
+bool midi_router_set_transform(midi_router_t* router, uint8_t in, uint8_t out, const midi_router_transform_t* transform);
+
+/**
+ * @brief return true if the transform changes nothing
+ */
+bool midi_router_transform_is_none(const midi_router_transform_t* transform);
+
+/**
+ * @brief compile the route matrix and publish it to the routing loop
+ *
+ * @return false if the routing loop still uses the table that would be
+ * rebuilt; call again later
+ */
+bool midi_router_publish(midi_router_t* router);
+
+/**
+ * @brief start a pass of the routing loop
+ *
+ * A table published since the last pass takes effect here, between two
+ * messages. If it drops an output an open SysEx message was going to,
+ * that output gets an F7 to end the message; the rest of the message
+ * still goes to the outputs it started on that remain.
+ *
+ * @param router the router
+ * @param pass the state for this pass
+ * @param enabled_outputs bit per output that may receive data now
+ */
+void midi_router_begin(midi_router_t* router, midi_router_pass_t* pass, uint16_t enabled_outputs);
+
+/**
+ * @brief end a pass of the routing loop
+ */
+void midi_router_end(midi_router_pass_t* pass);
+
+/**
+ * @brief route one packet; a midi_parser_packet_cb with a pass as context
+ *
+ * The cable number of the packet is the input port. The packet is
+ * timestamped with pass->timestamp. It goes to every enabled output the
+ * input is connected to unless the route filter blocks its class, with
+ * the route transform applied.
+ */
+void midi_router_route(void* pass, const uint8_t packet[4]);
+
+/**
+ * @brief timestamp, count, parse and route bytes read from an input
+ */
+void midi_router_parse(midi_router_pass_t* pass, uint8_t in, const uint8_t* bytes, uint32_t nbytes);
+
+/**
+ * @brief add bytes read from an input to its counters
+ */
+void midi_router_count_received(midi_router_t* router, uint8_t in, uint32_t nbytes);
+
+/**
+ * @brief return the number of packets from an input that every enabled
+ * output that holds the input back (see midi_merger_holds_back()) can take
+ *
+ * @param pass the state for this pass
+ * @param in the input port
+ * @param room_source in, or MIDI_MERGER_NO_OWNER for the room of an input
+ * that is not held back behind another input's SysEx message
+ */
+uint16_t midi_router_room(const midi_router_pass_t* pass, uint8_t in, uint8_t room_source);
+
+/**
+ * @brief return how many bytes may be read from an input so that no
+ * output that blocks its sources has to drop a packet
+ *
+ * @param pass the state for this pass
+ * @param in the input port
+ * @param room_source see midi_router_room()
+ * @param max the most bytes the caller wants to read
+ */
+uint32_t midi_router_read_limit(const midi_router_pass_t* pass, uint8_t in, uint8_t room_source, uint32_t max);
+
+/**
+ * @brief return the outputs that messages of a class from an input go to
+ * in this pass
+ *
+ * @param msg_class see midi_router_message_class()
+ */
+uint16_t midi_router_outputs_of(const midi_router_pass_t* pass, uint8_t in, uint8_t msg_class);
+
+/**
+ * @brief send a packet the routing loop made itself, such as a clock
+ * tick, to an output
+ *
+ * The packet goes to the merger at once even if the output is
+ * scheduled, so a real-time message goes ahead of the queued data.
+ *
+ * @return false if a remote output dropped it
+ */
+bool midi_router_inject(midi_router_t* router, uint8_t out, const uint8_t packet[4], uint32_t timestamp);
+
+/**
+ * @brief push a packet to the merger of an output and count it
+ *
+ * The routing loop does this for local outputs that are not scheduled,
+ * and the timer wheel of a scheduled output when a packet is due. The owner of a remote
+ * output calls it for the packets the forward function passed along.
+ */
+void midi_router_push(midi_router_t* router, uint8_t out, const uint8_t packet[4], uint32_t timestamp);
+
+/**
+ * @brief count a packet that was dropped before it reached an output
+ */
+void midi_router_count_dropped(midi_router_t* router, uint8_t out, const uint8_t packet[4]);
+
+/**
+ * @brief clear the byte counters of every port
+ */
+void midi_router_reset_counters(midi_router_t* router);
+
+/**
+ * @brief clear the latency statistics of every route
+ */
+void midi_router_reset_stats(midi_router_t* router);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
@@ -0,0 +1,213 @@
+/**
+ * @file preset_store.c
+ * @brief keep numbered presets in flash with wear levelling and CRC checks
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "preset_store.h"
+
+#define PRESET_RECORD_MAGIC 0x5250494Du // "MIPR"
+
+// Every record starts at the start of a sector and is padded to whole pages
+typedef struct {
+  uint32_t magic;
+  uint32_t sequence; // one more than the newest record when it was written
+  uint16_t length;   // of the data that follows
+  uint8_t preset;
+  uint8_t reserved;
+  uint32_t crc;      // CRC-32 of the fields above and the data
+} preset_record_header_t;
+
+#define HEADER_CRC_BYTES (sizeof(preset_record_header_t) - sizeof(uint32_t))
+
+static uint32_t crc32_update(uint32_t crc, const void* data, uint32_t nbytes)
+{
+  const uint8_t* bytes = data;
+  for (uint32_t idx = 0; idx < nbytes; idx++) {
+    crc ^= bytes[idx];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+    }
+  }
+  return crc;
+}
+
+uint32_t preset_store_max_length(const preset_store_t* store)
+{
+  uint32_t max = store->flash->sector_size - sizeof(preset_record_header_t);
+  return max > UINT16_MAX ? UINT16_MAX : max;
+}
+
+// Return true if the sector holds a complete record; set header to its header
+static bool read_record(const preset_store_t* store, uint8_t sector, preset_record_header_t* header)
+{
+  const preset_flash_t* flash = store->flash;
+  uint32_t offset = sector * flash->sector_size;
+  if (!flash->read(flash->context, offset, header, sizeof(*header)) || header->magic != PRESET_RECORD_MAGIC ||
+      header->preset >= PRESET_STORE_NUM_PRESETS || header->length > preset_store_max_length(store)) {
+    return false;
+  }
+  uint32_t crc = crc32_update(0xFFFFFFFFu, header, HEADER_CRC_BYTES);
+  offset += sizeof(*header);
+  uint8_t chunk[64];
+  for (uint32_t done = 0; done < header->length; done += sizeof(chunk)) {
+    uint32_t nbytes = header->length - done < sizeof(chunk) ? header->length - done : sizeof(chunk);
+    if (!flash->read(flash->context, offset + done, chunk, nbytes)) {
+      return false;
+    }
+    crc = crc32_update(crc, chunk, nbytes);
+  }
+  return ~crc == header->crc;
+}
+
+void preset_store_init(preset_store_t* store, const preset_flash_t* flash)
+{
+  store->flash = flash;
+  store->sequence = 0;
+  store->next_sector = 0;
+  store->latest = -1;
+  for (uint8_t preset = 0; preset < PRESET_STORE_NUM_PRESETS; preset++) {
+    store->sector[preset] = -1;
+    store->length[preset] = 0;
+    store->saved[preset] = 0;
+  }
+  for (uint8_t sector = 0; sector < flash->num_sectors; sector++) {
+    preset_record_header_t header;
+    if (!read_record(store, sector, &header)) {
+      continue;
+    }
+    uint8_t preset = header.preset;
+    if (store->sector[preset] < 0 || header.sequence > store->saved[preset]) {
+      store->sector[preset] = sector;
+      store->length[preset] = header.length;
+      store->saved[preset] = header.sequence;
+    }
+    if (store->latest < 0 || header.sequence > store->sequence) {
+      store->sequence = header.sequence;
+      store->latest = preset;
+      store->next_sector = (sector + 1) % flash->num_sectors;
+    }
+  }
+}
+
+// Return the first sector from next_sector on that holds no newest copy
+static uint8_t free_sector(const preset_store_t* store)
+{
+  uint8_t sector = store->next_sector;
+  for (;;) {
+    bool in_use = false;
+    for (uint8_t preset = 0; preset < PRESET_STORE_NUM_PRESETS; preset++) {
+      in_use |= store->sector[preset] == sector;
+    }
+    if (!in_use) {
+      return sector;
+    }
+    sector = (sector + 1) % store->flash->num_sectors;
+  }
+}
+
+bool preset_store_save(preset_store_t* store, uint8_t preset, const void* data, uint32_t nbytes)
+{
+  const preset_flash_t* flash = store->flash;
+  if (preset >= PRESET_STORE_NUM_PRESETS || nbytes > preset_store_max_length(store) ||
+      flash->page_size > PRESET_STORE_MAX_PAGE_SIZE) {
+    return false;
+  }
+  preset_record_header_t header = {
+    .magic = PRESET_RECORD_MAGIC,
+    .sequence = store->sequence + 1,
+    .length = (uint16_t)nbytes,
+    .preset = preset,
+    .reserved = 0,
+  };
+  header.crc = ~crc32_update(crc32_update(0xFFFFFFFFu, &header, HEADER_CRC_BYTES), data, nbytes);
+  uint8_t sector = free_sector(store);
+  uint32_t offset = sector * flash->sector_size;
+  if (!flash->erase(flash->context, offset)) {
+    return false;
+  }
+  // Program the header and the data a page at a time, padding the last page
+  const uint8_t* bytes = data;
+  uint32_t total = sizeof(header) + nbytes;
+  uint8_t page[PRESET_STORE_MAX_PAGE_SIZE];
+  for (uint32_t done = 0; done < total; done += flash->page_size) {
+    memset(page, 0xFF, flash->page_size);
+    for (uint32_t idx = 0; idx < flash->page_size && done + idx < total; idx++) {
+      uint32_t pos = done + idx;
+      page[idx] = pos < sizeof(header) ? ((const uint8_t*)&header)[pos] : bytes[pos - sizeof(header)];
+    }
+    if (!flash->program(flash->context, offset + done, page, flash->page_size)) {
+      return false;
+    }
+  }
+  preset_record_header_t check;
+  if (!read_record(store, sector, &check) || check.sequence != header.sequence) {
+    return false;
+  }
+  store->sequence = header.sequence;
+  store->latest = preset;
+  store->next_sector = (sector + 1) % flash->num_sectors;
+  store->sector[preset] = sector;
+  store->length[preset] = header.length;
+  store->saved[preset] = header.sequence;
+  return true;
+}
+
+uint32_t preset_store_load(const preset_store_t* store, uint8_t preset, void* data, uint32_t max)
+{
+  if (preset >= PRESET_STORE_NUM_PRESETS || store->sector[preset] < 0 || store->length[preset] > max) {
+    return 0;
+  }
+  const preset_flash_t* flash = store->flash;
+  uint32_t offset = store->sector[preset] * flash->sector_size;
+  preset_record_header_t header;
+  if (!flash->read(flash->context, offset, &header, sizeof(header)) ||
+      header.length != store->length[preset] ||
+      !flash->read(flash->context, offset + sizeof(header), data, header.length)) {
+    return 0;
+  }
+  // Check again in case the flash changed since the store was initialized
+  uint32_t crc = crc32_update(crc32_update(0xFFFFFFFFu, &header, HEADER_CRC_BYTES), data, header.length);
+  return ~crc == header.crc ? header.length : 0;
+}
+
+bool preset_store_get_info(const preset_store_t* store, uint8_t preset, uint32_t* length)
+{
+  if (preset >= PRESET_STORE_NUM_PRESETS || store->sector[preset] < 0) {
+    return false;
+  }
+  *length = store->length[preset];
+  return true;
+}
+
+bool preset_store_latest(const preset_store_t* store, uint8_t* preset)
+{
+  if (store->latest < 0) {
+    return false;
+  }
+  *preset = (uint8_t)store->latest;
+  return true;
+}
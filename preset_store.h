@@ -0,0 +1,117 @@
+/**
+ * @file preset_store.h
+ * @brief keep numbered presets in flash with wear levelling and CRC checks
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef PRESET_STORE_H
+#define PRESET_STORE_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define PRESET_STORE_NUM_PRESETS 8
+// The most sectors the store can manage and the largest program unit
+#define PRESET_STORE_MAX_SECTORS 32
+#define PRESET_STORE_MAX_PAGE_SIZE 256
+
+/**
+ * @brief the flash area the presets live in
+ *
+ * Offsets are relative to the start of the area. The callbacks return
+ * false on failure. An erased byte reads as 0xFF.
+ */
+typedef struct {
+  uint32_t sector_size; // the erase unit
+  uint32_t page_size;   // the program unit; at most PRESET_STORE_MAX_PAGE_SIZE
+  uint32_t num_sectors; // PRESET_STORE_NUM_PRESETS + 1 to PRESET_STORE_MAX_SECTORS
+  bool (*read)(void* context, uint32_t offset, void* buffer, uint32_t nbytes);
+  bool (*erase)(void* context, uint32_t offset); // erase the sector at offset
+  bool (*program)(void* context, uint32_t offset, const void* data, uint32_t nbytes); // whole pages
+  void* context;
+} preset_flash_t;
+
+/**
+ * @brief Every save writes a new record into its own freshly erased
+ * sector. The sectors are used in turn, skipping the ones that hold the
+ * newest copy of a preset, so the erases spread over the whole area and
+ * the previous copy of a preset stays valid until the new one is complete.
+ * A record whose CRC does not match, e.g., after a power failure during a
+ * save, is ignored.
+ */
+typedef struct {
+  const preset_flash_t* flash;
+  uint32_t sequence;      // the sequence number of the newest record
+  uint8_t next_sector;    // where the search for a free sector starts
+  int8_t latest;          // the preset saved most recently, or -1
+  int8_t sector[PRESET_STORE_NUM_PRESETS];     // the newest copy of each preset, or -1
+  uint16_t length[PRESET_STORE_NUM_PRESETS];
+  uint32_t saved[PRESET_STORE_NUM_PRESETS];    // the sequence number of each newest copy
+} preset_store_t;
+
+/**
+ * @brief find the newest valid copy of every preset
+ */
+void preset_store_init(preset_store_t* store, const preset_flash_t* flash);
+
+/**
+ * @brief return the largest preset the store can hold in bytes
+ */
+uint32_t preset_store_max_length(const preset_store_t* store);
+
+/**
+ * @brief store a preset
+ *
+ * @return false if the preset number or the length is out of range or if
+ * the flash could not be written; the previous copy is then still valid
+ */
+bool preset_store_save(preset_store_t* store, uint8_t preset, const void* data, uint32_t nbytes);
+
+/**
+ * @brief read a preset
+ *
+ * @return the length of the preset, or 0 if it is empty, does not fit in
+ * max bytes or fails its CRC check
+ */
+uint32_t preset_store_load(const preset_store_t* store, uint8_t preset, void* data, uint32_t max);
+
+/**
+ * @brief return true if the preset holds data; set length to its length
+ */
+bool preset_store_get_info(const preset_store_t* store, uint8_t preset, uint32_t* length);
+
+/**
+ * @brief return true if any preset was saved; set preset to the newest one
+ */
+bool preset_store_latest(const preset_store_t* store, uint8_t* preset);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
@@ -0,0 +1,229 @@
+/**
+ * @file route_preset.c
+ * @brief convert the routing setup to and from the bytes of a preset
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "route_preset.h"
+
+#define ROUTE_HAS_FILTER 0x01
+#define ROUTE_HAS_TRANSFORM 0x02
+#define FILTER_BYTES 16
+#define TRANSFORM_BYTES 5
+
+typedef struct {
+  uint8_t* buffer;
+  uint32_t max;
+  uint32_t length;
+} writer_t;
+
+static void put(writer_t* writer, uint8_t byte)
+{
+  if (writer->length < writer->max) {
+    writer->buffer[writer->length] = byte;
+  }
+  writer->length++;
+}
+
+static bool filter_is_none(const midi_router_filter_t* filter)
+{
+  return (filter->bits[0] | filter->bits[1] | filter->bits[2] | filter->bits[3]) == 0;
+}
+
+uint32_t route_preset_encode(const midi_router_t* router, const route_preset_settings_t* settings,
+  uint8_t* buffer, uint32_t max)
+{
+  writer_t writer = {buffer, max, 0};
+  put(&writer, ROUTE_PRESET_VERSION);
+  put(&writer, router->num_ports);
+  for (uint8_t in = 0; in < router->num_ports; in++) {
+    put(&writer, router->matrix[in] & 0xff);
+    put(&writer, router->matrix[in] >> 8);
+  }
+  for (uint8_t out = 0; out < router->num_ports; out++) {
+    put(&writer, settings->policies[out]);
+  }
+  put(&writer, settings->trigger_in == MIDI_ROUTER_NO_TRIGGER ? 0xFF : settings->trigger_in);
+  put(&writer, settings->trigger_channel);
+  for (uint8_t port = 0; port < router->num_ports; port++) {
+    uint32_t baud = settings->baud[port] > ROUTE_PRESET_MAX_BAUD ? 0 : settings->baud[port];
+    put(&writer, baud & 0xff);
+    put(&writer, (baud >> 8) & 0xff);
+    put(&writer, baud >> 16);
+  }
+  uint32_t count_at = writer.length;
+  uint16_t nroutes = 0;
+  put(&writer, 0);
+  put(&writer, 0);
+  for (uint8_t in = 0; in < router->num_ports; in++) {
+    for (uint8_t out = 0; out < router->num_ports; out++) {
+      const midi_router_filter_t* filter = &router->filters[in][out];
+      const midi_router_transform_t* transform = &router->transforms[in][out];
+      uint8_t flags = (filter_is_none(filter) ? 0 : ROUTE_HAS_FILTER) |
+        (midi_router_transform_is_none(transform) ? 0 : ROUTE_HAS_TRANSFORM);
+      if (flags == 0) {
+        continue;
+      }
+      nroutes++;
+      put(&writer, in << 4 | out);
+      put(&writer, flags);
+      if (flags & ROUTE_HAS_FILTER) {
+        for (uint8_t idx = 0; idx < FILTER_BYTES; idx++) {
+          put(&writer, filter->bits[idx / 4] >> (8 * (idx % 4)));
+        }
+      }
+      if (flags & ROUTE_HAS_TRANSFORM) {
+        put(&writer, transform->channel);
+        put(&writer, (uint8_t)transform->transpose);
+        put(&writer, transform->velocity);
+        put(&writer, transform->cc_min);
+        put(&writer, transform->cc_max);
+      }
+    }
+  }
+  if (writer.length > max) {
+    return 0;
+  }
+  buffer[count_at] = nroutes & 0xff;
+  buffer[count_at + 1] = nroutes >> 8;
+  return writer.length;
+}
+
+// Check the preset and, if apply is true, load it. Checking first means
+// a bad preset leaves the routing setup as it was.
+static bool decode(midi_router_t* router, route_preset_settings_t* settings, const uint8_t* buffer,
+  uint32_t nbytes, bool apply)
+{
+  uint8_t num_ports = router->num_ports;
+  uint32_t pos = 2 + 3 * num_ports;
+  if (nbytes < pos + 2 || buffer[0] < 1 || buffer[0] > ROUTE_PRESET_VERSION || buffer[1] != num_ports) {
+    return false;
+  }
+  for (uint8_t port = 0; port < num_ports; port++) {
+    if (buffer[2 + 2 * num_ports + port] > MIDI_MERGER_BLOCK_SOURCE) {
+      return false;
+    }
+    if (apply) {
+      router->matrix[port] = buffer[2 + 2 * port] | buffer[3 + 2 * port] << 8;
+      settings->policies[port] = (midi_merger_policy_t)buffer[2 + 2 * num_ports + port];
+    }
+  }
+  uint16_t trigger_in = MIDI_ROUTER_NO_TRIGGER;
+  uint8_t trigger_channel = 0;
+  if (buffer[0] >= 2) {
+    if (nbytes < pos + 4 || (buffer[pos] >= num_ports && buffer[pos] != 0xFF) || buffer[pos + 1] > 15) {
+      return false;
+    }
+    trigger_in = buffer[pos] == 0xFF ? MIDI_ROUTER_NO_TRIGGER : buffer[pos];
+    trigger_channel = buffer[pos + 1];
+    pos += 2;
+  }
+  if (apply) {
+    settings->trigger_in = trigger_in;
+    settings->trigger_channel = trigger_channel;
+    memset(settings->baud, 0, sizeof(settings->baud));
+  }
+  if (buffer[0] >= 3) {
+    if (nbytes < pos + 3 * num_ports + 2) {
+      return false;
+    }
+    for (uint8_t port = 0; port < num_ports && apply; port++) {
+      settings->baud[port] = buffer[pos + 3 * port] | buffer[pos + 3 * port + 1] << 8 |
+        (uint32_t)buffer[pos + 3 * port + 2] << 16;
+    }
+    pos += 3 * num_ports;
+  }
+  if (apply) {
+    for (uint8_t in = 0; in < MIDI_ROUTER_MAX_PORTS; in++) {
+      for (uint8_t out = 0; out < MIDI_ROUTER_MAX_PORTS; out++) {
+        memset(&router->filters[in][out], 0, sizeof(midi_router_filter_t));
+        router->transforms[in][out] = midi_router_no_transform;
+      }
+    }
+  }
+  uint16_t nroutes = buffer[pos] | buffer[pos + 1] << 8;
+  pos += 2;
+  midi_router_transform_t slots[MIDI_ROUTER_NUM_TRANSFORMS];
+  uint8_t nslots = 0;
+  for (uint16_t route = 0; route < nroutes; route++) {
+    if (nbytes < pos + 2) {
+      return false;
+    }
+    uint8_t in = buffer[pos] >> 4;
+    uint8_t out = buffer[pos] & 0xf;
+    uint8_t flags = buffer[pos + 1];
+    pos += 2;
+    uint32_t length = ((flags & ROUTE_HAS_FILTER) ? FILTER_BYTES : 0) + ((flags & ROUTE_HAS_TRANSFORM) ? TRANSFORM_BYTES : 0);
+    if (in >= num_ports || out >= num_ports || (flags & ~(ROUTE_HAS_FILTER | ROUTE_HAS_TRANSFORM)) != 0 ||
+        nbytes < pos + length) {
+      return false;
+    }
+    if (flags & ROUTE_HAS_FILTER) {
+      if (apply) {
+        midi_router_filter_t* filter = &router->filters[in][out];
+        for (uint8_t idx = 0; idx < FILTER_BYTES; idx++) {
+          filter->bits[idx / 4] |= (uint32_t)buffer[pos + idx] << (8 * (idx % 4));
+        }
+      }
+      pos += FILTER_BYTES;
+    }
+    if (flags & ROUTE_HAS_TRANSFORM) {
+      midi_router_transform_t transform = {
+        .channel = buffer[pos],
+        .transpose = (int8_t)buffer[pos + 1],
+        .velocity = buffer[pos + 2],
+        .cc_min = buffer[pos + 3],
+        .cc_max = buffer[pos + 4],
+      };
+      if (transform.channel > 16 || transform.velocity == 0 || transform.cc_min > transform.cc_max ||
+          transform.cc_max > 127) {
+        return false;
+      }
+      // The router compiles at most MIDI_ROUTER_NUM_TRANSFORMS different ones
+      uint8_t slot = 0;
+      while (slot < nslots && memcmp(slots + slot, &transform, sizeof(transform)) != 0) {
+        slot++;
+      }
+      if (slot == nslots) {
+        if (nslots == MIDI_ROUTER_NUM_TRANSFORMS) {
+          return false;
+        }
+        slots[nslots++] = transform;
+      }
+      if (apply) {
+        router->transforms[in][out] = transform;
+      }
+      pos += TRANSFORM_BYTES;
+    }
+  }
+  return pos == nbytes;
+}
+
+bool route_preset_decode(midi_router_t* router, route_preset_settings_t* settings,
+  const uint8_t* buffer, uint32_t nbytes)
+{
+  return decode(router, settings, buffer, nbytes, false) && decode(router, settings, buffer, nbytes, true);
+}
@@ -0,0 +1,95 @@
+/**
+ * @file route_preset.h
+ * @brief convert the routing setup to and from the bytes of a preset
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef ROUTE_PRESET_H
+#define ROUTE_PRESET_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "midi_router.h"
+#include "midi_merger.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/**
+ * @brief A preset holds the route matrix, the output policies, the
+ * Program Change trigger and the filter and transform of every route
+ * that has one. Routes that pass
+ * everything unchanged take no space, so a typical preset is a few dozen
+ * bytes. All values are stored byte by byte, little endian.
+ *
+ *   version, number of ports
+ *   route matrix: 2 bytes per input
+ *   output policies: 1 byte per output
+ *   trigger input or 0xFF for none, trigger channel (version 2 on)
+ *   wire rate of each port in baud or 0 for the default: 3 bytes per
+ *   port (version 3 on)
+ *   number of route entries: 2 bytes
+ *   route entries: input << 4 | output, flags, then the 16 byte filter if
+ *   flag bit 0 is set and the 5 byte transform if flag bit 1 is set
+ */
+#define ROUTE_PRESET_VERSION 3
+// The largest wire rate a preset can hold
+#define ROUTE_PRESET_MAX_BAUD 0xFFFFFF
+
+// The settings a preset holds besides the routes
+typedef struct {
+  midi_merger_policy_t policies[MIDI_ROUTER_MAX_PORTS]; // of every output
+  uint16_t trigger_in;     // the input whose Program Changes load presets, or MIDI_ROUTER_NO_TRIGGER
+  uint8_t trigger_channel; // 0-15
+  uint32_t baud[MIDI_ROUTER_MAX_PORTS]; // wire rate of every port, or 0 for the default
+} route_preset_settings_t;
+
+/**
+ * @brief store the routing setup in buffer
+ *
+ * @return the preset length, or 0 if it does not fit in max bytes
+ */
+uint32_t route_preset_encode(const midi_router_t* router, const route_preset_settings_t* settings,
+  uint8_t* buffer, uint32_t max);
+
+/**
+ * @brief replace the routing setup with the one in a preset
+ *
+ * Nothing changes if the preset is not valid for this router. Call
+ * midi_router_publish() to start using the new routes.
+ *
+ * @param settings set to the other settings in the preset; a version 1
+ * preset has no trigger and presets before version 3 use the default
+ * wire rates
+ * @return false if the preset is not valid
+ */
+bool route_preset_decode(midi_router_t* router, route_preset_settings_t* settings,
+  const uint8_t* buffer, uint32_t nbytes);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
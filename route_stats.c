@@ -0,0 +1,65 @@
+/**
+ * @file route_stats.c
+ * @brief latency statistics for one MIDI route
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "route_stats.h"
+
+void route_stats_reset(route_stats_t* stats)
+{
+  memset(stats, 0, sizeof(*stats));
+  stats->min_us = UINT32_MAX;
+}
+
+void route_stats_record(route_stats_t* stats, uint32_t latency_us)
+{
+  stats->count++;
+  stats->total_us += latency_us;
+  if (latency_us < stats->min_us) {
+    stats->min_us = latency_us;
+  }
+  if (latency_us > stats->max_us) {
+    stats->max_us = latency_us;
+  }
+  uint8_t bin = latency_us == 0 ? 0 : 32 - __builtin_clz(latency_us);
+  if (bin >= ROUTE_STATS_NUM_BINS) {
+    bin = ROUTE_STATS_NUM_BINS - 1;
+  }
+  if (stats->histogram[bin] != UINT16_MAX) {
+    stats->histogram[bin]++;
+  }
+}
+
+uint32_t route_stats_mean_us(const route_stats_t* stats)
+{
+  return stats->count == 0 ? 0 : (uint32_t)(stats->total_us / stats->count);
+}
+
+uint32_t route_stats_bin_floor_us(uint8_t bin)
+{
+  return bin == 0 ? 0 : 1u << (bin - 1);
+}
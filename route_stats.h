@@ -0,0 +1,74 @@
+/**
+ * @file route_stats.h
+ * @brief latency statistics for one MIDI route
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef ROUTE_STATS_H
+#define ROUTE_STATS_H
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// Bin n of the histogram counts latencies that need n bits, i.e., bin 0
+// counts 0 us, bin 1 counts 1 us, bin 2 counts 2-3 us, bin 3 counts 4-7 us
+// and so on. The last bin also counts everything longer.
+#define ROUTE_STATS_NUM_BINS 16
+
+typedef struct {
+  uint32_t count;
+  uint32_t min_us;
+  uint32_t max_us;
+  uint64_t total_us;
+  uint16_t histogram[ROUTE_STATS_NUM_BINS]; // saturates at UINT16_MAX
+} route_stats_t;
+
+/**
+ * @brief clear all statistics
+ */
+void route_stats_reset(route_stats_t* stats);
+
+/**
+ * @brief add one latency measurement
+ */
+void route_stats_record(route_stats_t* stats, uint32_t latency_us);
+
+/**
+ * @brief return the mean latency in microseconds, or 0 if there are no measurements
+ */
+uint32_t route_stats_mean_us(const route_stats_t* stats);
+
+/**
+ * @brief return the smallest latency in microseconds that falls in histogram bin
+ */
+uint32_t route_stats_bin_floor_us(uint8_t bin);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * @file spsc_ring.c
+ * @brief a lock-free single-producer single-consumer ring buffer
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "spsc_ring.h"
+
+void spsc_ring_init(spsc_ring_t* ring, void* storage, uint32_t element_size, uint32_t capacity)
+{
+  assert(capacity != 0 && (capacity & (capacity - 1)) == 0);
+  ring->storage = storage;
+  ring->element_size = element_size;
+  ring->capacity = capacity;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+}
+
+bool spsc_ring_push(spsc_ring_t* ring, const void* element)
+{
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  if (tail - head >= ring->capacity) {
+    return false;
+  }
+  memcpy(ring->storage + (tail & (ring->capacity - 1)) * ring->element_size, element, ring->element_size);
+  // publish the element only after it has been copied
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+bool spsc_ring_pop(spsc_ring_t* ring, void* element)
+{
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (head == tail) {
+    return false;
+  }
+  memcpy(element, ring->storage + (head & (ring->capacity - 1)) * ring->element_size, ring->element_size);
+  // free the slot only after the element has been copied out
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return true;
+}
+
+bool spsc_ring_peek(spsc_ring_t* ring, void* element)
+{
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (head == tail) {
+    return false;
+  }
+  memcpy(element, ring->storage + (head & (ring->capacity - 1)) * ring->element_size, ring->element_size);
+  return true;
+}
+
+uint32_t spsc_ring_count(spsc_ring_t* ring)
+{
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  return tail - head;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file spsc_ring.h
+ * @brief a lock-free single-producer single-consumer ring buffer
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/**
+ * @brief A ring buffer of fixed size elements that one producer and one
+ * consumer may use at the same time without locks, e.g., one on each core
+ * or one in an interrupt handler.
+ *
+ * Only 32-bit atomic loads and stores are used, so the ring is lock-free
+ * on Cortex-M0+, which has no atomic read-modify-write instructions.
+ */
+typedef struct {
+  uint8_t* storage;
+  uint32_t element_size;
+  uint32_t capacity;       // number of elements; must be a power of 2
+  atomic_uint_least32_t head; // written only by the consumer
+  atomic_uint_least32_t tail; // written only by the producer
+} spsc_ring_t;
+
+/**
+ * @brief initialize the ring
+ *
+ * @param ring the ring to initialize
+ * @param storage capacity * element_size bytes of storage for the ring
+ * @param element_size the number of bytes in each element
+ * @param capacity the maximum number of elements in the ring; must be a power of 2
+ */
+void spsc_ring_init(spsc_ring_t* ring, void* storage, uint32_t element_size, uint32_t capacity);
+
+/**
+ * @brief copy an element into the ring (producer only)
+ *
+ * @return true if there was room for the element
+ */
+bool spsc_ring_push(spsc_ring_t* ring, const void* element);
+
+/**
+ * @brief copy the oldest element out of the ring (consumer only)
+ *
+ * @return true if there was an element to copy
+ */
+bool spsc_ring_pop(spsc_ring_t* ring, void* element);
+
+/**
+ * @brief copy the oldest element out of the ring but leave it in the ring
+ * (consumer only)
+ *
+ * @return true if there was an element to copy
+ */
+bool spsc_ring_peek(spsc_ring_t* ring, void* element);
+
+/**
+ * @brief return the number of elements in the ring
+ *
+ * The value may be stale by the time it is used, but it is never more
+ * than the true count when called by the consumer and never less than
+ * the true count when called by the producer.
+ */
+uint32_t spsc_ring_count(spsc_ring_t* ring);
+
+static inline uint32_t spsc_ring_free(spsc_ring_t* ring)
+{
+  return ring->capacity - spsc_ring_count(ring);
+}
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
@@ -0,0 +1,73 @@
+/**
+ * @file table_publisher.c
+ * @brief publish a double-buffered table from one core to a reader on another
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "table_publisher.h"
+
+void table_publisher_init(table_publisher_t* publisher, void* current_table, void* spare_table)
+{
+  publisher->tables[0] = current_table;
+  publisher->tables[1] = spare_table;
+  atomic_init(&publisher->current, current_table);
+  atomic_init(&publisher->generation, 0);
+  atomic_init(&publisher->released, 0);
+}
+
+bool table_publisher_spare_is_free(table_publisher_t* publisher)
+{
+  uint32_t generation = atomic_load_explicit(&publisher->generation, memory_order_relaxed);
+  uint32_t released = atomic_load_explicit(&publisher->released, memory_order_acquire);
+  return released == generation;
+}
+
+void* table_publisher_spare(table_publisher_t* publisher)
+{
+  void* current = atomic_load_explicit(&publisher->current, memory_order_relaxed);
+  return current == publisher->tables[0] ? publisher->tables[1] : publisher->tables[0];
+}
+
+void table_publisher_publish(table_publisher_t* publisher)
+{
+  void* spare = table_publisher_spare(publisher);
+  uint32_t generation = atomic_load_explicit(&publisher->generation, memory_order_relaxed);
+  atomic_store_explicit(&publisher->current, spare, memory_order_release);
+  atomic_store_explicit(&publisher->generation, generation + 1, memory_order_release);
+}
+
+void* table_publisher_acquire(table_publisher_t* publisher, uint32_t* generation)
+{
+  // Read the generation first: if the reader sees the new generation it
+  // also sees the new table. If it sees the old generation with the new
+  // table, it only makes the writer wait one more pass.
+  *generation = atomic_load_explicit(&publisher->generation, memory_order_acquire);
+  return atomic_load_explicit(&publisher->current, memory_order_acquire);
+}
+
+void table_publisher_release(table_publisher_t* publisher, uint32_t generation)
+{
+  atomic_store_explicit(&publisher->released, generation, memory_order_release);
+}
@@ -0,0 +1,95 @@
+/**
+ * @file table_publisher.h
+ * @brief publish a double-buffered table from one core to a reader on another
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef TABLE_PUBLISHER_H
+#define TABLE_PUBLISHER_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/**
+ * @brief The writer builds a new version of a table in the spare buffer
+ * while the reader keeps using the current one, then swaps the two with a
+ * single atomic store. The reader picks up the new table at the start of
+ * its next pass, so it never sees a partly updated table.
+ *
+ * The reader brackets each pass with table_publisher_acquire() and
+ * table_publisher_release(). The writer may only rebuild the spare buffer
+ * after the reader has released a generation at least as new as the last
+ * one published, which guarantees the reader has stopped using it.
+ */
+typedef struct {
+  void* tables[2];
+  _Atomic(void*) current;
+  atomic_uint_least32_t generation; // written only by the writer
+  atomic_uint_least32_t released;   // written only by the reader
+} table_publisher_t;
+
+/**
+ * @brief initialize the publisher; current_table is published first
+ */
+void table_publisher_init(table_publisher_t* publisher, void* current_table, void* spare_table);
+
+/**
+ * @brief return true if the reader no longer uses the spare table (writer only)
+ */
+bool table_publisher_spare_is_free(table_publisher_t* publisher);
+
+/**
+ * @brief return the table the writer may build the next version in (writer only)
+ *
+ * Only write to it if table_publisher_spare_is_free() returns true.
+ */
+void* table_publisher_spare(table_publisher_t* publisher);
+
+/**
+ * @brief make the spare table the current table (writer only)
+ */
+void table_publisher_publish(table_publisher_t* publisher);
+
+/**
+ * @brief return the table to use for this pass (reader only)
+ *
+ * @param generation set to the value to pass to table_publisher_release()
+ */
+void* table_publisher_acquire(table_publisher_t* publisher, uint32_t* generation);
+
+/**
+ * @brief signal that the reader is done with the table from the matching acquire (reader only)
+ */
+void table_publisher_release(table_publisher_t* publisher, uint32_t generation);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
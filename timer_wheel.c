@@ -0,0 +1,152 @@
+/**
+ * @file timer_wheel.c
+ * @brief release MIDI packets to an output at the time each one is due
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "timer_wheel.h"
+
+static bool is_before(uint32_t a, uint32_t b)
+{
+  return (int32_t)(a - b) < 0;
+}
+
+static uint16_t slot_of(uint32_t time_us)
+{
+  return (time_us / TIMER_WHEEL_SLOT_US) % TIMER_WHEEL_SLOTS;
+}
+
+void timer_wheel_init(timer_wheel_t* wheel, timer_wheel_entry_t* pool, uint16_t pool_len,
+  timer_wheel_release_fn release, void* context, uint32_t now_us)
+{
+  wheel->pool = pool;
+  wheel->pool_len = pool_len;
+  wheel->release = release;
+  wheel->context = context;
+  timer_wheel_reset(wheel, now_us);
+}
+
+void timer_wheel_reset(timer_wheel_t* wheel, uint32_t now_us)
+{
+  for (uint16_t idx = 0; idx < wheel->pool_len; idx++) {
+    wheel->pool[idx].next = idx + 1 < wheel->pool_len ? idx + 1 : TIMER_WHEEL_NONE;
+  }
+  wheel->free = wheel->pool_len > 0 ? 0 : TIMER_WHEEL_NONE;
+  wheel->count = 0;
+  for (uint16_t slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+    wheel->head[slot] = TIMER_WHEEL_NONE;
+    wheel->tail[slot] = TIMER_WHEEL_NONE;
+  }
+  wheel->cursor_us = now_us - now_us % TIMER_WHEEL_SLOT_US;
+}
+
+bool timer_wheel_add(timer_wheel_t* wheel, uint32_t due_us, const midi_merger_entry_t* entry)
+{
+  uint16_t idx = wheel->free;
+  if (idx == TIMER_WHEEL_NONE) {
+    return false;
+  }
+  timer_wheel_entry_t* node = wheel->pool + idx;
+  wheel->free = node->next;
+  node->entry = *entry;
+  node->due_us = due_us;
+  node->next = TIMER_WHEEL_NONE;
+  // A packet that is already due goes in the slot the next poll looks at
+  uint16_t slot = slot_of(is_before(due_us, wheel->cursor_us) ? wheel->cursor_us : due_us);
+  if (wheel->head[slot] == TIMER_WHEEL_NONE) {
+    wheel->head[slot] = idx;
+  }
+  else {
+    wheel->pool[wheel->tail[slot]].next = idx;
+  }
+  wheel->tail[slot] = idx;
+  wheel->count++;
+  return true;
+}
+
+// Release the packets in one slot that are due by now_us
+static void release_slot(timer_wheel_t* wheel, uint16_t slot, uint32_t now_us)
+{
+  uint16_t prev = TIMER_WHEEL_NONE;
+  uint16_t idx = wheel->head[slot];
+  while (idx != TIMER_WHEEL_NONE) {
+    timer_wheel_entry_t* node = wheel->pool + idx;
+    uint16_t next = node->next;
+    if (is_before(now_us, node->due_us)) {
+      prev = idx; // due on a later turn of the wheel
+    }
+    else {
+      if (prev == TIMER_WHEEL_NONE) {
+        wheel->head[slot] = next;
+      }
+      else {
+        wheel->pool[prev].next = next;
+      }
+      if (wheel->tail[slot] == idx) {
+        wheel->tail[slot] = prev;
+      }
+      const midi_merger_entry_t entry = node->entry;
+      node->next = wheel->free;
+      wheel->free = idx;
+      wheel->count--;
+      wheel->release(wheel->context, &entry);
+    }
+    idx = next;
+  }
+}
+
+void timer_wheel_poll(timer_wheel_t* wheel, uint32_t now_us)
+{
+  for (uint16_t n = 0; n < TIMER_WHEEL_SLOTS && wheel->count != 0 && !is_before(now_us, wheel->cursor_us); n++) {
+    release_slot(wheel, slot_of(wheel->cursor_us), now_us);
+    if (is_before(now_us, wheel->cursor_us + TIMER_WHEEL_SLOT_US)) {
+      return; // packets due later in this slot may still come
+    }
+    wheel->cursor_us += TIMER_WHEEL_SLOT_US;
+  }
+  // Every slot up to now has been looked at
+  uint32_t now_slot_us = now_us - now_us % TIMER_WHEEL_SLOT_US;
+  if (is_before(wheel->cursor_us, now_slot_us)) {
+    wheel->cursor_us = now_slot_us;
+  }
+}
+
+bool timer_wheel_next_due(const timer_wheel_t* wheel, uint32_t* due_us)
+{
+  if (wheel->count == 0) {
+    return false;
+  }
+  bool found = false;
+  for (uint16_t slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+    for (uint16_t idx = wheel->head[slot]; idx != TIMER_WHEEL_NONE; idx = wheel->pool[idx].next) {
+      uint32_t due = wheel->pool[idx].due_us;
+      if (!found || is_before(due, *due_us)) {
+        *due_us = due;
+        found = true;
+      }
+    }
+  }
+  return found;
+}
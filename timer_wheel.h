@@ -0,0 +1,125 @@
+/**
+ * @file timer_wheel.h
+ * @brief release MIDI packets to an output at the time each one is due
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "midi_merger.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// The wheel turns once every TIMER_WHEEL_SLOTS * TIMER_WHEEL_SLOT_US;
+// a packet due further ahead waits for the wheel to come round again
+#define TIMER_WHEEL_SLOTS 64
+#define TIMER_WHEEL_SLOT_US 1024
+#define TIMER_WHEEL_NONE 0xFFFF
+
+typedef struct {
+  midi_merger_entry_t entry;
+  uint32_t due_us;
+  uint16_t next; // the next entry in the same slot or on the free list
+} timer_wheel_entry_t;
+
+/**
+ * @brief called for each packet when it is due
+ *
+ * @param context the context passed to timer_wheel_init()
+ * @param entry the packet and the timestamp it was added with
+ */
+typedef void (*timer_wheel_release_fn)(void* context, const midi_merger_entry_t* entry);
+
+/**
+ * @brief A hashed timer wheel of packets. Each slot holds the packets
+ * due in one TIMER_WHEEL_SLOT_US interval, so adding a packet and
+ * releasing the packets that are due take the same time however many
+ * packets wait. Packets due at the same time are released in the order
+ * they were added.
+ */
+typedef struct {
+  timer_wheel_entry_t* pool;
+  uint16_t pool_len;
+  uint16_t free;      // the first unused entry
+  uint16_t count;     // packets waiting
+  uint16_t head[TIMER_WHEEL_SLOTS];
+  uint16_t tail[TIMER_WHEEL_SLOTS];
+  uint32_t cursor_us; // the start of the slot timer_wheel_poll() looks at next
+  timer_wheel_release_fn release;
+  void* context;
+} timer_wheel_t;
+
+/**
+ * @brief initialize the wheel with no packets waiting
+ *
+ * @param wheel the wheel to initialize
+ * @param pool storage for the waiting packets
+ * @param pool_len the number of entries in pool
+ * @param release the function to call when a packet is due
+ * @param context passed unchanged to release
+ * @param now_us the current time
+ */
+void timer_wheel_init(timer_wheel_t* wheel, timer_wheel_entry_t* pool, uint16_t pool_len,
+  timer_wheel_release_fn release, void* context, uint32_t now_us);
+
+/**
+ * @brief add a packet to release at a time
+ *
+ * A packet whose time has passed is released by the next
+ * timer_wheel_poll(). The time must be less than half the range of
+ * the clock ahead.
+ *
+ * @return false if the wheel is full
+ */
+bool timer_wheel_add(timer_wheel_t* wheel, uint32_t due_us, const midi_merger_entry_t* entry);
+
+/**
+ * @brief release every packet that is due
+ *
+ * @param wheel the wheel
+ * @param now_us the current time
+ */
+void timer_wheel_poll(timer_wheel_t* wheel, uint32_t now_us);
+
+/**
+ * @brief return true if a packet is waiting and set due_us to the time
+ * the first one is due
+ */
+bool timer_wheel_next_due(const timer_wheel_t* wheel, uint32_t* due_us);
+
+/**
+ * @brief discard the waiting packets
+ */
+void timer_wheel_reset(timer_wheel_t* wheel, uint32_t now_us);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
@@ -97,13 +97,15 @@
 #define CFG_TUD_MIDI              1
 #define CFG_TUD_VENDOR            0
 
-// Number of virtual MIDI cables IN to the host and OUT from the host
+// Number of virtual MIDI cables IN to the host and OUT from the host.
+// The last cable carries the SysEx control protocol (see midi_control.h)
+// and is not routed.
 #if NUM_PIOS > 2
-#define CFG_TUD_MIDI_NUMCABLES_IN 8
-#define CFG_TUD_MIDI_NUMCABLES_OUT 8
+#define CFG_TUD_MIDI_NUMCABLES_IN 9
+#define CFG_TUD_MIDI_NUMCABLES_OUT 9
 #else
-#define CFG_TUD_MIDI_NUMCABLES_IN 6
-#define CFG_TUD_MIDI_NUMCABLES_OUT 6
+#define CFG_TUD_MIDI_NUMCABLES_IN 7
+#define CFG_TUD_MIDI_NUMCABLES_OUT 7
 #endif
 #if CFG_TUD_MIDI_NUMCABLES_IN != CFG_TUD_MIDI_NUMCABLES_OUT
 #error "CFG_TUD_MIDI_NUMCABLES_IN must equal CFG_TUD_MIDI_NUMCABLES_OUT"
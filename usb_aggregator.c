@@ -0,0 +1,99 @@
+/**
+ * @file usb_aggregator.c
+ * @brief collect USB MIDI IN event packets into full transfers
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "usb_aggregator.h"
+#include "midi_parser.h"
+
+void usb_aggregator_init(usb_aggregator_t* aggregator, uint8_t* storage, uint16_t capacity, uint32_t deadline_us,
+  usb_aggregator_write_fn write, void* context)
+{
+  aggregator->storage = storage;
+  aggregator->capacity = capacity;
+  aggregator->count = 0;
+  aggregator->deadline_us = deadline_us;
+  aggregator->oldest_us = 0;
+  aggregator->write = write;
+  aggregator->context = context;
+  route_stats_reset(&aggregator->waits);
+}
+
+static void flush(usb_aggregator_t* aggregator, uint32_t now_us)
+{
+  uint32_t nwritten = aggregator->write(aggregator->context, aggregator->storage, aggregator->count);
+  if (nwritten == 0) {
+    return; // the driver is full; try again on the next poll
+  }
+  route_stats_record(&aggregator->waits, now_us - aggregator->oldest_us);
+  aggregator->count -= nwritten;
+  memmove(aggregator->storage, aggregator->storage + 4 * nwritten, 4 * aggregator->count);
+  // The packets left over arrived later, but they are due now too
+}
+
+bool usb_aggregator_add(usb_aggregator_t* aggregator, const uint8_t packet[4], uint32_t now_us)
+{
+  if (aggregator->count == aggregator->capacity) {
+    flush(aggregator, now_us);
+    if (aggregator->count == aggregator->capacity) {
+      return false;
+    }
+  }
+  if (aggregator->count == 0) {
+    aggregator->oldest_us = now_us;
+  }
+  memcpy(aggregator->storage + 4 * aggregator->count++, packet, 4);
+  // Real-time messages keep their timing: they take the batch with them
+  if (aggregator->count == aggregator->capacity || aggregator->deadline_us == 0 || midi_packet_is_realtime(packet)) {
+    flush(aggregator, now_us);
+  }
+  return true;
+}
+
+void usb_aggregator_poll(usb_aggregator_t* aggregator, uint32_t now_us)
+{
+  if (aggregator->count != 0 && usb_aggregator_due_us(aggregator, now_us) == 0) {
+    flush(aggregator, now_us);
+  }
+}
+
+uint32_t usb_aggregator_due_us(const usb_aggregator_t* aggregator, uint32_t now_us)
+{
+  if (aggregator->count == 0) {
+    return UINT32_MAX;
+  }
+  if (aggregator->count == aggregator->capacity) {
+    return 0;
+  }
+  uint32_t waited = now_us - aggregator->oldest_us;
+  return waited >= aggregator->deadline_us ? 0 : aggregator->deadline_us - waited;
+}
+
+void usb_aggregator_reset(usb_aggregator_t* aggregator)
+{
+  aggregator->count = 0;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file usb_aggregator.h
+ * @brief collect USB MIDI IN event packets into full transfers
+ * 
+ * MIT License
+
+ * Copyright (c) 2026 rppicomidi
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef USB_AGGREGATOR_H
+#define USB_AGGREGATOR_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "route_stats.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/**
+ * @brief hand event packets to the USB device driver and start one
+ * transfer for all of them
+ *
+ * @param context the context passed to usb_aggregator_init()
+ * @param packets npackets 4-byte USB MIDI event packets
+ * @param npackets the number of packets
+ * @return the number of packets the driver took
+ */
+typedef uint32_t (*usb_aggregator_write_fn)(void* context, const uint8_t* packets, uint32_t npackets);
+
+/**
+ * @brief Collects the event packets for the USB MIDI IN endpoint and
+ * hands them to the driver together, so they share one transfer. The
+ * packets go when they fill a transfer or when the oldest one has
+ * waited for the flush deadline, whichever comes first. A real-time
+ * message, e.g., clock, does not wait; it takes the waiting packets with
+ * it.
+ */
+typedef struct {
+  uint8_t* storage;     // 4 * capacity bytes
+  uint16_t capacity;    // the packets in one full transfer
+  uint16_t count;       // packets waiting
+  uint32_t deadline_us; // the longest a packet waits; 0 sends each packet at once
+  uint32_t oldest_us;   // when the oldest waiting packet arrived
+  usb_aggregator_write_fn write;
+  void* context;
+  route_stats_t waits;  // how long the oldest packet of each batch waited for the driver
+} usb_aggregator_t;
+
+/**
+ * @brief initialize the aggregator with no packets waiting
+ *
+ * @param aggregator the aggregator to initialize
+ * @param storage 4 * capacity bytes for the waiting packets
+ * @param capacity the number of packets in one full transfer
+ * @param deadline_us the longest a packet may wait
+ * @param write the function that hands packets to the driver
+ * @param context passed to write
+ */
+void usb_aggregator_init(usb_aggregator_t* aggregator, uint8_t* storage, uint16_t capacity, uint32_t deadline_us,
+  usb_aggregator_write_fn write, void* context);
+
+/**
+ * @brief add one event packet
+ *
+ * Hands the waiting packets to the driver if this one fills a transfer,
+ * is a real-time message or the deadline is 0.
+ *
+ * @return false if the aggregator is full and the driver takes nothing
+ */
+bool usb_aggregator_add(usb_aggregator_t* aggregator, const uint8_t packet[4], uint32_t now_us);
+
+/**
+ * @brief hand the waiting packets to the driver if they fill a transfer
+ * or the oldest one has waited for the deadline
+ *
+ * Call this on every pass of the main loop.
+ */
+void usb_aggregator_poll(usb_aggregator_t* aggregator, uint32_t now_us);
+
+/**
+ * @brief return how long until usb_aggregator_poll() must run, or
+ * UINT32_MAX if no packets are waiting
+ */
+uint32_t usb_aggregator_due_us(const usb_aggregator_t* aggregator, uint32_t now_us);
+
+/**
+ * @brief discard the waiting packets, e.g., when USB is disconnected
+ */
+void usb_aggregator_reset(usb_aggregator_t* aggregator);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
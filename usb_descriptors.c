@@ -183,10 +183,11 @@ char const* string_desc_arr [] =
   "MIDI 4",
   "MIDI 5",
   "MIDI 6",
-#if CFG_TUD_MIDI_NUMCABLES_IN == 8
+#if CFG_TUD_MIDI_NUMCABLES_IN == 9
   "MIDI 7",
   "MIDI 8",
 #endif
+  "Control",
 };
 
 static uint16_t _desc_str[32];